@@ -66,7 +66,7 @@ std::vector<char>& cnpy::operator+=(std::vector<char>& lhs, const char* rhs) {
 
 uint16_t cnpy::parse_npy_header(const char* buffer, size_t& word_size,
                                 std::vector<size_t>& shape,
-                                bool& fortran_order) {
+                                bool& fortran_order, char* type_kind) {
     // std::string magic_string(buffer,6);
     uint8_t major_version = *reinterpret_cast<const uint8_t*>(buffer + 6);
     uint8_t minor_version = *reinterpret_cast<const uint8_t*>(buffer + 7);
@@ -111,12 +111,14 @@ uint16_t cnpy::parse_npy_header(const char* buffer, size_t& word_size,
     char fmt = header[loc1 + 1];
     // MODIFIED: fix unicode string
     if (fmt == 'U') word_size *= 4;
+    if (type_kind != nullptr) *type_kind = fmt;
 
     return header_len + 10;
 }
 
 void cnpy::parse_npy_header(FILE* fp, size_t& word_size,
-                            std::vector<size_t>& shape, bool& fortran_order) {
+                            std::vector<size_t>& shape, bool& fortran_order,
+                            char* type_kind) {
     char buffer[256];
     size_t res = fread(buffer, sizeof(char), 11, fp);
     if (res != 11) throw std::runtime_error("parse_npy_header: failed fread");
@@ -172,6 +174,7 @@ void cnpy::parse_npy_header(FILE* fp, size_t& word_size,
 
     // MODIFIED: fix unicode string
     if (fmt == 'U') word_size *= 4;
+    if (type_kind != nullptr) *type_kind = fmt;
 }
 
 void cnpy::parse_zip_footer(FILE* fp, uint16_t& nrecs,
@@ -201,9 +204,11 @@ cnpy::NpyArray load_the_npy_file(FILE* fp) {
     std::vector<size_t> shape;
     size_t word_size;
     bool fortran_order;
-    cnpy::parse_npy_header(fp, word_size, shape, fortran_order);
+    char type_kind;
+    cnpy::parse_npy_header(fp, word_size, shape, fortran_order, &type_kind);
 
     cnpy::NpyArray arr(shape, word_size, fortran_order);
+    arr.type_kind = type_kind;
     size_t nread = fread(arr.data<char>(), 1, arr.num_bytes(), fp);
     if (nread != arr.num_bytes())
         throw std::runtime_error("load_the_npy_file: failed fread");
@@ -214,9 +219,12 @@ cnpy::NpyArray load_mem_npy_file(const char** ptr, const char* ptr_end) {
     std::vector<size_t> shape;
     size_t word_size;
     bool fortran_order;
-    *ptr += cnpy::parse_npy_header(*ptr, word_size, shape, fortran_order);
+    char type_kind;
+    *ptr += cnpy::parse_npy_header(*ptr, word_size, shape, fortran_order,
+                                   &type_kind);
 
     cnpy::NpyArray arr(shape, word_size, fortran_order);
+    arr.type_kind = type_kind;
     if (*ptr + arr.num_bytes() >= ptr_end)
         throw std::runtime_error("load_mem_npy_file: unexpected EOF");
     memcpy(arr.data<char>(), *ptr, arr.num_bytes());
@@ -256,7 +264,7 @@ cnpy::NpyArray load_the_npz_array(FILE* fp, uint64_t compr_bytes,
     size_t word_size;
     bool fortran_order;
     cnpy::parse_npy_header(&array.data_holder[0], word_size, shape,
-                           fortran_order);
+                           fortran_order, &array.type_kind);
 
     array.reinit(shape, word_size, fortran_order);
     return array;
@@ -294,7 +302,7 @@ cnpy::NpyArray load_mem_npz_array(const char** ptr, const char* ptr_end,
     size_t word_size;
     bool fortran_order;
     cnpy::parse_npy_header(&array.data_holder[0], word_size, shape,
-                           fortran_order);
+                           fortran_order, &array.type_kind);
     array.reinit(shape, word_size, fortran_order);
     *ptr += compr_bytes;
     return array;
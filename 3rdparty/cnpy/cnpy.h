@@ -31,7 +31,8 @@ struct NpyArray {
         reinit(_shape, _word_size, _fortran_order);
     }
 
-    NpyArray() : shape(0), word_size(0), fortran_order(0), num_vals(0) {}
+    NpyArray()
+        : shape(0), word_size(0), fortran_order(0), num_vals(0), type_kind(0) {}
 
     void reinit(const std::vector<size_t>& _shape, size_t _word_size,
                 bool _fortran_order) {
@@ -72,6 +73,8 @@ struct NpyArray {
     size_t word_size;
     bool fortran_order;
     size_t num_vals;
+    // MODIFIED: dtype kind of the descr ('f', 'i', 'u', 'b', 'U', ...)
+    char type_kind;
 };
 
 using npz_t = std::map<std::string, NpyArray>;
@@ -80,10 +83,12 @@ char BigEndianTest();
 char map_type(const std::type_info& t);
 template <typename T>
 std::vector<char> create_npy_header(const std::vector<size_t>& shape);
+// MODIFIED: type_kind, if given, is set to the dtype kind
 void parse_npy_header(FILE* fp, size_t& word_size, std::vector<size_t>& shape,
-                      bool& fortran_order);
+                      bool& fortran_order, char* type_kind = nullptr);
 uint16_t parse_npy_header(const char* buffer, size_t& word_size,
-                          std::vector<size_t>& shape, bool& fortran_order);
+                          std::vector<size_t>& shape, bool& fortran_order,
+                          char* type_kind = nullptr);
 void parse_zip_footer(FILE* fp, uint16_t& nrecs, size_t& global_header_size,
                       size_t& global_header_offset);
 npz_t npz_load(const std::string& fname);
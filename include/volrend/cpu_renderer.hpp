@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "volrend/camera.hpp"
+#include "volrend/mesh.hpp"
+#include "volrend/n3tree.hpp"
+#include "volrend/render_options.hpp"
+
+namespace volrend {
+// How the CPU renderer distributes image tiles over its threads:
+// equal contiguous ranges, a shared atomic tile counter, or per-thread
+// ranges with work stealing (default)
+enum class TileSchedule { STATIC, DYNAMIC, STEALING };
+
+// Placement of the tree's CPU data over NUMA nodes for the CPU renderer:
+// left where it was first touched (when loading), pages interleaved over
+// all nodes, or copied to every node with threads reading their node's
+// copy (interleaves instead if some node lacks the free memory)
+enum class NumaPolicy { NONE, INTERLEAVE, REPLICATE };
+
+// One frame of CPURenderer::render_batch
+struct BatchFrame {
+    // Set by the setup callback (including _update(false))
+    Camera camera;
+    // Options of this frame, reset to render_batch's before setup, which
+    // may change the per-frame ones (region of interest)
+    RenderOptions options;
+    // u8 RGBA image, 4 * camera.width * camera.height bytes. Setup may fill
+    // in pixels of tiles it masks out (e.g. from a frame cache)
+    std::vector<uint8_t> rgba;
+    // Row-major over the tiles; only nonzero tiles are rendered. Empty
+    // renders all tiles
+    std::vector<uint8_t> tile_mask;
+    // Render nothing, pass the frame straight to the done callback
+    bool skip = false;
+};
+
+// Multithreaded CPU volume renderer for offscreen rendering, producing the
+// same u8 RGBA images as the CUDA offscreen renderer (probe and grid are
+// not drawn). Uses the tree's CPU data, so works without CUDA
+struct CPURenderer {
+    // n_threads = 0 uses all hardware threads
+    explicit CPURenderer(int n_threads = 0);
+    ~CPURenderer();
+
+    // Render the tree into out (4 * cam.width * cam.height bytes),
+    // composited over the background, in tile_size x tile_size tiles.
+    // If tile_mask is given (row-major over the tiles), only pixels of
+    // nonzero tiles are written.
+    // Returns the total number of tree samples taken
+    uint64_t render(const N3Tree& tree, const Camera& cam,
+                    const RenderOptions& options, uint8_t* out,
+                    const uint8_t* tile_mask = nullptr, int tile_size = 16);
+
+    // Render like render(), but only the pixels nonzero in pixel_mask
+    // (row-major, cam.width * cam.height; nullptr renders all). If depth is
+    // given (cam.width * cam.height floats), each rendered pixel's depth is
+    // written there: the distance along its ray at which the remaining light
+    // first drops below half, or +inf if it never does (always for NDC
+    // trees). Used for reprojection (internal/reprojection.hpp)
+    uint64_t render_pixels(const N3Tree& tree, const Camera& cam,
+                           const RenderOptions& options, uint8_t* out,
+                           const uint8_t* pixel_mask, float* depth = nullptr,
+                           int tile_size = 16);
+
+    // Progressive rendering for large frames: pixels are traced in
+    // interleaved lattices, coarse to fine (internal/progressive.hpp), and
+    // publish(rgba, progress) receives the partial image with its untraced
+    // pixels filled in, and the fraction traced, whenever interval_ms have
+    // passed since the last one; then the final image (progress 1), which is
+    // out and identical to render()'s. Returns the total number of tree
+    // samples taken
+    uint64_t render_progressive(
+        const N3Tree& tree, const Camera& cam, const RenderOptions& options,
+        uint8_t* out, float interval_ms,
+        const std::function<void(const uint8_t*, float)>& publish,
+        int tile_size = 16);
+
+    // Render n_frames frames with up to frames_in_flight of them in progress
+    // at once: the threads pull (frame, tile) jobs from one queue spanning
+    // all frames in flight, so they never idle on the last tiles of a frame.
+    // setup(i, frame) fills in frame i (camera, optional tile mask) and
+    // done(i, frame) receives it once all its tiles are rendered; both are
+    // called in frame order on a single writer thread, and the frame object
+    // is reused for frame i + frames_in_flight after done returns.
+    // Returns the total number of tree samples taken
+    uint64_t render_batch(
+        const N3Tree& tree, const RenderOptions& options, size_t n_frames,
+        int frames_in_flight,
+        const std::function<void(size_t, BatchFrame&)>& setup,
+        const std::function<void(size_t, BatchFrame&)>& done,
+        int tile_size = 16);
+
+    // Enable the per-leaf view-dependent color cache, using at most
+    // budget_bytes with view directions quantized to dir_res x dir_res
+    // octahedral bins; 0 disables. Colors of SH/SG data are then shaded at
+    // the bin center direction, which pays off when the same leaves are seen
+    // from similar directions repeatedly (turntables, fixed cameras)
+    void set_color_cache(size_t budget_bytes, int dir_res = 32);
+
+    // Color cache hits/misses (sample colors reused/evaluated)
+    void color_cache_stats(uint64_t& hits, uint64_t& misses) const;
+
+    // Meshes to composite with the volume in every render (nullptr = none;
+    // must outlive the renders), rasterized on the CPU per frame
+    // (internal/mesh_raster.hpp). As in the GL renderers, rays stop at the
+    // nearest mesh, whose color replaces the background
+    void set_meshes(const std::vector<Mesh>* meshes);
+
+    // Tile scheduling; tiles are visited in Morton order for locality
+    void set_schedule(TileSchedule schedule);
+
+    // Beam traversal (default on): each tile's frustum is intersected with
+    // the tree once, and its rays look up leaves in the resulting
+    // front-to-back node list instead of descending from the root at every
+    // sample. Same images either way
+    void set_beam_traversal(bool enabled);
+
+    // Short-stack restarts (default off): each ray keeps the last few cells
+    // of its previous leaf lookup and restarts the next lookup from the
+    // deepest one still containing the sample, rather than the root. Needs
+    // no per-tree memory, unlike ropes (which are used first if the tree
+    // has them); replaces beam traversal when on. Same images either way
+    void set_short_stack(bool enabled);
+
+    // NUMA placement of the tree data, applied when rendering a tree the
+    // first time. pin_threads pins the threads to CPUs spread over the
+    // nodes, giving each node a contiguous range of threads and thus tiles
+    // (work is stolen within a node first); it cannot be undone
+    void set_numa(NumaPolicy policy, bool pin_threads);
+
+    int n_threads() const;
+
+   private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+// First point along the world-space ray (origin, dir) where the tree's
+// density exceeds options.sigma_thresh inside options.render_bbox, found
+// with the CPU renderer's traversal (leaf descents, and ropes if the tree
+// has them), e.g. for picking surfaces in the GUI. Returns its world
+// distance from origin, or +inf if there is none. Uses the tree's CPU data
+float tree_first_hit(const N3Tree& tree, const RenderOptions& options,
+                     const glm::vec3& origin, const glm::vec3& dir);
+
+}  // namespace volrend
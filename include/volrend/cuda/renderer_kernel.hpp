@@ -6,8 +6,15 @@
 #include "volrend/render_options.hpp"
 
 namespace volrend {
+// If tile_mask (device, row-major over tile_size x tile_size tiles) is given,
+// only pixels in tiles with nonzero mask are rendered; others are left as is.
+// If sample_counts (device, width * height) is given, the number of tree
+// samples taken by each pixel's ray is written to it
 __host__ void launch_renderer(const N3Tree& tree, const Camera& cam,
                               const RenderOptions& options,
                               cudaArray_t& image_arr, cudaArray_t& depth_arr,
-                              cudaStream_t stream, bool offscreen = false);
+                              cudaStream_t stream, bool offscreen = false,
+                              const uint8_t* tile_mask = nullptr,
+                              int tile_size = 16,
+                              uint32_t* sample_counts = nullptr);
 }  // namespace volrend
@@ -33,17 +33,23 @@ __device__ __inline__ void _dda_world(
     }
 }
 
+// Also sets face to the exit face (2 * axis + 1 if leaving on the positive
+// side), for following ropes
 template<typename scalar_t>
 __device__ __inline__ scalar_t _dda_unit(
         const scalar_t* __restrict__ cen,
-        const scalar_t* __restrict__ _invdir) {
+        const scalar_t* __restrict__ _invdir,
+        int* __restrict__ face) {
     scalar_t t1, t2;
     scalar_t tmax = 1e4;
 #pragma unroll
     for (int i = 0; i < 3; ++i) {
         t1 = - cen[i] * _invdir[i];
         t2 = t1 +  _invdir[i];
-        tmax = min(tmax, max(t1, t2));
+        if (max(t1, t2) < tmax) {
+            tmax = max(t1, t2);
+            *face = 2 * i + (_invdir[i] > 0.f);
+        }
     }
     return tmax;
 }
@@ -62,15 +68,22 @@ __device__ __inline__ scalar_t _get_delta_scale(
     return delta_scale;
 }
 
+// Returns the number of tree samples (leaf lookups) taken along the ray.
+// pixel_angle is the pixel footprint per unit distance (1 / focal length),
+// used by adaptive marching; 0 disables footprint-based steps.
+// If depth is given, it is set to the distance at which the remaining light
+// first drops below half (left unchanged if it never does)
 template<typename scalar_t>
-__device__ __inline__ void trace_ray(
+__device__ __inline__ int trace_ray(
         const internal::TreeSpec& __restrict__ tree,
         scalar_t* __restrict__ dir,
         const scalar_t* __restrict__ vdir,
         const scalar_t* __restrict__ cen,
         RenderOptions opt,
         float tmax_bg,
-        scalar_t* __restrict__ out) {
+        scalar_t* __restrict__ out,
+        scalar_t pixel_angle = 0.f,
+        scalar_t* __restrict__ depth = nullptr) {
 
     const float delta_scale = _get_delta_scale(
             tree.scale, /*modifies*/ dir);
@@ -89,7 +102,7 @@ __device__ __inline__ void trace_ray(
         // Ray doesn't hit box
         if (opt.render_depth)
             out[3] = 1.f;
-        return;
+        return 0;
     } else {
         scalar_t pos[3], tmp;
         const half* tree_val;
@@ -105,22 +118,51 @@ __device__ __inline__ void trace_ray(
         scalar_t light_intensity = 1.f;
         scalar_t t = tmin;
         scalar_t cube_sz;
+        int n_samples = 0;
+        // Adaptive mode: minimum step per unit t in empty cells, and total
+        // weight of samples whose color evaluation was skipped
+        const scalar_t min_step_per_t =
+            opt.adaptive ? opt.adaptive_footprint * pixel_angle : 0.f;
+        scalar_t skipped_weight = 0.f;
+        // Leaf cell of the previous sample and the face the ray left it by
+        int64_t cell = -1;
+        int face = 0;
         while (t < tmax) {
+            ++n_samples;
             pos[0] = cen[0] + t * dir[0];
             pos[1] = cen[1] + t * dir[1];
             pos[2] = cen[2] + t * dir[2];
 
-            internal::query_single_from_root(tree, pos, &tree_val, &cube_sz);
+            // Step to the leaf across the exit face, else (corners, steps
+            // past small neighbours) descend from the root
+            const int32_t rope =
+                cell >= 0 ? tree.ropes[cell * 6 + face] : -1;
+            if (rope < 0 || !internal::query_single_from_cell(
+                                tree, rope, pos, &tree_val, &cube_sz)) {
+                internal::query_single_from_root(tree, pos, &tree_val,
+                                                 &cube_sz);
+            }
+            if (tree.ropes != nullptr) {
+                cell = (tree_val - tree.data) / tree.data_dim;
+            }
 
             scalar_t att;
-            const scalar_t t_subcube = _dda_unit(pos, invdir) /  cube_sz;
-            const scalar_t delta_t = t_subcube + opt.step_size;
+            const scalar_t t_subcube = _dda_unit(pos, invdir, &face) /  cube_sz;
+            scalar_t delta_t = t_subcube + opt.step_size;
+            // Adaptive mode: pixel footprint here in cells of this leaf; the
+            // footprint-based steps and stop only apply where it exceeds 1
+            const scalar_t footprint = min_step_per_t > 0.f ?
+                min_step_per_t * t * cube_sz : 0.f;
             if (__half2float(tree_val[tree.data_dim - 1]) > opt.sigma_thresh) {
                 att = expf(-delta_t * delta_scale * __half2float(tree_val[tree.data_dim - 1]));
                 const scalar_t weight = light_intensity * (1.f - att);
 
                 if (opt.render_depth) {
                     out[0] += weight * t;
+                } else if (opt.adaptive &&
+                           skipped_weight + weight < VOLREND_ADAPTIVE_COLOR_EPS) {
+                    // Cannot change the 8-bit output, skip basis evaluation
+                    skipped_weight += weight;
                 } else {
                     if (tree.data_format.basis_dim >= 0) {
                         int off = 0;
@@ -171,9 +213,19 @@ __device__ __inline__ void trace_ray(
                     }
                 }
 
+                if (depth != nullptr && light_intensity >= 0.5f &&
+                        light_intensity * att < 0.5f) {
+                    *depth = t * delta_scale;
+                }
                 light_intensity *= att;
 
-                if (light_intensity < opt.stop_thresh) {
+                // Adaptive mode: a footprint spanning several cells blurs
+                // what lies behind anyway, so stop sooner
+                const scalar_t stop_thresh = footprint > 1.f ?
+                    opt.stop_thresh * min(footprint,
+                                          VOLREND_ADAPTIVE_STOP_SCALE_MAX) :
+                    opt.stop_thresh;
+                if (light_intensity < stop_thresh) {
                     // Almost full opacity, stop
                     if (opt.render_depth) {
                         out[0] = out[1] = out[2] = min(out[0] * 0.3f, 1.0f);
@@ -181,8 +233,11 @@ __device__ __inline__ void trace_ray(
                     scalar_t scale = 1.f / (1.f - light_intensity);
                     out[0] *= scale; out[1] *= scale; out[2] *= scale;
                     out[3] = 1.f;
-                    return;
+                    return n_samples;
                 }
+            } else if (footprint > 1.f) {
+                // Low-sigma cell smaller than the footprint: step a footprint
+                delta_t = max(delta_t, min_step_per_t * t + opt.step_size);
             }
             t += delta_t;
         }
@@ -192,6 +247,7 @@ __device__ __inline__ void trace_ray(
         } else {
             out[3] = 1.f - light_intensity;
         }
+        return n_samples;
     }
 }
 
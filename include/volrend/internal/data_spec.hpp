@@ -26,6 +26,9 @@ struct TreeSpec {
     const float* VOLREND_RESTRICT const offset;
     const float* VOLREND_RESTRICT const scale;
     const float* VOLREND_RESTRICT const extra;
+    // Neighbour ropes and node positions, or nullptr (see N3Tree::ropes_)
+    const int32_t* VOLREND_RESTRICT const ropes;
+    const int32_t* VOLREND_RESTRICT const node_pos;
     const int N;
     const int N3;
     const int data_dim;
@@ -40,6 +43,10 @@ struct TreeSpec {
           offset(cpu ? tree.offset.data() : tree.device.offset),
           scale(cpu ? tree.scale.data() : tree.device.scale),
           extra(cpu ? tree.extra_.data<float>() : tree.device.extra),
+          ropes(cpu ? (tree.has_ropes() ? tree.ropes_.data<int32_t>() : nullptr)
+                    : tree.device.ropes),
+          node_pos(cpu ? (tree.has_ropes() ? tree.node_pos_.data() : nullptr)
+                       : tree.device.node_pos),
           N(tree.N),
           N3(tree.N * tree.N * tree.N),
           data_dim(tree.data_dim),
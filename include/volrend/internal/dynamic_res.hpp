@@ -0,0 +1,105 @@
+#pragma once
+
+#include "glm/mat4x3.hpp"
+#include "glm/vec2.hpp"
+#include "volrend/render_options.hpp"
+
+#ifdef __EMSCRIPTEN__
+// WebGL
+#include <GLES3/gl3.h>
+#else
+#include <GL/glew.h>
+#endif
+
+namespace volrend {
+namespace internal {
+
+// Resolution scale of each interactive frame: options.dynamic_res_scale
+// while the camera moves, then doubling every idle frame back up to 1
+class DynamicResolution {
+   public:
+    float next_scale(bool moving, const RenderOptions& options);
+
+    // Size of a width x height image at scale, at least 1 x 1
+    static void scaled_size(int width, int height, float scale,
+                            int& out_width, int& out_height);
+
+   private:
+    float scale_ = 1.f;
+};
+
+// Edge-aware upsampling of a low resolution render to the current
+// framebuffer, guided by its depth: each output pixel blends the 4 nearest
+// low resolution pixels bilinearly, down-weighting those whose depth differs
+// from the nearest one's, so silhouettes stay sharp instead of bleeding
+// into the background
+class DepthUpsampler {
+   public:
+    ~DepthUpsampler();
+
+    // Draw the lower-left width x height region of color_tex (RGBA) and
+    // depth_tex (R32F, distance from the camera) to the out_width x
+    // out_height viewport. Needs a current GL context
+    void draw(GLuint color_tex, GLuint depth_tex, int width, int height,
+              int out_width, int out_height);
+
+   private:
+    void init();
+
+    GLuint program_ = 0, vao_ = 0, vbo_ = 0;
+    GLint u_color_tex_, u_depth_tex_, u_low_reso_, u_out_reso_;
+};
+
+// Draws a progressively or foveated traced image (internal/progressive.hpp,
+// internal/foveation.hpp) to the current framebuffer, interpolating pixels
+// not yet traced from the completed lattice
+class ProgressiveFill {
+   public:
+    ~ProgressiveFill();
+
+    // Draw the width x height color_tex (RGBA) after passes_done >= 1
+    // passes, fewer outside options' region of interest if enabled. Needs a
+    // current GL context
+    void draw(GLuint color_tex, int passes_done, int width, int height,
+              const RenderOptions& options);
+
+   private:
+    void init();
+
+    GLuint program_ = 0, vao_ = 0, vbo_ = 0;
+    GLint u_color_tex_, u_passes_done_, u_roi_, u_roi_passes_;
+};
+
+// Forward warp of the previous interactive frame into the current camera
+// for reprojection (RenderOptions::reproject; internal::Reprojector is the
+// CPU counterpart): each pixel with a depth is drawn as a point at its
+// surface point, nearest first, carrying its color and its info (world
+// origin it was traced from, resampling error in pixels so far). The error
+// grows by each point's distance to the pixel center it lands on, and is
+// set to infinity where the view direction turned more than max_angle
+// (radians) since traced or on depth edges of the previous frame (relative
+// depth_tol), so that rt.frag retraces those pixels
+class ReprojectSplat {
+   public:
+    ~ReprojectSplat();
+
+    // Warp the width x height color_tex (RGBA), depth_tex (R32F, distance
+    // from the camera) and info_tex (RGBA32F) of camera prev_c2w /
+    // prev_focal into camera c2w / focal, drawing to color attachments
+    // 0-2 and the depth buffer of the bound framebuffer, which are
+    // cleared first (holes get alpha 0). Needs a current GL context
+    void draw(GLuint color_tex, GLuint depth_tex, GLuint info_tex, int width,
+              int height, const glm::mat4x3& prev_c2w,
+              const glm::vec2& prev_focal, const glm::mat4x3& c2w,
+              const glm::vec2& focal, float max_angle, float depth_tol);
+
+   private:
+    void init();
+
+    GLuint program_ = 0, vao_ = 0;
+    GLint u_color_tex_, u_depth_tex_, u_info_tex_, u_reso_, u_prev_c2w_,
+        u_prev_focal_, u_c2w_, u_focal_, u_cos_max_angle_, u_depth_tol_;
+};
+
+}  // namespace internal
+}  // namespace volrend
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "volrend/internal/progressive.hpp"
+#include "volrend/render_options.hpp"
+
+namespace volrend {
+namespace internal {
+
+// Foveated rendering (RenderOptions::roi): outside the region of interest
+// only the first roi_passes() passes of the progressive order
+// (internal/progressive.hpp) are traced, i.e. the lattice of stride
+// roi_stride(), and the other pixels are interpolated from it.
+// rt.frag and ProgressiveFill (dynamic_res.cpp) implement the same on GL
+
+// Lattice stride outside the region, options.roi_stride rounded down to a
+// power of two in [1, PROGRESSIVE_BLOCK]
+inline int roi_stride(const RenderOptions& options) {
+    int stride = 1;
+    while (stride < PROGRESSIVE_BLOCK && 2 * stride <= options.roi_stride) {
+        stride *= 2;
+    }
+    return stride;
+}
+
+// Progressive passes traced outside the region
+inline int roi_passes(const RenderOptions& options) {
+    const int n = PROGRESSIVE_BLOCK / roi_stride(options);
+    return n * n;
+}
+
+// Whether the center of pixel (x, y) is outside the region of interest
+inline bool roi_outside(const RenderOptions& options, int x, int y) {
+    if (!options.roi) return false;
+    const float dx = x + 0.5f - options.roi_center[0],
+                dy = y + 0.5f - options.roi_center[1];
+    return dx * dx + dy * dy > options.roi_radius * options.roi_radius;
+}
+
+// Whether pixel (x, y) is traced under foveation
+inline bool roi_traced(const RenderOptions& options, int x, int y) {
+    return !roi_outside(options, x, y) ||
+           progressive_rank(x % PROGRESSIVE_BLOCK, y % PROGRESSIVE_BLOCK) <
+               roi_passes(options);
+}
+
+// Interpolate the untraced pixels of the region [x0, x1) x [y0, y1) of a
+// width-wide u8 RGBA image bilinearly from the lattice pixels around them
+// inside the region, which must be traced; x0 and y0 must be multiples of
+// roi_stride(options). Depths (if given) are taken from the nearest lattice
+// pixel up and to the left
+inline void roi_fill(const RenderOptions& options, int width, int x0, int y0,
+                     int x1, int y1, uint8_t* rgba, float* depth = nullptr) {
+    const int stride = roi_stride(options);
+    if (!options.roi || stride == 1) return;
+    for (int y = y0; y < y1; ++y) {
+        const int ly0 = y - y % stride,
+                  ly1 = ly0 + stride < y1 ? ly0 + stride : ly0;
+        const float wy = (float)(y - ly0) / stride;
+        for (int x = x0; x < x1; ++x) {
+            if (roi_traced(options, x, y)) continue;
+            const int lx0 = x - x % stride,
+                      lx1 = lx0 + stride < x1 ? lx0 + stride : lx0;
+            const float wx = (float)(x - lx0) / stride;
+            const uint8_t* c00 = rgba + 4 * ((size_t)ly0 * width + lx0);
+            const uint8_t* c01 = rgba + 4 * ((size_t)ly0 * width + lx1);
+            const uint8_t* c10 = rgba + 4 * ((size_t)ly1 * width + lx0);
+            const uint8_t* c11 = rgba + 4 * ((size_t)ly1 * width + lx1);
+            uint8_t* dst = rgba + 4 * ((size_t)y * width + x);
+            for (int c = 0; c < 4; ++c) {
+                const float top = c00[c] + wx * (c01[c] - c00[c]),
+                            bottom = c10[c] + wx * (c11[c] - c10[c]);
+                dst[c] = uint8_t(top + wy * (bottom - top) + 0.5f);
+            }
+            if (depth != nullptr) {
+                depth[(size_t)y * width + x] =
+                    depth[(size_t)ly0 * width + lx0];
+            }
+        }
+    }
+}
+
+}  // namespace internal
+}  // namespace volrend
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "volrend/common.hpp"
+#include "volrend/n3tree.hpp"
+#include "volrend/camera.hpp"
+#include "volrend/mesh.hpp"
+#include "volrend/render_options.hpp"
+
+namespace volrend {
+namespace internal {
+
+// Combine two hashes (order dependent)
+uint64_t hash_combine(uint64_t seed, uint64_t value);
+
+// Hash of raw bytes
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0);
+
+// Hash of the tree contents (data, child links, transform, format, NDC)
+uint64_t hash_tree(const N3Tree& tree);
+
+// Hash of the render options which affect the output image,
+// excluding render_bbox which the cache handles separately.
+// Any new output-affecting RenderOptions field must be added here.
+uint64_t hash_render_options(const RenderOptions& options);
+
+// Hash of the camera pose, focal lengths and image size
+uint64_t hash_camera(const Camera& cam);
+
+// Hash of the visible meshes composited into frames (geometry, colors,
+// transforms)
+uint64_t hash_meshes(const std::vector<Mesh>& meshes);
+
+// Mark the tile_size x tile_size tiles of cam's image whose rays may pass
+// through the region where render bboxes bbox_a and bbox_b differ,
+// i.e. the only tiles which change when switching between them.
+// mask is resized to the row-major tile grid. Returns number of dirty tiles.
+int bbox_dirty_tiles(const N3Tree& tree, const Camera& cam,
+                     const float* bbox_a, const float* bbox_b, int tile_size,
+                     std::vector<uint8_t>& mask);
+
+// Content-addressed on-disk cache of rendered u8 RGBA frames.
+// Frames are stored in <root>/<key>/<bbox hash>.frame where key should
+// combine the tree, render options and camera hashes above, so that
+// frames differing only in render_bbox can be found and partially retraced.
+class FrameCache {
+   public:
+    explicit FrameCache(const std::string& root);
+
+    // Load the frame rendered with exactly this render_bbox into out
+    // (4 * width * height bytes). Returns false if not cached
+    bool load(uint64_t key, const float* bbox, int width, int height,
+              uint8_t* out) const;
+
+    // Load the cached frame for key with the closest render_bbox, which is
+    // written to bbox_out. Returns false if no frame is cached for key
+    bool load_nearest(uint64_t key, const float* bbox, int width, int height,
+                      uint8_t* out, float* bbox_out) const;
+
+    // Store a frame; returns false on IO failure
+    bool store(uint64_t key, const float* bbox, int width, int height,
+               const uint8_t* data) const;
+
+   private:
+    std::string root_;
+};
+
+}  // namespace internal
+}  // namespace volrend
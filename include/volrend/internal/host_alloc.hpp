@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace volrend {
+
+// Pages backing large host buffers (the tree's child/data arrays):
+// ordinary heap pages, transparent huge pages requested with madvise, or
+// explicit hugetlbfs 2MB/1GB pages (reserved via vm.nr_hugepages)
+enum class PageMode { DEFAULT, THP, HUGE_2MB, HUGE_1GB };
+
+namespace internal {
+
+// Parse default/thp/2mb/1gb; false if unknown
+bool parse_page_mode(const std::string& str, PageMode& mode);
+const char* page_mode_name(PageMode mode);
+
+// Allocate bytes backed per mode. Huge page modes fall back to ordinary
+// pages (warning once) if unavailable; blocks are freed with host_free
+// given the same bytes and mode
+void* host_alloc(size_t bytes, PageMode mode);
+void host_free(void* ptr, size_t bytes, PageMode mode);
+
+// Standard allocator over host_alloc, carrying the page mode along when
+// containers are swapped or moved
+template <typename T>
+struct HostAllocator {
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    HostAllocator() = default;
+    explicit HostAllocator(PageMode mode) : mode(mode) {}
+    template <typename U>
+    HostAllocator(const HostAllocator<U>& other) : mode(other.mode) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(host_alloc(n * sizeof(T), mode));
+    }
+    void deallocate(T* ptr, size_t n) { host_free(ptr, n * sizeof(T), mode); }
+
+    PageMode mode = PageMode::DEFAULT;
+};
+
+template <typename T, typename U>
+bool operator==(const HostAllocator<T>& a, const HostAllocator<U>& b) {
+    return a.mode == b.mode;
+}
+template <typename T, typename U>
+bool operator!=(const HostAllocator<T>& a, const HostAllocator<U>& b) {
+    return a.mode != b.mode;
+}
+
+// Array of the tree (N3Tree's child, data and ropes) with its data on
+// pages of a PageMode; loaded from cnpy::NpyArray, whose accessors it
+// mirrors
+struct HostArray {
+    // Reallocate for shape (zeroed), with pages of mode
+    void reinit(const std::vector<size_t>& shape, size_t word_size,
+                PageMode mode = PageMode::DEFAULT);
+
+    template <typename T>
+    T* data() {
+        return reinterpret_cast<T*>(data_holder.data());
+    }
+    template <typename T>
+    const T* data() const {
+        return reinterpret_cast<const T*>(data_holder.data());
+    }
+    size_t num_bytes() const { return data_holder.size(); }
+    PageMode page_mode() const { return data_holder.get_allocator().mode; }
+
+    std::vector<char, HostAllocator<char>> data_holder;
+    std::vector<size_t> shape;
+    size_t word_size = 0;
+    size_t num_vals = 0;
+};
+
+}  // namespace internal
+}  // namespace volrend
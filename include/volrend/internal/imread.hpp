@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace volrend {
+namespace internal {
+
+// Read a PNG file as u8, 4 channel RGBA (gray/palette/16-bit are converted,
+// missing alpha is filled with 255)
+bool read_png_file(const std::string &filename, std::vector<uint8_t> &out,
+                   int &width, int &height);
+
+}  // namespace internal
+}  // namespace volrend
@@ -6,8 +6,8 @@ namespace volrend {
 namespace internal {
 
 // Write a u8, 4 channel PNG file
-bool write_png_file(const std::string &filename, uint8_t *ptr, int width,
-                    int height);
+bool write_png_file(const std::string &filename, const uint8_t *ptr,
+                    int width, int height);
 
 }  // namespace internal
 }  // namespace volrend
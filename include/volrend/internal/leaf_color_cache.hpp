@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace volrend {
+namespace internal {
+
+// Cache of view-dependent leaf colors for the CPU renderer: sigmoid'ed RGB
+// as 8-bit, keyed by (leaf index, octahedral view direction bin).
+// Colors are always evaluated at the bin center direction, so results do
+// not depend on which ray filled an entry.
+//
+// Bounded, set-associative with LRU replacement inside each set: every
+// entry is a single 64-bit word (40-bit key | 24-bit RGB), so concurrent
+// render threads read and write without locks. Races may drop or duplicate
+// entries but never mix up key and color.
+class LeafColorCache {
+   public:
+    // Entries use at most budget_bytes; view directions are quantized to
+    // dir_res x dir_res octahedral bins
+    LeafColorCache(size_t budget_bytes, int dir_res);
+
+    int dir_res() const { return dir_res_; }
+    int n_bins() const { return dir_res_ * dir_res_; }
+    // Number of entries
+    size_t capacity() const { return n_sets_ * WAYS; }
+    // Whether keys of a tree with this many leaf slots fit the entry tag
+    bool supports(uint64_t n_leaves) const {
+        return n_leaves * n_bins() < (1ULL << KEY_BITS) - 1;
+    }
+
+    // Octahedral bin of unit direction dir
+    uint32_t dir_bin(const float* dir) const {
+        const float inv_l1 =
+            1.f / (std::fabs(dir[0]) + std::fabs(dir[1]) + std::fabs(dir[2]));
+        float u = dir[0] * inv_l1, v = dir[1] * inv_l1;
+        if (dir[2] < 0.f) {
+            // Fold the lower hemisphere over the diagonals
+            const float fu = (1.f - std::fabs(v)) * (u >= 0.f ? 1.f : -1.f);
+            v = (1.f - std::fabs(u)) * (v >= 0.f ? 1.f : -1.f);
+            u = fu;
+        }
+        int bu = (int)((u * 0.5f + 0.5f) * dir_res_),
+            bv = (int)((v * 0.5f + 0.5f) * dir_res_);
+        bu = bu < 0 ? 0 : (bu >= dir_res_ ? dir_res_ - 1 : bu);
+        bv = bv < 0 ? 0 : (bv >= dir_res_ ? dir_res_ - 1 : bv);
+        return (uint32_t)(bv * dir_res_ + bu);
+    }
+
+    // Unit direction at the center of bin
+    void bin_dir(uint32_t bin, float* dir) const;
+
+    // Look up the color of leaf in bin; marks it most recently used
+    bool lookup(uint64_t leaf, uint32_t bin, uint8_t* rgb) {
+        const uint64_t tag = leaf * n_bins() + bin + 1;
+        std::atomic<uint64_t>* set = get_set(tag);
+        for (int w = 0; w < WAYS; ++w) {
+            const uint64_t entry = set[w].load(std::memory_order_relaxed);
+            if ((entry >> RGB_BITS) != tag) continue;
+            rgb[0] = (uint8_t)entry;
+            rgb[1] = (uint8_t)(entry >> 8);
+            rgb[2] = (uint8_t)(entry >> 16);
+            if (w > 0) {
+                // Move to front
+                for (int j = w; j > 0; --j) {
+                    set[j].store(set[j - 1].load(std::memory_order_relaxed),
+                                 std::memory_order_relaxed);
+                }
+                set[0].store(entry, std::memory_order_relaxed);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    // Insert as most recently used, evicting the set's least recently used
+    void insert(uint64_t leaf, uint32_t bin, const uint8_t* rgb) {
+        const uint64_t tag = leaf * n_bins() + bin + 1;
+        std::atomic<uint64_t>* set = get_set(tag);
+        for (int j = WAYS - 1; j > 0; --j) {
+            set[j].store(set[j - 1].load(std::memory_order_relaxed),
+                         std::memory_order_relaxed);
+        }
+        set[0].store(tag << RGB_BITS | (uint64_t)rgb[2] << 16 |
+                         (uint64_t)rgb[1] << 8 | rgb[0],
+                     std::memory_order_relaxed);
+    }
+
+    // Drop all entries; not thread safe against concurrent lookups
+    void clear();
+
+    // Hit/miss statistics, accumulated by the renderer
+    void add_stats(uint64_t hits, uint64_t misses) {
+        hits_ += hits;
+        misses_ += misses;
+    }
+    uint64_t hits() const { return hits_; }
+    uint64_t misses() const { return misses_; }
+
+   private:
+    static const int WAYS = 4;
+    static const int RGB_BITS = 24;
+    static const int KEY_BITS = 64 - RGB_BITS;
+
+    std::atomic<uint64_t>* get_set(uint64_t tag) {
+        return entries_.get() +
+               ((tag * 0x9E3779B97F4A7C15ULL) >> set_shift_) * WAYS;
+    }
+
+    int dir_res_;
+    size_t n_sets_;
+    int set_shift_;
+    std::unique_ptr<std::atomic<uint64_t>[]> entries_;
+    std::atomic<uint64_t> hits_{0}, misses_{0};
+};
+
+}  // namespace internal
+}  // namespace volrend
@@ -1,25 +1,39 @@
+#pragma once
+#include <cmath>
 #include "volrend/common.hpp"
+#include "volrend/data_format.hpp"
+#ifdef VOLREND_CUDA
 #include "volrend/internal/data_spec.hpp"
+#endif
 
 namespace volrend {
 namespace internal {
 namespace {
 
 template <typename scalar_t>
-VOLREND_COMMON_FUNCTION void maybe_precalc_basis(
-    const TreeSpec& VOLREND_RESTRICT tree, const scalar_t* VOLREND_RESTRICT dir,
-    scalar_t* VOLREND_RESTRICT out) {
-    const int basis_dim = tree.data_format.basis_dim;
-    switch (tree.data_format.format) {
+VOLREND_COMMON_FUNCTION scalar_t _basis_dot3(const scalar_t* VOLREND_RESTRICT u,
+                                             const scalar_t* VOLREND_RESTRICT v) {
+    return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+}
+
+// Evaluate the basis functions of data_format in direction dir;
+// extra holds the SG/ASG lobe parameters. Usable on host and device
+template <typename scalar_t>
+VOLREND_COMMON_FUNCTION void precalc_basis(const DataFormat& data_format,
+                                           const scalar_t* VOLREND_RESTRICT extra,
+                                           const scalar_t* VOLREND_RESTRICT dir,
+                                           scalar_t* VOLREND_RESTRICT out) {
+    const int basis_dim = data_format.basis_dim;
+    switch (data_format.format) {
         case DataFormat::ASG: {
             // UNTESTED ASG
-            const scalar_t* ptr = tree.extra;
+            const scalar_t* ptr = extra;
             for (int i = 0; i < basis_dim; ++i) {
                 const scalar_t *ptr_mu_x = ptr + 2, *ptr_mu_y = ptr + 5,
                                *ptr_mu_z = ptr + 8;
-                scalar_t S = _dot3(dir, ptr_mu_z);
-                scalar_t dot_x = _dot3(dir, ptr_mu_x);
-                scalar_t dot_y = _dot3(dir, ptr_mu_y);
+                scalar_t S = _basis_dot3(dir, ptr_mu_z);
+                scalar_t dot_x = _basis_dot3(dir, ptr_mu_x);
+                scalar_t dot_y = _basis_dot3(dir, ptr_mu_y);
                 out[i] =
                     S * expf(-ptr[0] * dot_x * dot_x - ptr[1] * dot_y * dot_y) /
                     basis_dim;
@@ -28,9 +42,10 @@ VOLREND_COMMON_FUNCTION void maybe_precalc_basis(
         }  // ASG
         break;
         case DataFormat::SG: {
-            const scalar_t* ptr = tree.extra;
+            const scalar_t* ptr = extra;
             for (int i = 0; i < basis_dim; ++i) {
-                out[i] = expf(ptr[0] * (_dot3(dir, ptr + 1) - 1.f)) / basis_dim;
+                out[i] = expf(ptr[0] * (_basis_dot3(dir, ptr + 1) - 1.f)) /
+                         basis_dim;
                 ptr += 4;
             }
         }  // SG
@@ -86,6 +101,15 @@ VOLREND_COMMON_FUNCTION void maybe_precalc_basis(
     }  // switch
 }
 
+#ifdef VOLREND_CUDA
+template <typename scalar_t>
+VOLREND_COMMON_FUNCTION void maybe_precalc_basis(
+    const TreeSpec& VOLREND_RESTRICT tree, const scalar_t* VOLREND_RESTRICT dir,
+    scalar_t* VOLREND_RESTRICT out) {
+    precalc_basis(tree.data_format, tree.extra, dir, out);
+}
+#endif
+
 }  // namespace
 }  // namespace internal
 }  // namespace volrend
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm/mat4x4.hpp"
+#include "glm/vec3.hpp"
+#include "volrend/mesh.hpp"
+
+namespace volrend {
+namespace internal {
+
+// Frustum culling of the mesh list for the GL renderers. cull() returns the
+// visible meshes whose world bounds (Mesh::world_bounds) intersect the view
+// frustum, so that off-screen meshes cost no uniform updates or draw calls.
+// Each mesh's bounds are cached with a stamp of what they depend on (vertex
+// version and buffer, model transform) and recomputed only when the stamp
+// changes. Checking the stamps is the only per-frame work over the whole
+// list; lists of at least BVH_MIN_MESHES meshes are tested through a
+// bounding volume hierarchy over the bounds, refit only above the leaves of
+// changed meshes and rebuilt when the list length changes, so the frustum
+// tests scale with the visible meshes rather than the list
+class MeshCuller {
+   public:
+    static const size_t BVH_MIN_MESHES = 64;
+
+    // Indices of the meshes to draw for view V and projection K (as given
+    // to Mesh::draw), in no particular order; valid until the next call
+    const std::vector<uint32_t>& cull(const std::vector<Mesh>& meshes,
+                                      const glm::mat4& V, const glm::mat4& K);
+
+   private:
+    struct Box {
+        glm::vec3 min, max;
+    };
+    // What the world bounds of a mesh depend on
+    struct Stamp {
+        uint64_t version;
+        const float* vert;
+        glm::vec3 rotation, translation;
+        float scale;
+
+        bool operator==(const Stamp& other) const {
+            return version == other.version && vert == other.vert &&
+                   rotation == other.rotation &&
+                   translation == other.translation && scale == other.scale;
+        }
+    };
+    // BVH node over the meshes items_[begin, end); inner nodes have
+    // children index + 1 and right, leaves right = 0
+    struct Node {
+        Box box;
+        uint32_t begin, end, right, parent;
+    };
+
+    uint32_t build(uint32_t begin, uint32_t end, uint32_t parent);
+    // Recompute the box of node i from its items or children; returns
+    // whether it changed
+    bool fit(uint32_t i);
+
+    std::vector<Stamp> stamps_;
+    std::vector<Box> boxes_;
+    std::vector<uint32_t> changed_;
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> items_;
+    // Leaf node of each mesh
+    std::vector<uint32_t> leaf_;
+    std::vector<uint32_t> visible_;
+};
+
+}  // namespace internal
+}  // namespace volrend
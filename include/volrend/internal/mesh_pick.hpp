@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm/vec3.hpp"
+#include "volrend/mesh.hpp"
+
+namespace volrend {
+namespace internal {
+
+// Ray picking against the triangles of a mesh list, e.g. to place the probe
+// on a surface under the cursor. Each triangle mesh gets a bounding volume
+// hierarchy over its own vertices, built on its first pick and rebuilt when
+// its vertices change (Mesh::version); rays are transformed into the local
+// space of each mesh instance instead, so moving meshes costs no rebuild.
+// Point and line meshes are not picked
+class MeshPicker {
+   public:
+    // Nearest hit of the world-space ray (origin, dir) on the visible
+    // meshes: its distance t along the ray in units of |dir| and the index
+    // of its mesh. False if nothing is hit
+    bool pick(const std::vector<Mesh>& meshes, const glm::vec3& origin,
+              const glm::vec3& dir, float& t, int& mesh);
+
+   private:
+    // Node over the triangles [begin, end); inner nodes have children
+    // index + 1 and right, leaves right = 0
+    struct Node {
+        glm::vec3 min, max;
+        uint32_t begin, end, right;
+    };
+    // Hierarchy of one mesh, and the vertices it was built from
+    struct Bvh {
+        const float* vert = nullptr;
+        size_t vert_size = 0, faces_size = 0;
+        uint64_t version = 0;
+        // Triangle corners, 3 per triangle in leaf order
+        std::vector<glm::vec3> tris;
+        std::vector<Node> nodes;
+    };
+
+    static void build(const Mesh& mesh, Bvh& bvh);
+    // Nearest hit closer than t, updating t
+    static bool intersect(const Bvh& bvh, const glm::vec3& origin,
+                          const glm::vec3& dir, float& t);
+
+    std::vector<Bvh> bvhs_;
+};
+
+}  // namespace internal
+}  // namespace volrend
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "glm/vec3.hpp"
+#include "volrend/camera.hpp"
+#include "volrend/mesh.hpp"
+
+namespace volrend {
+namespace internal {
+
+// CPU rasterizer for Mesh, to composite drawlists into CPU volume renders
+// without a GL framebuffer. It produces the mesh color (u8 RGBA over the
+// background) and depth (distance from the camera, +inf where no mesh)
+// that the GL renderers read as the volume's background and tmax_bg.
+// Triangles, lines and points are shaded like the mesh shader in mesh.cpp,
+// with perspective-correct interpolation, at the CPU renderer's pixel
+// sample positions. setup() transforms, near-clips and bins the primitives
+// into image tiles once per frame; tiles are then rasterized independently,
+// each by the thread tracing it
+class MeshRasterizer {
+   public:
+    // Set up the visible meshes for a cam.width x cam.height image in
+    // tile_size x tile_size tiles; background is the color where no mesh is
+    void setup(const std::vector<Mesh>& meshes, const Camera& cam,
+               int tile_size, float background);
+
+    // Whether setup() found nothing to draw
+    bool empty() const { return prims_.empty(); }
+
+    // Rasterize one tile (row-major index). Different tiles may be
+    // rasterized concurrently
+    void rasterize_tile(uint32_t tile);
+
+    // Color (4 per pixel) and depth of the image, valid in rasterized tiles
+    const uint8_t* color() const { return color_.data(); }
+    const float* depth() const { return depth_.data(); }
+
+   private:
+    // Projected vertex: pixel position and 1 / camera-space depth, with
+    // attributes premultiplied by it for perspective-correct interpolation
+    struct Vertex {
+        float x, y, inv_z;
+        glm::vec3 pos, color, normal;
+    };
+    // Point, line or triangle of n consecutive vertices from first
+    struct Prim {
+        uint32_t first;
+        uint8_t n;
+        bool unlit;
+    };
+
+    void add_prim(const Vertex* verts, int n, bool unlit);
+    // Depth test and shade a fragment interpolated from prim's vertices
+    // with weights w (summing to 1 in screen space)
+    void fragment(const Prim& prim, const float* w, int x, int y);
+
+    int width_ = 0, height_ = 0, tile_size_ = 16, tiles_x_ = 0;
+    float background_ = 1.f;
+    float fx_ = 1.f, fy_ = 1.f;
+    // World position of the camera, for specular lighting
+    glm::vec3 cam_pos_;
+
+    std::vector<Vertex> verts_;
+    std::vector<Prim> prims_;
+    // Primitives overlapping tile t, in drawing order:
+    // bin_items_[bin_start_[t], bin_start_[t + 1])
+    std::vector<uint32_t> bin_start_, bin_items_;
+
+    std::vector<uint8_t> color_;
+    std::vector<float> depth_;
+};
+
+}  // namespace internal
+}  // namespace volrend
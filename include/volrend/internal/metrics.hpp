@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+
+namespace volrend {
+namespace internal {
+
+// Image quality metrics between two u8 RGBA images of the same size,
+// computed over the RGB channels only. If mask (u8, width * height) is given,
+// only pixels with nonzero mask are counted (NaN if there are none)
+
+// Peak signal-to-noise ratio in dB (infinite for identical images)
+double psnr(const uint8_t* a, const uint8_t* b, int width, int height,
+            const uint8_t* mask = nullptr);
+
+// Mean structural similarity, 11x11 Gaussian window with sigma 1.5 over the
+// valid region, as in the usual NeRF evaluation code. With a mask, the SSIM
+// map is averaged over windows whose center pixel is in the mask
+double ssim(const uint8_t* a, const uint8_t* b, int width, int height,
+            const uint8_t* mask = nullptr);
+
+// Composite a u8 RGBA image over a uniform background of given brightness
+// (0-1) in place, setting alpha to 255
+void composite_background(uint8_t* rgba, int width, int height,
+                          float background_brightness);
+
+}  // namespace internal
+}  // namespace volrend
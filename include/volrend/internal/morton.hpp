@@ -1,3 +1,4 @@
+#pragma once
 #include <cstdint>
 #include "volrend/common.hpp"
 
@@ -38,6 +39,21 @@ VOLREND_COMMON_FUNCTION void inv_morton_code_3(uint32_t code, uint32_t* x,
     *y = _unexpand_bits(code >> 1);
     *z = _unexpand_bits(code);
 }
+
+// 2D Morton code helpers
+VOLREND_COMMON_FUNCTION uint32_t _expand_bits_2(uint32_t v) {
+    v &= 0x0000ffff;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+// 2D Morton code (interleave), e.g. for image tile order
+VOLREND_COMMON_FUNCTION uint32_t morton_code_2(uint32_t x, uint32_t y) {
+    return (_expand_bits_2(y) << 1) + _expand_bits_2(x);
+}
 }  // namespace
 }  // namespace internal
 }  // namespace volrend
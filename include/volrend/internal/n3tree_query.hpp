@@ -47,6 +47,51 @@ VOLREND_COMMON_FUNCTION static void query_single_from_root(
     }
 }
 
+// As query_single_from_root, but starting from cell (following a rope);
+// returns false, leaving xyz unchanged, if xyz is not in cell
+VOLREND_COMMON_FUNCTION static bool query_single_from_cell(
+    const TreeSpec& tree, int64_t cell, float* VOLREND_RESTRICT xyz,
+    const half** VOLREND_RESTRICT out, float* VOLREND_RESTRICT cube_sz) {
+    const float fN = tree.N;
+    const int N = tree.N;
+    const int idx = (int)(cell % tree.N3);
+    const int ijk[3] = {idx / (N * N), idx / N % N, idx % N};
+    const int32_t* pos = tree.node_pos + (cell / tree.N3) * 4;
+    const float res = (float)pos[3];
+    float local[3];
+#pragma unroll 3
+    for (int i = 0; i < 3; ++i) {
+        const float x =
+            VOLREND_MAX(VOLREND_MIN(xyz[i], 1.f - 1e-6f), 0.f) * res;
+        const float idx_dimi = floorf(x);
+        if (idx_dimi != (float)(pos[i] + ijk[i])) return false;
+        local[i] = x - idx_dimi;
+    }
+    xyz[0] = local[0];
+    xyz[1] = local[1];
+    xyz[2] = local[2];
+    *cube_sz = res;
+    int64_t sub_ptr = cell;
+    while (true) {
+        const int64_t skip = tree.child[sub_ptr];
+        if (skip == 0) {
+            *out = tree.data + sub_ptr * tree.data_dim;
+            return true;
+        }
+        *cube_sz *= fN;
+        const int64_t ptr = sub_ptr - sub_ptr % tree.N3 + skip * tree.N3;
+        float index = 0.f;
+#pragma unroll 3
+        for (int i = 0; i < 3; ++i) {
+            xyz[i] *= fN;
+            const float idx_dimi = floorf(xyz[i]);
+            index = index * fN + idx_dimi;
+            xyz[i] -= idx_dimi;
+        }
+        sub_ptr = ptr + (int32_t)index;
+    }
+}
+
 }  // namespace
 }  // namespace internal
 }  // namespace volrend
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace volrend {
+namespace internal {
+
+// Array of a NpzView, with the interface of cnpy::NpyArray but not owning
+// its data
+struct NpyView {
+    template <typename T>
+    const T* data() const {
+        return reinterpret_cast<const T*>(ptr);
+    }
+    size_t num_bytes() const { return num_vals * word_size; }
+
+    const char* ptr = nullptr;
+    std::vector<size_t> shape;
+    size_t word_size = 0;
+    bool fortran_order = false;
+    size_t num_vals = 0;
+};
+
+// Read-only npz archive whose arrays point into the archive itself where
+// possible, replacing cnpy::npz_load for drawlists: stored (uncompressed,
+// np.savez) entries are viewed in place in the file, memory-mapped where
+// supported, or in the caller's memory, so geometry is read straight into
+// Mesh::vert/faces without intermediate copies. Compressed entries
+// (np.savez_compressed) are inflated into buffers owned by the view, as are
+// stored entries misaligned for their element type. The arrays are valid
+// while the view (and, for open_mem, the memory given) is alive
+class NpzView {
+   public:
+    NpzView() = default;
+    ~NpzView();
+    NpzView(const NpzView&) = delete;
+    NpzView& operator=(const NpzView&) = delete;
+
+    // Map the npz file at path; false with error set on failure
+    bool open(const std::string& path, std::string& error);
+    // View an npz archive in memory
+    bool open_mem(const char* data, size_t size, std::string& error);
+
+    // Arrays by name (without .npy)
+    const std::map<std::string, NpyView>& arrays() const { return arrays_; }
+
+   private:
+    bool parse(const char* data, size_t size, std::string& error);
+    void close();
+
+    std::map<std::string, NpyView> arrays_;
+    // Inflated or realigned arrays
+    std::vector<std::unique_ptr<char[]>> owned_;
+    // Mapped (or, without mmap, read) file
+    void* map_ = nullptr;
+    size_t map_size_ = 0;
+    std::vector<char> file_;
+};
+
+}  // namespace internal
+}  // namespace volrend
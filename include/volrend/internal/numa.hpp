@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace volrend {
+namespace internal {
+
+// NUMA nodes and their CPUs, from /sys on Linux. Elsewhere (or if sysfs is
+// unavailable) a single node 0 holding all hardware threads
+struct NumaTopology {
+    // Kernel node ids
+    std::vector<int> node_ids;
+    // CPUs of each node, by node index
+    std::vector<std::vector<int>> node_cpus;
+    // Node index of each CPU
+    std::vector<int> cpu_nodes;
+
+    int n_nodes() const { return (int)node_ids.size(); }
+    // Index of the node with this CPU (0 if unknown)
+    int node_of_cpu(int cpu) const {
+        return cpu >= 0 && cpu < (int)cpu_nodes.size() ? cpu_nodes[cpu] : 0;
+    }
+    // Free memory of node (by index) in bytes, or 0 if unknown
+    size_t free_bytes(int node) const;
+
+    // Detected once
+    static const NumaTopology& get();
+};
+
+// Pin the calling thread to cpu; false if unsupported
+bool pin_thread(int cpu);
+
+// CPU the calling thread is running on, or -1 if unknown
+int current_cpu();
+
+// Page placement of [ptr, ptr + bytes), rounded out to whole pages:
+// interleaved over all nodes, or on one node (by index). Pages already
+// touched are migrated. Returns false if unsupported or it failed
+bool numa_interleave(const void* ptr, size_t bytes);
+bool numa_bind(const void* ptr, size_t bytes, int node);
+
+// Node index holding the (touched) page at ptr, or -1 if unknown
+int numa_page_node(const void* ptr);
+
+// Page-aligned buffer whose pages are placed on one node (by index),
+// bound before first touch
+class NumaBuffer {
+   public:
+    NumaBuffer(size_t bytes, int node);
+    ~NumaBuffer();
+    NumaBuffer(const NumaBuffer&) = delete;
+    NumaBuffer& operator=(const NumaBuffer&) = delete;
+
+    char* data() { return data_; }
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+   private:
+    char* data_ = nullptr;
+    size_t size_;
+    size_t mapped_ = 0;
+};
+
+}  // namespace internal
+}  // namespace volrend
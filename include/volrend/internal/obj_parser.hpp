@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "volrend/mesh.hpp"
+
+namespace volrend {
+namespace internal {
+
+// Parallel OBJ parser for Mesh::load_basic_obj. The text is split into
+// chunks at line boundaries, parsed by one thread each, then merged:
+// polygons are triangulated (quads along the shorter diagonal, larger ones
+// as fans) and built directly into the interleaved Mesh::vert layout.
+// Vertices are the OBJ positions with their optional colors (white if
+// absent); if every face corner has its own normal index, distinct
+// (position, normal) pairs become vertices, deduplicated by hash. Normals
+// are otherwise taken by position index if there are enough, or estimated.
+// Texture coordinates, materials and groups are ignored. Returns false with
+// error set if the file cannot be read
+bool parse_obj(const char* data, size_t size, Mesh& mesh, std::string& error);
+
+// parse_obj on a file, memory-mapped where supported
+bool parse_obj_file(const std::string& path, Mesh& mesh, std::string& error);
+
+// Set the normals of a triangle mesh (Mesh::vert, indexed by faces, or
+// consecutive triangles if faces is empty) to the normalized sum of the
+// unnormalized normals of the faces around each vertex. Faces are split
+// over threads accumulating into their own buffers, summed per vertex
+void estimate_normals(std::vector<float>& verts,
+                      const std::vector<unsigned int>& faces);
+
+}  // namespace internal
+}  // namespace volrend
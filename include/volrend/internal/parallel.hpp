@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+namespace volrend {
+namespace internal {
+
+// Threads for short data-parallel loops outside the renderers' schedulers
+// (loading, per-frame mesh work); one under Emscripten
+inline int max_threads() {
+#ifdef __EMSCRIPTEN__
+    return 1;
+#else
+    return std::max((int)std::thread::hardware_concurrency(), 1);
+#endif
+}
+
+// Threads for n items, each getting at least grain
+inline int threads_for(size_t n, size_t grain) {
+    return (int)std::max<size_t>(
+        1, std::min<size_t>((size_t)max_threads(), n / grain));
+}
+
+// Run fn(begin, end, thread) on n_threads even ranges of [0, n), the first
+// on the calling thread
+template <class Fn>
+void parallel_ranges(size_t n, int n_threads, const Fn& fn) {
+    std::vector<std::thread> threads;
+    threads.reserve(n_threads - 1);
+    for (int t = 1; t < n_threads; ++t) {
+        threads.emplace_back([&fn, n, n_threads, t] {
+            fn(n * t / n_threads, n * (t + 1) / n_threads, t);
+        });
+    }
+    fn(size_t(0), n / n_threads, 0);
+    for (std::thread& thread : threads) thread.join();
+}
+
+}  // namespace internal
+}  // namespace volrend
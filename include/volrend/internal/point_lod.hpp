@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "glm/mat4x4.hpp"
+#include "glm/vec3.hpp"
+
+namespace volrend {
+namespace internal {
+
+// Level of detail index of a point cloud Mesh (Mesh::build_point_lod).
+// build() sorts the points (interleaved Mesh::vert) in Morton order and cuts
+// them into chunks of consecutive points with their bounding boxes; each
+// chunk is then reordered by bit-reversed Morton rank, so that any prefix of
+// it is an evenly spread subsample. select() culls chunks outside the view
+// frustum and keeps a prefix of each visible one sized to its projected
+// area, giving vertex ranges that draw() submits without re-uploading
+class PointLod {
+   public:
+    // Points per chunk; chunks are also the unit of parallel work
+    static const uint32_t CHUNK_SIZE = 4096;
+
+    // Build for the points of verts (vert_size floats each, position first),
+    // which are reordered in place
+    void build(std::vector<float>& verts, int vert_size);
+
+    size_t n_points() const { return n_points_; }
+    size_t n_chunks() const { return chunks_.size(); }
+
+    // Vertex ranges (first, count) to draw for model-view MV and projection
+    // K (as given to the mesh shader), with focal_px the focal length in
+    // pixels and about one point per spacing_px pixels kept of surfaces
+    // (0 keeps every point of visible chunks). Ranges are merged where a
+    // complete chunk is followed by a visible one
+    void select(const glm::mat4& MV, const glm::mat4& K, float focal_px,
+                float spacing_px, std::vector<int>& first,
+                std::vector<int>& count) const;
+
+   private:
+    struct Chunk {
+        glm::vec3 min, max;
+        uint32_t first, count;
+    };
+    std::vector<Chunk> chunks_;
+    size_t n_points_ = 0;
+};
+
+}  // namespace internal
+}  // namespace volrend
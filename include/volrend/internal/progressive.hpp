@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace volrend {
+namespace internal {
+
+// Progressive rendering order: each PROGRESSIVE_BLOCK x PROGRESSIVE_BLOCK
+// block of the image is traced one pixel per pass, in bit-reversed 2D
+// Morton order of the pixel's offset within its block. The first 4^j passes
+// thus trace a regular lattice of stride PROGRESSIVE_BLOCK >> j, so partial
+// images refine coarse to fine and are filled from the lattice pixels.
+// Passes are grouped into levels, one per lattice, to keep rays coherent.
+// rt.frag (progressive uniforms) and the GL fill shader in dynamic_res.cpp
+// implement the same order
+const int PROGRESSIVE_BLOCK = 8;
+const int PROGRESSIVE_PASSES = PROGRESSIVE_BLOCK * PROGRESSIVE_BLOCK;
+
+// Pass in which the pixel at offset (ox, oy) within its block is traced
+inline int progressive_rank(int ox, int oy) {
+    int rank = 0;
+    for (int b = 0; b < 3; ++b) {
+        // Morton bits (x even, y odd) from the most significant down,
+        // 3 per axis for PROGRESSIVE_BLOCK = 8
+        rank |= ((ox >> (2 - b)) & 1) << (2 * b + 1);
+        rank |= ((oy >> (2 - b)) & 1) << (2 * b);
+    }
+    return rank;
+}
+
+// Progressive levels: level 0 traces pass 0, level j > 0 passes
+// [4^(j-1), 4^j), completing the lattice of stride PROGRESSIVE_BLOCK >> j.
+// Each level j > 0 traces 3 times as many pixels as all levels before it
+const int PROGRESSIVE_LEVELS = 4;
+
+// First pass of a level (PROGRESSIVE_LEVELS for the end)
+inline int progressive_level_start(int level) {
+    return level == 0 ? 0 : 1 << (2 * (level - 1));
+}
+
+// Fill the pixels of a width x height u8 RGBA image not marked in traced
+// from the lattice of stride completed so far (nearest lattice pixel up and
+// to the left), writing the result to out
+inline void progressive_fill(const uint8_t* rgba, const uint8_t* traced,
+                             int width, int height, int stride,
+                             uint8_t* out) {
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const size_t p = (size_t)y * width + x;
+            const size_t src =
+                traced[p] ? p : (size_t)(y - y % stride) * width +
+                                    (x - x % stride);
+            for (int c = 0; c < 4; ++c) out[4 * p + c] = rgba[4 * src + c];
+        }
+    }
+}
+
+}  // namespace internal
+}  // namespace volrend
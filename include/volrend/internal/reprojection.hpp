@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "volrend/camera.hpp"
+
+namespace volrend {
+namespace internal {
+
+// When a reprojected pixel must be retraced instead of reused
+struct ReprojectOptions {
+    // Resampling error, in pixels: each reuse moves a pixel's color by the
+    // distance from its reprojected position to the pixel center it lands
+    // on; once the sum since it was traced exceeds this, it is retraced
+    float max_error = 1.f;
+    // View-dependent color error: retraced once the direction its surface
+    // point is seen from turned by more than this (radians) since traced
+    float max_angle = 0.035f;
+    // Pixels whose depth differs from a neighbour's by more than this
+    // fraction are on a depth edge and retraced, as are pixels showing
+    // something farther than this behind their nearest neighbour (gaps
+    // where a disoccluded background shows through a surface)
+    float depth_tol = 0.05f;
+};
+
+// Temporal reprojection of u8 RGBA frames along a camera path: each pixel
+// of the previous frame is moved to its surface point (from its depth) and
+// splatted into the next camera with a depth test, so only disoccluded
+// pixels, edges and pixels over the error bounds of ReprojectOptions need
+// to be retraced (CPURenderer::render_pixels). Pixels without a finite
+// depth (the background, mostly transparent rays) are always retraced
+class Reprojector {
+   public:
+    explicit Reprojector(const ReprojectOptions& options = ReprojectOptions());
+
+    // Warp the previous frame into cam: writes the reused pixels' colors to
+    // rgba and their depths to depth (4 * and 1 * cam.width * cam.height),
+    // and sets retrace (resized to cam.width * cam.height) to 1 at the
+    // pixels to retrace and 0 elsewhere. Returns the number of pixels to
+    // retrace, all of them if there is no previous frame of this size
+    size_t warp(const Camera& cam, uint8_t* rgba, float* depth,
+                std::vector<uint8_t>& retrace);
+
+    // Keep the frame for cam as the previous frame, once the pixels to
+    // retrace from the last warp(cam, ...) are rendered into rgba and depth
+    void update(const Camera& cam, const uint8_t* rgba, const float* depth);
+
+    // Forget the previous frame (e.g. on a cut)
+    void reset();
+
+    ReprojectOptions options;
+
+   private:
+    int width_ = 0, height_ = 0;
+    float fx_ = 0.f, fy_ = 0.f;
+    glm::mat4x3 c2w_;
+    std::vector<uint8_t> rgba_;
+    std::vector<float> depth_;
+    // Resampling error so far, and world direction each pixel's color was
+    // traced along
+    std::vector<float> error_;
+    std::vector<glm::vec3> traced_dir_;
+
+    // The frame being warped: previous frame pixel reused at each pixel
+    // (-1 = retraced), its nearest splat distance and error
+    std::vector<int64_t> src_;
+    std::vector<float> zbuf_, next_error_;
+    std::vector<uint8_t> reject_;
+};
+
+}  // namespace internal
+}  // namespace volrend
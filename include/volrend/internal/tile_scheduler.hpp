@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "volrend/cpu_renderer.hpp"
+
+namespace volrend {
+namespace internal {
+
+// Chase-Lev work-stealing deque of tile indices with fixed capacity
+// (Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models").
+// The owner pushes and pops at the bottom, thieves steal from the top
+class WorkStealingDeque {
+   public:
+    enum StealResult { STOLEN, EMPTY, ABORT };
+
+    // Empty the deque, with room for capacity items; not thread safe
+    void reset(size_t capacity);
+
+    // Owner only
+    void push(uint32_t item) {
+        const int64_t b = bottom_.load(std::memory_order_relaxed);
+        buf_[b & mask_].store(item, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+    }
+
+    // Owner only
+    bool pop(uint32_t& item) {
+        const int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+        bottom_.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top_.load(std::memory_order_relaxed);
+        if (t > b) {
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+        item = buf_[b & mask_].load(std::memory_order_relaxed);
+        if (t == b) {
+            // Last item, race against thieves
+            const bool won = top_.compare_exchange_strong(
+                t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom_.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+        return true;
+    }
+
+    // Any thread
+    StealResult steal(uint32_t& item) {
+        int64_t t = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t b = bottom_.load(std::memory_order_acquire);
+        if (t >= b) return EMPTY;
+        item = buf_[t & mask_].load(std::memory_order_relaxed);
+        if (!top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                          std::memory_order_relaxed)) {
+            return ABORT;
+        }
+        return STOLEN;
+    }
+
+   private:
+    // Separate cache lines for the owner and thief ends
+    alignas(64) std::atomic<int64_t> top_{0};
+    alignas(64) std::atomic<int64_t> bottom_{0};
+    std::unique_ptr<std::atomic<uint32_t>[]> buf_;
+    size_t capacity_ = 0;
+    int64_t mask_ = 0;
+};
+
+// Persistent worker threads running a function over lists of image tiles,
+// with static, dynamic (shared atomic counter) or work-stealing scheduling.
+// The calling thread takes part as worker 0
+class TileScheduler {
+   public:
+    explicit TileScheduler(int n_threads);
+    ~TileScheduler();
+
+    int n_threads() const { return n_threads_; }
+
+    // Run fn(tile, thread_id) for every tile, returning when all are done.
+    // Tiles should be in a locality-preserving (e.g. Morton) order: static and
+    // work-stealing scheduling give each thread a contiguous range of it
+    void run(const std::vector<uint32_t>& tiles, TileSchedule schedule,
+             const std::function<void(uint32_t, int)>& fn);
+
+    // Run fn(thread_id) once on every thread, returning when all returned
+    void run_all(const std::function<void(int)>& fn);
+
+    // Group of each thread (e.g. its NUMA node), all 0 by default. With
+    // work stealing, threads first steal within their group; thread ids of a
+    // group should be consecutive so that its ranges are contiguous
+    void set_thread_groups(const std::vector<int>& groups);
+
+   private:
+    void worker_loop(int thread_id);
+    void work_tiles(int thread_id);
+
+    const int n_threads_;
+    std::vector<std::thread> threads_;
+    std::unique_ptr<WorkStealingDeque[]> deques_;
+    std::vector<int> groups_;
+
+    // Current job
+    const std::function<void(int)>* job_ = nullptr;
+    const std::vector<uint32_t>* tiles_ = nullptr;
+    TileSchedule schedule_;
+    const std::function<void(uint32_t, int)>* fn_ = nullptr;
+    alignas(64) std::atomic<size_t> next_tile_{0};
+
+    std::mutex mutex_;
+    std::condition_variable start_cv_, done_cv_;
+    uint64_t generation_ = 0;
+    int n_running_ = 0;
+    bool stop_ = false;
+};
+
+}  // namespace internal
+}  // namespace volrend
@@ -1,21 +1,41 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
 #include <vector>
 #include <string>
 #include "glm/mat4x4.hpp"
 
 namespace volrend {
+namespace internal {
+class PointLod;
+}
 
 struct Mesh {
     explicit Mesh(int n_verts = 0, int n_faces = 0, int face_size = 3,
                   bool unshaded = false);
 
-    // Upload to GPU
+    // Upload to GPU; deferred to the next draw(), so meshes can be built
+    // and loaded without a GL context (e.g. for CPU rasterization)
     void update();
 
     // Use mesh shader program (for shader render purposes only)
     static void use_shader();
 
+    // Model transform from rotation, translation and scale
+    glm::mat4 model_transform() const;
+
+    // Bounds of the vertices over all instances, before the model
+    // transform (min > max if empty); cached until update() or
+    // apply_transform()
+    void local_bounds(glm::vec3& min, glm::vec3& max) const;
+    // Axis-aligned world bounds: local_bounds under the model transform
+    void world_bounds(glm::vec3& min, glm::vec3& max) const;
+
+    // Incremented by update() and apply_transform(), for caches of the
+    // vertices (e.g. internal::MeshPicker)
+    uint64_t version() const { return version_; }
+
     // Draw the mesh
     void draw(const glm::mat4x4& V, glm::mat4x4 K, bool y_up = true) const;
 
@@ -35,6 +55,30 @@ struct Mesh {
     // Triangle indices
     std::vector<unsigned int> faces;
 
+    // Instances: if any, the mesh is drawn once per instance with its
+    // affine transform (3 rows of 4 floats, applied before the model
+    // transform) and, if instance_color is given, its color (3 floats)
+    // instead of the vertex colors
+    std::vector<float> instance_transform;
+    std::vector<float> instance_color;
+
+    // Number of instances (0 if not instanced)
+    size_t n_instances() const { return instance_transform.size() / 12; }
+
+    // Append an instance with axis-angle rotation r and translation t
+    void add_instance(glm::vec3 r, glm::vec3 t);
+
+    // Transform of instance i
+    glm::mat4 instance_matrix(size_t i) const;
+
+    // Index a large point cloud (face_size 1 without faces or instances)
+    // for draw(): the points are reordered into spatial chunks, chunks
+    // outside the view are skipped and distant ones thinned to about one
+    // point per point_lod_px pixels (0: draw all points of visible chunks).
+    // Call again after changing vert; small clouds are left as is
+    void build_point_lod();
+    float point_lod_px = 1.f;
+
     // Model transform, rotation is axis-angle
     glm::vec3 rotation, translation;
     float scale = 1.f;
@@ -88,7 +132,35 @@ struct Mesh {
                                                bool default_visible = true);
 
    private:
-    unsigned int vao_, vbo_, ebo_;
+    void upload() const;
+    // Upload vert into gl_.vbo (bound on return)
+    void upload_vert() const;
+
+    // GL objects, deleted with the mesh (with the GL context current) and
+    // handed over on move, so dropping or reloading meshes frees them
+    struct GLObjects {
+        GLObjects() = default;
+        GLObjects(GLObjects&& other) noexcept;
+        GLObjects& operator=(GLObjects&& other) noexcept;
+        ~GLObjects();
+        void release();
+
+        unsigned int vao = 0, vbo = 0, ebo = 0, inst_vbo = 0,
+                     inst_color_vbo = 0;
+        // Persistent mapping of vbo for large vertex buffers, its size,
+        // and the fence (GLsync) of the last draw reading it
+        void* vbo_map = nullptr;
+        size_t vbo_capacity = 0;
+        void* vbo_fence = nullptr;
+    };
+    mutable GLObjects gl_;
+    mutable bool dirty_ = true;
+    mutable glm::vec3 bounds_min_, bounds_max_;
+    mutable bool bounds_dirty_ = true;
+    uint64_t version_ = 0;
+    // Point cloud index, and the vertex ranges drawn last
+    std::shared_ptr<const internal::PointLod> point_lod_;
+    mutable std::vector<int> lod_first_, lod_count_;
 };
 
 }  // namespace volrend
@@ -9,6 +9,7 @@
 #include <tuple>
 #include <utility>
 #include "cnpy.h"
+#include "volrend/internal/host_alloc.hpp"
 
 #include "glm/vec3.hpp"
 
@@ -23,11 +24,12 @@ namespace volrend {
 // Read-only N3Tree loader
 struct N3Tree {
     N3Tree();
-    explicit N3Tree(const std::string& path);
+    explicit N3Tree(const std::string& path,
+                    PageMode pages = PageMode::DEFAULT);
     ~N3Tree();
 
-    // Open npz
-    void open(const std::string& path);
+    // Open npz, with the child and data arrays on pages of the given mode
+    void open(const std::string& path, PageMode pages = PageMode::DEFAULT);
     // Open memory data stream (for web mostly)
     void open_mem(const char* data, uint64_t size);
 
@@ -58,6 +60,15 @@ struct N3Tree {
     // Clear the CPU memory.
     void clear_cpu_memory();
 
+    // Move the child and data arrays onto pages of the given mode; huge
+    // pages cut TLB misses of random descents through large trees
+    void set_page_mode(PageMode pages);
+
+    // Build the neighbour ropes (below) if the npz did not have them;
+    // about 6 int32 per cell
+    void build_ropes();
+    bool has_ropes() const;
+
     // Index pack/unpack
     int pack_index(int nd, int i, int j, int k);
     std::tuple<int, int, int, int> unpack_index(int packed);
@@ -75,20 +86,35 @@ struct N3Tree {
         float* offset = nullptr;
         float* scale = nullptr;
         float* extra = nullptr;
+        int32_t* ropes = nullptr;
+        int32_t* node_pos = nullptr;
     } device;
 #endif
     // Main data holder
-    cnpy::NpyArray data_;
+    internal::HostArray data_;
 
     // Child link data holder
-    cnpy::NpyArray child_;
+    internal::HostArray child_;
 
     // Optional extra data, only used for SG/ASG
     cnpy::NpyArray extra_;
 
+    // Optional neighbour ropes, shape (capacity, N, N, N, 6): for each cell
+    // and face (-x, +x, -y, +y, -z, +z), the index of the adjacent cell of
+    // the same size, or the leaf covering it where the tree is coarser
+    // there; -1 at the tree boundary. Rays step between leaves through
+    // these instead of descending from the root. Read from the npz key
+    // "ropes" if present (written by a converter), else see build_ropes
+    internal::HostArray ropes_;
+
+    // With ropes: for each node, the integer coords of its first cell and
+    // its cells per side (x, y, z, res), to locate rope targets
+    std::vector<int32_t> node_pos_;
+
    private:
-    // Load data from npz (destructive since it moves some data)
-    void load_npz(cnpy::npz_t& npz);
+    // Load data from npz (destructive since it frees the arrays taken),
+    // copying the child, data and ropes arrays onto pages of the given mode
+    void load_npz(cnpy::npz_t& npz, PageMode pages = PageMode::DEFAULT);
 
     // Paths
     std::string npz_path_, data_path_, poses_bounds_path_;
@@ -96,11 +122,15 @@ struct N3Tree {
 
     int N2_, N3_;
 
+    // Fill node_pos_ for ropes_
+    void index_nodes();
+
     mutable float last_sigma_thresh_;
 
 #ifdef VOLREND_CUDA
     bool cuda_loaded_;
     void load_cuda();
+    void load_cuda_ropes();
     void free_cuda();
 #endif
 };
@@ -5,6 +5,14 @@
 // Max global basis
 #define VOLREND_GLOBAL_BASIS_MAX 25
 
+// Half an 8-bit output level; in adaptive mode, samples whose total
+// weight stays below this cannot change the output color
+#define VOLREND_ADAPTIVE_COLOR_EPS (0.5f / 255.f)
+
+// Factor by which adaptive mode at most loosens stop_thresh, where a pixel's
+// footprint spans several leaf cells
+#define VOLREND_ADAPTIVE_STOP_SCALE_MAX 4.f
+
 namespace volrend {
 
 // Rendering options
@@ -22,6 +30,61 @@ struct RenderOptions {
     // Background brightness
     float background_brightness = 1.f;
 
+    // * ADAPTIVE MARCHING (CUDA and CPU renderers)
+    // Adapt marching to the pixel footprint and accumulated opacity:
+    // cells with sigma <= sigma_thresh smaller than adaptive_footprint pixel
+    // footprints at the current distance are crossed in steps of that
+    // footprint (0 = exact cell exits), color evaluation is skipped for
+    // samples as long as their total weight cannot change the 8-bit output,
+    // and where the footprint spans several leaf cells, rays stop once their
+    // transmittance drops below stop_thresh times that many cells (at most
+    // VOLREND_ADAPTIVE_STOP_SCALE_MAX). Off by default: it only pays off
+    // where pixels are coarser than the leaves (distant or low resolution
+    // views), see scripts/adaptive_report.md
+    bool adaptive = false;
+    float adaptive_footprint = 1.f;
+
+    // * DYNAMIC RESOLUTION (interactive VolumeRenderer)
+    // While the camera is dragged, render at dynamic_res_scale of the
+    // window resolution and upsample (edge-aware, guided by depth), then
+    // refine back to full resolution over the next idle frames
+    bool dynamic_res = false;
+    float dynamic_res_scale = 0.5f;
+
+    // * PROGRESSIVE (interactive VolumeRenderer, shader backend)
+    // While the view is unchanged, trace progressive_passes of the 64
+    // interleaved pixel passes (internal/progressive.hpp) per frame and show
+    // the partial image hole-filled, for windows too large to trace at an
+    // interactive rate. Takes precedence over dynamic resolution
+    bool progressive = false;
+    int progressive_passes = 4;
+
+    // * REPROJECTION (interactive VolumeRenderer, shader backend)
+    // While the camera moves, warp the previous frame into the new view by
+    // its depth and retrace only disoccluded pixels, depth edges, the
+    // background and pixels whose accumulated resampling shift exceeds
+    // reproject_max_error pixels or whose view direction turned more than
+    // reproject_max_angle degrees since traced, as internal::Reprojector
+    // does for the CPU renderer. Frames of a still camera are traced in
+    // full. Replaces dynamic resolution; ignored for NDC trees
+    bool reproject = false;
+    float reproject_max_error = 1.f;
+    float reproject_max_angle = 2.f;
+
+    // * REGION OF INTEREST (shader VolumeRenderer and CPU renderer)
+    // Foveated rendering: full quality only within roi_radius pixels of
+    // roi_center (pixels from the top-left corner). Outside it, rays use
+    // step_size * roi_step_scale and only one pixel in roi_stride x
+    // roi_stride (a power of two up to 8) is traced, the others
+    // interpolated from them. Replaces dynamic resolution in the
+    // VolumeRenderer; the CPU renderer thins out pixels in render() and
+    // render_batch() only
+    bool roi = false;
+    float roi_center[2] = {0.f, 0.f};
+    float roi_radius = 128.f;
+    int roi_stride = 4;
+    float roi_step_scale = 2.f;
+
     // * VISUALIZATION
     // Rendering bounding box (relative to outer tree bounding box [0, 1])
     // [minx, miny, minz, maxx, maxy, maxz]
@@ -5,14 +5,18 @@
 
 #include <cstdlib>
 #include <cstdio>
+#include <cmath>
+#include <limits>
 #include <string>
 #include <fstream>
 
 #include "volrend/renderer.hpp"
 #include "volrend/n3tree.hpp"
+#include "volrend/cpu_renderer.hpp"
 
 #include "volrend/internal/opts.hpp"
 #include "volrend/internal/imwrite.hpp"
+#include "volrend/internal/mesh_pick.hpp"
 
 #include "imgui_impl_opengl3.h"
 #include "imgui_impl_glfw.h"
@@ -60,6 +64,78 @@ void glfw_update_title(GLFWwindow* window) {
 int gizmo_mesh_op = ImGuizmo::TRANSLATE;
 int gizmo_mesh_space = ImGuizmo::LOCAL;
 
+// What the region of interest follows
+enum { ROI_FOCUS_CURSOR, ROI_FOCUS_PROBE };
+int roi_focus = ROI_FOCUS_CURSOR;
+
+// Center the region of interest on the cursor or on the probe's projection
+void update_roi(GLFWwindow* window, VolumeRenderer& rend) {
+    const Camera& cam = rend.camera;
+    float* center = rend.options.roi_center;
+    if (roi_focus == ROI_FOCUS_PROBE) {
+        const float* probe = rend.options.probe;
+        const glm::vec4 p =
+            cam.w2c * glm::vec4(probe[0], probe[1], probe[2], 1.f);
+        // Keep the last center while the probe is behind the camera
+        if (p.z >= 0.f) return;
+        center[0] = 0.5f * cam.width - cam.fx * p.x / p.z;
+        center[1] = 0.5f * cam.height + cam.fy * p.y / p.z;
+    } else {
+        // Window to framebuffer coordinates (differ on high DPI screens)
+        double x, y;
+        int win_width, win_height;
+        glfwGetCursorPos(window, &x, &y);
+        glfwGetWindowSize(window, &win_width, &win_height);
+        center[0] = (float)(x * cam.width / std::max(win_width, 1));
+        center[1] = (float)(y * cam.height / std::max(win_height, 1));
+    }
+}
+
+// Tree picked by Ctrl + click, and the picking structures of the meshes
+const N3Tree* pick_tree = nullptr;
+internal::MeshPicker mesh_picker;
+
+// Place the probe (if enabled) or else the rotation origin on the nearest
+// mesh or volume surface under the cursor
+void pick_surface(GLFWwindow* window, VolumeRenderer& rend, double x,
+                  double y) {
+    Camera& cam = rend.camera;
+    int win_width, win_height;
+    glfwGetWindowSize(window, &win_width, &win_height);
+    const float px = (float)(x * cam.width / std::max(win_width, 1)),
+                py = (float)(y * cam.height / std::max(win_height, 1));
+    const glm::vec3 origin = cam.transform[3];
+    const glm::vec3 dir =
+        glm::normalize(cam.transform[0] * ((px - 0.5f * cam.width) / cam.fx) -
+                       cam.transform[1] * ((py - 0.5f * cam.height) / cam.fy) -
+                       cam.transform[2]);
+
+    float t = std::numeric_limits<float>::infinity(), mesh_t;
+    int mesh_id;
+    const char* what = "volume";
+    if (mesh_picker.pick(rend.meshes, origin, dir, mesh_t, mesh_id)) {
+        t = mesh_t;
+        what = rend.meshes[mesh_id].name.c_str();
+    }
+    if (pick_tree != nullptr) {
+        const float tree_t =
+            tree_first_hit(*pick_tree, rend.options, origin, dir);
+        if (tree_t < t) {
+            t = tree_t;
+            what = "volume";
+        }
+    }
+    if (!std::isfinite(t)) return;
+
+    const glm::vec3 hit = origin + t * dir;
+    printf("Picked %s at %f %f %f\n", what, hit.x, hit.y, hit.z);
+    if (rend.options.enable_probe) {
+        for (int i = 0; i < 3; ++i) rend.options.probe[i] = hit[i];
+    } else {
+        cam.origin = hit;
+    }
+}
+
 void draw_imgui(VolumeRenderer& rend, N3Tree& tree) {
     auto& cam = rend.camera;
     ImGui_ImplOpenGL3_NewFrame();
@@ -208,6 +284,34 @@ void draw_imgui(VolumeRenderer& rend, N3Tree& tree) {
                            0.4f);
         ImGui::SliderFloat("bg_brightness", &rend.options.background_brightness,
                            0.f, 1.0f);
+        ImGui::Checkbox("Dynamic resolution", &rend.options.dynamic_res);
+        if (rend.options.dynamic_res) {
+            ImGui::SliderFloat("drag scale", &rend.options.dynamic_res_scale,
+                               0.1f, 1.0f);
+        }
+#ifndef VOLREND_CUDA
+        ImGui::Checkbox("Progressive", &rend.options.progressive);
+        if (rend.options.progressive) {
+            ImGui::SliderInt("passes/frame", &rend.options.progressive_passes,
+                             1, 64);
+        }
+        ImGui::Checkbox("Reprojection", &rend.options.reproject);
+        if (rend.options.reproject) {
+            ImGui::SliderFloat("max error px",
+                               &rend.options.reproject_max_error, 0.f, 4.f);
+            ImGui::SliderFloat("max angle deg",
+                               &rend.options.reproject_max_angle, 0.f, 10.f);
+        }
+        ImGui::Checkbox("Region of interest", &rend.options.roi);
+        if (rend.options.roi) {
+            ImGui::Combo("roi focus", &roi_focus, "cursor\0probe\0");
+            ImGui::SliderFloat("roi radius", &rend.options.roi_radius, 8.f,
+                               1024.f);
+            ImGui::SliderInt("roi stride", &rend.options.roi_stride, 1, 8);
+            ImGui::SliderFloat("roi step scale",
+                               &rend.options.roi_step_scale, 1.f, 8.f);
+        }
+#endif
 
     }  // End render node
     ImGui::SetNextTreeNodeOpen(true, ImGuiCond_Once);
@@ -581,7 +685,10 @@ void glfw_mouse_button_callback(GLFWwindow* window, int button, int action,
     auto& cam = rend.camera;
     double x, y;
     glfwGetCursorPos(window, &x, &y);
-    if (action == GLFW_PRESS) {
+    if (action == GLFW_PRESS && button == GLFW_MOUSE_BUTTON_LEFT &&
+        (mods & GLFW_MOD_CONTROL)) {
+        pick_surface(window, rend, x, y);
+    } else if (action == GLFW_PRESS) {
         const bool SHIFT = mods & GLFW_MOD_SHIFT;
         cam.begin_drag(x, y, SHIFT || button == GLFW_MOUSE_BUTTON_MIDDLE,
                        button == GLFW_MOUSE_BUTTON_RIGHT ||
@@ -768,6 +875,7 @@ int main(int argc, char* argv[]) {
 
         // Set user pointer and callbacks
         glfwSetWindowUserPointer(window, &rend);
+        pick_tree = &tree;
         glfwSetKeyCallback(window, glfw_key_callback);
         glfwSetMouseButtonCallback(window, glfw_mouse_button_callback);
         glfwSetCursorPosCallback(window, glfw_cursor_pos_callback);
@@ -780,6 +888,7 @@ int main(int argc, char* argv[]) {
             glPointSize(4.f);
             glfw_update_title(window);
 
+            if (rend.options.roi) update_roi(window, rend);
             rend.render();
 
             if (!nogui) draw_imgui(rend, tree);
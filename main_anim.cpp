@@ -109,6 +109,19 @@ void save_screenshot(int width, int height, const std::string& path) {
     }
 }
 
+// Append the camera pose (c2w 4x4, as read by volrend_headless) to path,
+// so written animations can be re-rendered offline, e.g. with the CPU
+// renderer's temporal reprojection (volrend_headless --cpu --reproject)
+void append_pose(const glm::mat4x3& c2w, const std::string& path) {
+    std::ofstream ofs(path, std::ios::app);
+    ofs.precision(9);
+    for (int i = 0; i < 3; ++i) {
+        ofs << c2w[0][i] << " " << c2w[1][i] << " " << c2w[2][i] << " "
+            << c2w[3][i] << "\n";
+    }
+    ofs << "0 0 0 1\n";
+}
+
 struct MeshState {
     MeshState() {}
     explicit MeshState(const Mesh& mesh)
@@ -157,7 +170,12 @@ struct AnimKF {
         rend.camera.v_back = glm::normalize(v_back);
         rend.camera.fx = fx;
         rend.camera.fy = fy;
+        // Reprojection is a setting of the renderer, not of keyframes
+        const RenderOptions prev = rend.options;
         rend.options = opt;
+        rend.options.reproject = prev.reproject;
+        rend.options.reproject_max_error = prev.reproject_max_error;
+        rend.options.reproject_max_angle = prev.reproject_max_angle;
         for (volrend::Mesh& mesh : rend.meshes) {
             if (!mesh_state.count(mesh.name)) {
                 mesh.visible = false;
@@ -207,6 +225,7 @@ struct AnimState {
         anim_once(keyframes[0], keyframes[1], previewing, -1.f, 0);
         if (!previewing) {
             std::filesystem::create_directories(output_folder);
+            std::ofstream(output_folder + "poses.txt", std::ios::trunc);
         }
         f_idx = 0;
     }
@@ -679,6 +698,17 @@ void draw_imgui(VolumeRenderer& rend, N3Tree& tree) {
                                0.4f);
             ImGui::SliderFloat("bg_brightness",
                                &rend.options.background_brightness, 0.f, 1.0f);
+#ifndef VOLREND_CUDA
+            ImGui::Checkbox("Reprojection", &rend.options.reproject);
+            if (rend.options.reproject) {
+                ImGui::SliderFloat("max error px",
+                                   &rend.options.reproject_max_error, 0.f,
+                                   4.f);
+                ImGui::SliderFloat("max angle deg",
+                                   &rend.options.reproject_max_angle, 0.f,
+                                   10.f);
+            }
+#endif
 
         }  // End render node
         ImGui::SetNextTreeNodeOpen(true, ImGuiCond_Once);
@@ -1257,6 +1287,8 @@ int main(int argc, char* argv[]) {
                         << std::setw(6) << anim.f_idx << ".png";
                     save_screenshot(rend.camera.width, rend.camera.height,
                                     sst.str());
+                    append_pose(rend.camera.transform,
+                                anim.output_folder + "poses.txt");
                 }
                 anim.update(rend);
             }
@@ -0,0 +1,752 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "volrend/common.hpp"
+#include "volrend/n3tree.hpp"
+#include "volrend/cpu_renderer.hpp"
+
+#include "volrend/internal/metrics.hpp"
+#include "volrend/internal/numa.hpp"
+#include "volrend/internal/opts.hpp"
+#include "volrend/internal/reprojection.hpp"
+
+#include "glm/geometric.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace volrend {
+namespace {
+
+// Orbit of c2w poses (NeRF convention, z up) around the tree center,
+// at radius times the tree's largest world extent, spanning arc radians
+std::vector<glm::mat4x3> orbit_poses(const N3Tree& tree, int n_poses,
+                                     float radius, float elevation = 0.4f,
+                                     float arc = 2.f * M_PI) {
+    glm::vec3 center;
+    float extent = 0.f;
+    for (int i = 0; i < 3; ++i) {
+        center[i] = (0.5f - tree.offset[i]) / tree.scale[i];
+        extent = std::max(extent, 1.f / tree.scale[i]);
+    }
+    std::vector<glm::mat4x3> poses;
+    for (int i = 0; i < n_poses; ++i) {
+        const float theta = arc * i / n_poses;
+        const glm::vec3 back(std::cos(theta) * std::cos(elevation),
+                             std::sin(theta) * std::cos(elevation),
+                             std::sin(elevation));
+        const glm::vec3 right =
+            glm::normalize(glm::cross(glm::vec3(0.f, 0.f, 1.f), back));
+        glm::mat4x3 c2w;
+        c2w[0] = right;
+        c2w[1] = glm::cross(back, right);
+        c2w[2] = back;
+        c2w[3] = center + radius * extent * back;
+        poses.push_back(c2w);
+    }
+    return poses;
+}
+
+// Mean ms per frame rendering all poses reps times (after a warmup frame)
+float time_frames(CPURenderer& renderer, const N3Tree& tree, Camera& camera,
+                  const std::vector<glm::mat4x3>& poses,
+                  const RenderOptions& options, int reps,
+                  std::vector<uint8_t>& buf) {
+    camera.transform = poses[0];
+    camera._update(false);
+    renderer.render(tree, camera, options, buf.data());
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < reps; ++r) {
+        for (const glm::mat4x3& pose : poses) {
+            camera.transform = pose;
+            camera._update(false);
+            renderer.render(tree, camera, options, buf.data());
+        }
+    }
+    return std::chrono::duration<float, std::milli>(
+               std::chrono::steady_clock::now() - start)
+               .count() /
+           (reps * poses.size());
+}
+
+// Tile scheduling: static ranges vs atomic counter vs work stealing,
+// over thread counts
+int bench_schedule(cxxopts::ParseResult& args, const N3Tree& tree,
+                   Camera& camera, const std::vector<glm::mat4x3>& poses,
+                   const RenderOptions& options, std::ofstream& csv) {
+    const char* names[] = {"static", "dynamic", "stealing"};
+    const int reps = args["reps"].as<int>();
+    std::vector<uint8_t> buf((size_t)4 * camera.width * camera.height);
+    if (csv.is_open()) csv << "threads,schedule,ms_per_frame\n";
+    printf("| threads | static ms | dynamic ms | stealing ms | "
+           "dynamic speedup | stealing speedup |\n");
+    printf("|---|---|---|---|---|---|\n");
+    for (int n_threads : args["threads"].as<std::vector<int>>()) {
+        CPURenderer renderer(n_threads);
+        float ms[3];
+        for (int s = 0; s < 3; ++s) {
+            renderer.set_schedule((TileSchedule)s);
+            ms[s] = time_frames(renderer, tree, camera, poses, options, reps,
+                                buf);
+            if (csv.is_open()) {
+                csv << n_threads << "," << names[s] << "," << ms[s] << "\n";
+            }
+        }
+        printf("| %d | %.3f | %.3f | %.3f | %.2fx | %.2fx |\n", n_threads,
+               ms[0], ms[1], ms[2], ms[0] / ms[1], ms[0] / ms[2]);
+    }
+    return 0;
+}
+
+// Beam traversal vs per-sample root descents, over thread counts, checking
+// that the images match
+int bench_beam(cxxopts::ParseResult& args, const N3Tree& tree, Camera& camera,
+               const std::vector<glm::mat4x3>& poses,
+               const RenderOptions& options, std::ofstream& csv) {
+    const int reps = args["reps"].as<int>();
+    std::vector<uint8_t> buf((size_t)4 * camera.width * camera.height),
+        ref(buf.size());
+    int max_diff = 0;
+    {
+        CPURenderer renderer(1);
+        for (const glm::mat4x3& pose : poses) {
+            camera.transform = pose;
+            camera._update(false);
+            renderer.set_beam_traversal(false);
+            renderer.render(tree, camera, options, ref.data());
+            renderer.set_beam_traversal(true);
+            renderer.render(tree, camera, options, buf.data());
+            for (size_t i = 0; i < buf.size(); ++i) {
+                max_diff = std::max(max_diff, std::abs(buf[i] - ref[i]));
+            }
+        }
+    }
+    printf("Max pixel difference over poses: %d\n\n", max_diff);
+
+    if (csv.is_open()) csv << "threads,beam,ms_per_frame\n";
+    printf("| threads | descent ms | beam ms | speedup |\n");
+    printf("|---|---|---|---|\n");
+    for (int n_threads : args["threads"].as<std::vector<int>>()) {
+        CPURenderer renderer(n_threads);
+        float ms[2];
+        for (int b = 0; b < 2; ++b) {
+            renderer.set_beam_traversal(b == 1);
+            ms[b] = time_frames(renderer, tree, camera, poses, options, reps,
+                                buf);
+            if (csv.is_open()) {
+                csv << n_threads << "," << b << "," << ms[b] << "\n";
+            }
+        }
+        printf("| %d | %.3f | %.3f | %.2fx |\n", n_threads, ms[0], ms[1],
+               ms[0] / ms[1]);
+    }
+    return max_diff == 0 ? 0 : 1;
+}
+
+// Neighbour ropes vs root descents (beam traversal off for both), over
+// thread counts, checking that the images match
+int bench_ropes(cxxopts::ParseResult& args, const N3Tree& tree,
+                Camera& camera, const std::vector<glm::mat4x3>& poses,
+                const RenderOptions& options, std::ofstream& csv) {
+    N3Tree rope_tree(args["file"].as<std::string>());
+    auto start = std::chrono::steady_clock::now();
+    rope_tree.build_ropes();
+    printf("Built ropes in %.1f ms, %.1f MB\n",
+           std::chrono::duration<float, std::milli>(
+               std::chrono::steady_clock::now() - start)
+               .count(),
+           rope_tree.ropes_.num_bytes() / (1024.f * 1024.f));
+
+    const int reps = args["reps"].as<int>();
+    std::vector<uint8_t> buf((size_t)4 * camera.width * camera.height),
+        ref(buf.size());
+    int max_diff = 0;
+    {
+        CPURenderer renderer(1);
+        renderer.set_beam_traversal(false);
+        for (const glm::mat4x3& pose : poses) {
+            camera.transform = pose;
+            camera._update(false);
+            renderer.render(tree, camera, options, ref.data());
+            renderer.render(rope_tree, camera, options, buf.data());
+            for (size_t i = 0; i < buf.size(); ++i) {
+                max_diff = std::max(max_diff, std::abs(buf[i] - ref[i]));
+            }
+        }
+    }
+    printf("Max pixel difference over poses: %d\n\n", max_diff);
+
+    if (csv.is_open()) csv << "threads,ropes,ms_per_frame\n";
+    printf("| threads | descent ms | ropes ms | speedup |\n");
+    printf("|---|---|---|---|\n");
+    for (int n_threads : args["threads"].as<std::vector<int>>()) {
+        CPURenderer renderer(n_threads);
+        renderer.set_beam_traversal(false);
+        float ms[2];
+        for (int r = 0; r < 2; ++r) {
+            ms[r] = time_frames(renderer, r ? rope_tree : tree, camera, poses,
+                                options, reps, buf);
+            if (csv.is_open()) {
+                csv << n_threads << "," << r << "," << ms[r] << "\n";
+            }
+        }
+        printf("| %d | %.3f | %.3f | %.2fx |\n", n_threads, ms[0], ms[1],
+               ms[0] / ms[1]);
+    }
+    return max_diff == 0 ? 0 : 1;
+}
+
+// Depth of the deepest leaf (root cells at depth 1)
+int tree_depth(const N3Tree& tree) {
+    const int32_t* child = tree.child_.data<int32_t>();
+    const int N3 = tree.N * tree.N * tree.N;
+    int max_depth = 0;
+    std::vector<std::pair<int64_t, int>> stack{{0, 1}};
+    while (!stack.empty()) {
+        const auto [node, depth] = stack.back();
+        stack.pop_back();
+        max_depth = std::max(max_depth, depth);
+        for (int i = 0; i < N3; ++i) {
+            const int32_t skip = child[node * N3 + i];
+            if (skip) stack.emplace_back(node + skip, depth + 1);
+        }
+    }
+    return max_depth;
+}
+
+// Short-stack restarts vs root restarts (beam traversal off for both), over
+// thread counts, checking that the images match. Run on trees of several
+// depths, e.g. from scripts/gen_synthetic_tree.py --depth 8..12
+int bench_stack(cxxopts::ParseResult& args, const N3Tree& tree,
+                Camera& camera, const std::vector<glm::mat4x3>& poses,
+                const RenderOptions& options, std::ofstream& csv) {
+    const int depth = tree_depth(tree);
+    const int reps = args["reps"].as<int>();
+    std::vector<uint8_t> buf((size_t)4 * camera.width * camera.height),
+        ref(buf.size());
+    int max_diff = 0;
+    {
+        CPURenderer renderer(1);
+        renderer.set_beam_traversal(false);
+        for (const glm::mat4x3& pose : poses) {
+            camera.transform = pose;
+            camera._update(false);
+            renderer.set_short_stack(false);
+            renderer.render(tree, camera, options, ref.data());
+            renderer.set_short_stack(true);
+            renderer.render(tree, camera, options, buf.data());
+            for (size_t i = 0; i < buf.size(); ++i) {
+                max_diff = std::max(max_diff, std::abs(buf[i] - ref[i]));
+            }
+        }
+    }
+    printf("Tree depth %d; max pixel difference over poses: %d\n\n", depth,
+           max_diff);
+
+    if (csv.is_open()) csv << "depth,threads,short_stack,ms_per_frame\n";
+    printf("| depth | threads | root restart ms | short stack ms | speedup |\n");
+    printf("|---|---|---|---|---|\n");
+    for (int n_threads : args["threads"].as<std::vector<int>>()) {
+        CPURenderer renderer(n_threads);
+        renderer.set_beam_traversal(false);
+        float ms[2];
+        for (int r = 0; r < 2; ++r) {
+            renderer.set_short_stack(r == 1);
+            ms[r] = time_frames(renderer, tree, camera, poses, options, reps,
+                                buf);
+            if (csv.is_open()) {
+                csv << depth << "," << n_threads << "," << r << "," << ms[r]
+                    << "\n";
+            }
+        }
+        printf("| %d | %d | %.3f | %.3f | %.2fx |\n", depth, n_threads, ms[0],
+               ms[1], ms[0] / ms[1]);
+    }
+    return max_diff == 0 ? 0 : 1;
+}
+
+// Temporal reprojection on orbit paths of several angular speeds: pixels
+// retraced, tree samples and time vs rendering every frame in full, and
+// PSNR against the full frames, for each reprojection error bound
+int bench_reproject(cxxopts::ParseResult& args, const N3Tree& tree,
+                    Camera& camera, const RenderOptions& options,
+                    std::ofstream& csv) {
+    const int n_frames = std::max(args["frames"].as<int>(), 2);
+    const size_t n_pixels = (size_t)camera.width * camera.height;
+    std::vector<uint8_t> ref(4 * n_pixels), buf(4 * n_pixels), retrace;
+    std::vector<float> depth(n_pixels);
+    CPURenderer renderer(args["threads"].as<std::vector<int>>()[0]);
+
+    if (csv.is_open()) {
+        csv << "deg_per_frame,max_error,retraced,samples,ms_full,"
+               "ms_reproject,psnr_min,psnr_mean\n";
+    }
+    printf("| deg/frame | max error px | retraced | samples | full ms | "
+           "reproject ms | speedup | PSNR min | PSNR mean |\n");
+    printf("|---|---|---|---|---|---|---|---|---|\n");
+    for (float step : args["deg_per_frame"].as<std::vector<float>>()) {
+        const std::vector<glm::mat4x3> path =
+            orbit_poses(tree, n_frames, args["radius"].as<float>(), 0.4f,
+                        step * n_frames * (float)M_PI / 180.f);
+        for (float max_error : args["max_error"].as<std::vector<float>>()) {
+            internal::ReprojectOptions reproject_options;
+            reproject_options.max_error = max_error;
+            reproject_options.max_angle =
+                args["max_angle"].as<float>() * (float)M_PI / 180.f;
+            internal::Reprojector reprojector(reproject_options);
+            size_t n_retraced = 0;
+            uint64_t samples_full = 0, samples = 0;
+            double ms_full = 0.0, ms = 0.0, psnr_sum = 0.0,
+                   psnr_min = std::numeric_limits<double>::infinity();
+            for (int i = 0; i < n_frames; ++i) {
+                camera.transform = path[i];
+                camera._update(false);
+                auto start = std::chrono::steady_clock::now();
+                const uint64_t frame_samples_full =
+                    renderer.render(tree, camera, options, ref.data());
+                auto mid = std::chrono::steady_clock::now();
+                const size_t frame_retraced = reprojector.warp(
+                    camera, buf.data(), depth.data(), retrace);
+                const uint64_t frame_samples = renderer.render_pixels(
+                    tree, camera, options, buf.data(), retrace.data(),
+                    depth.data());
+                reprojector.update(camera, buf.data(), depth.data());
+                auto end = std::chrono::steady_clock::now();
+                // The first frame is rendered in full either way
+                if (i == 0) continue;
+                n_retraced += frame_retraced;
+                samples_full += frame_samples_full;
+                samples += frame_samples;
+                ms_full +=
+                    std::chrono::duration<double, std::milli>(mid - start)
+                        .count();
+                ms += std::chrono::duration<double, std::milli>(end - mid)
+                          .count();
+                const double psnr = std::min(
+                    internal::psnr(buf.data(), ref.data(), camera.width,
+                                   camera.height),
+                    100.0);
+                psnr_sum += psnr;
+                psnr_min = std::min(psnr_min, psnr);
+            }
+            const float retraced =
+                (float)n_retraced / (n_pixels * (n_frames - 1));
+            const float sample_frac = (float)samples / samples_full;
+            ms_full /= n_frames - 1;
+            ms /= n_frames - 1;
+            const double psnr_mean = psnr_sum / (n_frames - 1);
+            printf("| %g | %g | %.1f%% | %.1f%% | %.3f | %.3f | %.2fx | %.2f "
+                   "| %.2f |\n",
+                   step, max_error, 100.f * retraced, 100.f * sample_frac,
+                   ms_full, ms, ms_full / ms, psnr_min, psnr_mean);
+            if (csv.is_open()) {
+                csv << step << "," << max_error << "," << retraced << ","
+                    << sample_frac << "," << ms_full << "," << ms << ","
+                    << psnr_min << "," << psnr_mean << "\n";
+            }
+        }
+    }
+    return 0;
+}
+
+// Run fn(i) on one thread pinned to each CPU of node, returning the
+// seconds taken by the slowest
+double run_on_node(int node, const std::function<void(int)>& fn) {
+    const std::vector<int>& cpus =
+        internal::NumaTopology::get().node_cpus[node];
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        threads.emplace_back([&, i] {
+            internal::pin_thread(cpus[i]);
+            fn((int)i);
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                         start)
+        .count();
+}
+
+// NUMA: throughput of all CPUs of each node reading memory on each node,
+// then rendering with each tree placement policy (threads pinned)
+int bench_numa(cxxopts::ParseResult& args, const N3Tree& tree,
+               Camera& camera, const std::vector<glm::mat4x3>& poses,
+               const RenderOptions& options, std::ofstream& csv) {
+    const internal::NumaTopology& topo = internal::NumaTopology::get();
+    const int n_nodes = topo.n_nodes();
+    printf("%d NUMA node(s)\n", n_nodes);
+    for (int i = 0; i < n_nodes; ++i) {
+        printf("  node %d: %zu CPUs, %.1f GB free\n", topo.node_ids[i],
+               topo.node_cpus[i].size(), topo.free_bytes(i) / 1e9);
+    }
+
+    // Random 8-byte reads are latency bound, like tree descents; the
+    // sequential pass measures bandwidth
+    const size_t bytes = (size_t)args["numa_mb"].as<int>() << 20;
+    const size_t n_words = bytes / sizeof(uint64_t);
+    const size_t n_random = 1 << 22;
+    if (csv.is_open()) {
+        csv << "cpu_node,mem_node,random_maccess_per_s,sequential_gb_per_s\n";
+    }
+    printf("\n| CPU node | memory node | placed on | random Maccess/s | "
+           "sequential GB/s |\n");
+    printf("|---|---|---|---|---|\n");
+    for (int mem = 0; mem < n_nodes; ++mem) {
+        internal::NumaBuffer buf(bytes, mem);
+        uint64_t* words = (uint64_t*)buf.data();
+        for (size_t i = 0; i < n_words; ++i) {
+            words[i] = i * 0x9E3779B97F4A7C15ULL;
+        }
+        const int placed = internal::numa_page_node(words);
+        for (int node = 0; node < n_nodes; ++node) {
+            const size_t n_cpus = topo.node_cpus[node].size();
+            std::vector<uint64_t> sums(n_cpus);
+            const double random_s = run_on_node(node, [&](int i) {
+                uint64_t rng = 0x2545F4914F6CDD1DULL * (i + 1), sum = 0;
+                for (size_t k = 0; k < n_random; ++k) {
+                    rng ^= rng << 13;
+                    rng ^= rng >> 7;
+                    rng ^= rng << 17;
+                    sum += words[rng % n_words];
+                }
+                sums[i] = sum;
+            });
+            const double seq_s = run_on_node(node, [&](int i) {
+                const size_t begin = n_words * i / n_cpus,
+                             end = n_words * (i + 1) / n_cpus;
+                uint64_t sum = 0;
+                for (size_t k = begin; k < end; ++k) sum += words[k];
+                sums[i] += sum;
+            });
+            const double maccess = n_cpus * n_random / random_s / 1e6,
+                         gbps = bytes / seq_s / 1e9;
+            printf("| %d | %d | %d | %.1f | %.2f |\n", topo.node_ids[node],
+                   topo.node_ids[mem],
+                   placed < 0 ? -1 : topo.node_ids[placed], maccess, gbps);
+            if (csv.is_open()) {
+                csv << topo.node_ids[node] << "," << topo.node_ids[mem] << ","
+                    << maccess << "," << gbps << "\n";
+            }
+            // Keep the reads from being optimized out
+            volatile uint64_t sink = 0;
+            for (uint64_t sum : sums) sink = sink + sum;
+        }
+    }
+
+    // Placement policies in this order, as interleaving migrates the
+    // tree's pages for good
+    const char* names[] = {"none", "interleave", "replicate"};
+    const std::vector<int> thread_counts =
+        args["threads"].as<std::vector<int>>();
+    const int reps = args["reps"].as<int>();
+    std::vector<uint8_t> buf((size_t)4 * camera.width * camera.height);
+    std::vector<std::vector<float>> ms(3);
+    for (int p = 0; p < 3; ++p) {
+        for (int n_threads : thread_counts) {
+            CPURenderer renderer(n_threads);
+            renderer.set_numa((NumaPolicy)p, true);
+            ms[p].push_back(time_frames(renderer, tree, camera, poses,
+                                        options, reps, buf));
+        }
+    }
+    printf("\n| threads | none ms | interleave ms | replicate ms | "
+           "interleave speedup | replicate speedup |\n");
+    printf("|---|---|---|---|---|---|\n");
+    if (csv.is_open()) csv << "\nthreads,policy,ms_per_frame\n";
+    for (size_t t = 0; t < thread_counts.size(); ++t) {
+        printf("| %d | %.3f | %.3f | %.3f | %.2fx | %.2fx |\n",
+               thread_counts[t], ms[0][t], ms[1][t], ms[2][t],
+               ms[0][t] / ms[1][t], ms[0][t] / ms[2][t]);
+        if (csv.is_open()) {
+            for (int p = 0; p < 3; ++p) {
+                csv << thread_counts[t] << "," << names[p] << "," << ms[p][t]
+                    << "\n";
+            }
+        }
+    }
+    return 0;
+}
+
+// Data TLB load misses of the calling thread, via perf_event_open
+class DtlbCounter {
+   public:
+    DtlbCounter() {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd_ = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+    ~DtlbCounter() {
+#ifdef __linux__
+        if (fd_ >= 0) close(fd_);
+#endif
+    }
+
+    // False if counters are unavailable (e.g. perf_event_paranoid, VMs)
+    bool ok() const { return fd_ >= 0; }
+
+    void start() {
+#ifdef __linux__
+        if (fd_ < 0) return;
+        ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    uint64_t stop() {
+        uint64_t count = 0;
+#ifdef __linux__
+        if (fd_ < 0) return 0;
+        ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd_, &count, sizeof(count)) != sizeof(count)) count = 0;
+#endif
+        return count;
+    }
+
+   private:
+    int fd_ = -1;
+};
+
+// MB of this process backed by huge pages (transparent or hugetlbfs), or
+// -1 if unknown
+float huge_page_mb() {
+    std::ifstream ifs("/proc/self/smaps_rollup");
+    if (!ifs) return -1.f;
+    std::string line;
+    float kb = 0.f;
+    while (std::getline(ifs, line)) {
+        if (line.rfind("AnonHugePages:", 0) == 0 ||
+            line.rfind("Private_Hugetlb:", 0) == 0 ||
+            line.rfind("Shared_Hugetlb:", 0) == 0) {
+            kb += std::atof(line.c_str() + line.find(':') + 1);
+        }
+    }
+    return kb / 1024.f;
+}
+
+// Descend from the root to the leaf containing each of n_queries random
+// points, as volume rendering does for every sample; returns the sum of the
+// leaves' raw sigma so the reads are kept
+uint64_t random_descents(const N3Tree& tree, size_t n_queries, uint64_t seed) {
+    const int32_t* child = tree.child_.data<int32_t>();
+    const uint16_t* data = tree.data_.data<uint16_t>();
+    const int N = tree.N, N3 = N * N * N;
+    uint64_t rng = seed, sum = 0;
+    for (size_t q = 0; q < n_queries; ++q) {
+        uint32_t xyz[3];
+        for (int i = 0; i < 3; ++i) {
+            rng ^= rng << 13;
+            rng ^= rng >> 7;
+            rng ^= rng << 17;
+            xyz[i] = (uint32_t)(rng >> 32);
+        }
+        // Fixed point position in [0, 1), consumed one level per step
+        int64_t node = 0;
+        for (int depth = 0;; ++depth) {
+            int index = 0;
+            for (int i = 0; i < 3; ++i) {
+                const uint64_t scaled = (uint64_t)xyz[i] * N;
+                index = index * N + (int)(scaled >> 32);
+                xyz[i] = (uint32_t)scaled;
+            }
+            const int64_t sub = node + index;
+            if (child[sub] == 0 || depth >= 31) {
+                sum += data[sub * tree.data_dim + tree.data_dim - 1];
+                break;
+            }
+            node += (int64_t)child[sub] * N3;
+        }
+    }
+    return sum;
+}
+
+// Huge pages: tree load time, random descent throughput and dTLB misses
+// with the tree's arrays on each page mode
+int bench_tlb(cxxopts::ParseResult& args, std::ofstream& csv) {
+    const std::string path = args["file"].as<std::string>();
+    const size_t n_queries = (size_t)args["queries"].as<int>();
+    DtlbCounter counter;
+    if (!counter.ok()) {
+        fputs("WARNING: dTLB miss counter unavailable "
+              "(check /proc/sys/kernel/perf_event_paranoid)\n",
+              stderr);
+    }
+    if (csv.is_open()) {
+        csv << "pages,load_s,huge_mb,mdescents_per_s,dtlb_misses_per_descent"
+               "\n";
+    }
+    printf("| pages | load s | huge page MB | Mdescents/s | "
+           "dTLB misses/descent |\n");
+    printf("|---|---|---|---|---|\n");
+    for (const std::string& name :
+         args["pages"].as<std::vector<std::string>>()) {
+        PageMode pages;
+        if (!internal::parse_page_mode(name, pages)) {
+            fprintf(stderr, "ERROR: Unknown page mode '%s'\n", name.c_str());
+            return 1;
+        }
+        const float huge_before = huge_page_mb();
+        auto start = std::chrono::steady_clock::now();
+        N3Tree tree(path, pages);
+        const float load_s = std::chrono::duration<float>(
+                                 std::chrono::steady_clock::now() - start)
+                                 .count();
+        const float huge_mb = huge_page_mb() - huge_before;
+
+        // Warm up (faults pages in), then measure
+        volatile uint64_t sink = random_descents(tree, n_queries / 4, 1);
+        start = std::chrono::steady_clock::now();
+        counter.start();
+        sink = sink + random_descents(tree, n_queries, 2);
+        const uint64_t misses = counter.stop();
+        const float secs = std::chrono::duration<float>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+        const float mdescents = n_queries / secs / 1e6f;
+        const float miss_rate = counter.ok() ? (float)misses / n_queries : -1.f;
+        char miss_str[32] = "n/a";
+        if (counter.ok()) {
+            snprintf(miss_str, sizeof(miss_str), "%.3f", miss_rate);
+        }
+        printf("| %s | %.2f | %.0f | %.2f | %s |\n", name.c_str(), load_s,
+               huge_mb, mdescents, miss_str);
+        if (csv.is_open()) {
+            csv << name << "," << load_s << "," << huge_mb << "," << mdescents
+                << "," << miss_rate << "\n";
+        }
+    }
+    return 0;
+}
+
+}  // namespace
+}  // namespace volrend
+
+int main(int argc, char* argv[]) {
+    using namespace volrend;
+    cxxopts::Options cxxoptions(
+        "volrend_bench",
+        "CPU renderer benchmarks (c) PlenOctree authors 2021\n"
+        "Benchmarks:\n"
+        "  schedule: tile scheduling (static/dynamic/work stealing) "
+        "vs threads\n"
+        "  beam: beam traversal vs per-sample root descents\n"
+        "  ropes: neighbour ropes vs per-sample root descents\n"
+        "  stack: short-stack vs root restarts, with the tree's depth\n"
+        "  reproject: temporal reprojection on orbit paths, retraced pixels "
+        "and PSNR vs full frames (first --threads count only)\n"
+        "  numa: local vs remote memory throughput per NUMA node pair, and "
+        "tree placement policies vs threads\n"
+        "  tlb: random tree descents and dTLB misses with the tree on "
+        "ordinary vs huge pages");
+    internal::add_common_opts(cxxoptions);
+
+    // clang-format off
+    cxxoptions.add_options()
+        ("bench", "benchmark to run", cxxopts::value<std::string>())
+        ("n_poses", "number of orbit poses to render",
+                cxxopts::value<int>()->default_value("8"))
+        ("radius", "orbit radius, in tree extents",
+                cxxopts::value<float>()->default_value("1.5"))
+        ("reps", "times to render the poses",
+                cxxopts::value<int>()->default_value("3"))
+        ("threads", "thread counts to benchmark",
+                cxxopts::value<std::vector<int>>()->default_value("8,32,128"))
+        ("numa_mb", "numa: buffer size for the memory throughput test",
+                cxxopts::value<int>()->default_value("512"))
+        ("pages", "tlb: page modes to compare (default, thp, 2mb, 1gb)",
+                cxxopts::value<std::vector<std::string>>()->default_value(
+                    "default,thp,2mb,1gb"))
+        ("queries", "tlb: random descents to time",
+                cxxopts::value<int>()->default_value("4000000"))
+        ("frames", "reproject: frames per orbit path",
+                cxxopts::value<int>()->default_value("60"))
+        ("deg_per_frame", "reproject: orbit speeds to benchmark",
+                cxxopts::value<std::vector<float>>()->default_value(
+                    "0.5,1,2,4"))
+        ("max_error", "reproject: error bounds (pixels) to benchmark",
+                cxxopts::value<std::vector<float>>()->default_value(
+                    "0.5,1,2"))
+        ("max_angle", "reproject: view direction change bound (degrees)",
+                cxxopts::value<float>()->default_value("2"))
+        ("csv", "also write results to this CSV",
+                cxxopts::value<std::string>()->default_value(""))
+        ;
+    // clang-format on
+    cxxoptions.positional_help("benchmark npz_file");
+    cxxoptions.parse_positional({"bench", "file"});
+    cxxopts::ParseResult args = cxxoptions.parse(argc, argv);
+    if (args.count("help") || !args.count("bench") || !args.count("file")) {
+        printf("%s\n", cxxoptions.help().c_str());
+        return args.count("help") ? 0 : 1;
+    }
+
+    std::ofstream csv;
+    const std::string csv_path = args["csv"].as<std::string>();
+    if (csv_path.size()) {
+        csv.open(csv_path);
+        if (!csv) {
+            fprintf(stderr, "ERROR: Could not open '%s'\n", csv_path.c_str());
+            return 1;
+        }
+    }
+
+    const std::string bench = args["bench"].as<std::string>();
+    if (bench == "tlb") {
+        // Loads the tree itself, once per page mode
+        return bench_tlb(args, csv);
+    }
+
+    N3Tree tree(args["file"].as<std::string>());
+    float fx = args["fx"].as<float>();
+    if (fx < 0) fx = 1111.11f;
+    float fy = args["fy"].as<float>();
+    if (fy < 0) fy = fx;
+    Camera camera(args["width"].as<int>(), args["height"].as<int>(), fx, fy);
+    const std::vector<glm::mat4x3> poses = orbit_poses(
+        tree, std::max(args["n_poses"].as<int>(), 1),
+        args["radius"].as<float>());
+    RenderOptions options = internal::render_options_from_args(args);
+
+    printf("INFO: %s, %zu poses at %dx%d, %u hardware threads\n\n",
+           args["file"].as<std::string>().c_str(), poses.size(),
+           camera.width, camera.height, std::thread::hardware_concurrency());
+    if (bench == "schedule") {
+        return bench_schedule(args, tree, camera, poses, options, csv);
+    } else if (bench == "beam") {
+        return bench_beam(args, tree, camera, poses, options, csv);
+    } else if (bench == "ropes") {
+        return bench_ropes(args, tree, camera, poses, options, csv);
+    } else if (bench == "stack") {
+        return bench_stack(args, tree, camera, poses, options, csv);
+    } else if (bench == "reproject") {
+        return bench_reproject(args, tree, camera, options, csv);
+    } else if (bench == "numa") {
+        return bench_numa(args, tree, camera, poses, options, csv);
+    }
+    fprintf(stderr, "ERROR: Unknown benchmark '%s'\n", bench.c_str());
+    return 1;
+}
@@ -2,6 +2,14 @@
 #include <cstdio>
 #include <string>
 #include <vector>
+#include <map>
+#include <utility>
+#include <memory>
+#include <algorithm>
+#include <climits>
+#include <thread>
+#include <cmath>
+#include <chrono>
 #include <fstream>
 #include <iomanip>
 
@@ -9,14 +17,199 @@
 
 #include "volrend/common.hpp"
 #include "volrend/n3tree.hpp"
+#include "volrend/mesh.hpp"
 
 #include "volrend/internal/opts.hpp"
 
+#include "volrend/cpu_renderer.hpp"
+#ifdef VOLREND_CUDA
 #include "volrend/cuda/common.cuh"
 #include "volrend/cuda/renderer_kernel.hpp"
+#endif
 #include "volrend/internal/imwrite.hpp"
+#include "volrend/internal/frame_cache.hpp"
+#include "volrend/internal/imread.hpp"
+#include "volrend/internal/metrics.hpp"
+#include "volrend/internal/reprojection.hpp"
+#include "volrend/internal/bounded_queue.hpp"
 
+#include "glm/geometric.hpp"
+#include "glm/vec2.hpp"
+
+namespace volrend {
 namespace {
+// Tile size used when retracing cached frames after a render_bbox change
+const int CACHE_TILE_SIZE = 16;
+
+// Renders frames into u8 RGBA host buffers, with the CUDA renderer or the
+// CPU renderer (--cpu, and always when built without CUDA).
+// Buffers are pooled per resolution, so datasets mixing image sizes only
+// allocate once per distinct size
+class FrameRenderer {
+   public:
+    FrameRenderer(bool use_cpu, int n_threads) {
+#ifndef VOLREND_CUDA
+        use_cpu = true;  // The only renderer
+#endif
+        if (use_cpu) {
+            cpu_ = std::make_unique<CPURenderer>(n_threads);
+            return;
+        }
+#ifdef VOLREND_CUDA
+        cuda(StreamCreateWithFlags(&stream_, cudaStreamDefault));
+        cudaEventCreate(&start_);
+        cudaEventCreate(&stop_);
+#endif
+    }
+
+    ~FrameRenderer() {
+#ifdef VOLREND_CUDA
+        if (!cpu_) {
+            for (auto &it : buffers_) {
+                Buffer &buf = it.second;
+                cuda(FreeArray(buf.array));
+                if (buf.host != nullptr) cuda(FreeHost(buf.host));
+                if (buf.tile_mask != nullptr) cuda(Free(buf.tile_mask));
+                if (buf.sample_counts != nullptr) {
+                    cuda(Free(buf.sample_counts));
+                }
+            }
+            cudaEventDestroy(start_);
+            cudaEventDestroy(stop_);
+            cuda(StreamDestroy(stream_));
+        }
+#endif
+    }
+
+    // CPU renderer, or nullptr if rendering with CUDA
+    CPURenderer *cpu() { return cpu_.get(); }
+
+    // Host buffer holding frames of this size
+    uint8_t *host_buffer(int width, int height) {
+        return get_buffer(width, height).host;
+    }
+
+    // Whether render() copies frames into host_buffer() (default); the CPU
+    // renderer always renders there
+    void set_readback(bool readback) { readback_ = readback; }
+
+    // Render a frame of the camera's size. If tile_mask is given (row-major
+    // over CACHE_TILE_SIZE tiles), only its tiles are rendered over the
+    // current host buffer contents. If n_samples/ms are given, returns the
+    // total tree samples and the render time there, waiting for the GPU
+    void render(const N3Tree &tree, const Camera &cam,
+                const RenderOptions &options,
+                const std::vector<uint8_t> *tile_mask = nullptr,
+                uint64_t *n_samples = nullptr, float *ms = nullptr) {
+        Buffer &buf = get_buffer(cam.width, cam.height);
+        if (cpu_) {
+            auto start = std::chrono::steady_clock::now();
+            uint64_t samples = cpu_->render(
+                tree, cam, options, buf.host,
+                tile_mask ? tile_mask->data() : nullptr, CACHE_TILE_SIZE);
+            if (n_samples) *n_samples = samples;
+            if (ms) {
+                *ms = std::chrono::duration<float, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+            }
+            return;
+        }
+#ifdef VOLREND_CUDA
+        const int width = cam.width, height = cam.height;
+        const size_t n_pixels = (size_t)width * height;
+        const uint8_t *dev_tile_mask = nullptr;
+        if (tile_mask) {
+            if (buf.tile_mask == nullptr) {
+                cuda(Malloc(&buf.tile_mask, tile_mask->size()));
+            }
+            cuda(MemcpyAsync(buf.tile_mask, tile_mask->data(),
+                             tile_mask->size(), cudaMemcpyHostToDevice,
+                             stream_));
+            cuda(Memcpy2DToArrayAsync(buf.array, 0, 0, buf.host, 4 * width,
+                                      4 * width, height,
+                                      cudaMemcpyHostToDevice, stream_));
+            dev_tile_mask = buf.tile_mask;
+        }
+        if (n_samples && buf.sample_counts == nullptr) {
+            cuda(Malloc(&buf.sample_counts, n_pixels * sizeof(uint32_t)));
+            buf.sample_counts_host.resize(n_pixels);
+        }
+
+        if (ms) cudaEventRecord(start_, stream_);
+        launch_renderer(tree, cam, options, buf.array, depth_arr_, stream_,
+                        true, dev_tile_mask, CACHE_TILE_SIZE,
+                        n_samples ? buf.sample_counts : nullptr);
+        if (ms) cudaEventRecord(stop_, stream_);
+        if (readback_) {
+            cuda(Memcpy2DFromArrayAsync(buf.host, 4 * width, buf.array, 0, 0,
+                                        4 * width, height,
+                                        cudaMemcpyDeviceToHost, stream_));
+        }
+        if (n_samples) {
+            cuda(MemcpyAsync(buf.sample_counts_host.data(), buf.sample_counts,
+                             n_pixels * sizeof(uint32_t),
+                             cudaMemcpyDeviceToHost, stream_));
+        }
+        if (readback_ || n_samples || ms) cuda(StreamSynchronize(stream_));
+        if (ms) cudaEventElapsedTime(ms, start_, stop_);
+        if (n_samples) {
+            *n_samples = 0;
+            for (size_t j = 0; j < n_pixels; ++j) {
+                *n_samples += buf.sample_counts_host[j];
+            }
+        }
+#endif
+    }
+
+    // Wait for all queued GPU work
+    void synchronize() {
+#ifdef VOLREND_CUDA
+        if (!cpu_) cuda(StreamSynchronize(stream_));
+#endif
+    }
+
+   private:
+    struct Buffer {
+        uint8_t *host = nullptr;
+        std::vector<uint8_t> cpu_host;
+#ifdef VOLREND_CUDA
+        // Offscreen render target; host is pinned staging memory
+        cudaArray_t array = nullptr;
+        // Device tile mask for partial re-rendering from the frame cache
+        uint8_t *tile_mask = nullptr;
+        uint32_t *sample_counts = nullptr;
+        std::vector<uint32_t> sample_counts_host;
+#endif
+    };
+
+    Buffer &get_buffer(int width, int height) {
+        Buffer &buf = buffers_[std::make_pair(width, height)];
+        if (buf.host != nullptr) return buf;
+        if (cpu_) {
+            buf.cpu_host.resize((size_t)4 * width * height);
+            buf.host = buf.cpu_host.data();
+            return buf;
+        }
+#ifdef VOLREND_CUDA
+        cudaChannelFormatDesc channelDesc =
+            cudaCreateChannelDesc(8, 8, 8, 8, cudaChannelFormatKindUnsigned);
+        cuda(MallocArray(&buf.array, &channelDesc, width, height));
+        cuda(MallocHost(&buf.host, 4 * width * height));
+#endif
+        return buf;
+    }
+
+    std::unique_ptr<CPURenderer> cpu_;
+    std::map<std::pair<int, int>, Buffer> buffers_;
+    bool readback_ = true;
+#ifdef VOLREND_CUDA
+    cudaStream_t stream_ = nullptr;
+    cudaEvent_t start_, stop_;
+    cudaArray_t depth_arr_ = nullptr;  // Not using depth buffer
+#endif
+};
+
 std::string path_basename(const std::string &str) {
     for (size_t i = str.size() - 1; ~i; --i) {
         const char c = str[i];
@@ -62,6 +255,194 @@ int read_transform_matrices(const std::string &path,
     return cnt;
 }
 
+// Check if str ends with given suffix
+bool ends_with(const std::string &str, const std::string &suffix) {
+    return str.size() >= suffix.size() &&
+           str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// Exit unless arr (named name in path) is a C order array of a supported
+// dtype: float16/32/64 or (unsigned) 8-64 bit integers
+void check_npy_dtype(const cnpy::NpyArray &arr, const char *name,
+                     const std::string &path) {
+    const size_t ws = arr.word_size;
+    const bool supported =
+        arr.type_kind == 'f'
+            ? ws == 2 || ws == 4 || ws == 8
+            : (arr.type_kind == 'i' || arr.type_kind == 'u') &&
+                  (ws == 1 || ws == 2 || ws == 4 || ws == 8);
+    if (!supported) {
+        fprintf(stderr, "ERROR: %s in '%s' has unsupported dtype '%c%zu'\n",
+                name, path.c_str(), arr.type_kind ? arr.type_kind : '?', ws);
+        std::exit(1);
+    }
+    if (arr.fortran_order) {
+        fprintf(stderr, "ERROR: %s in '%s' is in Fortran order, save it in "
+                "C order\n", name, path.c_str());
+        std::exit(1);
+    }
+}
+
+// Read element i of an npy array passing check_npy_dtype, by its dtype
+double npy_get(const cnpy::NpyArray &arr, size_t i) {
+    switch (arr.type_kind) {
+        case 'f':
+            switch (arr.word_size) {
+                case 2: return (float)arr.data<half>()[i];
+                case 4: return arr.data<float>()[i];
+                default: return arr.data<double>()[i];
+            }
+        case 'i':
+            switch (arr.word_size) {
+                case 1: return arr.data<int8_t>()[i];
+                case 2: return arr.data<int16_t>()[i];
+                case 4: return arr.data<int32_t>()[i];
+                default: return (double)arr.data<int64_t>()[i];
+            }
+        default:
+            switch (arr.word_size) {
+                case 1: return arr.data<uint8_t>()[i];
+                case 2: return arr.data<uint16_t>()[i];
+                case 4: return arr.data<uint32_t>()[i];
+                default: return (double)arr.data<uint64_t>()[i];
+            }
+    }
+}
+
+// Load c2w poses of shape [N,4,4] or [N,3,4] from a .npy file, or from a
+// .npz file with key 'poses' and optionally
+// 'intrinsics' [N,3,3] (or [3,3] shared by all cameras),
+// 'image_wh' [N,2] (or [2]) image width, height,
+// 'roi' [N,3] (or [3]) region of interest center x, y and radius in pixels.
+// Focal lengths/sizes not given in the file are set to -1 (use global),
+// regions to radius -1 (use --roi).
+int read_poses_npy(const std::string &path, std::vector<glm::mat4x3> &out,
+                   std::vector<glm::vec2> &focals,
+                   std::vector<glm::ivec2> &sizes,
+                   std::vector<glm::vec3> &rois) {
+    if (!std::ifstream(path)) {
+        fprintf(stderr, "ERROR: '%s' does not exist\n", path.c_str());
+        std::exit(1);
+    }
+    cnpy::npz_t npz;
+    if (ends_with(path, ".npz")) {
+        npz = cnpy::npz_load(path);
+        if (!npz.count("poses")) {
+            fprintf(stderr, "ERROR: '%s' has no 'poses' array\n",
+                    path.c_str());
+            std::exit(1);
+        }
+    } else {
+        npz["poses"] = cnpy::npy_load(path);
+    }
+
+    const cnpy::NpyArray &poses = npz["poses"];
+    if (poses.shape.size() != 3 || poses.shape[2] != 4 ||
+        (poses.shape[1] != 3 && poses.shape[1] != 4)) {
+        fprintf(stderr, "ERROR: poses in '%s' must have shape [N,4,4] or "
+                "[N,3,4]\n", path.c_str());
+        std::exit(1);
+    }
+    check_npy_dtype(poses, "poses", path);
+    const size_t cnt = poses.shape[0];
+    const size_t rows = poses.shape[1];
+    const size_t start = out.size();
+    out.resize(start + cnt);
+    focals.resize(start + cnt, glm::vec2(-1.f));
+    sizes.resize(start + cnt, glm::ivec2(-1));
+    rois.resize(start + cnt, glm::vec3(0.f, 0.f, -1.f));
+    for (size_t i = 0; i < cnt; ++i) {
+        glm::mat4x3 &tmp = out[start + i];
+        const size_t off = i * rows * 4;
+        // Recall GL is column major
+        for (int r = 0; r < 3; ++r) {
+            for (int c = 0; c < 4; ++c) {
+                tmp[c][r] = (float)npy_get(poses, off + r * 4 + c);
+            }
+        }
+        const float det = glm::dot(tmp[0], glm::cross(tmp[1], tmp[2]));
+        if (!(std::fabs(det) > 1e-6f) || !std::isfinite(det) ||
+            !std::isfinite(glm::dot(tmp[3], tmp[3]))) {
+            fprintf(stderr, "ERROR: poses in '%s' have a singular or "
+                    "non-finite c2w for frame %zu\n", path.c_str(), i);
+            std::exit(1);
+        }
+    }
+
+    if (npz.count("intrinsics")) {
+        const cnpy::NpyArray &intrins = npz["intrinsics"];
+        const bool shared = intrins.shape.size() == 2;
+        if (intrins.num_vals != (shared ? 9 : cnt * 9)) {
+            fprintf(stderr, "ERROR: intrinsics in '%s' must have shape "
+                    "[N,3,3] or [3,3]\n", path.c_str());
+            std::exit(1);
+        }
+        check_npy_dtype(intrins, "intrinsics", path);
+        for (size_t i = 0; i < cnt; ++i) {
+            const size_t off = shared ? 0 : i * 9;
+            const double fx = npy_get(intrins, off),
+                         fy = npy_get(intrins, off + 4);
+            if (!(fx > 0.0 && fy > 0.0)) {
+                fprintf(stderr, "ERROR: intrinsics in '%s' have invalid "
+                        "focal lengths %g, %g for frame %zu\n",
+                        path.c_str(), fx, fy, i);
+                std::exit(1);
+            }
+            focals[start + i] = glm::vec2((float)fx, (float)fy);
+        }
+    }
+
+    if (npz.count("image_wh")) {
+        const cnpy::NpyArray &wh = npz["image_wh"];
+        const bool shared = wh.shape.size() == 1;
+        if (wh.num_vals != (shared ? 2 : cnt * 2)) {
+            fprintf(stderr, "ERROR: image_wh in '%s' must have shape "
+                    "[N,2] or [2]\n", path.c_str());
+            std::exit(1);
+        }
+        check_npy_dtype(wh, "image_wh", path);
+        for (size_t i = 0; i < cnt; ++i) {
+            const size_t off = shared ? 0 : i * 2;
+            const double width = npy_get(wh, off),
+                         height = npy_get(wh, off + 1);
+            if (!(width >= 1.0 && height >= 1.0 && width <= INT_MAX &&
+                  height <= INT_MAX)) {
+                fprintf(stderr, "ERROR: image_wh in '%s' has invalid size "
+                        "%g x %g for frame %zu\n", path.c_str(), width,
+                        height, i);
+                std::exit(1);
+            }
+            sizes[start + i] = glm::ivec2((int)width, (int)height);
+        }
+    }
+
+    if (npz.count("roi")) {
+        const cnpy::NpyArray &roi = npz["roi"];
+        const bool shared = roi.shape.size() == 1;
+        if (roi.num_vals != (shared ? 3 : cnt * 3)) {
+            fprintf(stderr, "ERROR: roi in '%s' must have shape "
+                    "[N,3] or [3]\n", path.c_str());
+            std::exit(1);
+        }
+        check_npy_dtype(roi, "roi", path);
+        for (size_t i = 0; i < cnt; ++i) {
+            const size_t off = shared ? 0 : i * 3;
+            rois[start + i] = glm::vec3((float)npy_get(roi, off),
+                                        (float)npy_get(roi, off + 1),
+                                        (float)npy_get(roi, off + 2));
+        }
+    }
+    return (int)cnt;
+}
+
+// Parse shard spec 'i/k'
+bool parse_shard(const std::string &str, int &shard_id, int &n_shards) {
+    if (sscanf(str.c_str(), "%d/%d", &shard_id, &n_shards) != 2) {
+        return false;
+    }
+    return n_shards > 0 && shard_id >= 0 && shard_id < n_shards;
+}
+
 void read_intrins(const std::string &path, float &fx, float &fy) {
     std::ifstream ifs(path);
     if (!ifs) {
@@ -72,7 +453,327 @@ void read_intrins(const std::string &path, float &fx, float &fy) {
     ifs >> fx >> _ >> _ >> _;
     ifs >> _ >> fy;
 }
+
+// Computes image metrics against ground truth PNGs while rendering continues:
+// a reader thread loads the ground truth in frame order, and worker threads
+// compute PSNR/SSIM (plain and masked by ground truth alpha) for each
+// finished frame. Rendered frames never touch the disk
+class MetricsStage {
+   public:
+    MetricsStage(const std::string &gt_dir,
+                 const std::vector<std::string> &basenames,
+                 const std::vector<glm::ivec2> &sizes,
+                 float background_brightness, int n_workers)
+        : basenames_(basenames),
+          sizes_(sizes),
+          gt_queue_(8),
+          jobs_(2 * n_workers),
+          results_(basenames.size()) {
+        reader_ = std::thread([=] {
+            for (size_t i = 0; i < basenames_.size(); ++i) {
+                GtImage gt;
+                const std::string path = gt_dir + "/" + basenames_[i] + ".png";
+                int width, height;
+                if (!internal::read_png_file(path, gt.rgba, width, height)) {
+                    fprintf(stderr, "WARNING: Could not read ground truth "
+                            "'%s'\n", path.c_str());
+                } else if (width != sizes_[i].x || height != sizes_[i].y) {
+                    fprintf(stderr, "WARNING: Ground truth '%s' is %dx%d, "
+                            "expected %dx%d\n", path.c_str(), width, height,
+                            sizes_[i].x, sizes_[i].y);
+                } else {
+                    const size_t n_pix = (size_t)width * height;
+                    gt.mask.resize(n_pix);
+                    for (size_t j = 0; j < n_pix; ++j) {
+                        gt.mask[j] = gt.rgba[4 * j + 3];
+                    }
+                    internal::composite_background(gt.rgba.data(), width,
+                                                   height,
+                                                   background_brightness);
+                    gt.ok = true;
+                }
+                if (!gt_queue_.push(std::move(gt))) break;
+            }
+        });
+        for (int i = 0; i < n_workers; ++i) {
+            workers_.emplace_back([this] {
+                Job job;
+                while (jobs_.pop(job)) {
+                    if (!job.gt.ok) continue;
+                    const int width = sizes_[job.i].x,
+                              height = sizes_[job.i].y;
+                    const uint8_t *pred = job.pred.data(),
+                                  *gt = job.gt.rgba.data(),
+                                  *mask = job.gt.mask.data();
+                    Result &res = results_[job.i];
+                    res.psnr = internal::psnr(pred, gt, width, height);
+                    res.ssim = internal::ssim(pred, gt, width, height);
+                    res.masked_psnr =
+                        internal::psnr(pred, gt, width, height, mask);
+                    res.masked_ssim =
+                        internal::ssim(pred, gt, width, height, mask);
+                    res.ok = true;
+                }
+            });
+        }
+    }
+
+    ~MetricsStage() { join(); }
+
+    // Queue finished frame i (4 * width * height RGBA, copied);
+    // must be called in frame order
+    void submit(size_t i, const uint8_t *rgba) {
+        Job job;
+        job.i = i;
+        gt_queue_.pop(job.gt);
+        const size_t size = (size_t)4 * sizes_[i].x * sizes_[i].y;
+        job.pred.assign(rgba, rgba + size);
+        jobs_.push(std::move(job));
+    }
+
+    // Wait for all submitted frames, then write the per-frame CSV and a
+    // summary CSV of the means next to it (also printed)
+    bool finish(const std::string &csv_path) {
+        join();
+        std::ofstream csv(csv_path);
+        if (!csv) {
+            fprintf(stderr, "ERROR: Could not open '%s'\n", csv_path.c_str());
+            return false;
+        }
+        csv << "frame,psnr,ssim,masked_psnr,masked_ssim\n";
+        double sums[4] = {0.0, 0.0, 0.0, 0.0};
+        int counts[4] = {0, 0, 0, 0};
+        int n_ok = 0;
+        for (size_t i = 0; i < results_.size(); ++i) {
+            const Result &res = results_[i];
+            if (!res.ok) continue;
+            ++n_ok;
+            const double vals[4] = {res.psnr, res.ssim, res.masked_psnr,
+                                    res.masked_ssim};
+            csv << basenames_[i];
+            for (int j = 0; j < 4; ++j) {
+                csv << "," << vals[j];
+                // Masked metrics are NaN for frames with empty masks
+                if (!std::isnan(vals[j])) {
+                    sums[j] += vals[j];
+                    ++counts[j];
+                }
+            }
+            csv << "\n";
+        }
+        double means[4];
+        for (int j = 0; j < 4; ++j) {
+            means[j] = counts[j] ? sums[j] / counts[j] : NAN;
+        }
+
+        std::string summary_path = csv_path;
+        if (ends_with(summary_path, ".csv")) {
+            summary_path.resize(summary_path.size() - 4);
+        }
+        summary_path += "_summary.csv";
+        std::ofstream summary(summary_path);
+        summary << "frames,psnr,ssim,masked_psnr,masked_ssim\n"
+                << n_ok << "," << means[0] << "," << means[1] << ","
+                << means[2] << "," << means[3] << "\n";
+        printf("Metrics over %d/%zu frames: PSNR %.4f SSIM %.4f, "
+               "masked PSNR %.4f SSIM %.4f\n",
+               n_ok, results_.size(), means[0], means[1], means[2],
+               means[3]);
+        printf("INFO: Wrote metrics to '%s' and '%s'\n", csv_path.c_str(),
+               summary_path.c_str());
+        return true;
+    }
+
+   private:
+    struct GtImage {
+        std::vector<uint8_t> rgba, mask;
+        bool ok = false;
+    };
+    struct Job {
+        size_t i;
+        std::vector<uint8_t> pred;
+        GtImage gt;
+    };
+    struct Result {
+        double psnr, ssim, masked_psnr, masked_ssim;
+        bool ok = false;
+    };
+
+    void join() {
+        gt_queue_.close();
+        jobs_.close();
+        if (reader_.joinable()) reader_.join();
+        for (std::thread &worker : workers_) worker.join();
+        workers_.clear();
+    }
+
+    const std::vector<std::string> &basenames_;
+    const std::vector<glm::ivec2> &sizes_;
+    internal::BoundedQueue<GtImage> gt_queue_;
+    internal::BoundedQueue<Job> jobs_;
+    std::thread reader_;
+    std::vector<std::thread> workers_;
+    std::vector<Result> results_;
+};
+
+// Values of one sweep axis; the single command line value if not swept
+std::vector<float> sweep_axis(cxxopts::ParseResult &args, const char *name,
+                              float value) {
+    std::vector<float> values;
+    if (args.count(name)) values = args[name].as<std::vector<float>>();
+    if (values.empty()) values.push_back(value);
+    return values;
+}
+
+// Use the region of interest (center x, y, radius) of a frame, unless its
+// radius is negative
+void apply_frame_roi(const glm::vec3 &roi, RenderOptions &opt) {
+    if (roi.z < 0.f) return;
+    opt.roi = true;
+    opt.roi_center[0] = roi.x;
+    opt.roi_center[1] = roi.y;
+    opt.roi_radius = roi.z;
+}
+
+// Render all frames over the grid of step_size x sigma_thresh x stop_thresh
+// (x adaptive marching footprint) given by the --sweep_* options, with the tree loaded once, writing time,
+// samples per ray and PSNR/SSIM against reference images to a CSV.
+// References are ground truth images if --gt is given, else the frames
+// rendered with base_options.
+int run_sweep(cxxopts::ParseResult &args, const N3Tree &tree, Camera &camera,
+              const std::vector<glm::mat4x3> &trans,
+              const std::vector<glm::ivec2> &sizes,
+              const std::vector<glm::vec2> &focals,
+              const std::vector<glm::vec3> &rois,
+              const std::vector<std::string> &basenames,
+              const RenderOptions &base_options, FrameRenderer &renderer) {
+    const std::vector<float> step_sizes = sweep_axis(
+                                 args, "sweep_step_size", base_options.step_size),
+                             sigma_threshs =
+                                 sweep_axis(args, "sweep_sigma_thresh",
+                                            base_options.sigma_thresh),
+                             stop_threshs =
+                                 sweep_axis(args, "sweep_stop_thresh",
+                                            base_options.stop_thresh);
+    // Adaptive marching footprints; -1 = keep the base setting
+    std::vector<float> footprints = {-1.f};
+    if (args.count("sweep_adaptive_footprint")) {
+        footprints = args["sweep_adaptive_footprint"].as<std::vector<float>>();
+    }
+    std::vector<RenderOptions> settings;
+    for (float step_size : step_sizes) {
+        for (float sigma_thresh : sigma_threshs) {
+            for (float stop_thresh : stop_threshs) {
+                for (float footprint : footprints) {
+                    RenderOptions options = base_options;
+                    options.step_size = step_size;
+                    options.sigma_thresh = sigma_thresh;
+                    options.stop_thresh = stop_thresh;
+                    if (footprint >= 0.f) {
+                        options.adaptive = true;
+                        options.adaptive_footprint = footprint;
+                    }
+                    settings.push_back(options);
+                }
+            }
+        }
+    }
+    const size_t n_frames = trans.size();
+
+    auto setup_camera = [&](size_t i) {
+        camera.width = sizes[i].x;
+        camera.height = sizes[i].y;
+        camera.transform = trans[i];
+        camera.fx = focals[i].x;
+        camera.fy = focals[i].y;
+        camera._update(false);
+    };
+
+    // Reference images
+    std::vector<std::vector<uint8_t>> refs(n_frames);
+    const std::string gt_dir = args["gt"].as<std::string>();
+    for (size_t i = 0; i < n_frames; ++i) {
+        const int width = sizes[i].x, height = sizes[i].y;
+        if (gt_dir.size()) {
+            const std::string path = gt_dir + "/" + basenames[i] + ".png";
+            int gt_width, gt_height;
+            if (!internal::read_png_file(path, refs[i], gt_width, gt_height)) {
+                fprintf(stderr, "ERROR: Could not read ground truth '%s'\n",
+                        path.c_str());
+                return 1;
+            }
+            if (gt_width != width || gt_height != height) {
+                fprintf(stderr,
+                        "ERROR: Ground truth '%s' is %dx%d, expected %dx%d\n",
+                        path.c_str(), gt_width, gt_height, width, height);
+                return 1;
+            }
+            internal::composite_background(refs[i].data(), width, height,
+                                           base_options.background_brightness);
+        } else {
+            setup_camera(i);
+            RenderOptions frame_options = base_options;
+            apply_frame_roi(rois[i], frame_options);
+            renderer.render(tree, camera, frame_options);
+            const uint8_t *host = renderer.host_buffer(width, height);
+            refs[i].assign(host, host + 4 * width * height);
+        }
+    }
+
+    const std::string csv_path = args["sweep_csv"].as<std::string>();
+    std::ofstream csv(csv_path);
+    if (!csv) {
+        fprintf(stderr, "ERROR: Could not open '%s'\n", csv_path.c_str());
+        return 1;
+    }
+    csv << "step_size,sigma_thresh,stop_thresh,adaptive_footprint,"
+           "ms_per_frame,samples_per_ray,psnr,ssim\n";
+
+    for (const RenderOptions &options : settings) {
+        float total_ms = 0.f;
+        uint64_t total_samples = 0, total_pixels = 0;
+        double total_psnr = 0.0, total_ssim = 0.0;
+        for (size_t i = 0; i < n_frames; ++i) {
+            const int width = sizes[i].x, height = sizes[i].y;
+            const size_t n_pixels = (size_t)width * height;
+            setup_camera(i);
+
+            // As in a normal run
+            RenderOptions frame_options = options;
+            apply_frame_roi(rois[i], frame_options);
+            uint64_t n_samples;
+            float ms;
+            renderer.render(tree, camera, frame_options, nullptr, &n_samples,
+                            &ms);
+            total_ms += ms;
+            total_samples += n_samples;
+            total_pixels += n_pixels;
+            const uint8_t *host = renderer.host_buffer(width, height);
+            total_psnr += internal::psnr(host, refs[i].data(), width, height);
+            total_ssim += internal::ssim(host, refs[i].data(), width, height);
+        }
+        const float ms_per_frame = total_ms / n_frames;
+        const double samples_per_ray = (double)total_samples / total_pixels;
+        const double mean_psnr = total_psnr / n_frames,
+                     mean_ssim = total_ssim / n_frames;
+        const float adaptive_footprint =
+            options.adaptive ? options.adaptive_footprint : -1.f;
+        csv << options.step_size << "," << options.sigma_thresh << ","
+            << options.stop_thresh << "," << adaptive_footprint << ","
+            << ms_per_frame << "," << samples_per_ray << "," << mean_psnr
+            << "," << mean_ssim << "\n";
+        printf("step_size=%g sigma_thresh=%g stop_thresh=%g "
+               "adaptive_footprint=%g: %.4f ms/frame, %.2f samples/ray, "
+               "PSNR %.3f, SSIM %.4f\n",
+               options.step_size, options.sigma_thresh, options.stop_thresh,
+               adaptive_footprint, ms_per_frame, samples_per_ray, mean_psnr,
+               mean_ssim);
+    }
+    printf("INFO: Wrote sweep results to '%s'\n", csv_path.c_str());
+    return 0;
+}
 }  // namespace
+}  // namespace volrend
 
 int main(int argc, char *argv[]) {
     using namespace volrend;
@@ -94,27 +795,142 @@ int main(int argc, char *argv[]) {
                 cxxopts::value<float>()->default_value("1.0"))
         ("max_imgs", "max images to render, default no limit",
                 cxxopts::value<int>()->default_value("0"))
+        ("shard", "only render shard i of k of the poses (frames with "
+                  "index % k == i), as 'i/k'; for splitting a pose set "
+                  "across processes",
+                cxxopts::value<std::string>()->default_value(""))
+        ("adaptive", "adaptive marching: coarser steps in low-sigma cells, "
+                     "no color evaluation where it cannot change the "
+                     "8-bit output and earlier stops where pixels span "
+                     "several cells")
+        ("adaptive_footprint", "minimum step in low-sigma cells for "
+                               "--adaptive, in pixel footprints",
+                cxxopts::value<float>()->default_value("1.0"))
+        ("bbox", "render bounding box relative to the tree, as "
+                 "'minx,miny,minz,maxx,maxy,maxz'",
+                cxxopts::value<std::vector<float>>())
+        ("sweep_step_size", "sweep mode: step sizes to render with, "
+                            "as 'a,b,...'",
+                cxxopts::value<std::vector<float>>())
+        ("sweep_sigma_thresh", "sweep mode: sigma thresholds to render with",
+                cxxopts::value<std::vector<float>>())
+        ("sweep_stop_thresh", "sweep mode: stop thresholds to render with",
+                cxxopts::value<std::vector<float>>())
+        ("sweep_adaptive_footprint", "sweep mode: adaptive marching "
+                                     "footprints to render with (enables "
+                                     "adaptive marching)",
+                cxxopts::value<std::vector<float>>())
+        ("sweep_csv", "sweep mode: output CSV path",
+                cxxopts::value<std::string>()->default_value("sweep.csv"))
+        ("gt", "directory of ground truth <pose name>.png; computes PSNR/SSIM "
+               "of each frame against it. In sweep mode, if empty, compares "
+               "against the frames rendered with the -s/-a/-e options",
+                cxxopts::value<std::string>()->default_value(""))
+        ("metrics_csv", "per-frame metrics CSV path when using --gt; "
+                        "means are written to <path>_summary.csv",
+                cxxopts::value<std::string>()->default_value("metrics.csv"))
+        ("metrics_threads", "metrics worker threads when using --gt",
+                cxxopts::value<int>()->default_value("4"))
+        ("cache", "frame cache directory; frames already rendered with the "
+                  "same tree, pose, intrinsics and options are read from it "
+                  "instead, and render bbox changes only retrace the "
+                  "affected tiles",
+                cxxopts::value<std::string>()->default_value(""))
+        ("cpu", "render on the CPU (always used if built without CUDA)")
+        ("threads", "CPU renderer threads; 0 = all hardware threads",
+                cxxopts::value<int>()->default_value("0"))
+        ("schedule", "CPU renderer tile scheduling: static, dynamic or "
+                     "stealing",
+                cxxopts::value<std::string>()->default_value("stealing"))
+        ("color_cache_mb", "CPU renderer per-leaf view-dependent color cache "
+                           "budget in MB, 0 = off; leaf colors are shaded "
+                           "once per quantized view direction and reused, "
+                           "for turntables and fixed cameras",
+                cxxopts::value<float>()->default_value("0"))
+        ("color_cache_res", "color cache view direction bins per side of "
+                            "the octahedral map",
+                cxxopts::value<int>()->default_value("32"))
+        ("numa", "CPU renderer NUMA placement of the tree: none (where "
+                 "loaded), interleave (pages over all nodes) or replicate "
+                 "(a copy per node)",
+                cxxopts::value<std::string>()->default_value("none"))
+        ("pin_threads", "pin CPU renderer threads to CPUs spread over the "
+                        "NUMA nodes, with tiles assigned per node")
+        ("pages", "pages backing the tree's CPU arrays: default, thp "
+                  "(transparent huge pages), 2mb or 1gb (hugetlbfs); huge "
+                  "pages cut TLB misses on large trees",
+                cxxopts::value<std::string>()->default_value("default"))
+        ("ropes", "build neighbour ropes at load if the npz has none, so "
+                  "rays step between leaves without root descents "
+                  "(about 6 int32 per cell)")
+        ("reproject", "CPU renderer temporal reprojection for camera paths: "
+                "reuse pixels of the previous frame, retracing those "
+                "disoccluded or past this error bound (pixels); 0 = off. "
+                "Renders frames one at a time",
+                cxxopts::value<float>()->default_value("0"))
+        ("reproject_max_angle", "reprojection: view direction change "
+                "(degrees) after which a reused pixel is retraced",
+                cxxopts::value<float>()->default_value("2"))
+        ("progressive", "CPU renderer progressive mode for large frames: "
+                "trace pixels in interleaved passes, coarse to fine, writing "
+                "the partial image (holes filled) to the output path every "
+                "this many ms; 0 = off. Renders frames one at a time",
+                cxxopts::value<float>()->default_value("0"))
+        ("roi", "CPU renderer region of interest 'x,y,radius' in pixels: "
+                "full quality only within radius of (x, y), coarser and "
+                "sparser outside; per-frame regions can be given as 'roi' "
+                "in pose npz files",
+                cxxopts::value<std::vector<float>>())
+        ("roi_stride", "region of interest: trace one in stride x stride "
+                "pixels outside it (power of two up to 8)",
+                cxxopts::value<int>()->default_value("4"))
+        ("roi_step_scale", "region of interest: step size factor outside it",
+                cxxopts::value<float>()->default_value("2"))
+        ("frames_in_flight", "CPU renderer frames rendered concurrently; "
+                             "threads take tiles of the next frames while "
+                             "the last tiles of a frame finish and it is "
+                             "written out",
+                cxxopts::value<int>()->default_value("4"))
         ;
     // clang-format on
 
     cxxoptions.allow_unrecognised_options();
 
     // Pass a list of camera pose *.txt files after npz file
-    // each file should have 4x4 c2w pose matrix
-    cxxoptions.positional_help("npz_file [c2w_txt_4x4...]");
+    // each file should have 4x4 c2w pose matrix;
+    // alternatively pass *.npy/*.npz files with many poses each
+    cxxoptions.positional_help("npz_file [c2w_txt_4x4_or_npy...]");
 
     cxxopts::ParseResult args = internal::parse_options(cxxoptions, argc, argv);
 
+#ifdef VOLREND_CUDA
+    const bool use_cpu = args.count("cpu") > 0;
     const int device_id = args["gpu"].as<int>();
-    if (~device_id) {
+    if (!use_cpu && ~device_id) {
         cuda(SetDevice(device_id));
     }
+#else
+    const bool use_cpu = true;
+#endif
 
     // Load all transform matrices
     std::vector<glm::mat4x3> trans;
     std::vector<std::string> basenames;
+    // Per-frame focal length/image size, -1 = use global
+    std::vector<glm::vec2> focals;
+    std::vector<glm::ivec2> sizes;
+    // Per-frame region of interest (x, y, radius), radius -1 = use --roi
+    std::vector<glm::vec3> rois;
     for (auto path : args.unmatched()) {
-        int cnt = read_transform_matrices(path, trans);
+        int cnt;
+        if (ends_with(path, ".npy") || ends_with(path, ".npz")) {
+            cnt = read_poses_npy(path, trans, focals, sizes, rois);
+        } else {
+            cnt = read_transform_matrices(path, trans);
+            focals.resize(trans.size(), glm::vec2(-1.f));
+            sizes.resize(trans.size(), glm::ivec2(-1));
+            rois.resize(trans.size(), glm::vec3(0.f, 0.f, -1.f));
+        }
         std::string fname = remove_ext(path_basename(path));
         if (cnt == 1) {
             basenames.push_back(fname);
@@ -148,7 +964,14 @@ int main(int argc, char *argv[]) {
     }
     std::string out_dir = args["write_images"].as<std::string>();
 
-    N3Tree tree(args["file"].as<std::string>());
+    PageMode pages;
+    if (!internal::parse_page_mode(args["pages"].as<std::string>(), pages)) {
+        fprintf(stderr, "ERROR: Unknown --pages '%s'\n",
+                args["pages"].as<std::string>().c_str());
+        return 1;
+    }
+    N3Tree tree(args["file"].as<std::string>(), pages);
+    if (args.count("ropes") > 0) tree.build_ropes();
 
     int width = args["width"].as<int>(), height = args["height"].as<int>();
     float fx = args["fx"].as<float>();
@@ -164,72 +987,390 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    {
-        float scale = args["scale"].as<float>();
-        if (scale != 1.f) {
-            int owidth = width, oheight = height;
-            width *= scale;
-            height *= scale;
-            fx *= (float)width / owidth;
-            fy *= (float)height / oheight;
-        }
-    }
-
     {
         int max_imgs = args["max_imgs"].as<int>();
         if (max_imgs > 0 && trans.size() > (size_t)max_imgs) {
             trans.resize(max_imgs);
             basenames.resize(max_imgs);
+            focals.resize(max_imgs);
+            sizes.resize(max_imgs);
+            rois.resize(max_imgs);
+        }
+    }
+
+    {
+        std::string shard_str = args["shard"].as<std::string>();
+        if (shard_str.size()) {
+            int shard_id, n_shards;
+            if (!parse_shard(shard_str, shard_id, n_shards)) {
+                fprintf(stderr, "ERROR: --shard must be of format 'i/k' "
+                        "with 0 <= i < k\n");
+                return 1;
+            }
+            // Keep global frame indices in the basenames so that shards
+            // writing to the same directory do not collide
+            size_t j = 0;
+            for (size_t i = shard_id; i < trans.size(); i += n_shards, ++j) {
+                trans[j] = trans[i];
+                basenames[j] = std::move(basenames[i]);
+                focals[j] = focals[i];
+                sizes[j] = sizes[i];
+                rois[j] = rois[i];
+            }
+            trans.resize(j);
+            basenames.resize(j);
+            focals.resize(j);
+            sizes.resize(j);
+            rois.resize(j);
+            printf("INFO: Shard %d/%d, %zu frames\n", shard_id, n_shards, j);
+            if (j == 0) {
+                fputs("WARNING: Shard is empty, quitting\n", stderr);
+                return 0;
+            }
         }
     }
 
-    Camera camera(width, height, fx, fy);
-    cudaArray_t array;
-    cudaStream_t stream;
+    // Per-frame image size and focal length; entries not given by the poses
+    // file fall back to the command line values
+    const float scale = args["scale"].as<float>();
+    for (size_t i = 0; i < trans.size(); ++i) {
+        glm::ivec2 &size = sizes[i];
+        glm::vec2 &focal = focals[i];
+        if (size.x <= 0) size = glm::ivec2(width, height);
+        if (focal.x <= 0.f) focal = glm::vec2(fx, fy);
+        if (scale != 1.f) {
+            glm::ivec2 osize = size;
+            size = glm::ivec2(size.x * scale, size.y * scale);
+            focal.x *= (float)size.x / osize.x;
+            focal.y *= (float)size.y / osize.y;
+            if (rois[i].z >= 0.f) rois[i] *= (float)size.x / osize.x;
+        }
+    }
 
-    cudaChannelFormatDesc channelDesc =
-        cudaCreateChannelDesc(8, 8, 8, 8, cudaChannelFormatKindUnsigned);
+    Camera camera(sizes[0].x, sizes[0].y, focals[0].x, focals[0].y);
+    FrameRenderer renderer(use_cpu, args["threads"].as<int>());
+    if (CPURenderer *cpu = renderer.cpu()) {
+        const float cache_mb = args["color_cache_mb"].as<float>();
+        const std::string schedule = args["schedule"].as<std::string>();
+        if (schedule == "static") {
+            cpu->set_schedule(TileSchedule::STATIC);
+        } else if (schedule == "dynamic") {
+            cpu->set_schedule(TileSchedule::DYNAMIC);
+        } else if (schedule != "stealing") {
+            fprintf(stderr, "ERROR: Unknown --schedule '%s'\n",
+                    schedule.c_str());
+            return 1;
+        }
+        const std::string numa = args["numa"].as<std::string>();
+        NumaPolicy numa_policy = NumaPolicy::NONE;
+        if (numa == "interleave") {
+            numa_policy = NumaPolicy::INTERLEAVE;
+        } else if (numa == "replicate") {
+            numa_policy = NumaPolicy::REPLICATE;
+        } else if (numa != "none") {
+            fprintf(stderr, "ERROR: Unknown --numa '%s'\n", numa.c_str());
+            return 1;
+        }
+        cpu->set_numa(numa_policy, args.count("pin_threads") > 0);
+        printf("INFO: Rendering on the CPU with %d threads\n",
+               cpu->n_threads());
+        if (cache_mb > 0.f) {
+            cpu->set_color_cache((size_t)(cache_mb * (1 << 20)),
+                                 args["color_cache_res"].as<int>());
+        }
+    }
 
-    std::vector<uint8_t> buf;
     if (out_dir.size()) {
         std::filesystem::create_directories(out_dir);
-        buf.resize(4 * width * height);
     }
 
-    cuda(MallocArray(&array, &channelDesc, width, height));
-    cuda(StreamCreateWithFlags(&stream, cudaStreamDefault));
-    cudaArray_t depth_arr = nullptr;  // Not using depth buffer
+    RenderOptions options = internal::render_options_from_args(args);
+    options.adaptive = args.count("adaptive") > 0;
+    options.adaptive_footprint = args["adaptive_footprint"].as<float>();
+    if (args.count("bbox")) {
+        auto bbox = args["bbox"].as<std::vector<float>>();
+        if (bbox.size() != 6) {
+            fputs("ERROR: --bbox must be of format "
+                  "'minx,miny,minz,maxx,maxy,maxz'\n", stderr);
+            return 1;
+        }
+        std::copy(bbox.begin(), bbox.end(), options.render_bbox);
+    }
+    options.roi_stride = args["roi_stride"].as<int>();
+    options.roi_step_scale = args["roi_step_scale"].as<float>();
+    if (args.count("roi")) {
+        auto roi = args["roi"].as<std::vector<float>>();
+        if (roi.size() != 3) {
+            fputs("ERROR: --roi must be of format 'x,y,radius'\n", stderr);
+            return 1;
+        }
+        options.roi = true;
+        options.roi_center[0] = roi[0] * scale;
+        options.roi_center[1] = roi[1] * scale;
+        options.roi_radius = roi[2] * scale;
+    }
+    const bool use_roi =
+        options.roi ||
+        std::any_of(rois.begin(), rois.end(),
+                    [](const glm::vec3 &roi) { return roi.z >= 0.f; });
+    if (use_roi && !renderer.cpu()) {
+        fputs("ERROR: --roi and per-frame regions of interest need the CPU "
+              "renderer (--cpu)\n", stderr);
+        return 1;
+    }
 
-    cudaEvent_t start, stop;
-    cudaEventCreate(&start);
-    cudaEventCreate(&stop);
+    // Meshes are rasterized and composited on the CPU
+    std::vector<Mesh> meshes;
+    {
+        const std::string draw_path = args["draw"].as<std::string>();
+        if (draw_path.size()) {
+            if (!renderer.cpu()) {
+                fputs("ERROR: --draw needs the CPU renderer (--cpu)\n",
+                      stderr);
+                return 1;
+            }
+            meshes = Mesh::open_drawlist(draw_path);
+            renderer.cpu()->set_meshes(&meshes);
+        }
+    }
 
-    cudaEventRecord(start);
-    for (size_t i = 0; i < trans.size(); ++i) {
-        camera.transform = trans[i];
-        camera._update(false);
+    if (args.count("sweep_step_size") || args.count("sweep_sigma_thresh") ||
+        args.count("sweep_stop_thresh") ||
+        args.count("sweep_adaptive_footprint")) {
+        return run_sweep(args, tree, camera, trans, sizes, focals, rois,
+                         basenames, options, renderer);
+    }
+
+    std::unique_ptr<MetricsStage> metrics;
+    {
+        std::string gt_dir = args["gt"].as<std::string>();
+        if (gt_dir.size()) {
+            metrics = std::make_unique<MetricsStage>(
+                gt_dir, basenames, sizes, options.background_brightness,
+                std::max(args["metrics_threads"].as<int>(), 1));
+        }
+    }
 
-        RenderOptions options = internal::render_options_from_args(args);
+    std::unique_ptr<internal::FrameCache> cache;
+    uint64_t cache_base_key = 0;
+    int cache_hits = 0, cache_partial = 0;
+    size_t tiles_retraced = 0, tiles_total = 0;
+    std::vector<uint8_t> tile_mask;
+    {
+        std::string cache_dir = args["cache"].as<std::string>();
+        if (cache_dir.size()) {
+            cache = std::make_unique<internal::FrameCache>(cache_dir);
+            cache_base_key = internal::hash_combine(
+                internal::hash_tree(tree),
+                internal::hash_render_options(options));
+            if (meshes.size()) {
+                cache_base_key = internal::hash_combine(
+                    cache_base_key, internal::hash_meshes(meshes));
+            }
+            // Pixels also differ between the backends, and with the color
+            // cache (shading at the view direction bin centers) by its
+            // resolution
+            const bool color_cache =
+                renderer.cpu() && args["color_cache_mb"].as<float>() > 0.f;
+            cache_base_key = internal::hash_combine(
+                cache_base_key, renderer.cpu() != nullptr);
+            cache_base_key = internal::hash_combine(
+                cache_base_key,
+                color_cache ? (uint64_t)args["color_cache_res"].as<int>() : 0);
+        }
+    }
 
-        launch_renderer(tree, camera, options, array, depth_arr, stream, true);
+    const bool need_host = out_dir.size() || cache || metrics;
+    renderer.set_readback(need_host);
+    std::vector<uint64_t> cache_keys(trans.size());
+    // Set up cam and opt for frame i and try the frame cache, loading into
+    // host. Returns false if the frame is fully cached; otherwise the tiles
+    // to render are in mask (empty = all)
+    auto begin_frame = [&](size_t i, Camera &cam, RenderOptions &opt,
+                           uint8_t *host, std::vector<uint8_t> &mask) {
+        const int width = sizes[i].x, height = sizes[i].y;
+        cam.width = width;
+        cam.height = height;
+        cam.transform = trans[i];
+        cam.fx = focals[i].x;
+        cam.fy = focals[i].y;
+        cam._update(false);
+        opt = options;
+        apply_frame_roi(rois[i], opt);
+        mask.clear();
+        if (!cache) return true;
 
+        cache_keys[i] = internal::hash_combine(cache_base_key,
+                                               internal::hash_camera(cam));
+        if (rois[i].z >= 0.f) {
+            cache_keys[i] = internal::hash_combine(
+                cache_keys[i], internal::hash_render_options(opt));
+        }
+        if (cache->load(cache_keys[i], options.render_bbox, width, height,
+                        host)) {
+            ++cache_hits;
+            return false;
+        }
+        float cached_bbox[6];
+        if (cache->load_nearest(cache_keys[i], options.render_bbox, width,
+                                height, host, cached_bbox)) {
+            // Only retrace tiles whose rays see the bbox change
+            int n_dirty = internal::bbox_dirty_tiles(
+                tree, cam, cached_bbox, options.render_bbox, CACHE_TILE_SIZE,
+                mask);
+            ++cache_partial;
+            tiles_retraced += n_dirty;
+            tiles_total += mask.size();
+        }
+        return true;
+    };
+    // Hand the finished frame i in host to the cache, metrics and output
+    auto end_frame = [&](size_t i, uint8_t *host, bool rendered) {
+        const int width = sizes[i].x, height = sizes[i].y;
+        if (cache && rendered) {
+            cache->store(cache_keys[i], options.render_bbox, width, height,
+                         host);
+        }
+        if (metrics) metrics->submit(i, host);
         if (out_dir.size()) {
-            cuda(Memcpy2DFromArrayAsync(buf.data(), 4 * width, array, 0, 0,
-                                        4 * width, height,
-                                        cudaMemcpyDeviceToHost, stream));
-            std::string fpath = out_dir + "/" + basenames[i] + ".png";
-            internal::write_png_file(fpath, buf.data(), width, height);
+            internal::write_png_file(out_dir + "/" + basenames[i] + ".png",
+                                     host, width, height);
         }
+    };
+
+    std::unique_ptr<internal::Reprojector> reprojector;
+    size_t pixels_retraced = 0, pixels_total = 0;
+    if (args["reproject"].as<float>() > 0.f) {
+        if (!renderer.cpu() || cache || use_roi) {
+            fputs("ERROR: --reproject needs the CPU renderer (--cpu) and "
+                  "cannot be combined with --cache or --roi\n",
+                  stderr);
+            return 1;
+        }
+        internal::ReprojectOptions reproject_options;
+        reproject_options.max_error = args["reproject"].as<float>();
+        reproject_options.max_angle =
+            args["reproject_max_angle"].as<float>() * (float)M_PI / 180.f;
+        reprojector =
+            std::make_unique<internal::Reprojector>(reproject_options);
+    }
+
+    const float progressive_ms = args["progressive"].as<float>();
+    if (progressive_ms > 0.f &&
+        (!renderer.cpu() || cache || reprojector || use_roi)) {
+        fputs("ERROR: --progressive needs the CPU renderer (--cpu) and "
+              "cannot be combined with --cache, --reproject or --roi\n",
+              stderr);
+        return 1;
     }
-    cudaEventRecord(stop);
-    cudaEventSynchronize(stop);
-    float milliseconds = 0;
-    cudaEventElapsedTime(&milliseconds, start, stop);
+
+    RenderOptions frame_options;
+    auto start = std::chrono::steady_clock::now();
+    if (progressive_ms > 0.f) {
+        CPURenderer *cpu = renderer.cpu();
+        for (size_t i = 0; i < trans.size(); ++i) {
+            uint8_t *host = renderer.host_buffer(sizes[i].x, sizes[i].y);
+            begin_frame(i, camera, frame_options, host, tile_mask);
+            cpu->render_progressive(
+                tree, camera, frame_options, host, progressive_ms,
+                [&](const uint8_t *rgba, float progress) {
+                    if (progress >= 1.f) return;
+                    printf("INFO: %s %.1f%% traced\n", basenames[i].c_str(),
+                           100.f * progress);
+                    if (out_dir.size()) {
+                        internal::write_png_file(
+                            out_dir + "/" + basenames[i] + ".png", rgba,
+                            camera.width, camera.height);
+                    }
+                },
+                CACHE_TILE_SIZE);
+            end_frame(i, host, true);
+        }
+    } else if (reprojector) {
+        // Sequential, since each frame starts from the previous one
+        CPURenderer *cpu = renderer.cpu();
+        std::vector<uint8_t> retrace;
+        std::vector<float> depth;
+        for (size_t i = 0; i < trans.size(); ++i) {
+            uint8_t *host = renderer.host_buffer(sizes[i].x, sizes[i].y);
+            begin_frame(i, camera, frame_options, host, tile_mask);
+            depth.resize((size_t)camera.width * camera.height);
+            pixels_retraced +=
+                reprojector->warp(camera, host, depth.data(), retrace);
+            pixels_total += depth.size();
+            cpu->render_pixels(tree, camera, frame_options, host,
+                               retrace.data(), depth.data(), CACHE_TILE_SIZE);
+            reprojector->update(camera, host, depth.data());
+            end_frame(i, host, true);
+        }
+    } else if (CPURenderer *cpu = renderer.cpu()) {
+        // Pipelined: tiles of the next frames are rendered while the
+        // previous ones are written out
+        cpu->render_batch(
+            tree, options, trans.size(),
+            args["frames_in_flight"].as<int>(),
+            [&](size_t i, BatchFrame &frame) {
+                frame.rgba.resize((size_t)4 * sizes[i].x * sizes[i].y);
+                frame.skip =
+                    !begin_frame(i, frame.camera, frame.options,
+                                 frame.rgba.data(), frame.tile_mask);
+            },
+            [&](size_t i, BatchFrame &frame) {
+                end_frame(i, frame.rgba.data(), !frame.skip);
+            },
+            CACHE_TILE_SIZE);
+    } else {
+        for (size_t i = 0; i < trans.size(); ++i) {
+            uint8_t *host = renderer.host_buffer(sizes[i].x, sizes[i].y);
+            const bool render =
+                begin_frame(i, camera, frame_options, host, tile_mask);
+            if (render) {
+                renderer.render(tree, camera, frame_options,
+                                tile_mask.empty() ? nullptr : &tile_mask);
+            }
+            end_frame(i, host, render);
+        }
+    }
+    renderer.synchronize();
+    float milliseconds = std::chrono::duration<float, std::milli>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
     milliseconds = milliseconds / trans.size();
 
     printf("%.10f ms per frame\n", milliseconds);
     printf("%.10f fps\n", 1000.f / milliseconds);
+    {
+        std::vector<std::pair<int, int>> distinct;
+        for (const glm::ivec2 &size : sizes) {
+            distinct.emplace_back(size.x, size.y);
+        }
+        std::sort(distinct.begin(), distinct.end());
+        distinct.erase(std::unique(distinct.begin(), distinct.end()),
+                       distinct.end());
+        if (distinct.size() > 1) {
+            printf("INFO: %zu distinct image sizes\n", distinct.size());
+        }
+    }
+    if (renderer.cpu() && args["color_cache_mb"].as<float>() > 0.f) {
+        uint64_t hits, misses;
+        renderer.cpu()->color_cache_stats(hits, misses);
+        printf("INFO: Color cache: %llu hits, %llu misses (%.1f%% reused)\n",
+               (unsigned long long)hits, (unsigned long long)misses,
+               100.0 * hits / std::max<uint64_t>(hits + misses, 1));
+    }
+    if (reprojector) {
+        printf("INFO: Reprojection: %zu/%zu pixels retraced (%.1f%%)\n",
+               pixels_retraced, pixels_total,
+               100.0 * pixels_retraced / std::max<size_t>(pixels_total, 1));
+    }
+    if (cache) {
+        printf("INFO: Frame cache: %d hits, %d partial (%zu/%zu tiles "
+               "retraced), %d misses\n",
+               cache_hits, cache_partial, tiles_retraced, tiles_total,
+               (int)trans.size() - cache_hits - cache_partial);
+    }
+    const bool metrics_ok =
+        !metrics || metrics->finish(args["metrics_csv"].as<std::string>());
 
-    cuda(FreeArray(array));
-    cuda(StreamDestroy(stream));
+    return metrics_ok ? 0 : 1;
 }
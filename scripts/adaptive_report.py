@@ -0,0 +1,132 @@
+"""
+This script measures quality vs speed of adaptive marching (--adaptive in
+volrend_headless) on synthetic trees, writing a markdown report.
+Each tree is rendered from orbits of poses using the headless sweep mode;
+quality is PSNR/SSIM against the non-adaptive render.
+The mode only engages where a pixel footprint spans more than a leaf cell, so
+besides the close orbit (radius 3, footprint under a leaf cell of the default
+depth 8 trees) there is a distant one (radius 12, about 1.4 cells at
+footprint 1). Farther orbits render a proportionally smaller image, so the
+trees fill the same part of it (as in a thumbnail or preview).
+
+Usage: python adaptive_report.py <path/to/volrend_headless> [--out adaptive_report.md]
+       [--trees a.npz b.npz ...] [--footprints 0,0.5,1,2,4] [--radii 3,12]
+       [--repeats 3] [--cpu]
+Without --trees, synthetic trees are generated with gen_synthetic_tree.py.
+"""
+import argparse
+import csv
+import os
+import os.path as osp
+import subprocess
+import sys
+import tempfile
+import numpy as np
+
+sys.path.append(osp.dirname(osp.abspath(__file__)))
+import gen_synthetic_tree
+
+
+def orbit_poses(n_poses, radius=3.0, elevation=0.4):
+    """c2w matrices (NeRF convention) on a circle looking at the origin"""
+    poses = []
+    for i in range(n_poses):
+        theta = 2 * np.pi * i / n_poses
+        pos = radius * np.array([np.cos(theta) * np.cos(elevation),
+                                 np.sin(theta) * np.cos(elevation),
+                                 np.sin(elevation)])
+        back = pos / np.linalg.norm(pos)
+        right = np.cross([0.0, 0.0, 1.0], back)
+        right /= np.linalg.norm(right)
+        up = np.cross(back, right)
+        c2w = np.eye(4, dtype=np.float32)
+        c2w[:3, 0], c2w[:3, 1], c2w[:3, 2], c2w[:3, 3] = right, up, back, pos
+        poses.append(c2w)
+    return np.stack(poses)
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('headless', help='path to volrend_headless')
+    parser.add_argument('--out', default='adaptive_report.md')
+    parser.add_argument('--trees', nargs='*', default=[])
+    parser.add_argument('--footprints', default='0,0.5,1,2,4')
+    parser.add_argument('--radii', default='3,12',
+                        help='orbit radii (world units; the trees span [-1, 1]^3)')
+    parser.add_argument('--n_poses', type=int, default=16)
+    parser.add_argument('--size', type=int, default=800,
+                        help='image size at the first radius')
+    parser.add_argument('--repeats', type=int, default=3,
+                        help='sweeps per tree; the fastest time is reported')
+    parser.add_argument('--cpu', action='store_true',
+                        help='render with the CPU renderer')
+    args = parser.parse_args()
+
+    work_dir = tempfile.mkdtemp(prefix='volrend_adaptive_')
+    trees = args.trees
+    if not trees:
+        for scene in ['spheres', 'shell', 'fog']:
+            path = osp.join(work_dir, scene + '.npz')
+            child, data, data_dim = gen_synthetic_tree.build_tree(scene, 8, 9)
+            np.savez(path, data_dim=np.int64(data_dim),
+                     data_format=np.array('SH9'), child=child, data=data,
+                     invradius=np.float64(0.5),
+                     offset=np.array([0.5, 0.5, 0.5], dtype=np.float32))
+            trees.append(path)
+
+    radii = [float(r) for r in args.radii.split(',')]
+    rows = []
+    for radius in radii:
+        poses_path = osp.join(work_dir, 'orbit_%g.npy' % radius)
+        np.save(poses_path, orbit_poses(args.n_poses, radius))
+        size = int(round(args.size * radii[0] / radius))
+        for tree in trees:
+            results = None
+            for rep in range(args.repeats):
+                csv_path = osp.join(work_dir, '%s_%g_%d.csv' %
+                                    (osp.basename(tree), radius, rep))
+                # -1 renders the non-adaptive baseline (also the quality
+                # reference)
+                cmd = [args.headless, tree, poses_path,
+                       '-w', str(size), '-h', str(size),
+                       '--sweep_adaptive_footprint=-1,' + args.footprints,
+                       '--sweep_csv', csv_path]
+                if args.cpu:
+                    cmd.append('--cpu')
+                print(' '.join(cmd))
+                subprocess.run(cmd, check=True)
+                with open(csv_path) as f:
+                    rep_results = list(csv.DictReader(f))
+                if results is None:
+                    results = rep_results
+                    continue
+                # Timing noise only slows runs down
+                for res, rep_res in zip(results, rep_results):
+                    res['ms_per_frame'] = min(float(res['ms_per_frame']),
+                                              float(rep_res['ms_per_frame']))
+            base_ms = float(results[0]['ms_per_frame'])
+            for res in results:
+                rows.append((osp.basename(tree), radius, size, res, base_ms))
+
+    with open(args.out, 'w') as f:
+        f.write('# Adaptive marching: quality vs speed\n\n')
+        f.write('%d orbit poses per radius on the %s renderer, fastest of %d '
+                'runs; PSNR/SSIM against the non-adaptive render of the same '
+                'tree.\n\n' % (args.n_poses, 'CPU' if args.cpu else 'default',
+                               args.repeats))
+        f.write('| tree | radius | size | footprint | ms/frame | speedup '
+                '| samples/ray | PSNR | SSIM |\n')
+        f.write('|---|---|---|---|---|---|---|---|---|\n')
+        for tree, radius, size, res, base_ms in rows:
+            footprint = float(res['adaptive_footprint'])
+            ms = float(res['ms_per_frame'])
+            f.write('| %s | %g | %d | %s | %.3f | %.2fx | %.1f | %s | %.4f |\n'
+                    % (tree, radius, size,
+                       'off' if footprint < 0 else '%g' % footprint, ms,
+                       base_ms / ms, float(res['samples_per_ray']),
+                       res['psnr'], float(res['ssim'])))
+    print('Wrote', args.out)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,62 @@
+"""
+This script adds neighbour ropes to a PlenOctree npz, so the renderers can
+step rays between leaves without descending from the root, without building
+them at load (see N3Tree::ropes_). For each cell and face (-x, +x, -y, +y,
+-z, +z) the rope is the index of the adjacent cell of the same size, or of
+the leaf covering it where the tree is coarser there; -1 at the boundary.
+
+Usage: python add_ropes.py <tree.npz> [--out tree_ropes.npz]
+"""
+import argparse
+import numpy as np
+
+
+def build_ropes(child):
+    """Ropes of shape (capacity, N, N, N, 6), built level by level"""
+    N = child.shape[1]
+    N3 = N ** 3
+    child_flat = child.reshape(-1).astype(np.int64)
+    ropes = np.full((child.shape[0], N3, 6), -1, dtype=np.int32)
+
+    idx = np.arange(N3)
+    ijk = np.stack([idx // (N * N), idx // N % N, idx % N], -1)
+    stride = np.array([N * N, N, 1])
+
+    nodes = np.zeros(1, dtype=np.int64)
+    parent_ropes = np.full((1, 6), -1, dtype=np.int64)
+    while nodes.size:
+        cells = nodes[:, None] * N3 + idx[None]
+        level = np.empty((nodes.size, N3, 6), dtype=np.int64)
+        for axis in range(3):
+            for side in range(2):
+                c = ijk[:, axis] + (1 if side else -1)
+                inside = (c >= 0) & (c < N)
+                rope = np.broadcast_to(
+                    parent_ropes[:, 2 * axis + side, None], cells.shape).copy()
+                # Same-size cell across the parent's face
+                inner = (rope >= 0) & (child_flat[np.maximum(rope, 0)] != 0)
+                wrapped = 0 if side else N - 1
+                sub_node = rope // N3 + child_flat[np.maximum(rope, 0)]
+                across = sub_node * N3 + idx + (wrapped - ijk[:, axis]) * stride[axis]
+                rope = np.where(inner, across, rope)
+                sibling = cells + (c - ijk[:, axis]) * stride[axis]
+                level[..., 2 * axis + side] = np.where(inside[None], sibling, rope)
+        ropes[nodes] = level
+        has_child = child_flat[cells] != 0
+        nodes = (nodes[:, None] + child_flat[cells])[has_child]
+        parent_ropes = level[has_child]
+    return ropes.reshape(child.shape + (6,))
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument('input', type=str, help='Input npz')
+    parser.add_argument('--out', type=str, default=None,
+                        help='Output npz (default: overwrite input)')
+    args = parser.parse_args()
+
+    z = dict(np.load(args.input))
+    z['ropes'] = build_ropes(z['child'])
+    out = args.out if args.out is not None else args.input
+    print('Saving', out, '(ropes', z['ropes'].nbytes / 2 ** 20, 'MB)')
+    np.savez(out, **z)
@@ -0,0 +1,127 @@
+"""
+This script generates synthetic PlenOctree npz files for benchmarking the
+renderers without a trained scene. Leaves are refined to full depth only near
+surfaces, as in a real PlenOctree; colors are spherical harmonics with some
+view dependence.
+
+Scenes:
+    spheres: a few solid spheres (dense surfaces, empty space around)
+    shell: thin hollow shell (rays cross many small dense cells)
+    fog: spheres inside low-density fog (many low-sigma cells)
+
+Usage: python gen_synthetic_tree.py <out.npz> [--scene spheres] [--depth 8] [--sh_dim 9]
+"""
+import argparse
+import numpy as np
+
+SH_C0 = 0.28209479177387814
+
+# (center, radius, rgb) in world coordinates; the tree spans [-1, 1]^3
+SPHERES = [
+    ((0.0, 0.0, 0.0), 0.45, (0.8, 0.3, 0.2)),
+    ((0.55, 0.3, 0.1), 0.25, (0.2, 0.7, 0.3)),
+    ((-0.4, -0.5, 0.3), 0.3, (0.2, 0.3, 0.9)),
+]
+
+
+def sphere_sdf(pts):
+    """Signed distance to the union of SPHERES and index of nearest sphere"""
+    dists = np.stack([np.linalg.norm(pts - np.array(c), axis=-1) - r
+                      for c, r, _ in SPHERES], -1)
+    return dists.min(-1), dists.argmin(-1)
+
+
+def scene_fields(scene, pts):
+    """Returns (sdf used for refinement, sigma, rgb) at world points"""
+    sdf, idx = sphere_sdf(pts)
+    rgb = np.array([col for _, _, col in SPHERES])[idx]
+    if scene == 'shell':
+        sdf = np.abs(np.linalg.norm(pts, axis=-1) - 0.7) - 0.02
+        rgb = 0.5 + 0.4 * np.sin(4.0 * pts)
+        sigma = np.where(sdf < 0, 200.0, 0.0)
+    else:
+        sigma = np.where(sdf < 0, 100.0, 0.0)
+        if scene == 'fog':
+            fog = 0.3 * (1.0 + np.sin(5.0 * pts[..., 0]) *
+                         np.cos(4.0 * pts[..., 1]) * np.sin(3.0 * pts[..., 2]))
+            sigma = np.maximum(sigma, fog)
+    return sdf, sigma, rgb
+
+
+def build_tree(scene, depth, sh_dim, seed=0):
+    rng = np.random.default_rng(seed)
+    offs = np.stack(np.meshgrid([0, 1], [0, 1], [0, 1], indexing='ij'),
+                    -1).reshape(8, 3).astype(np.float64)
+    data_dim = 3 * sh_dim + 1
+
+    origins = np.zeros((1, 3))  # In tree coordinates [0, 1]^3
+    size = 1.0
+    node_base = 0
+    n_nodes = 1
+    childs, datas = [], []
+    for d in range(depth):
+        M = origins.shape[0]
+        size *= 0.5
+        corners = origins[:, None, :] + offs[None] * size
+        centers = corners + 0.5 * size
+        world = centers * 2.0 - 1.0
+        sdf, sigma, rgb = scene_fields(scene, world)
+
+        # Refine cells which may contain the surface
+        half_diag = np.sqrt(3.0) * size
+        split = np.abs(sdf) < 2.0 * half_diag
+        if d + 1 == depth:
+            split[:] = False
+        node_ids = node_base + np.arange(M)
+        new_ids = n_nodes + np.arange(int(split.sum()))
+        child = np.zeros((M, 8), dtype=np.int32)
+        child[split] = new_ids - np.broadcast_to(node_ids[:, None],
+                                                 (M, 8))[split]
+
+        data = np.zeros((M, 8, data_dim), dtype=np.float32)
+        rgb = np.clip(rgb, 0.02, 0.98)
+        for c in range(3):
+            # Sigmoid output: DC term gives the base color
+            data[..., c * sh_dim] = np.log(rgb[..., c] / (1 - rgb[..., c])) / SH_C0
+            if sh_dim > 1:
+                data[..., c * sh_dim + 1:(c + 1) * sh_dim] = \
+                    0.3 * rng.standard_normal((M, 8, sh_dim - 1))
+        data[..., -1] = sigma
+
+        childs.append(child.reshape(M, 2, 2, 2))
+        datas.append(data.reshape(M, 2, 2, 2, data_dim))
+        origins = corners[split]
+        node_base = n_nodes
+        n_nodes += len(new_ids)
+        if origins.shape[0] == 0:
+            break
+
+    child = np.concatenate(childs, 0)
+    data = np.concatenate(datas, 0).astype(np.float16)
+    return child, data, data_dim
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('out', help='output npz path')
+    parser.add_argument('--scene', default='spheres',
+                        choices=['spheres', 'shell', 'fog'])
+    parser.add_argument('--depth', type=int, default=8,
+                        help='max tree depth (leaf resolution 2^depth)')
+    parser.add_argument('--sh_dim', type=int, default=9,
+                        choices=[1, 4, 9, 16, 25])
+    args = parser.parse_args()
+
+    child, data, data_dim = build_tree(args.scene, args.depth, args.sh_dim)
+    print('Generated', args.scene, 'tree with', child.shape[0], 'nodes')
+    np.savez(args.out,
+             data_dim=np.int64(data_dim),
+             data_format=np.array('SH' + str(args.sh_dim)),
+             child=child,
+             data=data,
+             invradius=np.float64(0.5),
+             offset=np.array([0.5, 0.5, 0.5], dtype=np.float32))
+
+
+if __name__ == '__main__':
+    main()
@@ -8,8 +8,13 @@ precision highp int;
 #define FORMAT_SG 2
 #define FORMAT_ASG 3
 
-// The output color
-out vec4 FragColor;
+// The output color, and distance from the camera at which the remaining
+// light first drops below half (else the mesh depth), for upsampling
+layout(location = 0) out vec4 FragColor;
+layout(location = 1) out float Depth;
+// For reprojection: the world origin the pixel was traced from and its
+// resampling error so far (0 when traced)
+layout(location = 2) out vec4 Info;
 
 // Computer vision style camera
 struct Camera {
@@ -65,6 +70,30 @@ uniform mediump sampler2D tree_data_tex;
 uniform mediump sampler2D mesh_depth_tex;
 uniform mediump sampler2D mesh_color_tex;
 
+// Progressive rendering: only pixels of passes [prog_begin, prog_end) are
+// traced, in the order of internal/progressive.hpp
+#define PROGRESSIVE_BLOCK 8
+uniform int prog_begin;
+uniform int prog_end;
+
+// Region of interest (internal/foveation.hpp): center in window pixels and
+// radius (< 0 = none); outside it only passes < roi_passes are traced, with
+// step size scaled by roi_step_scale
+uniform vec3 roi;
+uniform int roi_passes;
+uniform float roi_step_scale;
+
+// Reprojection (RenderOptions::reproject): the previous frame warped into
+// this view by ReprojectSplat (dynamic_res.cpp). Its pixels are reused
+// rather than traced unless holes, over reproj_max_error pixels of error,
+// or farther than their nearest neighbour (background showing through
+// gaps of a nearer surface); reproj_max_error < 0 = trace all
+#define REPROJ_DEPTH_TOL 0.05
+uniform float reproj_max_error;
+uniform mediump sampler2D reproj_color_tex;
+uniform highp sampler2D reproj_depth_tex;
+uniform highp sampler2D reproj_info_tex;
+
 // Hacky ways to store octree in 2 textures
 float get_tree_data(int y, int x) {
     return texelFetch(tree_data_tex, ivec2(x, y), 0).r;
@@ -219,7 +248,8 @@ float _get_delta_scale(vec3 scaling, inout vec3 dir) {
     return delta_scale;
 }
 
-vec3 trace_ray(vec3 dir, vec3 vdir, vec3 cen, float tmax_bg, vec3 bg_color) {
+vec3 trace_ray(vec3 dir, vec3 vdir, vec3 cen, float tmax_bg, vec3 bg_color,
+               float step_size, inout float depth) {
     float delta_scale = _get_delta_scale(tree.scale, dir);
     vec3 output_color;
     vec3 invdir = 1.f / (dir + 1e-9);
@@ -258,7 +288,7 @@ vec3 trace_ray(vec3 dir, vec3 vdir, vec3 cen, float tmax_bg, vec3 bg_color) {
             int tree_y = doffset / tree_data_dim;
             int tree_x = doffset % tree_data_dim;
 
-            float delta_t = t_subcube + opt.step_size;
+            float delta_t = t_subcube + step_size;
             float sigma = get_tree_data(tree_y, tree_x + tree.data_dim - 1);
             if (sigma > opt.sigma_thresh) {
                 float att = min(exp(-delta_t * delta_scale * sigma), 1.f);
@@ -310,6 +340,9 @@ vec3 trace_ray(vec3 dir, vec3 vdir, vec3 cen, float tmax_bg, vec3 bg_color) {
                     }
                 }
 
+                if (light_intensity >= 0.5f && light_intensity * att < 0.5f) {
+                    depth = t * delta_scale;
+                }
                 light_intensity *= att;
                 if (light_intensity < opt.stop_thresh) {
                     // Almost full opacity, stop
@@ -342,8 +375,47 @@ void world2ndc(inout vec3 dir, inout vec3 cen, float near) {
     dir = normalize(dir);
 }
 
+int progressive_rank(ivec2 offset) {
+    int rank = 0;
+    for (int b = 0; b < 3; ++b) {
+        rank |= ((offset.x >> (2 - b)) & 1) << (2 * b + 1);
+        rank |= ((offset.y >> (2 - b)) & 1) << (2 * b);
+    }
+    return rank;
+}
+
+bool reproj_reuse(ivec2 pt) {
+    if (texelFetch(reproj_color_tex, pt, 0).a == 0.0 ||
+        texelFetch(reproj_info_tex, pt, 0).w > reproj_max_error) {
+        return false;
+    }
+    float depth = texelFetch(reproj_depth_tex, pt, 0).r;
+    float nearest = depth;
+    ivec2 hi = textureSize(reproj_depth_tex, 0) - 1;
+    for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+            ivec2 q = clamp(pt + ivec2(dx, dy), ivec2(0), hi);
+            nearest = min(nearest, texelFetch(reproj_depth_tex, q, 0).r);
+        }
+    }
+    return depth <= (1.0 + REPROJ_DEPTH_TOL) * nearest;
+}
+
 void main()
 {
+    bool outside = roi.z >= 0.0 && distance(gl_FragCoord.xy, roi.xy) > roi.z;
+    int rank = progressive_rank(ivec2(gl_FragCoord.xy) % PROGRESSIVE_BLOCK);
+    if (rank < prog_begin || rank >= (outside ? min(prog_end, roi_passes)
+                                              : prog_end)) discard;
+    ivec2 screen_pt = ivec2(gl_FragCoord.x, gl_FragCoord.y);
+    if (reproj_max_error >= 0.0 && reproj_reuse(screen_pt)) {
+        // The warp targets can't also be drawn to, so copy
+        FragColor = texelFetch(reproj_color_tex, screen_pt, 0);
+        Depth = texelFetch(reproj_depth_tex, screen_pt, 0).r;
+        Info = texelFetch(reproj_info_tex, screen_pt, 0);
+        return;
+    }
+
     vec2 xy = (vec2(gl_FragCoord) - 0.5 * cam.reso + vec2(-0.5, 0.5)) / cam.focal;
     vec3 dir = normalize(vec3(xy, -1.0));
     dir = normalize(mat3(cam.transform) * dir);
@@ -358,12 +430,15 @@ void main()
     rodrigues(opt.rot_dirs, vdir);
 
     // Get depth of drawn meshes
-    ivec2 screen_pt = ivec2(gl_FragCoord.x, gl_FragCoord.y);
     float tmax_bg = texelFetch(mesh_depth_tex, screen_pt, 0).r;
     vec4 mesh_color = texelFetch(mesh_color_tex, screen_pt, 0);
     vec3 bg_color = vec3(mesh_color);
 
-    rgb = trace_ray(dir, vdir, cen, tmax_bg, bg_color);
+    float depth = tmax_bg;
+    float step_size = outside ? opt.step_size * roi_step_scale : opt.step_size;
+    rgb = trace_ray(dir, vdir, cen, tmax_bg, bg_color, step_size, depth);
     rgb = clamp(rgb, 0.0, 1.0);
     FragColor = vec4(rgb, 1.0);
+    Depth = depth;
+    Info = vec4(cam.transform[3], 0.0);
 }
@@ -0,0 +1,1449 @@
+#include "volrend/cpu_renderer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+#include "glm/gtc/type_ptr.hpp"
+#include "volrend/internal/lumisphere.hpp"
+#include "volrend/internal/foveation.hpp"
+#include "volrend/internal/leaf_color_cache.hpp"
+#include "volrend/internal/mesh_raster.hpp"
+#include "volrend/internal/morton.hpp"
+#include "volrend/internal/numa.hpp"
+#include "volrend/internal/progressive.hpp"
+#include "volrend/internal/tile_scheduler.hpp"
+
+namespace volrend {
+namespace {
+
+float half_to_float(uint16_t h) {
+#ifdef __F16C__
+    return _cvtsh_ss(h);
+#else
+    // Shift into a float and rescale the exponent bias, which also
+    // normalizes subnormals; then restore inf/nan and sign
+    uint32_t bits = (uint32_t)(h & 0x7fff) << 13;
+    float f;
+    memcpy(&f, &bits, 4);
+    f *= 5.192296858534828e+33f;  // 2^(127 - 15)
+    memcpy(&bits, &f, 4);
+    if ((h & 0x7c00) == 0x7c00) bits |= 0x7f800000u;
+    bits |= (uint32_t)(h & 0x8000) << 16;
+    memcpy(&f, &bits, 4);
+    return f;
+#endif
+}
+
+// Host counterpart of internal::TreeSpec, on the tree's CPU data
+struct HostTreeSpec {
+    const uint16_t* data;
+    const int32_t* child;
+    const float* offset;
+    const float* scale;
+    const float* extra;
+    // Neighbour ropes and node positions, or nullptr (see N3Tree::ropes_)
+    const int32_t* ropes;
+    const int32_t* node_pos;
+    int N;
+    int N3;
+    int data_dim;
+    DataFormat data_format;
+    float ndc_width;
+    float ndc_height;
+    float ndc_focal;
+
+    explicit HostTreeSpec(const N3Tree& tree)
+        : data(tree.data_.data<uint16_t>()),
+          child(tree.child_.data<int32_t>()),
+          offset(tree.offset.data()),
+          scale(tree.scale.data()),
+          extra(tree.extra_.data_holder.empty() ? nullptr
+                                                : tree.extra_.data<float>()),
+          ropes(tree.has_ropes() ? tree.ropes_.data<int32_t>() : nullptr),
+          node_pos(tree.has_ropes() ? tree.node_pos_.data() : nullptr),
+          N(tree.N),
+          N3(tree.N * tree.N * tree.N),
+          data_dim(tree.data_dim),
+          data_format(tree.data_format),
+          ndc_width(tree.use_ndc ? tree.ndc_width : -1),
+          ndc_height(tree.ndc_height),
+          ndc_focal(tree.ndc_focal) {}
+};
+
+#ifdef VOLREND_CUDA
+bool render_depth(const RenderOptions& opt) { return opt.render_depth; }
+#else
+// The option only exists in CUDA builds
+bool render_depth(const RenderOptions&) { return false; }
+#endif
+
+float dot3(const float* u, const float* v) {
+    return u[0] * v[0] + u[1] * v[1] + u[2] * v[2];
+}
+
+void normalize3(float* v) {
+    const float inv_norm = 1.f / std::sqrt(dot3(v, v));
+    v[0] *= inv_norm;
+    v[1] *= inv_norm;
+    v[2] *= inv_norm;
+}
+
+// Find the leaf containing xyz (tree coordinates, modified);
+// see internal::query_single_from_root
+const uint16_t* query_leaf(const HostTreeSpec& tree, float* xyz,
+                           float* cube_sz) {
+    const float fN = tree.N;
+    for (int i = 0; i < 3; ++i) {
+        xyz[i] = std::max(std::min(xyz[i], 1.f - 1e-6f), 0.f);
+    }
+    int64_t ptr = 0;
+    *cube_sz = fN;
+    while (true) {
+        float index = 0.f;
+        for (int i = 0; i < 3; ++i) {
+            xyz[i] *= fN;
+            const float idx_dimi = std::floor(xyz[i]);
+            index = index * fN + idx_dimi;
+            xyz[i] -= idx_dimi;
+        }
+        const int64_t sub_ptr = ptr + (int32_t)index;
+        const int64_t skip = tree.child[sub_ptr];
+        if (skip == 0) return tree.data + sub_ptr * tree.data_dim;
+        *cube_sz *= fN;
+        ptr += skip * tree.N3;
+    }
+}
+
+// Leaf containing xyz as query_leaf, starting from cell rather than the
+// root, or nullptr if xyz is not in cell
+const uint16_t* query_from_cell(const HostTreeSpec& tree, int64_t cell,
+                                float* xyz, float* cube_sz) {
+    const float fN = tree.N;
+    const int N = tree.N;
+    const int idx = (int)(cell % tree.N3);
+    const int ijk[3] = {idx / (N * N), idx / N % N, idx % N};
+    const int32_t* pos = tree.node_pos + (cell / tree.N3) * 4;
+    const float res = (float)pos[3];
+    float local[3];
+    for (int i = 0; i < 3; ++i) {
+        const float x = std::max(std::min(xyz[i], 1.f - 1e-6f), 0.f) * res;
+        const float idx_dimi = std::floor(x);
+        if (idx_dimi != (float)(pos[i] + ijk[i])) return nullptr;
+        local[i] = x - idx_dimi;
+    }
+    for (int i = 0; i < 3; ++i) xyz[i] = local[i];
+    *cube_sz = res;
+    int64_t sub_ptr = cell;
+    while (true) {
+        const int64_t skip = tree.child[sub_ptr];
+        if (skip == 0) return tree.data + sub_ptr * tree.data_dim;
+        *cube_sz *= fN;
+        const int64_t ptr = sub_ptr - sub_ptr % tree.N3 + skip * tree.N3;
+        float index = 0.f;
+        for (int i = 0; i < 3; ++i) {
+            xyz[i] *= fN;
+            const float idx_dimi = std::floor(xyz[i]);
+            index = index * fN + idx_dimi;
+            xyz[i] -= idx_dimi;
+        }
+        sub_ptr = ptr + (int32_t)index;
+    }
+}
+
+// Tree nodes (down to MAX_DEPTH) that the primary rays of one image tile
+// can reach, listed depth first with children ordered front to back for
+// the rays' direction octant. Every ray then meets its nodes in list order,
+// so each sample finds its leaf by scanning forward from the previous
+// sample's node, jumping over subtrees not containing it, instead of
+// descending from the root. Only for N = 2, where cell lookups are exact in
+// float, so results match query_leaf bit for bit
+struct Beam {
+    struct Node {
+        // Node bounds; as cells are powers of 2 in size, lo <= xyz < hi
+        // exactly when floor(xyz * res) is the node's cell
+        float lo[3], hi[3];
+        // Cells per side at the node's depth
+        float res;
+        // Index just past the node's subtree
+        uint32_t skip;
+        // Leaf data, nullptr for inner nodes
+        const uint16_t* leaf;
+        // For inner nodes at MAX_DEPTH, the offset of the children, which
+        // are not listed; queries descend from here as in query_leaf
+        int64_t child;
+    };
+
+    // Give up on tiles seeing more nodes than this (grazing views)
+    static const size_t MAX_NODES = 1 << 16;
+    // Depth of the deepest nodes listed. Deeper subtrees mostly lie within
+    // a handful of pixels and cost more to gather than to descend
+    static const int MAX_DEPTH = 4;
+
+    // Gather the nodes in the pyramid with apex origin spanned by the 4
+    // corner directions (in order around the tile; tree coordinates),
+    // clipped to render_bbox. Leaves the beam inactive if the rays'
+    // direction signs differ or it is too large
+    void build(const HostTreeSpec& tree, const float* origin,
+               const float (*corners)[3], const float* render_bbox) {
+        nodes.clear();
+        active = false;
+        if (tree.N != 2 || tree.ndc_width > 0) return;
+        float center[3] = {0.f, 0.f, 0.f};
+        for (int i = 0; i < 3; ++i) {
+            bool pos = false, neg = false;
+            for (int c = 0; c < 4; ++c) {
+                pos |= corners[c][i] > 0.f;
+                neg |= corners[c][i] < 0.f;
+                center[i] += corners[c][i];
+            }
+            if (pos && neg) return;
+            reverse[i] = neg;
+            origin_[i] = origin[i];
+            bbox[i] = render_bbox[i];
+            bbox[i + 3] = render_bbox[i + 3];
+        }
+        // Side planes, normals pointing inwards, then the camera plane
+        for (int k = 0; k < 4; ++k) {
+            const float* a = corners[k];
+            const float* b = corners[(k + 1) % 4];
+            float* n = planes[k];
+            n[0] = a[1] * b[2] - a[2] * b[1];
+            n[1] = a[2] * b[0] - a[0] * b[2];
+            n[2] = a[0] * b[1] - a[1] * b[0];
+            if (dot3(n, center) < 0.f) {
+                for (int i = 0; i < 3; ++i) n[i] = -n[i];
+            }
+        }
+        for (int i = 0; i < 3; ++i) planes[4][i] = center[i];
+        for (int k = 0; k < 5; ++k) {
+            margins[k] = 1e-5f * std::sqrt(dot3(planes[k], planes[k]));
+        }
+        const float root[3] = {0.f, 0.f, 0.f};
+        active = add_children(tree, 0, root, 2.f, 1);
+    }
+
+    // Leaf containing xyz, modifying xyz and setting cube_sz exactly like
+    // query_leaf. cursor is the list position, 0 at the start of the ray
+    const uint16_t* query(const HostTreeSpec& tree, float* xyz,
+                          float* cube_sz, uint32_t* cursor) const {
+        for (int i = 0; i < 3; ++i) {
+            xyz[i] = std::max(std::min(xyz[i], 1.f - 1e-6f), 0.f);
+        }
+        uint32_t k = *cursor;
+        while (k < nodes.size()) {
+            const Node& node = nodes[k];
+            const bool inside =
+                (xyz[0] >= node.lo[0]) & (xyz[0] < node.hi[0]) &
+                (xyz[1] >= node.lo[1]) & (xyz[1] < node.hi[1]) &
+                (xyz[2] >= node.lo[2]) & (xyz[2] < node.hi[2]);
+            if (!inside) {
+                k = node.skip;
+            } else if (node.leaf == nullptr && node.child == 0) {
+                ++k;
+            } else {
+                *cursor = k;
+                for (int i = 0; i < 3; ++i) {
+                    // Same as query_leaf, as scaling by res is exact
+                    const float cell = xyz[i] * node.res;
+                    xyz[i] = cell - std::floor(cell);
+                }
+                *cube_sz = node.res;
+                if (node.leaf != nullptr) return node.leaf;
+                int64_t ptr = node.child;
+                while (true) {
+                    int32_t index = 0;
+                    for (int i = 0; i < 3; ++i) {
+                        xyz[i] *= 2.f;
+                        const float idx_dimi = std::floor(xyz[i]);
+                        index = index * 2 + (int32_t)idx_dimi;
+                        xyz[i] -= idx_dimi;
+                    }
+                    const int64_t sub_ptr = ptr + index;
+                    const int64_t skip = tree.child[sub_ptr];
+                    *cube_sz *= 2.f;
+                    if (skip == 0) return tree.data + sub_ptr * tree.data_dim;
+                    ptr += skip * tree.N3;
+                }
+            }
+        }
+        // Outside the beam (only by rounding); stay on the slow path
+        *cursor = k;
+        return query_leaf(tree, xyz, cube_sz);
+    }
+
+    std::vector<Node> nodes;
+    bool active = false;
+
+   private:
+    // Append the children of the node with cells starting at ptr, whose
+    // lowest child cell is base at resolution res and given depth; false if
+    // too many
+    bool add_children(const HostTreeSpec& tree, int64_t ptr,
+                      const float* base, float res, int depth) {
+        for (int a = 0; a < 2; ++a) {
+            for (int b = 0; b < 2; ++b) {
+                for (int c = 0; c < 2; ++c) {
+                    const int ix = reverse[0] ? 1 - a : a,
+                              iy = reverse[1] ? 1 - b : b,
+                              iz = reverse[2] ? 1 - c : c;
+                    const float ijk[3] = {base[0] + ix, base[1] + iy,
+                                          base[2] + iz};
+                    if (!overlaps(ijk, res)) continue;
+                    if (nodes.size() >= MAX_NODES) return false;
+                    const int64_t sub_ptr = ptr + ix * 4 + iy * 2 + iz;
+                    const int64_t skip = tree.child[sub_ptr];
+                    const bool expand = skip && depth < MAX_DEPTH;
+                    const size_t index = nodes.size();
+                    nodes.push_back(
+                        {{ijk[0] / res, ijk[1] / res, ijk[2] / res},
+                         {(ijk[0] + 1.f) / res, (ijk[1] + 1.f) / res,
+                          (ijk[2] + 1.f) / res},
+                         res,
+                         0,
+                         skip ? nullptr : tree.data + sub_ptr * tree.data_dim,
+                         expand ? 0 : ptr + skip * tree.N3});
+                    if (expand) {
+                        const float child_base[3] = {2.f * ijk[0], 2.f * ijk[1],
+                                                     2.f * ijk[2]};
+                        if (!add_children(tree, ptr + skip * tree.N3,
+                                          child_base, 2.f * res, depth + 1)) {
+                            return false;
+                        }
+                    }
+                    nodes[index].skip = (uint32_t)nodes.size();
+                }
+            }
+        }
+        return true;
+    }
+
+    // Conservatively, whether cell ijk at resolution res meets the beam
+    bool overlaps(const float* ijk, float res) const {
+        float lo[3], hi[3];
+        for (int i = 0; i < 3; ++i) {
+            lo[i] = ijk[i] / res;
+            hi[i] = (ijk[i] + 1.f) / res;
+            if (lo[i] > bbox[i + 3] || hi[i] < bbox[i]) return false;
+        }
+        for (int k = 0; k < 5; ++k) {
+            // Corner furthest along the plane normal
+            float dist = 0.f;
+            for (int i = 0; i < 3; ++i) {
+                dist += planes[k][i] *
+                        ((planes[k][i] > 0.f ? hi[i] : lo[i]) - origin_[i]);
+            }
+            if (dist < -margins[k]) return false;
+        }
+        return true;
+    }
+
+    bool reverse[3];
+    float origin_[3];
+    float bbox[6];
+    float planes[5][3];
+    float margins[5];
+};
+
+// Restart trail of one ray: the deepest cells of the previous lookup's path
+// and their bounds. Successive samples mostly stay within a near ancestor,
+// so lookups restart from the deepest cached cell still containing the
+// sample instead of the root. Fixed size whatever the depth, and no
+// per-tree memory unlike ropes. Exact for N = 2 as Beam
+struct ShortStack {
+    static const int SIZE = 4;
+
+    // Leaf containing xyz, modifying xyz and setting cube_sz exactly like
+    // query_leaf
+    const uint16_t* query(const HostTreeSpec& tree, float* xyz,
+                          float* cube_sz) {
+        const float fN = tree.N;
+        for (int i = 0; i < 3; ++i) {
+            xyz[i] = std::max(std::min(xyz[i], 1.f - 1e-6f), 0.f);
+        }
+        // Deepest cached cell containing xyz
+        float local[3];
+        while (depth > base) {
+            const Entry& entry = entries[(depth - 1) % SIZE];
+            bool inside = true;
+            for (int i = 0; i < 3; ++i) {
+                const float cell = xyz[i] * entry.res;
+                const float idx_dimi = std::floor(cell);
+                inside &= idx_dimi == entry.ijk[i];
+                local[i] = cell - idx_dimi;
+            }
+            if (inside) break;
+            --depth;
+        }
+        int64_t ptr = 0;
+        float res = 1.f, ijk[3] = {0.f, 0.f, 0.f};
+        if (depth > base) {
+            const Entry& entry = entries[(depth - 1) % SIZE];
+            for (int i = 0; i < 3; ++i) xyz[i] = local[i];
+            const int64_t skip = tree.child[entry.cell];
+            if (skip == 0) {
+                *cube_sz = entry.res;
+                return tree.data + entry.cell * tree.data_dim;
+            }
+            ptr = entry.cell - entry.cell % tree.N3 + skip * tree.N3;
+            res = entry.res;
+            for (int i = 0; i < 3; ++i) ijk[i] = entry.ijk[i];
+        } else {
+            depth = base = 0;
+        }
+        while (true) {
+            float index = 0.f;
+            for (int i = 0; i < 3; ++i) {
+                xyz[i] *= fN;
+                const float idx_dimi = std::floor(xyz[i]);
+                index = index * fN + idx_dimi;
+                xyz[i] -= idx_dimi;
+                ijk[i] = ijk[i] * fN + idx_dimi;
+            }
+            res *= fN;
+            const int64_t sub_ptr = ptr + (int32_t)index;
+            Entry& entry = entries[depth % SIZE];
+            entry.cell = sub_ptr;
+            entry.res = res;
+            for (int i = 0; i < 3; ++i) entry.ijk[i] = ijk[i];
+            ++depth;
+            base = std::max(base, depth - SIZE);
+            const int64_t skip = tree.child[sub_ptr];
+            if (skip == 0) {
+                *cube_sz = res;
+                return tree.data + sub_ptr * tree.data_dim;
+            }
+            ptr += skip * tree.N3;
+        }
+    }
+
+   private:
+    struct Entry {
+        int64_t cell;
+        // Cells per side at the cell's depth, and its integer coords there
+        float res;
+        float ijk[3];
+    };
+    // Ring buffer of the path's cells at depths [base, depth)
+    Entry entries[SIZE];
+    int depth = 0, base = 0;
+};
+
+void dda_world(const float* cen, const float* invdir, float* tmin,
+               float* tmax, const float* render_bbox) {
+    *tmin = 0.f;
+    *tmax = 1e4f;
+    for (int i = 0; i < 3; ++i) {
+        const float t1 = (render_bbox[i] + 1e-6f - cen[i]) * invdir[i];
+        const float t2 = (render_bbox[i + 3] - 1e-6f - cen[i]) * invdir[i];
+        *tmin = std::max(*tmin, std::min(t1, t2));
+        *tmax = std::min(*tmax, std::max(t1, t2));
+    }
+}
+
+// Also sets face to the exit face (2 * axis + 1 if leaving on the positive
+// side), for following ropes
+float dda_unit(const float* cen, const float* invdir, int* face) {
+    float tmax = 1e4f;
+    for (int i = 0; i < 3; ++i) {
+        const float t1 = -cen[i] * invdir[i];
+        const float t2 = t1 + invdir[i];
+        const float t = std::max(t1, t2);
+        if (t < tmax) {
+            tmax = t;
+            *face = 2 * i + (invdir[i] > 0.f);
+        }
+    }
+    return tmax;
+}
+
+void maybe_world2ndc(const HostTreeSpec& tree, float* dir, float* cen) {
+    if (tree.ndc_width <= 0) return;
+    const float t = -(1.f + cen[2]) / dir[2];
+    for (int i = 0; i < 3; ++i) cen[i] = cen[i] + t * dir[i];
+
+    dir[0] = -((2 * tree.ndc_focal) / tree.ndc_width) *
+             (dir[0] / dir[2] - cen[0] / cen[2]);
+    dir[1] = -((2 * tree.ndc_focal) / tree.ndc_height) *
+             (dir[1] / dir[2] - cen[1] / cen[2]);
+    dir[2] = -2 / cen[2];
+
+    cen[0] = -((2 * tree.ndc_focal) / tree.ndc_width) * (cen[0] / cen[2]);
+    cen[1] = -((2 * tree.ndc_focal) / tree.ndc_height) * (cen[1] / cen[2]);
+    cen[2] = 1 + 2 / cen[2];
+
+    normalize3(dir);
+}
+
+// Inverse of the position mapping of maybe_world2ndc
+void ndc2world(const HostTreeSpec& tree, float* pos) {
+    const float z = 2.f / (pos[2] - 1.f);
+    pos[0] = -pos[0] * tree.ndc_width * z / (2 * tree.ndc_focal);
+    pos[1] = -pos[1] * tree.ndc_height * z / (2 * tree.ndc_focal);
+    pos[2] = z;
+}
+
+void rodrigues(const float* aa, float* dir) {
+    const float angle = std::sqrt(dot3(aa, aa));
+    if (angle < 1e-6f) return;
+    float k[3];
+    for (int i = 0; i < 3; ++i) k[i] = aa[i] / angle;
+    const float cos_angle = std::cos(angle), sin_angle = std::sin(angle);
+    const float cross[3] = {k[1] * dir[2] - k[2] * dir[1],
+                            k[2] * dir[0] - k[0] * dir[2],
+                            k[0] * dir[1] - k[1] * dir[0]};
+    const float dot = dot3(k, dir);
+    for (int i = 0; i < 3; ++i) {
+        dir[i] = dir[i] * cos_angle + cross[i] * sin_angle +
+                 k[i] * dot * (1.f - cos_angle);
+    }
+}
+
+// Per-thread counters, padded against false sharing
+struct alignas(64) ThreadStats {
+    uint64_t samples = 0, cache_hits = 0, cache_misses = 0;
+};
+
+// Evaluates sample colors along one ray: at the exact view direction, or
+// through the leaf color cache at the direction's bin center. The basis
+// functions are only computed if some sample actually needs them
+struct RayShader {
+    RayShader(const HostTreeSpec& tree, const RenderOptions& opt,
+              const float* vdir, internal::LeafColorCache* cache,
+              ThreadStats& stats)
+        : tree(tree), opt(opt), vdir(vdir), cache(cache), stats(stats) {
+        if (cache != nullptr) bin = cache->dir_bin(vdir);
+    }
+
+    void shade(const uint16_t* val, float* rgb) {
+        if (tree.data_format.basis_dim < 0) {
+            for (int j = 0; j < 3; ++j) rgb[j] = half_to_float(val[j]);
+            return;
+        }
+        if (cache == nullptr) {
+            if (!basis_ready) precalc(vdir);
+            eval(val, rgb);
+            return;
+        }
+        uint8_t rgb8[3];
+        const uint64_t leaf = (val - tree.data) / tree.data_dim;
+        if (cache->lookup(leaf, bin, rgb8)) {
+            ++stats.cache_hits;
+        } else {
+            ++stats.cache_misses;
+            if (!basis_ready) {
+                float bin_dir[3];
+                cache->bin_dir(bin, bin_dir);
+                precalc(bin_dir);
+            }
+            eval(val, rgb);
+            for (int j = 0; j < 3; ++j) {
+                rgb8[j] = (uint8_t)(rgb[j] * 255.f + 0.5f);
+            }
+            cache->insert(leaf, bin, rgb8);
+        }
+        for (int j = 0; j < 3; ++j) rgb[j] = rgb8[j] * (1.f / 255.f);
+    }
+
+    void precalc(const float* dir) {
+        internal::precalc_basis(tree.data_format, tree.extra, dir, basis_fn);
+        for (int i = 0; i < opt.basis_minmax[0]; ++i) basis_fn[i] = 0.f;
+        for (int i = opt.basis_minmax[1] + 1; i < VOLREND_GLOBAL_BASIS_MAX;
+             ++i) {
+            basis_fn[i] = 0.f;
+        }
+        basis_ready = true;
+    }
+
+    // Sigmoid of the basis-weighted coefficient sums
+    void eval(const uint16_t* val, float* rgb) const {
+        const int basis_dim = tree.data_format.basis_dim;
+        for (int t = 0; t < 3; ++t) {
+            const uint16_t* coeffs = val + t * basis_dim;
+            float tmp = 0.f;
+            for (int i = 0; i < basis_dim; ++i) {
+                tmp += basis_fn[i] * half_to_float(coeffs[i]);
+            }
+            rgb[t] = 1.f / (1.f + std::exp(-tmp));
+        }
+    }
+
+    const HostTreeSpec& tree;
+    const RenderOptions& opt;
+    const float* vdir;
+    internal::LeafColorCache* cache;
+    ThreadStats& stats;
+    uint32_t bin = 0;
+    bool basis_ready = false;
+    float basis_fn[VOLREND_GLOBAL_BASIS_MAX];
+};
+
+// Host port of device::trace_ray (cuda/rt_core.cuh); keep the two in sync.
+// Returns the number of tree samples taken. If beam is given (active, and
+// containing the ray), leaves are looked up in it. The ray stops at world
+// distance tmax_bg (the nearest mesh). If depth is given, it is set to the
+// distance at which the remaining light first drops below half (left
+// unchanged if it never does)
+int trace_ray(const HostTreeSpec& tree, float* dir, const float* cen,
+              const RenderOptions& opt, float pixel_angle, RayShader& shader,
+              const Beam* beam, bool short_stack, float tmax_bg, float* out,
+              float* depth_out = nullptr) {
+    const bool depth = render_depth(opt);
+    // See _get_delta_scale
+    for (int i = 0; i < 3; ++i) dir[i] *= tree.scale[i];
+    const float delta_scale = 1.f / std::sqrt(dot3(dir, dir));
+    for (int i = 0; i < 3; ++i) dir[i] *= delta_scale;
+
+    float tmin, tmax;
+    float invdir[3];
+    for (int i = 0; i < 3; ++i) invdir[i] = 1.f / (dir[i] + 1e-9f);
+    dda_world(cen, invdir, &tmin, &tmax, opt.render_bbox);
+    tmax = std::min(tmax, tmax_bg / delta_scale);
+
+    if (tmax < 0 || tmin > tmax) {
+        // Ray doesn't hit box
+        if (depth) out[3] = 1.f;
+        return 0;
+    }
+
+    float pos[3], rgb[3];
+    float light_intensity = 1.f;
+    float t = tmin;
+    float cube_sz;
+    int n_samples = 0;
+    const float min_step_per_t =
+        opt.adaptive ? opt.adaptive_footprint * pixel_angle : 0.f;
+    float skipped_weight = 0.f;
+    uint32_t beam_cursor = 0;
+    ShortStack stack;
+    // Leaf cell of the previous sample and the face the ray left it by
+    int64_t cell = -1;
+    int face = 0;
+    while (t < tmax) {
+        ++n_samples;
+        for (int i = 0; i < 3; ++i) pos[i] = cen[i] + t * dir[i];
+
+        const uint16_t* tree_val = nullptr;
+        if (cell >= 0) {
+            // The next leaf is usually across the exit face; corners and
+            // steps past small neighbours fall back to the lookups below
+            const int32_t rope = tree.ropes[cell * 6 + face];
+            if (rope >= 0) {
+                tree_val = query_from_cell(tree, rope, pos, &cube_sz);
+            }
+        }
+        if (tree_val == nullptr) {
+            if (short_stack) {
+                tree_val = stack.query(tree, pos, &cube_sz);
+            } else if (beam != nullptr) {
+                tree_val = beam->query(tree, pos, &cube_sz, &beam_cursor);
+            } else {
+                tree_val = query_leaf(tree, pos, &cube_sz);
+            }
+        }
+        if (tree.ropes != nullptr) {
+            cell = (tree_val - tree.data) / tree.data_dim;
+        }
+
+        const float t_subcube = dda_unit(pos, invdir, &face) / cube_sz;
+        float delta_t = t_subcube + opt.step_size;
+        // Adaptive mode: pixel footprint here in cells of this leaf; the
+        // footprint-based steps and stop only apply where it exceeds 1
+        const float footprint =
+            min_step_per_t > 0.f ? min_step_per_t * t * cube_sz : 0.f;
+        const float sigma = half_to_float(tree_val[tree.data_dim - 1]);
+        if (sigma > opt.sigma_thresh) {
+            const float att = std::exp(-delta_t * delta_scale * sigma);
+            const float weight = light_intensity * (1.f - att);
+
+            if (depth) {
+                out[0] += weight * t;
+            } else if (opt.adaptive &&
+                       skipped_weight + weight < VOLREND_ADAPTIVE_COLOR_EPS) {
+                skipped_weight += weight;
+            } else {
+                shader.shade(tree_val, rgb);
+                for (int j = 0; j < 3; ++j) out[j] += weight * rgb[j];
+            }
+
+            if (depth_out != nullptr && light_intensity >= 0.5f &&
+                light_intensity * att < 0.5f) {
+                *depth_out = t * delta_scale;
+            }
+            light_intensity *= att;
+
+            // Adaptive mode: a footprint spanning several cells blurs what
+            // lies behind anyway, so stop sooner
+            const float stop_thresh =
+                footprint > 1.f
+                    ? opt.stop_thresh *
+                          std::min(footprint, VOLREND_ADAPTIVE_STOP_SCALE_MAX)
+                    : opt.stop_thresh;
+            if (light_intensity < stop_thresh) {
+                // Almost full opacity, stop
+                if (depth) {
+                    out[0] = out[1] = out[2] = std::min(out[0] * 0.3f, 1.0f);
+                }
+                const float scale = 1.f / (1.f - light_intensity);
+                out[0] *= scale;
+                out[1] *= scale;
+                out[2] *= scale;
+                out[3] = 1.f;
+                return n_samples;
+            }
+        } else if (footprint > 1.f) {
+            delta_t = std::max(delta_t, min_step_per_t * t + opt.step_size);
+        }
+        t += delta_t;
+    }
+    if (depth) {
+        out[0] = out[1] = out[2] = std::min(out[0] * 0.3f, 1.0f);
+        out[3] = 1.f;
+    } else {
+        out[3] = 1.f - light_intensity;
+    }
+    return n_samples;
+}
+
+// Render pixel (x, y) into rgbx, and its depth (see trace_ray; +inf if
+// the ray stays more than half transparent, or the tree is NDC-warped) if
+// depth is given; see device::render_kernel. If mesh_rgbx is given, the
+// volume is traced up to mesh_depth and composited over that color instead
+// of the background, and the mesh depth is taken if the volume has none
+void render_pixel(const HostTreeSpec& tree, const float* c2w,
+                  const Camera& cam, const RenderOptions& opt,
+                  internal::LeafColorCache* cache, const Beam* beam,
+                  bool short_stack, ThreadStats& stats, int x, int y,
+                  uint8_t* rgbx, float* depth = nullptr,
+                  const uint8_t* mesh_rgbx = nullptr,
+                  float mesh_depth = std::numeric_limits<float>::infinity()) {
+    float out[4] = {0.f, 0.f, 0.f, 0.f};
+    if (depth != nullptr) *depth = std::numeric_limits<float>::infinity();
+    if (tree.N > 0) {
+        const float xyz[3] = {(x - 0.5f * cam.width) / cam.fx,
+                              -(y - 0.5f * cam.height) / cam.fy, -1.0f};
+        float dir[3], cen[3];
+        for (int i = 0; i < 3; ++i) {
+            dir[i] = c2w[i] * xyz[0] + c2w[3 + i] * xyz[1] +
+                     c2w[6 + i] * xyz[2];
+            cen[i] = c2w[9 + i];
+        }
+        normalize3(dir);
+        float vdir[3] = {dir[0], dir[1], dir[2]};
+        maybe_world2ndc(tree, dir, cen);
+        for (int i = 0; i < 3; ++i) {
+            cen[i] = tree.offset[i] + tree.scale[i] * cen[i];
+        }
+        rodrigues(opt.rot_dirs, vdir);
+
+        const float pixel_angle = tree.ndc_width > 0 ? 0.f : 1.f / cam.fx;
+        RayShader shader(tree, opt, vdir, cache, stats);
+        stats.samples +=
+            trace_ray(tree, dir, cen, opt, pixel_angle, shader, beam,
+                      short_stack, mesh_depth, out,
+                      tree.ndc_width > 0 ? nullptr : depth);
+    }
+    const float nalpha = 1.f - out[3];
+    if (mesh_rgbx != nullptr) {
+        for (int i = 0; i < 3; ++i) {
+            rgbx[i] = uint8_t((out[i] + mesh_rgbx[i] / 255.f * nalpha) * 255);
+        }
+        if (depth != nullptr && std::isinf(*depth)) *depth = mesh_depth;
+    } else {
+        const float remain = opt.background_brightness * nalpha;
+        for (int i = 0; i < 3; ++i) rgbx[i] = uint8_t((out[i] + remain) * 255);
+    }
+    rgbx[3] = 255;
+}
+
+// Set up one tile (row-major index) of cam's image for trace_tile: unless
+// using short stacks, builds beam (if given) over the tile and returns it
+// if active, else nullptr. If raster is given (set up for cam and
+// tile_size), the tile's meshes are rasterized
+Beam* setup_tile(const HostTreeSpec& tree, const Camera& cam,
+                 const RenderOptions& opt, Beam* beam, bool short_stack,
+                 uint32_t tile, int tile_size,
+                 internal::MeshRasterizer* raster = nullptr) {
+    const float* c2w = glm::value_ptr(cam.transform);
+    const int width = cam.width, height = cam.height;
+    const int tiles_x = (width + tile_size - 1) / tile_size;
+    const int x0 = (tile % tiles_x) * tile_size,
+              y0 = (tile / tiles_x) * tile_size;
+    const int x1 = std::min(x0 + tile_size, width),
+              y1 = std::min(y0 + tile_size, height);
+    if (short_stack) beam = nullptr;
+    if (beam != nullptr && tree.N > 0) {
+        // Corner rays of the tile, half a pixel out; see render_pixel
+        const float px[4] = {x0 - 0.5f, x1 - 0.5f, x1 - 0.5f, x0 - 0.5f},
+                    py[4] = {y0 - 0.5f, y0 - 0.5f, y1 - 0.5f, y1 - 0.5f};
+        float corners[4][3], origin[3];
+        for (int c = 0; c < 4; ++c) {
+            const float xyz[3] = {(px[c] - 0.5f * width) / cam.fx,
+                                  -(py[c] - 0.5f * height) / cam.fy, -1.0f};
+            for (int i = 0; i < 3; ++i) {
+                corners[c][i] = tree.scale[i] *
+                                (c2w[i] * xyz[0] + c2w[3 + i] * xyz[1] +
+                                 c2w[6 + i] * xyz[2]);
+            }
+        }
+        for (int i = 0; i < 3; ++i) {
+            origin[i] = tree.offset[i] + tree.scale[i] * c2w[9 + i];
+        }
+        beam->build(tree, origin, corners, opt.render_bbox);
+    }
+    if (raster != nullptr) raster->rasterize_tile(tile);
+    return beam != nullptr && beam->active ? beam : nullptr;
+}
+
+// Trace one tile (row-major index) of cam's image into out, with the beam
+// and raster of setup_tile (if not nullptr; the meshes are composited with
+// the volume). If pixel_mask is given, only its nonzero pixels are
+// rendered; if depth is, their depths are written there (see
+// render_pixel). Outside opt's region of interest, steps are coarser and,
+// without pixel_mask, only the foveation lattice is traced
+// (internal/foveation.hpp)
+void trace_tile(const HostTreeSpec& tree, const Camera& cam,
+                const RenderOptions& opt, internal::LeafColorCache* cache,
+                const Beam* beam, bool short_stack, ThreadStats& stats,
+                uint32_t tile, int tile_size, uint8_t* out,
+                const uint8_t* pixel_mask = nullptr, float* depth = nullptr,
+                const internal::MeshRasterizer* raster = nullptr) {
+    const float* c2w = glm::value_ptr(cam.transform);
+    const int width = cam.width, height = cam.height;
+    const int tiles_x = (width + tile_size - 1) / tile_size;
+    const int x0 = (tile % tiles_x) * tile_size,
+              y0 = (tile / tiles_x) * tile_size;
+    const int x1 = std::min(x0 + tile_size, width),
+              y1 = std::min(y0 + tile_size, height);
+
+    // The lattice must be aligned to the tile so it can be filled in here
+    const bool thin = opt.roi && pixel_mask == nullptr &&
+                      tile_size % internal::roi_stride(opt) == 0;
+    RenderOptions outer_opt = opt;
+    outer_opt.step_size *= opt.roi_step_scale;
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            const size_t pixel = (size_t)y * width + x;
+            if (pixel_mask != nullptr && !pixel_mask[pixel]) continue;
+            if (thin && !internal::roi_traced(opt, x, y)) continue;
+            render_pixel(tree, c2w, cam,
+                         internal::roi_outside(opt, x, y) ? outer_opt : opt,
+                         cache, beam, short_stack, stats, x, y,
+                         out + 4 * pixel,
+                         depth != nullptr ? depth + pixel : nullptr,
+                         raster != nullptr ? raster->color() + 4 * pixel
+                                           : nullptr,
+                         raster != nullptr
+                             ? raster->depth()[pixel]
+                             : std::numeric_limits<float>::infinity());
+        }
+    }
+    if (thin) internal::roi_fill(opt, width, x0, y0, x1, y1, out, depth);
+}
+
+// Render one tile of cam's image into out: setup_tile, with beam as
+// scratch, then trace_tile
+void render_tile(const HostTreeSpec& tree, const Camera& cam,
+                 const RenderOptions& opt, internal::LeafColorCache* cache,
+                 Beam* beam, bool short_stack, ThreadStats& stats,
+                 uint32_t tile, int tile_size, uint8_t* out,
+                 const uint8_t* pixel_mask = nullptr, float* depth = nullptr,
+                 internal::MeshRasterizer* raster = nullptr) {
+    beam = setup_tile(tree, cam, opt, beam, short_stack, tile, tile_size,
+                      raster);
+    trace_tile(tree, cam, opt, cache, beam, short_stack, stats, tile,
+               tile_size, out, pixel_mask, depth, raster);
+}
+
+// Tiles of a width x height image to render (nonzero in tile_mask if
+// given), in Morton order so that consecutive tiles (and thus each
+// thread's range) are spatially coherent in the tree
+void morton_tiles(int width, int height, int tile_size,
+                  const uint8_t* tile_mask, std::vector<uint32_t>& tiles) {
+    const int tiles_x = (width + tile_size - 1) / tile_size,
+              tiles_y = (height + tile_size - 1) / tile_size;
+    std::vector<std::pair<uint32_t, uint32_t>> codes;
+    codes.reserve((size_t)tiles_x * tiles_y);
+    for (int ty = 0; ty < tiles_y; ++ty) {
+        for (int tx = 0; tx < tiles_x; ++tx) {
+            const uint32_t tile = ty * tiles_x + tx;
+            if (tile_mask != nullptr && !tile_mask[tile]) continue;
+            codes.emplace_back(internal::morton_code_2(tx, ty), tile);
+        }
+    }
+    std::sort(codes.begin(), codes.end());
+    tiles.resize(codes.size());
+    for (size_t i = 0; i < codes.size(); ++i) tiles[i] = codes[i].second;
+}
+
+}  // namespace
+
+struct CPURenderer::Impl {
+    explicit Impl(int n_threads)
+        : scheduler(n_threads), beams(scheduler.n_threads()) {}
+
+    internal::TileScheduler scheduler;
+    TileSchedule schedule = TileSchedule::STEALING;
+    std::unique_ptr<internal::LeafColorCache> color_cache;
+    // Tree data and basis range the cached colors were shaded with
+    const void* cache_data = nullptr;
+    int cache_basis_minmax[2] = {0, 0};
+
+    // Color cache to use for rendering tree with options, or nullptr;
+    // cleared if the cached colors are stale
+    internal::LeafColorCache* get_color_cache(const N3Tree& tree,
+                                              const RenderOptions& options) {
+        if (!color_cache || tree.N <= 0 || tree.data_format.basis_dim < 0 ||
+            render_depth(options) ||
+            !color_cache->supports(tree.child_.num_vals)) {
+            return nullptr;
+        }
+        const void* data = tree.data_.data<uint16_t>();
+        if (cache_data != data ||
+            cache_basis_minmax[0] != options.basis_minmax[0] ||
+            cache_basis_minmax[1] != options.basis_minmax[1]) {
+            color_cache->clear();
+            cache_data = data;
+            cache_basis_minmax[0] = options.basis_minmax[0];
+            cache_basis_minmax[1] = options.basis_minmax[1];
+        }
+        return color_cache.get();
+    }
+
+    bool beam_traversal = true;
+    bool short_stack = false;
+    // Per-thread beam scratch
+    std::vector<Beam> beams;
+
+    // Beam for thread_id to render with, or nullptr
+    Beam* get_beam(int thread_id) {
+        return beam_traversal ? &beams[thread_id] : nullptr;
+    }
+    // Beam of each tile for render_progressive, built in its first level
+    // and kept for the later ones
+    std::vector<Beam> tile_beams;
+
+    NumaPolicy numa = NumaPolicy::NONE;
+    // NUMA node index of each thread if pinned, else empty
+    std::vector<int> thread_nodes;
+    // Tree data the NUMA policy was applied to, and its per-node copies
+    const void* numa_data = nullptr;
+    std::vector<std::unique_ptr<internal::NumaBuffer>> replica_data,
+        replica_child;
+
+    // Views of the tree to render, one per NUMA node if replicated
+    std::vector<HostTreeSpec> tree_specs(const N3Tree& tree) {
+        std::vector<HostTreeSpec> specs(1, HostTreeSpec(tree));
+        if (numa == NumaPolicy::NONE) return specs;
+        const internal::NumaTopology& topo = internal::NumaTopology::get();
+        if (numa_data != specs[0].data) {
+            numa_data = specs[0].data;
+            replica_data.clear();
+            replica_child.clear();
+            if (numa == NumaPolicy::REPLICATE) replicate(tree);
+            if (replica_data.empty()) {
+                internal::numa_interleave(tree.data_.data<char>(),
+                                          tree.data_.num_bytes());
+                internal::numa_interleave(tree.child_.data<char>(),
+                                          tree.child_.num_bytes());
+            }
+        }
+        if (!replica_data.empty()) {
+            specs.resize(topo.n_nodes(), specs[0]);
+            for (int i = 0; i < topo.n_nodes(); ++i) {
+                specs[i].data = (const uint16_t*)replica_data[i]->data();
+                specs[i].child = (const int32_t*)replica_child[i]->data();
+            }
+        }
+        return specs;
+    }
+
+    // Copy the tree data to every node if they all have room
+    void replicate(const N3Tree& tree) {
+        const internal::NumaTopology& topo = internal::NumaTopology::get();
+        if (topo.n_nodes() < 2) return;
+        const size_t data_bytes = tree.data_.num_bytes(),
+                     child_bytes = tree.child_.num_bytes();
+        for (int i = 0; i < topo.n_nodes(); ++i) {
+            if (topo.free_bytes(i) < data_bytes + child_bytes) {
+                fprintf(stderr,
+                        "WARNING: NUMA node %d has too little free memory "
+                        "to replicate the tree, interleaving instead\n",
+                        topo.node_ids[i]);
+                return;
+            }
+        }
+        for (int i = 0; i < topo.n_nodes(); ++i) {
+            replica_data.push_back(
+                std::make_unique<internal::NumaBuffer>(data_bytes, i));
+            replica_child.push_back(
+                std::make_unique<internal::NumaBuffer>(child_bytes, i));
+        }
+        // Copy in parallel, each thread a slice of every copy
+        const int n_threads = scheduler.n_threads();
+        auto copy_slice = [&](char* dst, const char* src, size_t bytes,
+                              int thread_id) {
+            const size_t begin = bytes * thread_id / n_threads,
+                         end = bytes * (thread_id + 1) / n_threads;
+            memcpy(dst + begin, src + begin, end - begin);
+        };
+        scheduler.run_all([&](int thread_id) {
+            for (int i = 0; i < topo.n_nodes(); ++i) {
+                copy_slice(replica_data[i]->data(), tree.data_.data<char>(),
+                           data_bytes, thread_id);
+                copy_slice(replica_child[i]->data(), tree.child_.data<char>(),
+                           child_bytes, thread_id);
+            }
+        });
+    }
+
+    // Index into tree_specs() of the view thread_id should read
+    int spec_index(int thread_id, size_t n_specs) const {
+        if (n_specs == 1) return 0;
+        if (!thread_nodes.empty()) return thread_nodes[thread_id];
+        return internal::NumaTopology::get().node_of_cpu(
+            internal::current_cpu());
+    }
+
+    // Meshes to composite (set_meshes), and their rasterizer for render()
+    // and render_pixels()
+    const std::vector<Mesh>* meshes = nullptr;
+    internal::MeshRasterizer raster;
+
+    // Set up raster for a frame, returning it if there are meshes to draw
+    internal::MeshRasterizer* setup_meshes(internal::MeshRasterizer& raster,
+                                           const Camera& cam,
+                                           const RenderOptions& options,
+                                           int tile_size) {
+        if (meshes == nullptr) return nullptr;
+        raster.setup(*meshes, cam, tile_size, options.background_brightness);
+        return raster.empty() ? nullptr : &raster;
+    }
+
+    // Sum per-thread counters into the cache statistics
+    uint64_t gather_stats(const std::vector<ThreadStats>& stats,
+                          internal::LeafColorCache* cache) {
+        uint64_t n_samples = 0, hits = 0, misses = 0;
+        for (const ThreadStats& ts : stats) {
+            n_samples += ts.samples;
+            hits += ts.cache_hits;
+            misses += ts.cache_misses;
+        }
+        if (cache != nullptr) cache->add_stats(hits, misses);
+        return n_samples;
+    }
+};
+
+CPURenderer::CPURenderer(int n_threads) {
+    if (n_threads <= 0) {
+        n_threads = std::max((int)std::thread::hardware_concurrency(), 1);
+    }
+    impl_ = std::make_unique<Impl>(n_threads);
+}
+
+CPURenderer::~CPURenderer() {}
+
+int CPURenderer::n_threads() const { return impl_->scheduler.n_threads(); }
+
+void CPURenderer::set_meshes(const std::vector<Mesh>* meshes) {
+    impl_->meshes = meshes;
+}
+
+void CPURenderer::set_schedule(TileSchedule schedule) {
+    impl_->schedule = schedule;
+}
+
+void CPURenderer::set_beam_traversal(bool enabled) {
+    impl_->beam_traversal = enabled;
+}
+
+void CPURenderer::set_short_stack(bool enabled) {
+    impl_->short_stack = enabled;
+}
+
+void CPURenderer::set_numa(NumaPolicy policy, bool pin_threads) {
+    impl_->numa = policy;
+    impl_->numa_data = nullptr;
+    impl_->replica_data.clear();
+    impl_->replica_child.clear();
+    if (!pin_threads) return;
+
+    // Give each node a share of the threads proportional to its CPUs
+    const internal::NumaTopology& topo = internal::NumaTopology::get();
+    const int n_threads = impl_->scheduler.n_threads();
+    size_t n_cpus = 0;
+    for (const std::vector<int>& cpus : topo.node_cpus) n_cpus += cpus.size();
+    std::vector<int> thread_cpus(n_threads);
+    impl_->thread_nodes.resize(n_threads);
+    size_t cpus_before = 0;
+    for (int i = 0; i < topo.n_nodes(); ++i) {
+        const std::vector<int>& cpus = topo.node_cpus[i];
+        const int begin = (int)(n_threads * cpus_before / n_cpus);
+        cpus_before += cpus.size();
+        const int end = (int)(n_threads * cpus_before / n_cpus);
+        for (int t = begin; t < end; ++t) {
+            thread_cpus[t] = cpus[(t - begin) % cpus.size()];
+            impl_->thread_nodes[t] = i;
+        }
+    }
+    impl_->scheduler.run_all([&](int thread_id) {
+        if (!internal::pin_thread(thread_cpus[thread_id])) {
+            fprintf(stderr, "WARNING: Failed to pin render thread %d\n",
+                    thread_id);
+        }
+    });
+    impl_->scheduler.set_thread_groups(impl_->thread_nodes);
+}
+
+void CPURenderer::set_color_cache(size_t budget_bytes, int dir_res) {
+    impl_->color_cache.reset();
+    impl_->cache_data = nullptr;
+    if (budget_bytes > 0) {
+        impl_->color_cache =
+            std::make_unique<internal::LeafColorCache>(budget_bytes, dir_res);
+    }
+}
+
+void CPURenderer::color_cache_stats(uint64_t& hits, uint64_t& misses) const {
+    hits = misses = 0;
+    if (impl_->color_cache) {
+        hits = impl_->color_cache->hits();
+        misses = impl_->color_cache->misses();
+    }
+}
+
+uint64_t CPURenderer::render(const N3Tree& tree, const Camera& cam,
+                             const RenderOptions& options, uint8_t* out,
+                             const uint8_t* tile_mask, int tile_size) {
+    const std::vector<HostTreeSpec> specs = impl_->tree_specs(tree);
+    internal::LeafColorCache* cache = impl_->get_color_cache(tree, options);
+    std::vector<uint32_t> tiles;
+    morton_tiles(cam.width, cam.height, tile_size, tile_mask, tiles);
+    internal::MeshRasterizer* raster =
+        impl_->setup_meshes(impl_->raster, cam, options, tile_size);
+
+    std::vector<ThreadStats> stats(impl_->scheduler.n_threads());
+    impl_->scheduler.run(
+        tiles, impl_->schedule, [&](uint32_t tile, int thread_id) {
+            render_tile(specs[impl_->spec_index(thread_id, specs.size())],
+                        cam, options, cache, impl_->get_beam(thread_id),
+                        impl_->short_stack, stats[thread_id], tile,
+                        tile_size, out, nullptr, nullptr, raster);
+        });
+    return impl_->gather_stats(stats, cache);
+}
+
+uint64_t CPURenderer::render_pixels(const N3Tree& tree, const Camera& cam,
+                                    const RenderOptions& options,
+                                    uint8_t* out, const uint8_t* pixel_mask,
+                                    float* depth, int tile_size) {
+    const std::vector<HostTreeSpec> specs = impl_->tree_specs(tree);
+    internal::LeafColorCache* cache = impl_->get_color_cache(tree, options);
+    std::vector<uint8_t> tile_mask;
+    if (pixel_mask != nullptr) {
+        const int tiles_x = (cam.width + tile_size - 1) / tile_size,
+                  tiles_y = (cam.height + tile_size - 1) / tile_size;
+        tile_mask.assign((size_t)tiles_x * tiles_y, 0);
+        for (int y = 0; y < cam.height; ++y) {
+            const uint8_t* row = pixel_mask + (size_t)y * cam.width;
+            for (int x = 0; x < cam.width; ++x) {
+                if (row[x]) {
+                    tile_mask[(y / tile_size) * tiles_x + x / tile_size] = 1;
+                }
+            }
+        }
+    }
+    std::vector<uint32_t> tiles;
+    morton_tiles(cam.width, cam.height, tile_size,
+                 pixel_mask != nullptr ? tile_mask.data() : nullptr, tiles);
+    internal::MeshRasterizer* raster =
+        impl_->setup_meshes(impl_->raster, cam, options, tile_size);
+
+    std::vector<ThreadStats> stats(impl_->scheduler.n_threads());
+    impl_->scheduler.run(
+        tiles, impl_->schedule, [&](uint32_t tile, int thread_id) {
+            render_tile(specs[impl_->spec_index(thread_id, specs.size())],
+                        cam, options, cache, impl_->get_beam(thread_id),
+                        impl_->short_stack, stats[thread_id], tile,
+                        tile_size, out, pixel_mask, depth, raster);
+        });
+    return impl_->gather_stats(stats, cache);
+}
+
+uint64_t CPURenderer::render_progressive(
+    const N3Tree& tree, const Camera& cam, const RenderOptions& options,
+    uint8_t* out, float interval_ms,
+    const std::function<void(const uint8_t*, float)>& publish,
+    int tile_size) {
+    using namespace internal;
+    const int width = cam.width, height = cam.height;
+    const size_t n_pixels = (size_t)width * height;
+    const int tiles_x = (width + tile_size - 1) / tile_size,
+              tiles_y = (height + tile_size - 1) / tile_size;
+    const size_t n_tiles = (size_t)tiles_x * tiles_y;
+    // Each level is traced in about 8 bands of tile rows, so partial
+    // images can be published within a level
+    const int band = std::max(
+        (height / 8 + tile_size - 1) / tile_size * tile_size, tile_size);
+
+    // Set up the frame once: the first level sets up every tile (beam and
+    // meshes), the later ones only trace their lattice pixels
+    const std::vector<HostTreeSpec> specs = impl_->tree_specs(tree);
+    LeafColorCache* cache = impl_->get_color_cache(tree, options);
+    MeshRasterizer* raster =
+        impl_->setup_meshes(impl_->raster, cam, options, tile_size);
+    if (impl_->beam_traversal) impl_->tile_beams.resize(n_tiles);
+    std::vector<const Beam*> beams(n_tiles, nullptr);
+    std::vector<ThreadStats> stats(impl_->scheduler.n_threads());
+
+    std::vector<uint8_t> mask(n_pixels, 0), traced(n_pixels, 0), band_tiles,
+        preview;
+    std::vector<uint32_t> tiles;
+    size_t n_traced = 0;
+    auto last_publish = std::chrono::steady_clock::now();
+    for (int level = 0; level < PROGRESSIVE_LEVELS; ++level) {
+        const int pass_begin = progressive_level_start(level),
+                  pass_end = progressive_level_start(level + 1);
+        for (int y0 = 0; y0 < height; y0 += band) {
+            const int y1 = std::min(y0 + band, height);
+            for (int y = y0; y < y1; ++y) {
+                for (int x = 0; x < width; ++x) {
+                    const int pass = progressive_rank(
+                        x % PROGRESSIVE_BLOCK, y % PROGRESSIVE_BLOCK);
+                    const size_t pixel = (size_t)y * width + x;
+                    mask[pixel] = pass >= pass_begin && pass < pass_end;
+                    if (mask[pixel]) {
+                        traced[pixel] = 1;
+                        ++n_traced;
+                    }
+                }
+            }
+            // Bands are whole tile rows
+            band_tiles.assign(n_tiles, 0);
+            std::fill(band_tiles.begin() + (size_t)(y0 / tile_size) * tiles_x,
+                      band_tiles.begin() +
+                          (size_t)((y1 + tile_size - 1) / tile_size) * tiles_x,
+                      1);
+            morton_tiles(width, height, tile_size, band_tiles.data(), tiles);
+            impl_->scheduler.run(
+                tiles, impl_->schedule, [&](uint32_t tile, int thread_id) {
+                    const HostTreeSpec& spec =
+                        specs[impl_->spec_index(thread_id, specs.size())];
+                    if (level == 0) {
+                        beams[tile] = setup_tile(
+                            spec, cam, options,
+                            impl_->beam_traversal ? &impl_->tile_beams[tile]
+                                                  : nullptr,
+                            impl_->short_stack, tile, tile_size, raster);
+                    }
+                    trace_tile(spec, cam, options, cache, beams[tile],
+                               impl_->short_stack, stats[thread_id], tile,
+                               tile_size, out, mask.data(), nullptr, raster);
+                });
+
+            // Untraced pixels are filled from the last completed lattice,
+            // so there is nothing to publish before the first
+            const bool level_done = y1 == height;
+            const auto now = std::chrono::steady_clock::now();
+            if (n_traced < n_pixels && (level > 0 || level_done) &&
+                std::chrono::duration<float, std::milli>(now - last_publish)
+                        .count() >= interval_ms) {
+                const int stride =
+                    PROGRESSIVE_BLOCK >> (level_done ? level : level - 1);
+                preview.resize(4 * n_pixels);
+                progressive_fill(out, traced.data(), width, height, stride,
+                                 preview.data());
+                publish(preview.data(), (float)n_traced / n_pixels);
+                last_publish = now;
+            }
+        }
+    }
+    publish(out, 1.f);
+    return impl_->gather_stats(stats, cache);
+}
+
+uint64_t CPURenderer::render_batch(
+    const N3Tree& tree, const RenderOptions& options, size_t n_frames,
+    int frames_in_flight, const std::function<void(size_t, BatchFrame&)>& setup,
+    const std::function<void(size_t, BatchFrame&)>& done, int tile_size) {
+    const std::vector<HostTreeSpec> specs = impl_->tree_specs(tree);
+    internal::LeafColorCache* cache = impl_->get_color_cache(tree, options);
+    const size_t n_slots = std::max(frames_in_flight, 1);
+
+    // Frame i uses slot i % n_slots; its tiles are the global jobs
+    // [job_end[i - 1], job_end[i]), so the job queue is a single counter
+    // running across frames
+    struct Slot {
+        BatchFrame frame;
+        std::vector<uint32_t> tiles;
+        // The frame's meshes, if any
+        internal::MeshRasterizer raster_storage;
+        internal::MeshRasterizer* raster = nullptr;
+        // Tiles not yet finished; the thread finishing the last one hands
+        // the frame to the writer
+        std::atomic<size_t> remaining{0};
+        bool complete = false;
+    };
+    std::unique_ptr<Slot[]> slots(new Slot[n_slots]);
+    std::vector<size_t> job_end(n_frames);
+    std::atomic<size_t> next_job{0};
+    // Jobs of frames set up so far; all_admitted once every frame is
+    std::atomic<size_t> admitted_jobs{0};
+    bool all_admitted = n_frames == 0;
+    std::mutex mutex;
+    std::condition_variable admit_cv, complete_cv;
+
+    // Set up frame i in its slot and publish its tiles (writer thread)
+    auto admit = [&](size_t i) {
+        Slot& slot = slots[i % n_slots];
+        BatchFrame& frame = slot.frame;
+        frame.options = options;
+        frame.tile_mask.clear();
+        frame.skip = false;
+        setup(i, frame);
+        const Camera& cam = frame.camera;
+        frame.rgba.resize((size_t)4 * cam.width * cam.height);
+        slot.raster = nullptr;
+        if (frame.skip) {
+            slot.tiles.clear();
+        } else {
+            slot.raster = impl_->setup_meshes(slot.raster_storage, cam,
+                                              frame.options, tile_size);
+            morton_tiles(cam.width, cam.height, tile_size,
+                         frame.tile_mask.empty() ? nullptr
+                                                 : frame.tile_mask.data(),
+                         slot.tiles);
+        }
+        slot.remaining.store(slot.tiles.size(), std::memory_order_relaxed);
+        std::lock_guard<std::mutex> lock(mutex);
+        slot.complete = slot.tiles.empty();
+        const size_t start = i ? job_end[i - 1] : 0;
+        job_end[i] = start + slot.tiles.size();
+        admitted_jobs.store(job_end[i], std::memory_order_release);
+        all_admitted = i + 1 == n_frames;
+        admit_cv.notify_all();
+    };
+
+    // Writer: hands finished frames to done in order, reusing their slots
+    // for the next frames
+    std::thread writer([&] {
+        for (size_t i = 0; i < std::min(n_slots, n_frames); ++i) admit(i);
+        for (size_t i = 0; i < n_frames; ++i) {
+            Slot& slot = slots[i % n_slots];
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                complete_cv.wait(lock, [&] { return slot.complete; });
+            }
+            done(i, slot.frame);
+            if (i + n_slots < n_frames) admit(i + n_slots);
+        }
+    });
+
+    std::vector<ThreadStats> stats(impl_->scheduler.n_threads());
+    impl_->scheduler.run_all([&](int thread_id) {
+        ThreadStats& ts = stats[thread_id];
+        size_t frame = 0;
+        while (true) {
+            const size_t job = next_job.fetch_add(1, std::memory_order_relaxed);
+            if (job >= admitted_jobs.load(std::memory_order_acquire)) {
+                // Frames ahead are still being set up (or none are left)
+                std::unique_lock<std::mutex> lock(mutex);
+                admit_cv.wait(lock, [&] {
+                    return job < admitted_jobs.load(
+                                     std::memory_order_relaxed) ||
+                           all_admitted;
+                });
+                if (job >= admitted_jobs.load(std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            // Jobs are claimed in increasing order per thread
+            while (job_end[frame] <= job) ++frame;
+            Slot& slot = slots[frame % n_slots];
+            const size_t start = frame ? job_end[frame - 1] : 0;
+            render_tile(specs[impl_->spec_index(thread_id, specs.size())],
+                        slot.frame.camera, slot.frame.options, cache,
+                        impl_->get_beam(thread_id), impl_->short_stack, ts,
+                        slot.tiles[job - start], tile_size,
+                        slot.frame.rgba.data(), nullptr, nullptr,
+                        slot.raster);
+            if (slot.remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                std::lock_guard<std::mutex> lock(mutex);
+                slot.complete = true;
+                complete_cv.notify_one();
+            }
+        }
+    });
+    writer.join();
+    return impl_->gather_stats(stats, cache);
+}
+
+float tree_first_hit(const N3Tree& n3tree, const RenderOptions& options,
+                     const glm::vec3& origin, const glm::vec3& dir) {
+    const float inf = std::numeric_limits<float>::infinity();
+    if (n3tree.N <= 0 || n3tree.data_.data_holder.empty()) return inf;
+    const HostTreeSpec tree(n3tree);
+    float cen[3] = {origin.x, origin.y, origin.z},
+          vdir[3] = {dir.x, dir.y, dir.z};
+    normalize3(vdir);
+    maybe_world2ndc(tree, vdir, cen);
+    for (int i = 0; i < 3; ++i) {
+        cen[i] = tree.offset[i] + tree.scale[i] * cen[i];
+        vdir[i] *= tree.scale[i];
+    }
+    // Traversal of trace_ray, stopping at the first dense sample
+    const float delta_scale = 1.f / std::sqrt(dot3(vdir, vdir));
+    float invdir[3];
+    for (int i = 0; i < 3; ++i) {
+        vdir[i] *= delta_scale;
+        invdir[i] = 1.f / (vdir[i] + 1e-9f);
+    }
+    float tmin, tmax;
+    dda_world(cen, invdir, &tmin, &tmax, options.render_bbox);
+    if (tmax < 0 || tmin > tmax) return inf;
+
+    float t = tmin, pos[3], cube_sz;
+    int64_t cell = -1;
+    int face = 0;
+    while (t < tmax) {
+        for (int i = 0; i < 3; ++i) pos[i] = cen[i] + t * vdir[i];
+        const uint16_t* tree_val = nullptr;
+        if (cell >= 0) {
+            const int32_t rope = tree.ropes[cell * 6 + face];
+            if (rope >= 0) {
+                tree_val = query_from_cell(tree, rope, pos, &cube_sz);
+            }
+        }
+        if (tree_val == nullptr) tree_val = query_leaf(tree, pos, &cube_sz);
+        if (tree.ropes != nullptr) {
+            cell = (tree_val - tree.data) / tree.data_dim;
+        }
+        if (half_to_float(tree_val[tree.data_dim - 1]) > options.sigma_thresh) {
+            // Back to world space
+            float hit[3];
+            for (int i = 0; i < 3; ++i) {
+                hit[i] = (cen[i] + t * vdir[i] - tree.offset[i]) /
+                         tree.scale[i];
+            }
+            if (tree.ndc_width > 0) ndc2world(tree, hit);
+            const float diff[3] = {hit[0] - origin.x, hit[1] - origin.y,
+                                   hit[2] - origin.z};
+            return std::sqrt(dot3(diff, diff));
+        }
+        t += dda_unit(pos, invdir, &face) / cube_sz + options.step_size;
+    }
+    return inf;
+}
+
+}  // namespace volrend
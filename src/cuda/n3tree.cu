@@ -37,14 +37,31 @@ void N3Tree::load_cuda() {
     } else {
         device.extra = nullptr;
     }
+    load_cuda_ropes();
     cuda_loaded_ = true;
 }
 
+void N3Tree::load_cuda_ropes() {
+    if (device.ropes != nullptr) cuda(Free(device.ropes));
+    if (device.node_pos != nullptr) cuda(Free(device.node_pos));
+    device.ropes = device.node_pos = nullptr;
+    if (!has_ropes()) return;
+    cuda(Malloc((void**)&device.ropes, ropes_.num_bytes()));
+    cuda(MemcpyAsync(device.ropes, ropes_.data<int32_t>(), ropes_.num_bytes(),
+                cudaMemcpyHostToDevice));
+    const size_t node_pos_sz = node_pos_.size() * sizeof(int32_t);
+    cuda(Malloc((void**)&device.node_pos, node_pos_sz));
+    cuda(MemcpyAsync(device.node_pos, node_pos_.data(), node_pos_sz,
+                cudaMemcpyHostToDevice));
+}
+
 void N3Tree::free_cuda() {
     if (device.data != nullptr) cuda(Free(device.data));
     if (device.child != nullptr) cuda(Free(device.child));
     if (device.offset != nullptr) cuda(Free(device.offset));
     if (device.scale != nullptr) cuda(Free(device.scale));
     if (device.extra != nullptr) cuda(Free(device.extra));
+    if (device.ropes != nullptr) cuda(Free(device.ropes));
+    if (device.node_pos != nullptr) cuda(Free(device.node_pos));
 }
 }  // namespace volrend
@@ -82,9 +82,17 @@ __global__ static void render_kernel(
         TreeSpec tree,
         RenderOptions opt,
         float* probe_coeffs,
-        bool offscreen) {
+        bool offscreen,
+        const uint8_t* __restrict__ tile_mask,
+        int tile_size,
+        uint32_t* __restrict__ sample_counts) {
     CUDA_GET_THREAD_ID(idx, cam.width * cam.height);
     const int x = idx % cam.width, y = idx / cam.width;
+    if (tile_mask != nullptr &&
+        !tile_mask[(y / tile_size) * ((cam.width + tile_size - 1) / tile_size) +
+                   x / tile_size]) {
+        return;
+    }
 
     float dir[3], cen[3], out[4];
 
@@ -147,7 +155,20 @@ __global__ static void render_kernel(
 
         rodrigues(opt.rot_dirs, vdir);
 
-        trace_ray(tree, dir, vdir, cen, opt, t_max, out);
+        // Footprint is only meaningful without the NDC warp
+        const float pixel_angle = tree.ndc_width > 0 ? 0.f : 1.f / cam.fx;
+        float depth = t_max;
+        const int n_samples = trace_ray(tree, dir, vdir, cen, opt, t_max, out,
+                                        pixel_angle,
+                                        offscreen ? nullptr : &depth);
+        if (sample_counts != nullptr) sample_counts[idx] = n_samples;
+        if (!offscreen && depth != t_max) {
+            // Volume depth, for depth-guided upsampling (dynamic_res)
+            surf2Dwrite(depth, surf_obj_depth, x * sizeof(float), y,
+                        cudaBoundaryModeZero);
+        }
+    } else if (sample_counts != nullptr) {
+        sample_counts[idx] = 0;
     }
     // Compositing with existing color
     const float nalpha = 1.f - out[3];
@@ -196,7 +217,10 @@ __host__ void launch_renderer(const N3Tree& tree,
         const Camera& cam, const RenderOptions& options, cudaArray_t& image_arr,
         cudaArray_t& depth_arr,
         cudaStream_t stream,
-        bool offscreen) {
+        bool offscreen,
+        const uint8_t* tile_mask,
+        int tile_size,
+        uint32_t* sample_counts) {
     cudaSurfaceObject_t surf_obj = 0, surf_obj_depth = 0;
 
     float* probe_coeffs = nullptr;
@@ -237,7 +261,10 @@ __host__ void launch_renderer(const N3Tree& tree,
             tree,
             options,
             probe_coeffs,
-            offscreen);
+            offscreen,
+            tile_mask,
+            tile_size,
+            sample_counts);
 
     if (options.enable_probe) {
         cudaFree(probe_coeffs);
@@ -13,6 +13,8 @@
 #include "volrend/cuda/common.cuh"
 #include "volrend/cuda/renderer_kernel.hpp"
 #include "volrend/internal/imwrite.hpp"
+#include "volrend/internal/dynamic_res.hpp"
+#include "volrend/internal/mesh_cull.hpp"
 
 namespace volrend {
 
@@ -50,6 +52,9 @@ struct VolumeRenderer::Impl {
         glDeleteRenderbuffers(2, depth_rb.data());
         glDeleteRenderbuffers(2, depth_buf_rb.data());
         glDeleteFramebuffers(2, fb.data());
+        glDeleteFramebuffers(1, &fb_low);
+        glDeleteTextures(1, &tex_low_color);
+        glDeleteTextures(1, &tex_low_depth);
         cuda(StreamDestroy(stream));
     }
 
@@ -77,6 +82,15 @@ struct VolumeRenderer::Impl {
                                           GL_COLOR_ATTACHMENT1};
             glNamedFramebufferDrawBuffers(fb[index], 2, attach_buffers);
         }
+
+        // Reduced resolution color and depth for upsampling (dynamic_res)
+        glCreateTextures(GL_TEXTURE_2D, 1, &tex_low_color);
+        glCreateTextures(GL_TEXTURE_2D, 1, &tex_low_depth);
+        glCreateFramebuffers(1, &fb_low);
+        glNamedFramebufferTexture(fb_low, GL_COLOR_ATTACHMENT0, tex_low_color,
+                                  0);
+        glNamedFramebufferTexture(fb_low, GL_COLOR_ATTACHMENT1, tex_low_depth,
+                                  0);
         started_ = true;
     }
 
@@ -100,10 +114,20 @@ struct VolumeRenderer::Impl {
             maybe_gen_wire(options.grid_max_depth);
         }
 
+        // Render at a lower resolution while the camera moves, into the
+        // first rw x rh pixels of the buffers
+        const float scale =
+            dynamic_res_.next_scale(camera.is_dragging(), options);
+        int rw = camera.width, rh = camera.height;
+        internal::DynamicResolution::scaled_size(camera.width, camera.height,
+                                                 scale, rw, rh);
+        const bool scaled = rw != camera.width || rh != camera.height;
+
         glDepthMask(GL_TRUE);
         glBindFramebuffer(GL_FRAMEBUFFER, fb[buf_index]);
-        for (const Mesh& mesh : meshes) {
-            mesh.draw(camera.w2c, camera.K);
+        glViewport(0, 0, rw, rh);
+        for (uint32_t i : culler_.cull(meshes, camera.w2c, camera.K)) {
+            meshes[i].draw(camera.w2c, camera.K);
         }
         probe_.draw(camera.w2c, camera.K);
         if (options.show_grid) {
@@ -111,17 +135,51 @@ struct VolumeRenderer::Impl {
         }
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
+        glViewport(0, 0, camera.width, camera.height);
+
         if (tree != nullptr) {
+            // The kernel sees a camera of the reduced size
+            const int width = camera.width, height = camera.height;
+            const float fx = camera.fx, fy = camera.fy;
+            RenderOptions scaled_options = options;
+            camera.width = rw;
+            camera.height = rh;
+            camera.fx *= (float)rw / width;
+            camera.fy *= (float)rh / height;
+            scaled_options.probe_disp_size =
+                std::max((int)(options.probe_disp_size * scale), 1);
+
             cuda(GraphicsMapResources(2, &cgr[buf_index * 2], stream));
-            launch_renderer(*tree, camera, options, ca[buf_index * 2],
+            launch_renderer(*tree, camera, scaled_options, ca[buf_index * 2],
                             ca[buf_index * 2 + 1], stream);
             cuda(GraphicsUnmapResources(2, &cgr[buf_index * 2], stream));
+
+            camera.width = width;
+            camera.height = height;
+            camera.fx = fx;
+            camera.fy = fy;
         }
 
-        glNamedFramebufferReadBuffer(fb[buf_index], GL_COLOR_ATTACHMENT0);
-        glBlitNamedFramebuffer(fb[buf_index], 0, 0, 0, camera.width,
-                               camera.height, 0, camera.height, camera.width, 0,
-                               GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        if (scaled) {
+            // Flip into the low resolution textures, then upsample
+            for (int i = 0; i < 2; ++i) {
+                glNamedFramebufferReadBuffer(fb[buf_index],
+                                             GL_COLOR_ATTACHMENT0 + i);
+                glNamedFramebufferDrawBuffer(fb_low, GL_COLOR_ATTACHMENT0 + i);
+                glBlitNamedFramebuffer(fb[buf_index], fb_low, 0, 0, rw, rh, 0,
+                                       rh, rw, 0, GL_COLOR_BUFFER_BIT,
+                                       GL_NEAREST);
+            }
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            upsampler_.draw(tex_low_color, tex_low_depth, rw, rh,
+                            camera.width, camera.height);
+        } else {
+            glNamedFramebufferReadBuffer(fb[buf_index], GL_COLOR_ATTACHMENT0);
+            glBlitNamedFramebuffer(fb[buf_index], 0, 0, 0, camera.width,
+                                   camera.height, 0, camera.height,
+                                   camera.width, 0, GL_COLOR_BUFFER_BIT,
+                                   GL_NEAREST);
+        }
         buf_index ^= 1;
     }
 
@@ -160,6 +218,18 @@ struct VolumeRenderer::Impl {
                     cudaGraphicsRegisterFlagsWriteDiscard));
         }
 
+        glBindTexture(GL_TEXTURE_2D, tex_low_color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, tex_low_depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED,
+                     GL_FLOAT, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
         cuda(GraphicsMapResources(cgr.size(), cgr.data(), 0));
         for (int index = 0; index < cgr.size(); index++) {
             cuda(GraphicsSubResourceGetMappedArray(&ca[index], cgr[index], 0,
@@ -196,6 +266,10 @@ struct VolumeRenderer::Impl {
 
     // GL buffers
     std::array<GLuint, 2> fb, rb, depth_rb, depth_buf_rb;
+    GLuint fb_low, tex_low_color, tex_low_depth;
+
+    internal::DynamicResolution dynamic_res_;
+    internal::DepthUpsampler upsampler_;
 
     // CUDA resources
     std::array<cudaGraphicsResource_t, 4> cgr = {{0}};
@@ -206,6 +280,7 @@ struct VolumeRenderer::Impl {
     int last_wire_depth_ = -1;
 
     std::vector<Mesh>& meshes;
+    internal::MeshCuller culler_;
     cudaStream_t stream;
     bool started_ = false;
 };
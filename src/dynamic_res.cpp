@@ -0,0 +1,400 @@
+#include "volrend/internal/dynamic_res.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "volrend/internal/foveation.hpp"
+#include "volrend/internal/shader.hpp"
+
+namespace volrend {
+namespace internal {
+namespace {
+
+const char* QUAD_VERT_SHADER_SRC =
+    R"glsl(
+in vec3 aPos;
+
+void main()
+{
+    gl_Position = vec4(aPos.x, aPos.y, aPos.z, 1.0);
+}
+)glsl";
+
+const char* UPSAMPLE_FRAG_SHADER_SRC =
+    R"glsl(
+precision highp float;
+precision highp int;
+
+// Depths within about this fraction of the nearest pixel's count as the
+// same surface
+#define DEPTH_TOL 0.05
+
+uniform mediump sampler2D color_tex;
+uniform highp sampler2D depth_tex;
+uniform ivec2 low_reso;
+uniform vec2 out_reso;
+
+layout(location = 0) out lowp vec4 FragColor;
+
+void main()
+{
+    vec2 q = gl_FragCoord.xy * vec2(low_reso) / out_reso - 0.5;
+    vec2 base = floor(q);
+    vec2 f = q - base;
+    ivec2 hi = low_reso - 1;
+    ivec2 nearest = clamp(ivec2(base + step(0.5, f)), ivec2(0), hi);
+    float depth_ref = texelFetch(depth_tex, nearest, 0).r;
+
+    vec4 color = vec4(0.0);
+    float weight_sum = 0.0;
+    for (int j = 0; j < 2; ++j) {
+        for (int i = 0; i < 2; ++i) {
+            ivec2 pt = clamp(ivec2(base) + ivec2(i, j), ivec2(0), hi);
+            float weight = (i == 1 ? f.x : 1.0 - f.x) *
+                           (j == 1 ? f.y : 1.0 - f.y);
+            float depth = texelFetch(depth_tex, pt, 0).r;
+            float rel = abs(depth - depth_ref) /
+                        (DEPTH_TOL * max(depth_ref, 1e-6));
+            weight *= exp(-rel * rel);
+            color += weight * texelFetch(color_tex, pt, 0);
+            weight_sum += weight;
+        }
+    }
+    // The nearest pixel always has weight >= 1/4
+    FragColor = vec4(color.rgb / weight_sum, 1.0);
+}
+)glsl";
+
+const char* FILL_FRAG_SHADER_SRC =
+    R"glsl(
+precision highp float;
+precision highp int;
+
+// See internal/progressive.hpp
+#define PROGRESSIVE_BLOCK 8
+
+uniform mediump sampler2D color_tex;
+uniform int passes_done;
+// Region of interest, as in rt.frag
+uniform vec3 roi;
+uniform int roi_passes;
+
+layout(location = 0) out lowp vec4 FragColor;
+
+int progressive_rank(ivec2 offset) {
+    int rank = 0;
+    for (int b = 0; b < 3; ++b) {
+        rank |= ((offset.x >> (2 - b)) & 1) << (2 * b + 1);
+        rank |= ((offset.y >> (2 - b)) & 1) << (2 * b);
+    }
+    return rank;
+}
+
+void main()
+{
+    ivec2 pt = ivec2(gl_FragCoord.xy);
+    bool outside = roi.z >= 0.0 && distance(gl_FragCoord.xy, roi.xy) > roi.z;
+    int passes = outside ? min(passes_done, roi_passes) : passes_done;
+    if (progressive_rank(pt % PROGRESSIVE_BLOCK) < passes) {
+        FragColor = texelFetch(color_tex, pt, 0);
+        return;
+    }
+
+    // Interpolate from the lattice traced everywhere
+    int lattice_passes =
+        roi.z >= 0.0 ? min(passes_done, roi_passes) : passes_done;
+    int stride = PROGRESSIVE_BLOCK;
+    for (int n = 4; n <= lattice_passes; n *= 4) stride >>= 1;
+    ivec2 base = pt - pt % stride;
+    ivec2 size = textureSize(color_tex, 0);
+    ivec2 far = ivec2(base.x + stride < size.x ? base.x + stride : base.x,
+                      base.y + stride < size.y ? base.y + stride : base.y);
+    vec2 f = vec2(pt - base) / float(stride);
+    vec4 bottom = mix(texelFetch(color_tex, base, 0),
+                      texelFetch(color_tex, ivec2(far.x, base.y), 0), f.x);
+    vec4 top = mix(texelFetch(color_tex, ivec2(base.x, far.y), 0),
+                   texelFetch(color_tex, far, 0), f.x);
+    FragColor = mix(bottom, top, f.y);
+}
+)glsl";
+
+const char* SPLAT_VERT_SHADER_SRC =
+    R"glsl(
+precision highp float;
+precision highp int;
+
+// rt.frag writes the mesh depth (1e9 without meshes) where no surface is hit
+#define NO_DEPTH 1e8
+// Distances are mapped linearly to the depth buffer up to this
+#define MAX_DEPTH 1e4
+
+uniform highp sampler2D color_tex;
+uniform highp sampler2D depth_tex;
+uniform highp sampler2D info_tex;
+uniform ivec2 reso;
+uniform mat4x3 prev_c2w;
+uniform vec2 prev_focal;
+uniform mat4x3 c2w;
+uniform vec2 focal;
+uniform float cos_max_angle;
+uniform float depth_tol;
+
+flat out vec4 v_color;
+flat out float v_depth;
+flat out vec4 v_info;
+
+// World direction of pixel pt's ray, as in rt.frag
+vec3 pixel_dir(mat4x3 transform, vec2 f, ivec2 pt) {
+    vec2 xy = (vec2(pt) + vec2(0.0, 1.0) - 0.5 * vec2(reso)) / f;
+    return normalize(mat3(transform) * normalize(vec3(xy, -1.0)));
+}
+
+// Whether pixel pt differs in depth from a 4-neighbour by more than
+// depth_tol relative, or borders a pixel without depth
+bool depth_edge(ivec2 pt, float depth) {
+    ivec2 offsets[4] = ivec2[4](ivec2(-1, 0), ivec2(1, 0), ivec2(0, -1),
+                                ivec2(0, 1));
+    for (int k = 0; k < 4; ++k) {
+        ivec2 q = pt + offsets[k];
+        if (q.x < 0 || q.y < 0 || q.x >= reso.x || q.y >= reso.y) continue;
+        float nd = texelFetch(depth_tex, q, 0).r;
+        if (nd >= NO_DEPTH || abs(nd - depth) > depth_tol * depth) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void main()
+{
+    ivec2 pt = ivec2(gl_VertexID % reso.x, gl_VertexID / reso.x);
+    gl_PointSize = 1.0;
+    // Clipped unless reprojected
+    gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+    float depth = texelFetch(depth_tex, pt, 0).r;
+    if (depth >= NO_DEPTH) return;
+
+    vec3 point = prev_c2w[3] + depth * pixel_dir(prev_c2w, prev_focal, pt);
+    vec3 rel = point - c2w[3];
+    vec3 local = transpose(mat3(c2w)) * rel;
+    float dist = length(rel);
+    if (local.z >= 0.0 || dist >= MAX_DEPTH) return;
+    // Window position; the point lands on the pixel it falls in
+    vec2 win = local.xy / -local.z * focal + 0.5 * vec2(reso) +
+               vec2(0.5, -0.5);
+
+    vec4 info = texelFetch(info_tex, pt, 0);
+    float error = info.w + length(fract(win) - 0.5);
+    if (dot(normalize(point - info.xyz), rel / dist) < cos_max_angle ||
+        depth_edge(pt, depth)) {
+        // Still occludes what is behind, but retraced
+        error = 1e30;
+    }
+    v_color = texelFetch(color_tex, pt, 0);
+    v_depth = dist;
+    v_info = vec4(info.xyz, error);
+    gl_Position = vec4(win / vec2(reso) * 2.0 - 1.0,
+                       dist / MAX_DEPTH * 2.0 - 1.0, 1.0);
+}
+)glsl";
+
+const char* SPLAT_FRAG_SHADER_SRC =
+    R"glsl(
+precision highp float;
+
+flat in vec4 v_color;
+flat in float v_depth;
+flat in vec4 v_info;
+
+layout(location = 0) out vec4 FragColor;
+layout(location = 1) out float Depth;
+layout(location = 2) out vec4 Info;
+
+void main()
+{
+    FragColor = vec4(v_color.rgb, 1.0);
+    Depth = v_depth;
+    Info = v_info;
+}
+)glsl";
+
+const float quad_verts[] = {
+    -1.f, -1.f, 0.5f, 1.f, -1.f, 0.5f, -1.f, 1.f, 0.5f, 1.f, 1.f, 0.5f,
+};
+
+// Full screen quad for the passes below
+void init_quad(GLuint& vao, GLuint& vbo) {
+    glGenBuffers(1, &vbo);
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof quad_verts, (GLvoid*)quad_verts,
+                 GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
+                          (GLvoid*)0);
+    glEnableVertexAttribArray(0);
+    glBindVertexArray(0);
+}
+
+}  // namespace
+
+float DynamicResolution::next_scale(bool moving,
+                                    const RenderOptions& options) {
+    if (!options.dynamic_res) return scale_ = 1.f;
+    const float low =
+        std::max(std::min(options.dynamic_res_scale, 1.f), 0.05f);
+    scale_ = moving ? low : std::min(scale_ * 2.f, 1.f);
+    return scale_;
+}
+
+void DynamicResolution::scaled_size(int width, int height, float scale,
+                                    int& out_width, int& out_height) {
+    out_width = std::max((int)std::lround(width * scale), 1);
+    out_height = std::max((int)std::lround(height * scale), 1);
+}
+
+DepthUpsampler::~DepthUpsampler() {
+    if (program_ == 0) return;
+    glDeleteProgram(program_);
+    glDeleteVertexArrays(1, &vao_);
+    glDeleteBuffers(1, &vbo_);
+}
+
+void DepthUpsampler::init() {
+    program_ = create_shader_program(QUAD_VERT_SHADER_SRC,
+                                     UPSAMPLE_FRAG_SHADER_SRC);
+    u_color_tex_ = glGetUniformLocation(program_, "color_tex");
+    u_depth_tex_ = glGetUniformLocation(program_, "depth_tex");
+    u_low_reso_ = glGetUniformLocation(program_, "low_reso");
+    u_out_reso_ = glGetUniformLocation(program_, "out_reso");
+    init_quad(vao_, vbo_);
+}
+
+void DepthUpsampler::draw(GLuint color_tex, GLuint depth_tex, int width,
+                          int height, int out_width, int out_height) {
+    if (program_ == 0) init();
+    glUseProgram(program_);
+    glUniform1i(u_color_tex_, 0);
+    glUniform1i(u_depth_tex_, 1);
+    glUniform2i(u_low_reso_, width, height);
+    glUniform2f(u_out_reso_, (float)out_width, (float)out_height);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, color_tex);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, depth_tex);
+
+    glViewport(0, 0, out_width, out_height);
+    glBindVertexArray(vao_);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, (GLsizei)4);
+    glBindVertexArray(0);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+ProgressiveFill::~ProgressiveFill() {
+    if (program_ == 0) return;
+    glDeleteProgram(program_);
+    glDeleteVertexArrays(1, &vao_);
+    glDeleteBuffers(1, &vbo_);
+}
+
+void ProgressiveFill::init() {
+    program_ =
+        create_shader_program(QUAD_VERT_SHADER_SRC, FILL_FRAG_SHADER_SRC);
+    u_color_tex_ = glGetUniformLocation(program_, "color_tex");
+    u_passes_done_ = glGetUniformLocation(program_, "passes_done");
+    u_roi_ = glGetUniformLocation(program_, "roi");
+    u_roi_passes_ = glGetUniformLocation(program_, "roi_passes");
+    init_quad(vao_, vbo_);
+}
+
+void ProgressiveFill::draw(GLuint color_tex, int passes_done, int width,
+                           int height, const RenderOptions& options) {
+    if (program_ == 0) init();
+    glUseProgram(program_);
+    glUniform1i(u_color_tex_, 0);
+    glUniform1i(u_passes_done_, passes_done);
+    glUniform3f(u_roi_, options.roi_center[0], height - options.roi_center[1],
+                options.roi ? options.roi_radius : -1.f);
+    glUniform1i(u_roi_passes_, roi_passes(options));
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, color_tex);
+
+    glViewport(0, 0, width, height);
+    glBindVertexArray(vao_);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, (GLsizei)4);
+    glBindVertexArray(0);
+}
+
+ReprojectSplat::~ReprojectSplat() {
+    if (program_ == 0) return;
+    glDeleteProgram(program_);
+    glDeleteVertexArrays(1, &vao_);
+}
+
+void ReprojectSplat::init() {
+    program_ =
+        create_shader_program(SPLAT_VERT_SHADER_SRC, SPLAT_FRAG_SHADER_SRC);
+    u_color_tex_ = glGetUniformLocation(program_, "color_tex");
+    u_depth_tex_ = glGetUniformLocation(program_, "depth_tex");
+    u_info_tex_ = glGetUniformLocation(program_, "info_tex");
+    u_reso_ = glGetUniformLocation(program_, "reso");
+    u_prev_c2w_ = glGetUniformLocation(program_, "prev_c2w");
+    u_prev_focal_ = glGetUniformLocation(program_, "prev_focal");
+    u_c2w_ = glGetUniformLocation(program_, "c2w");
+    u_focal_ = glGetUniformLocation(program_, "focal");
+    u_cos_max_angle_ = glGetUniformLocation(program_, "cos_max_angle");
+    u_depth_tol_ = glGetUniformLocation(program_, "depth_tol");
+    // Points are generated from gl_VertexID, without attributes
+    glGenVertexArrays(1, &vao_);
+}
+
+void ReprojectSplat::draw(GLuint color_tex, GLuint depth_tex,
+                          GLuint info_tex, int width, int height,
+                          const glm::mat4x3& prev_c2w,
+                          const glm::vec2& prev_focal,
+                          const glm::mat4x3& c2w, const glm::vec2& focal,
+                          float max_angle, float depth_tol) {
+    if (program_ == 0) init();
+    const GLfloat zero[4] = {0.f, 0.f, 0.f, 0.f}, no_depth = 1e9f,
+                  far_depth = 1.f;
+    glViewport(0, 0, width, height);
+    glDepthMask(GL_TRUE);
+    glClearBufferfv(GL_COLOR, 0, zero);
+    glClearBufferfv(GL_COLOR, 1, &no_depth);
+    glClearBufferfv(GL_COLOR, 2, zero);
+    glClearBufferfv(GL_DEPTH, 0, &far_depth);
+
+    glUseProgram(program_);
+    glUniform1i(u_color_tex_, 0);
+    glUniform1i(u_depth_tex_, 1);
+    glUniform1i(u_info_tex_, 2);
+    glUniform2i(u_reso_, width, height);
+    glUniformMatrix4x3fv(u_prev_c2w_, 1, GL_FALSE, glm::value_ptr(prev_c2w));
+    glUniform2f(u_prev_focal_, prev_focal.x, prev_focal.y);
+    glUniformMatrix4x3fv(u_c2w_, 1, GL_FALSE, glm::value_ptr(c2w));
+    glUniform2f(u_focal_, focal.x, focal.y);
+    glUniform1f(u_cos_max_angle_, std::cos(max_angle));
+    glUniform1f(u_depth_tol_, depth_tol);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, color_tex);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, depth_tex);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, info_tex);
+
+    const GLboolean depth_test = glIsEnabled(GL_DEPTH_TEST);
+    glEnable(GL_DEPTH_TEST);
+    glBindVertexArray(vao_);
+    glDrawArrays(GL_POINTS, 0, (GLsizei)width * height);
+    glBindVertexArray(0);
+    if (!depth_test) glDisable(GL_DEPTH_TEST);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+}  // namespace internal
+}  // namespace volrend
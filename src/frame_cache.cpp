@@ -0,0 +1,342 @@
+#include "volrend/internal/frame_cache.hpp"
+#include "volrend/internal/auto_filesystem.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace volrend {
+namespace internal {
+namespace {
+const uint64_t HASH_K = 0x9E3779B97F4A7C15ULL;
+const char FRAME_MAGIC[4] = {'V', 'R', 'F', 'C'};
+
+uint64_t mix64(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+uint64_t rotl64(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+template <typename T>
+uint64_t hash_value(uint64_t seed, const T& value) {
+    return hash_combine(seed, hash_bytes(&value, sizeof(T)));
+}
+
+// Shape and data of a cnpy::NpyArray or internal::HostArray
+template <typename Array>
+uint64_t hash_npy(uint64_t seed, const Array& arr) {
+    for (size_t s : arr.shape) seed = hash_combine(seed, s);
+    if (arr.num_bytes()) {
+        seed = hash_combine(
+            seed, hash_bytes(arr.template data<char>(), arr.num_bytes()));
+    }
+    return seed;
+}
+
+std::string hex_key(uint64_t key) {
+    char buf[17];
+    snprintf(buf, sizeof buf, "%016llx", (unsigned long long)key);
+    return buf;
+}
+
+uint64_t hash_bbox(const float* bbox) {
+    return hash_bytes(bbox, 6 * sizeof(float));
+}
+
+// Read a cached frame, checking the header matches
+bool read_frame(const std::string& path, int width, int height, uint8_t* out,
+                float* bbox_out) {
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) return false;
+    char magic[4];
+    int32_t wh[2];
+    float bbox[6];
+    ifs.read(magic, 4);
+    ifs.read(reinterpret_cast<char*>(wh), sizeof wh);
+    ifs.read(reinterpret_cast<char*>(bbox), sizeof bbox);
+    if (!ifs || memcmp(magic, FRAME_MAGIC, 4) || wh[0] != width ||
+        wh[1] != height) {
+        return false;
+    }
+    if (out != nullptr) {
+        ifs.read(reinterpret_cast<char*>(out), (size_t)4 * width * height);
+        if (!ifs) return false;
+    }
+    if (bbox_out != nullptr) std::copy(bbox, bbox + 6, bbox_out);
+    return true;
+}
+
+// Project world point to pixel coordinates; false if not in front of camera
+bool project(const Camera& cam, const glm::vec3& world, float& px,
+             float& py) {
+    const glm::mat4x3& c2w = cam.transform;
+    glm::vec3 rel = world - c2w[3];
+    // Camera looks along -z, with the rotation columns of c2w as axes
+    float xc = glm::dot(rel, c2w[0]), yc = glm::dot(rel, c2w[1]),
+          zc = -glm::dot(rel, c2w[2]);
+    if (zc < 1e-5f) return false;
+    px = 0.5f * cam.width + cam.fx * xc / zc;
+    py = 0.5f * cam.height - cam.fy * yc / zc;
+    return true;
+}
+}  // namespace
+
+uint64_t hash_combine(uint64_t seed, uint64_t value) {
+    return mix64(seed ^ (value + HASH_K + (seed << 6) + (seed >> 2)));
+}
+
+uint64_t hash_bytes(const void* data, size_t size, uint64_t seed) {
+    const char* ptr = static_cast<const char*>(data);
+    // 4 independent lanes so the multiplies pipeline on large buffers
+    uint64_t lanes[4] = {seed ^ HASH_K, seed + HASH_K, ~seed,
+                         seed * HASH_K + 1};
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int j = 0; j < 4; ++j) {
+            uint64_t w;
+            memcpy(&w, ptr + i + 8 * j, 8);
+            lanes[j] = rotl64(lanes[j] ^ (w * HASH_K), 31) *
+                       0x87c37b91114253d5ULL;
+        }
+    }
+    uint64_t h = size;
+    for (int j = 0; j < 4; ++j) h = hash_combine(h, lanes[j]);
+    for (; i < size; i += 8) {
+        uint64_t w = 0;
+        memcpy(&w, ptr + i, std::min<size_t>(8, size - i));
+        h = hash_combine(h, w);
+    }
+    return mix64(h);
+}
+
+uint64_t hash_tree(const N3Tree& tree) {
+    uint64_t h = hash_value(0, tree.N);
+    h = hash_value(h, tree.data_dim);
+    h = hash_value(h, tree.data_format.format);
+    h = hash_value(h, tree.data_format.basis_dim);
+    h = hash_value(h, tree.scale);
+    h = hash_value(h, tree.offset);
+    h = hash_value(h, tree.use_ndc);
+    if (tree.use_ndc) {
+        h = hash_value(h, tree.ndc_width);
+        h = hash_value(h, tree.ndc_height);
+        h = hash_value(h, tree.ndc_focal);
+    }
+    h = hash_npy(h, tree.data_);
+    h = hash_npy(h, tree.child_);
+    h = hash_npy(h, tree.extra_);
+    return h;
+}
+
+uint64_t hash_render_options(const RenderOptions& options) {
+    uint64_t h = hash_value(0, options.step_size);
+    h = hash_value(h, options.sigma_thresh);
+    h = hash_value(h, options.stop_thresh);
+    h = hash_value(h, options.background_brightness);
+    h = hash_value(h, options.adaptive);
+    if (options.adaptive) h = hash_value(h, options.adaptive_footprint);
+    h = hash_value(h, options.basis_minmax);
+    h = hash_value(h, options.rot_dirs);
+    h = hash_value(h, options.show_grid);
+    if (options.show_grid) h = hash_value(h, options.grid_max_depth);
+#ifdef VOLREND_CUDA
+    h = hash_value(h, options.render_depth);
+#endif
+    h = hash_value(h, options.roi);
+    if (options.roi) {
+        h = hash_value(h, options.roi_center);
+        h = hash_value(h, options.roi_radius);
+        h = hash_value(h, options.roi_stride);
+        h = hash_value(h, options.roi_step_scale);
+    }
+    h = hash_value(h, options.enable_probe);
+    if (options.enable_probe) {
+        h = hash_value(h, options.probe);
+        h = hash_value(h, options.probe_disp_size);
+    }
+    return h;
+}
+
+uint64_t hash_camera(const Camera& cam) {
+    uint64_t h = hash_value(0, cam.width);
+    h = hash_value(h, cam.height);
+    h = hash_value(h, cam.fx);
+    h = hash_value(h, cam.fy);
+    for (int i = 0; i < 4; ++i) {
+        for (int j = 0; j < 3; ++j) h = hash_value(h, cam.transform[i][j]);
+    }
+    return h;
+}
+
+uint64_t hash_meshes(const std::vector<Mesh>& meshes) {
+    uint64_t h = hash_value(0, meshes.size());
+    for (const Mesh& mesh : meshes) {
+        h = hash_value(h, mesh.visible);
+        if (!mesh.visible) continue;
+        h = hash_value(h, mesh.unlit);
+        h = hash_value(h, mesh.face_size);
+        h = hash_value(h, mesh.scale);
+        h = hash_value(h, mesh.rotation);
+        h = hash_value(h, mesh.translation);
+        h = hash_bytes(mesh.vert.data(), mesh.vert.size() * sizeof(float), h);
+        h = hash_bytes(mesh.faces.data(),
+                       mesh.faces.size() * sizeof(unsigned int), h);
+        h = hash_bytes(mesh.instance_transform.data(),
+                       mesh.instance_transform.size() * sizeof(float), h);
+        h = hash_bytes(mesh.instance_color.data(),
+                       mesh.instance_color.size() * sizeof(float), h);
+    }
+    return h;
+}
+
+int bbox_dirty_tiles(const N3Tree& tree, const Camera& cam,
+                     const float* bbox_a, const float* bbox_b, int tile_size,
+                     std::vector<uint8_t>& mask) {
+    const int tiles_x = (cam.width + tile_size - 1) / tile_size,
+              tiles_y = (cam.height + tile_size - 1) / tile_size;
+    mask.assign((size_t)tiles_x * tiles_y, 0);
+
+    // Rays are warped in NDC, so the bbox does not project simply
+    if (tree.use_ndc) {
+        std::fill(mask.begin(), mask.end(), 1);
+        return (int)mask.size();
+    }
+
+    // The symmetric difference of the two boxes is covered by one slab
+    // per differing face, spanning the union box on the other axes
+    float uni[6];
+    for (int i = 0; i < 3; ++i) {
+        uni[i] = std::min(bbox_a[i], bbox_b[i]);
+        uni[i + 3] = std::max(bbox_a[i + 3], bbox_b[i + 3]);
+    }
+    std::vector<std::array<float, 6>> slabs;
+    for (int i = 0; i < 3; ++i) {
+        for (int side = 0; side < 6; side += 3) {
+            const float a = bbox_a[i + side], b = bbox_b[i + side];
+            if (a == b) continue;
+            std::array<float, 6> slab;
+            std::copy(uni, uni + 6, slab.begin());
+            slab[i] = std::min(a, b);
+            slab[i + 3] = std::max(a, b);
+            slabs.push_back(slab);
+        }
+    }
+
+    int n_dirty = 0;
+    for (const auto& slab : slabs) {
+        float xmin = 1e9f, ymin = 1e9f, xmax = -1e9f, ymax = -1e9f;
+        bool behind = false;
+        for (int c = 0; c < 8 && !behind; ++c) {
+            glm::vec3 world;
+            for (int i = 0; i < 3; ++i) {
+                // Render bbox is in tree coordinates, see trace_ray
+                const float p = slab[(c >> i & 1) ? i + 3 : i];
+                world[i] = (p - tree.offset[i]) / tree.scale[i];
+            }
+            float px, py;
+            if (!project(cam, world, px, py)) {
+                behind = true;
+                break;
+            }
+            xmin = std::min(xmin, px);
+            xmax = std::max(xmax, px);
+            ymin = std::min(ymin, py);
+            ymax = std::max(ymax, py);
+        }
+        if (behind) {
+            // Slab crosses the camera plane, be conservative
+            std::fill(mask.begin(), mask.end(), 1);
+            return (int)mask.size();
+        }
+        // Pad by a pixel for rounding and the bbox epsilon in the tracer
+        xmin = std::max(xmin, -1.f);
+        ymin = std::max(ymin, -1.f);
+        xmax = std::min(xmax, cam.width + 1.f);
+        ymax = std::min(ymax, cam.height + 1.f);
+        const int tx0 = std::max((int)std::floor(xmin - 1.f) / tile_size, 0),
+                  ty0 = std::max((int)std::floor(ymin - 1.f) / tile_size, 0);
+        const int tx1 = std::min((int)std::ceil(xmax + 1.f) / tile_size,
+                                 tiles_x - 1),
+                  ty1 = std::min((int)std::ceil(ymax + 1.f) / tile_size,
+                                 tiles_y - 1);
+        for (int ty = ty0; ty <= ty1; ++ty) {
+            for (int tx = tx0; tx <= tx1; ++tx) {
+                uint8_t& m = mask[(size_t)ty * tiles_x + tx];
+                n_dirty += !m;
+                m = 1;
+            }
+        }
+    }
+    return n_dirty;
+}
+
+FrameCache::FrameCache(const std::string& root) : root_(root) {
+    std::filesystem::create_directories(root_);
+}
+
+bool FrameCache::load(uint64_t key, const float* bbox, int width, int height,
+                      uint8_t* out) const {
+    const std::string path =
+        root_ + "/" + hex_key(key) + "/" + hex_key(hash_bbox(bbox)) + ".frame";
+    return read_frame(path, width, height, out, nullptr);
+}
+
+bool FrameCache::load_nearest(uint64_t key, const float* bbox, int width,
+                              int height, uint8_t* out,
+                              float* bbox_out) const {
+    const std::filesystem::path dir = root_ + "/" + hex_key(key);
+    if (!std::filesystem::is_directory(dir)) return false;
+    // Headers only, then pick the closest bbox (fewest dirty tiles)
+    std::string best_path;
+    float best_dist = 1e9f;
+    for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+        const std::string path = entry.path().string();
+        float cbbox[6];
+        if (!read_frame(path, width, height, nullptr, cbbox)) continue;
+        float dist = 0.f;
+        for (int i = 0; i < 6; ++i) dist += std::fabs(cbbox[i] - bbox[i]);
+        if (dist < best_dist) {
+            best_dist = dist;
+            best_path = path;
+        }
+    }
+    if (best_path.empty()) return false;
+    return read_frame(best_path, width, height, out, bbox_out);
+}
+
+bool FrameCache::store(uint64_t key, const float* bbox, int width, int height,
+                       const uint8_t* data) const {
+    const std::string dir = root_ + "/" + hex_key(key);
+    std::filesystem::create_directories(dir);
+    const std::string path = dir + "/" + hex_key(hash_bbox(bbox)) + ".frame";
+    // Write then rename so concurrent readers never see partial frames
+    const std::string tmp_path = path + ".tmp";
+    {
+        std::ofstream ofs(tmp_path, std::ios::binary);
+        if (!ofs) {
+            fprintf(stderr, "WARNING: Could not write frame cache '%s'\n",
+                    tmp_path.c_str());
+            return false;
+        }
+        const int32_t wh[2] = {width, height};
+        ofs.write(FRAME_MAGIC, 4);
+        ofs.write(reinterpret_cast<const char*>(wh), sizeof wh);
+        ofs.write(reinterpret_cast<const char*>(bbox), 6 * sizeof(float));
+        ofs.write(reinterpret_cast<const char*>(data),
+                  (size_t)4 * width * height);
+        if (!ofs) return false;
+    }
+    std::filesystem::rename(tmp_path, path);
+    return true;
+}
+
+}  // namespace internal
+}  // namespace volrend
@@ -0,0 +1,129 @@
+#include "volrend/internal/host_alloc.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <new>
+#include <numeric>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#endif
+
+namespace volrend {
+namespace internal {
+namespace {
+
+const size_t SIZE_2MB = size_t(1) << 21;
+const size_t SIZE_1GB = size_t(1) << 30;
+
+size_t round_up(size_t x, size_t align) {
+    return (x + align - 1) / align * align;
+}
+
+// Granularity of mappings made in mode
+size_t mode_page_size(PageMode mode) {
+    return mode == PageMode::HUGE_1GB ? SIZE_1GB : SIZE_2MB;
+}
+
+void warn_once(PageMode mode, const char* msg) {
+    static std::atomic<bool> warned[4];
+    if (!warned[(int)mode].exchange(true)) {
+        fprintf(stderr, "WARNING: %s pages: %s\n", page_mode_name(mode), msg);
+    }
+}
+
+}  // namespace
+
+bool parse_page_mode(const std::string& str, PageMode& mode) {
+    if (str == "default") {
+        mode = PageMode::DEFAULT;
+    } else if (str == "thp") {
+        mode = PageMode::THP;
+    } else if (str == "2mb") {
+        mode = PageMode::HUGE_2MB;
+    } else if (str == "1gb") {
+        mode = PageMode::HUGE_1GB;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* page_mode_name(PageMode mode) {
+    switch (mode) {
+        case PageMode::THP:
+            return "thp";
+        case PageMode::HUGE_2MB:
+            return "2mb";
+        case PageMode::HUGE_1GB:
+            return "1gb";
+        default:
+            return "default";
+    }
+}
+
+void* host_alloc(size_t bytes, PageMode mode) {
+    if (mode == PageMode::DEFAULT || bytes == 0) return ::operator new(bytes);
+#ifdef __linux__
+    const size_t len = round_up(bytes, mode_page_size(mode));
+    if (mode != PageMode::THP) {
+        const int shift = mode == PageMode::HUGE_1GB ? 30 : 21;
+        void* ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB |
+                             (shift << MAP_HUGE_SHIFT),
+                         -1, 0);
+        if (ptr != MAP_FAILED) return ptr;
+        warn_once(mode,
+                  "hugetlbfs mapping failed (reserve pages with "
+                  "vm.nr_hugepages), using transparent huge pages");
+    }
+    // 2MB aligned, so that transparent huge pages can back all of it
+    char* ptr = (char*)mmap(nullptr, len + SIZE_2MB, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == (char*)MAP_FAILED) throw std::bad_alloc();
+    char* aligned = (char*)round_up((uintptr_t)ptr, SIZE_2MB);
+    if (aligned > ptr) munmap(ptr, aligned - ptr);
+    if (aligned < ptr + SIZE_2MB) {
+        munmap(aligned + len, ptr + SIZE_2MB - aligned);
+    }
+    if (madvise(aligned, len, MADV_HUGEPAGE) != 0) {
+        warn_once(mode,
+                  "madvise(MADV_HUGEPAGE) failed (transparent huge pages "
+                  "disabled?), using ordinary pages");
+    }
+    return aligned;
+#else
+    warn_once(mode, "not supported on this platform, using ordinary pages");
+    return ::operator new(bytes);
+#endif
+}
+
+void host_free(void* ptr, size_t bytes, PageMode mode) {
+    if (mode == PageMode::DEFAULT || bytes == 0) {
+        ::operator delete(ptr);
+        return;
+    }
+#ifdef __linux__
+    munmap(ptr, round_up(bytes, mode_page_size(mode)));
+#else
+    ::operator delete(ptr);
+#endif
+}
+
+void HostArray::reinit(const std::vector<size_t>& shape, size_t word_size,
+                       PageMode mode) {
+    this->shape = shape;
+    this->word_size = word_size;
+    num_vals = std::accumulate(shape.begin(), shape.end(), size_t(1),
+                               std::multiplies<size_t>());
+    decltype(data_holder)(num_vals * word_size, HostAllocator<char>(mode))
+        .swap(data_holder);
+}
+
+}  // namespace internal
+}  // namespace volrend
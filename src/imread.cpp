@@ -0,0 +1,85 @@
+#include "volrend/common.hpp"
+#include "volrend/internal/imread.hpp"
+#include <cstdio>
+
+#ifdef VOLREND_PNG
+#include <png.h>
+#endif
+
+namespace volrend {
+namespace internal {
+
+bool read_png_file(const std::string &filename, std::vector<uint8_t> &out,
+                   int &width, int &height) {
+#ifdef VOLREND_PNG
+    FILE *fp = fopen(filename.c_str(), "rb");
+    if (!fp) {
+        fprintf(stderr, "PNG '%s' could not be opened\n", filename.c_str());
+        return false;
+    }
+
+    png_structp png =
+        png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png) {
+        fprintf(stderr, "PNG read failed\n");
+        fclose(fp);
+        return false;
+    }
+
+    png_infop info = png_create_info_struct(png);
+    if (!info) {
+        fprintf(stderr, "PNG read failed\n");
+        png_destroy_read_struct(&png, NULL, NULL);
+        fclose(fp);
+        return false;
+    }
+
+    if (setjmp(png_jmpbuf(png))) {
+        fprintf(stderr, "PNG read failed\n");
+        png_destroy_read_struct(&png, &info, NULL);
+        fclose(fp);
+        return false;
+    }
+
+    png_init_io(png, fp);
+    png_read_info(png, info);
+
+    width = png_get_image_width(png, info);
+    height = png_get_image_height(png, info);
+    const png_byte color_type = png_get_color_type(png, info);
+    const png_byte bit_depth = png_get_bit_depth(png, info);
+
+    // Convert everything to 8bit depth, RGBA format
+    if (bit_depth == 16) png_set_strip_16(png);
+    if (color_type == PNG_COLOR_TYPE_PALETTE) png_set_palette_to_rgb(png);
+    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+        png_set_expand_gray_1_2_4_to_8(png);
+    if (png_get_valid(png, info, PNG_INFO_tRNS)) png_set_tRNS_to_alpha(png);
+    if (color_type == PNG_COLOR_TYPE_RGB || color_type == PNG_COLOR_TYPE_GRAY ||
+        color_type == PNG_COLOR_TYPE_PALETTE)
+        png_set_filler(png, 0xFF, PNG_FILLER_AFTER);
+    if (color_type == PNG_COLOR_TYPE_GRAY ||
+        color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+        png_set_gray_to_rgb(png);
+    png_read_update_info(png, info);
+
+    out.resize((size_t)4 * width * height);
+    std::vector<png_bytep> row_ptrs(height);
+    for (int i = 0; i < height; ++i) {
+        row_ptrs[i] = out.data() + (size_t)i * width * 4;
+    }
+    png_read_image(png, row_ptrs.data());
+
+    png_destroy_read_struct(&png, &info, NULL);
+    fclose(fp);
+    return true;
+#else
+    fprintf(stderr,
+            "WARNING: Not reading image because volrend was not built with "
+            "libpng\n");
+    return false;
+#endif
+}
+
+}  // namespace internal
+}  // namespace volrend
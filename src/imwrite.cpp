@@ -11,8 +11,8 @@
 namespace volrend {
 namespace internal {
 
-bool write_png_file(const std::string &filename, uint8_t *ptr, int width,
-                    int height) {
+bool write_png_file(const std::string &filename, const uint8_t *ptr,
+                    int width, int height) {
 #ifdef VOLREND_PNG
     FILE *fp = fopen(filename.c_str(), "wb");
     if (!fp) {
@@ -58,9 +58,10 @@ bool write_png_file(const std::string &filename, uint8_t *ptr, int width,
         return false;
     }
 
+    // libpng only reads the rows
     std::vector<uint8_t *> row_ptrs(height);
     for (int i = 0; i < height; ++i) {
-        row_ptrs[i] = ptr + i * width * 4;
+        row_ptrs[i] = const_cast<uint8_t *>(ptr) + i * width * 4;
     }
 
     png_write_image(png, row_ptrs.data());
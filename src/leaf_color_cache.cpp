@@ -0,0 +1,47 @@
+#include "volrend/internal/leaf_color_cache.hpp"
+
+#include <cmath>
+
+namespace volrend {
+namespace internal {
+
+LeafColorCache::LeafColorCache(size_t budget_bytes, int dir_res)
+    : dir_res_(dir_res < 1 ? 1 : dir_res) {
+    // Power of two number of sets, at least 1024
+    const size_t set_bytes = WAYS * sizeof(uint64_t);
+    int log_sets = 10;
+    while (((size_t)2 << log_sets) * set_bytes <= budget_bytes &&
+           log_sets < 40) {
+        ++log_sets;
+    }
+    n_sets_ = (size_t)1 << log_sets;
+    set_shift_ = 64 - log_sets;
+    entries_.reset(new std::atomic<uint64_t>[n_sets_ * WAYS]);
+    clear();
+}
+
+void LeafColorCache::bin_dir(uint32_t bin, float* dir) const {
+    const int bu = bin % dir_res_, bv = bin / dir_res_;
+    float u = (bu + 0.5f) / dir_res_ * 2.f - 1.f,
+          v = (bv + 0.5f) / dir_res_ * 2.f - 1.f;
+    const float z = 1.f - std::fabs(u) - std::fabs(v);
+    if (z < 0.f) {
+        // Unfold the lower hemisphere
+        const float fu = (1.f - std::fabs(v)) * (u >= 0.f ? 1.f : -1.f);
+        v = (1.f - std::fabs(u)) * (v >= 0.f ? 1.f : -1.f);
+        u = fu;
+    }
+    const float inv_norm = 1.f / std::sqrt(u * u + v * v + z * z);
+    dir[0] = u * inv_norm;
+    dir[1] = v * inv_norm;
+    dir[2] = z * inv_norm;
+}
+
+void LeafColorCache::clear() {
+    for (size_t i = 0; i < n_sets_ * WAYS; ++i) {
+        entries_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+}  // namespace internal
+}  // namespace volrend
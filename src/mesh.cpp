@@ -9,17 +9,24 @@
 #include <GL/glew.h>
 #endif
 
+#include <algorithm>
+#include <cmath>
 #include <numeric>
 #include <sstream>
 #include <fstream>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <limits>
 #include <map>
-#include <cnpy.h>
+#include <memory>
+#include <utility>
 #include "half.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
-#include <tiny_obj_loader.h>
+#include "volrend/internal/npz_view.hpp"
+#include "volrend/internal/obj_parser.hpp"
+#include "volrend/internal/point_lod.hpp"
 #include "volrend/internal/shader.hpp"
 
 namespace {
@@ -38,73 +45,21 @@ GLenum get_gl_ele_type(int face_size) {
     }
 }
 
-template <class scalar_t>
-void _cross3(const scalar_t* a, const scalar_t* b, scalar_t* out) {
-    out[0] = a[1] * b[2] - a[2] * b[1];
-    out[1] = a[2] * b[0] - a[0] * b[2];
-    out[2] = a[0] * b[1] - a[1] * b[0];
-}
-
-template <typename scalar_t>
-scalar_t _norm(scalar_t* dir) {
-    return sqrtf(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
-}
-
-template <typename scalar_t>
-void _normalize(scalar_t* dir) {
-    scalar_t norm = _norm(dir);
-    if (norm > 1e-6) {
-        dir[0] /= norm;
-        dir[1] /= norm;
-        dir[2] /= norm;
-    }
-}
-
-void estimate_normals(std::vector<float>& verts,
-                      const std::vector<unsigned int>& faces) {
-    const int n_faces =
-        faces.size() ? faces.size() / 3 : verts.size() / VERT_SZ / 3;
-    float a[3], b[3], cross[3], off[3];
-    for (int i = 0; i < verts.size() / VERT_SZ; ++i) {
-        for (int j = 0; j < 3; ++j) verts[i * VERT_SZ + 6 + j] = 0.f;
-    }
-    for (int i = 0; i < n_faces; ++i) {
-        if (faces.size()) {
-            off[0] = faces[3 * i] * VERT_SZ;
-            off[1] = faces[3 * i + 1] * VERT_SZ;
-            off[2] = faces[3 * i + 2] * VERT_SZ;
-        } else {
-            off[0] = i * VERT_SZ * 3;
-            off[1] = off[0] + VERT_SZ;
-            off[2] = off[1] + VERT_SZ;
-        }
-
-        for (int j = 0; j < 3; ++j) {
-            a[j] = verts[off[1] + j] - verts[off[0] + j];
-            b[j] = verts[off[2] + j] - verts[off[0] + j];
-        }
-        _cross3(a, b, cross);
-        for (int j = 0; j < 3; ++j) {
-            float* ptr = &verts[off[j] + 6];
-            for (int k = 0; k < 3; ++k) {
-                ptr[k] += cross[k];
-            }
-        }
-    }
-    for (int i = 0; i < verts.size() / VERT_SZ; ++i) {
-        _normalize(&verts[i * VERT_SZ + 6]);
-    }
-}
-
 const char* VERT_SHADER_SRC =
     R"glsl(
 uniform mat4x4 K;
 uniform mat4x4 MV;
 uniform mat4x4 M;
+uniform bool instColor;
 
 in vec3 aPos;
 in vec3 aColor;
 in vec3 aNormal;
+// Instance transform rows (identity if not instanced) and color
+layout(location = 3) in vec4 aInstRow0;
+layout(location = 4) in vec4 aInstRow1;
+layout(location = 5) in vec4 aInstRow2;
+layout(location = 6) in vec3 aInstColor;
 
 out lowp vec3 VertColor;
 out highp vec4 FragPos;
@@ -112,10 +67,14 @@ out highp vec3 Normal;
 
 void main()
 {
-    FragPos = MV * vec4(aPos.x, aPos.y, aPos.z, 1.0);
+    vec4 pos = vec4(aPos.x, aPos.y, aPos.z, 1.0);
+    mat3x3 inst = transpose(mat3x3(aInstRow0.xyz, aInstRow1.xyz,
+                                   aInstRow2.xyz));
+    FragPos = MV * vec4(dot(aInstRow0, pos), dot(aInstRow1, pos),
+                        dot(aInstRow2, pos), 1.0);
     gl_Position = K * FragPos;
-    VertColor = aColor;
-    Normal = normalize(mat3x3(M) * aNormal);
+    VertColor = instColor ? aInstColor : aColor;
+    Normal = normalize(mat3x3(M) * inst * aNormal);
 }
 )glsl";
 
@@ -161,7 +120,51 @@ void main()
 )glsl";
 
 unsigned int program = -1;
-unsigned int u_K, u_MV, u_M, u_cam_pos, u_unlit;
+unsigned int u_K, u_MV, u_M, u_cam_pos, u_unlit, u_inst_color;
+
+// Vertex attributes of the instance transform rows, and color
+const int INST_ATTRIB = 3, INST_COLOR_ATTRIB = 6;
+
+// Vertex buffers at least this large (e.g. huge point clouds) are uploaded
+// into persistently mapped immutable storage where available (GL 4.4 or
+// ARB_buffer_storage): written once straight into driver memory instead of
+// being staged by glBufferData, and rewritten in place on later updates
+const size_t PERSISTENT_VBO_BYTES = size_t(64) << 20;
+
+// Point clouds smaller than this are drawn whole, without a PointLod
+const size_t POINT_LOD_MIN_POINTS = size_t(1) << 18;
+
+// Affine transform with axis-angle rotation r and translation t
+glm::mat4 rotation_translation(glm::vec3 r, glm::vec3 t) {
+    glm::mat4 transform;
+    float norm = glm::length(r);
+    if (norm < 1e-3) {
+        transform = glm::mat4(1.0);
+    } else {
+        glm::quat rot = glm::angleAxis(norm, r / norm);
+        transform = glm::mat4_cast(rot);
+    }
+    transform[3] = glm::vec4(t, 1);
+    return transform;
+}
+
+// Axis-aligned bounds of the box [min, max] under an affine transform
+void transform_bounds(const glm::mat4& transform, glm::vec3 min,
+                      glm::vec3 max, glm::vec3& out_min, glm::vec3& out_max) {
+    const glm::vec3 center = 0.5f * (min + max), extent = 0.5f * (max - min);
+    const glm::vec3 tcenter(transform * glm::vec4(center, 1.f));
+    glm::vec3 textent(0.f);
+    for (int c = 0; c < 3; ++c) {
+        for (int r = 0; r < 3; ++r) {
+            textent[r] += std::fabs(transform[c][r]) * extent[c];
+        }
+    }
+    out_min = tcenter - textent;
+    out_max = tcenter + textent;
+}
+
+// Drawlist fields of a mesh, viewing the npz arrays
+using NpyFields = std::map<std::string, volrend::internal::NpyView>;
 
 // Split a string by '__'
 std::vector<std::string> split_by_2underscore(const std::string& s) {
@@ -181,9 +184,9 @@ std::vector<std::string> split_by_2underscore(const std::string& s) {
     return r;
 }
 
-// Get int with default val from a NpyArray map
-int map_get_int(const std::map<std::string, cnpy::NpyArray>& m,
-                const std::string& key, const int defval, std::ostream& errs) {
+// Get int with default val from a NpyView map
+int map_get_int(const NpyFields& m, const std::string& key, const int defval,
+                std::ostream& errs) {
     const auto it = m.find(key);
     if (it == m.end()) {
         return defval;
@@ -202,9 +205,8 @@ int map_get_int(const std::map<std::string, cnpy::NpyArray>& m,
     }
 }
 
-float map_get_float(const std::map<std::string, cnpy::NpyArray>& m,
-                    const std::string& key, const float defval,
-                    std::ostream& errs) {
+float map_get_float(const NpyFields& m, const std::string& key,
+                    const float defval, std::ostream& errs) {
     const auto it = m.find(key);
     if (it == m.end()) {
         return defval;
@@ -221,9 +223,8 @@ float map_get_float(const std::map<std::string, cnpy::NpyArray>& m,
     }
 }
 
-glm::vec3 map_get_vec3(const std::map<std::string, cnpy::NpyArray>& m,
-                       const std::string& key, const glm::vec3& defval,
-                       std::ostream& errs) {
+glm::vec3 map_get_vec3(const NpyFields& m, const std::string& key,
+                       const glm::vec3& defval, std::ostream& errs) {
     const auto it = m.find(key);
     if (it == m.end()) {
         return defval;
@@ -257,9 +258,9 @@ glm::vec3 map_get_vec3(const std::map<std::string, cnpy::NpyArray>& m,
     }
 }
 
-std::vector<float> map_get_floatarr(
-    const std::map<std::string, cnpy::NpyArray>& m, const std::string& key,
-    std::ostream& errs) {
+std::vector<float> map_get_floatarr(const NpyFields& m,
+                                    const std::string& key,
+                                    std::ostream& errs) {
     const auto it = m.find(key);
     std::vector<float> result;
     if (it == m.end()) {
@@ -286,21 +287,51 @@ std::vector<float> map_get_floatarr(
     return result;
 }
 
-std::vector<int> map_get_intarr(const std::map<std::string, cnpy::NpyArray>& m,
-                                const std::string& key, std::ostream& errs) {
+// Convert the floats at key straight into out, as rows of dim values
+// stride floats apart (e.g. into the interleaved Mesh::vert), avoiding the
+// intermediate vector of map_get_floatarr for large arrays. out must hold
+// all rows of the array
+void map_copy_floatarr(const NpyFields& m, const std::string& key, float* out,
+                       size_t dim, size_t stride, std::ostream& errs) {
     const auto it = m.find(key);
-    std::vector<int> result;
-    if (it == m.end()) {
-        return result;
+    if (it == m.end()) return;
+    const size_t n_rows = it->second.num_vals / dim;
+
+#define _COPY_PTR_ROWS(dtype)                                  \
+    do {                                                       \
+        const dtype* ptr = it->second.data<dtype>();           \
+        for (size_t i = 0; i < n_rows; ++i) {                  \
+            for (size_t j = 0; j < dim; ++j) {                 \
+                out[i * stride + j] = (float)ptr[i * dim + j]; \
+            }                                                  \
+        }                                                      \
+    } while (0)
+
+    if (it->second.word_size == 2) {
+        _COPY_PTR_ROWS(half);
+    } else if (it->second.word_size == 4) {
+        _COPY_PTR_ROWS(float);
+    } else if (it->second.word_size == 8) {
+        _COPY_PTR_ROWS(double);
+    } else {
+        errs << "Invalid word size for float " << it->second.word_size << "\n";
     }
+#undef _COPY_PTR_ROWS
+}
 
-#define _ASSN_PTR_ARR(dtype)                                       \
-    do {                                                           \
-        const dtype* ptr = it->second.data<dtype>();               \
-        std::copy(ptr, ptr + it->second.num_vals, result.begin()); \
+// Get ints at key as Mesh::faces indices, converting straight into faces
+void map_get_faces(const NpyFields& m, const std::string& key,
+                   std::vector<unsigned int>& faces, std::ostream& errs) {
+    const auto it = m.find(key);
+    if (it == m.end()) return;
+
+#define _ASSN_PTR_ARR(dtype)                                      \
+    do {                                                          \
+        const dtype* ptr = it->second.data<dtype>();              \
+        std::copy(ptr, ptr + it->second.num_vals, faces.begin()); \
     } while (0)
 
-    result.resize(it->second.num_vals);
+    faces.resize(it->second.num_vals);
     if (it->second.word_size == 1) {
         _ASSN_PTR_ARR(int8_t);
     } else if (it->second.word_size == 2) {
@@ -313,7 +344,31 @@ std::vector<int> map_get_intarr(const std::map<std::string, cnpy::NpyArray>& m,
         errs << "Invalid word size for int " << it->second.word_size << "\n";
     }
 #undef _ASSN_PTR_ARR
-    return result;
+}
+
+// Point cloud like Mesh::Points from the float array at key, converted
+// directly into the vertices
+volrend::Mesh map_get_points(const NpyFields& m, const std::string& key,
+                             const glm::vec3& color, std::ostream& errs) {
+    const auto it = m.find(key);
+    const size_t n_vals = it == m.end() ? 0 : it->second.num_vals;
+    if (n_vals % 3 != 0) {
+        errs << "Number of elements in " << key << " must be divisible by 3\n";
+    }
+    const int n_points = (int)(n_vals / 3);
+    volrend::Mesh me(n_points, 0, 1);
+    float* vptr = me.vert.data();
+    for (int i = 0; i < n_points; ++i) {
+        vptr[3] = color[0];
+        vptr[4] = color[1];
+        vptr[5] = color[2];
+        vptr[8] = 1.f;
+        vptr += VERT_SZ;
+    }
+    map_copy_floatarr(m, key, me.vert.data(), 3, VERT_SZ, errs);
+    me.name = "Points";
+    me.unlit = true;
+    return me;
 }
 }  // namespace
 
@@ -325,26 +380,63 @@ Mesh::Mesh(int n_verts, int n_faces, int face_size, bool unlit)
       rotation(0),
       translation(0),
       face_size(face_size),
-      unlit(unlit) {
-    if (program == -1) {
-        program = create_shader_program(VERT_SHADER_SRC, FRAG_SHADER_SRC);
-        u_MV = glGetUniformLocation(program, "MV");
-        u_M = glGetUniformLocation(program, "M");
-        u_K = glGetUniformLocation(program, "K");
-        u_cam_pos = glGetUniformLocation(program, "camPos");
-        u_unlit = glGetUniformLocation(program, "unlit");
+      unlit(unlit) {}
+
+Mesh::GLObjects::GLObjects(GLObjects&& other) noexcept {
+    *this = std::move(other);
+}
+
+Mesh::GLObjects& Mesh::GLObjects::operator=(GLObjects&& other) noexcept {
+    if (this != &other) {
+        release();
+        vao = std::exchange(other.vao, 0);
+        vbo = std::exchange(other.vbo, 0);
+        ebo = std::exchange(other.ebo, 0);
+        inst_vbo = std::exchange(other.inst_vbo, 0);
+        inst_color_vbo = std::exchange(other.inst_color_vbo, 0);
+        vbo_map = std::exchange(other.vbo_map, nullptr);
+        vbo_capacity = std::exchange(other.vbo_capacity, 0);
+        vbo_fence = std::exchange(other.vbo_fence, nullptr);
     }
+    return *this;
+}
+
+Mesh::GLObjects::~GLObjects() { release(); }
+
+void Mesh::GLObjects::release() {
+    // Nothing was created unless the mesh was drawn
+    if (vao == 0) return;
+#ifndef __EMSCRIPTEN__
+    if (vbo_fence != nullptr) glDeleteSync((GLsync)vbo_fence);
+    if (vbo_map != nullptr) {
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+#endif
+    const unsigned int buffers[] = {vbo, ebo, inst_vbo, inst_color_vbo};
+    glDeleteBuffers(4, buffers);
+    glDeleteVertexArrays(1, &vao);
+    vao = vbo = ebo = inst_vbo = inst_color_vbo = 0;
+    vbo_map = vbo_fence = nullptr;
+    vbo_capacity = 0;
 }
 
 void Mesh::update() {
-    glGenVertexArrays(1, &vao_);
-    glGenBuffers(1, &vbo_);
-    glGenBuffers(1, &ebo_);
-
-    glBindVertexArray(vao_);
-    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
-    glBufferData(GL_ARRAY_BUFFER, vert.size() * sizeof(vert[0]), vert.data(),
-                 GL_STATIC_DRAW);
+    dirty_ = true;
+    bounds_dirty_ = true;
+    ++version_;
+}
+
+void Mesh::upload() const {
+    if (gl_.vao == 0) {
+        glGenVertexArrays(1, &gl_.vao);
+        glGenBuffers(1, &gl_.vbo);
+        glGenBuffers(1, &gl_.ebo);
+    }
+
+    glBindVertexArray(gl_.vao);
+    upload_vert();
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, VERT_SZ * sizeof(float),
                           (void*)0);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, VERT_SZ * sizeof(float),
@@ -355,45 +447,239 @@ void Mesh::update() {
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl_.ebo);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, faces.size() * sizeof(faces[0]),
                  faces.data(), GL_STATIC_DRAW);
+
+    // Per-instance attributes; without them the constant identity set in
+    // draw() is used
+    const bool instanced = n_instances() > 0,
+               colored = instanced && !instance_color.empty();
+    if (instanced && gl_.inst_vbo == 0) {
+        glGenBuffers(1, &gl_.inst_vbo);
+        glGenBuffers(1, &gl_.inst_color_vbo);
+    }
+    if (instanced) {
+        glBindBuffer(GL_ARRAY_BUFFER, gl_.inst_vbo);
+        glBufferData(GL_ARRAY_BUFFER,
+                     instance_transform.size() * sizeof(float),
+                     instance_transform.data(), GL_STATIC_DRAW);
+        for (int i = 0; i < 3; ++i) {
+            glVertexAttribPointer(INST_ATTRIB + i, 4, GL_FLOAT, GL_FALSE,
+                                  12 * sizeof(float),
+                                  (void*)(4 * i * sizeof(float)));
+            glVertexAttribDivisor(INST_ATTRIB + i, 1);
+        }
+    }
+    if (colored) {
+        glBindBuffer(GL_ARRAY_BUFFER, gl_.inst_color_vbo);
+        glBufferData(GL_ARRAY_BUFFER, instance_color.size() * sizeof(float),
+                     instance_color.data(), GL_STATIC_DRAW);
+        glVertexAttribPointer(INST_COLOR_ATTRIB, 3, GL_FLOAT, GL_FALSE,
+                              3 * sizeof(float), (void*)0);
+        glVertexAttribDivisor(INST_COLOR_ATTRIB, 1);
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (instanced) {
+            glEnableVertexAttribArray(INST_ATTRIB + i);
+        } else {
+            glDisableVertexAttribArray(INST_ATTRIB + i);
+        }
+    }
+    if (colored) {
+        glEnableVertexAttribArray(INST_COLOR_ATTRIB);
+    } else {
+        glDisableVertexAttribArray(INST_COLOR_ATTRIB);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+    dirty_ = false;
 }
 
-void Mesh::use_shader() { glUseProgram(program); }
+void Mesh::upload_vert() const {
+    const size_t bytes = vert.size() * sizeof(vert[0]);
+#ifndef __EMSCRIPTEN__
+    if ((gl_.vbo_map != nullptr || bytes >= PERSISTENT_VBO_BYTES) &&
+        (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)) {
+        const GLbitfield flags =
+            GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        if (bytes > gl_.vbo_capacity) {
+            // Immutable storage can't grow; replace the buffer
+            if (gl_.vbo_map != nullptr) {
+                glBindBuffer(GL_ARRAY_BUFFER, gl_.vbo);
+                glUnmapBuffer(GL_ARRAY_BUFFER);
+            }
+            glDeleteBuffers(1, &gl_.vbo);
+            glGenBuffers(1, &gl_.vbo);
+            glBindBuffer(GL_ARRAY_BUFFER, gl_.vbo);
+            glBufferStorage(GL_ARRAY_BUFFER, bytes, nullptr, flags);
+            gl_.vbo_map = glMapBufferRange(GL_ARRAY_BUFFER, 0, bytes, flags);
+            gl_.vbo_capacity = gl_.vbo_map != nullptr ? bytes : 0;
+        } else {
+            glBindBuffer(GL_ARRAY_BUFFER, gl_.vbo);
+        }
+        if (gl_.vbo_fence != nullptr) {
+            // Don't overwrite vertices a pending draw still reads
+            GLsync fence = (GLsync)gl_.vbo_fence;
+            glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                             GLuint64(1000000000));
+            glDeleteSync(fence);
+            gl_.vbo_fence = nullptr;
+        }
+        if (gl_.vbo_map != nullptr) {
+            memcpy(gl_.vbo_map, vert.data(), bytes);
+            return;
+        }
+        // Mapping failed: fall back to a mutable buffer
+        glDeleteBuffers(1, &gl_.vbo);
+        glGenBuffers(1, &gl_.vbo);
+    }
+#endif
+    glBindBuffer(GL_ARRAY_BUFFER, gl_.vbo);
+    glBufferData(GL_ARRAY_BUFFER, bytes, vert.data(), GL_STATIC_DRAW);
+}
 
-void Mesh::draw(const glm::mat4x4& V, glm::mat4x4 K, bool y_up) const {
-    if (!visible) return;
+void Mesh::build_point_lod() {
+    point_lod_.reset();
+    if (face_size != 1 || !faces.empty() || n_instances() > 0 ||
+        vert.size() / VERT_SZ < POINT_LOD_MIN_POINTS) {
+        return;
+    }
+    auto lod = std::make_shared<internal::PointLod>();
+    lod->build(vert, VERT_SZ);
+    point_lod_ = std::move(lod);
+    update();
+}
+
+void Mesh::use_shader() {
+    if (program == -1) {
+        program = create_shader_program(VERT_SHADER_SRC, FRAG_SHADER_SRC);
+        u_MV = glGetUniformLocation(program, "MV");
+        u_M = glGetUniformLocation(program, "M");
+        u_K = glGetUniformLocation(program, "K");
+        u_cam_pos = glGetUniformLocation(program, "camPos");
+        u_unlit = glGetUniformLocation(program, "unlit");
+        u_inst_color = glGetUniformLocation(program, "instColor");
+    }
+    glUseProgram(program);
+}
+
+glm::mat4 Mesh::model_transform() const {
+    glm::mat4 transform;
     float norm = glm::length(rotation);
     if (norm < 1e-3) {
-        transform_ = glm::mat4(1.0);
+        transform = glm::mat4(1.0);
     } else {
         glm::quat rot = glm::angleAxis(norm, rotation / norm);
-        transform_ = glm::mat4_cast(rot);
+        transform = glm::mat4_cast(rot);
+    }
+    transform *= scale;
+    transform[3] = glm::vec4(translation, 1);
+    return transform;
+}
+
+void Mesh::local_bounds(glm::vec3& min, glm::vec3& max) const {
+    if (bounds_dirty_) {
+        glm::vec3 lo(std::numeric_limits<float>::max()),
+            hi(std::numeric_limits<float>::lowest());
+        for (size_t i = 0; i < vert.size(); i += VERT_SZ) {
+            const glm::vec3 p(vert[i], vert[i + 1], vert[i + 2]);
+            lo = glm::min(lo, p);
+            hi = glm::max(hi, p);
+        }
+        const size_t n_inst = n_instances();
+        if (n_inst > 0 && lo.x <= hi.x) {
+            // Union over the instances
+            glm::vec3 inst_lo(std::numeric_limits<float>::max()),
+                inst_hi(std::numeric_limits<float>::lowest());
+            for (size_t i = 0; i < n_inst; ++i) {
+                glm::vec3 a, b;
+                transform_bounds(instance_matrix(i), lo, hi, a, b);
+                inst_lo = glm::min(inst_lo, a);
+                inst_hi = glm::max(inst_hi, b);
+            }
+            lo = inst_lo;
+            hi = inst_hi;
+        }
+        bounds_min_ = lo;
+        bounds_max_ = hi;
+        bounds_dirty_ = false;
     }
-    transform_ *= scale;
+    min = bounds_min_;
+    max = bounds_max_;
+}
+
+void Mesh::world_bounds(glm::vec3& min, glm::vec3& max) const {
+    local_bounds(min, max);
+    if (min.x > max.x) return;
+    transform_bounds(model_transform(), min, max, min, max);
+}
+
+void Mesh::draw(const glm::mat4x4& V, glm::mat4x4 K, bool y_up) const {
+    if (!visible) return;
+    if (dirty_) upload();
+    transform_ = model_transform();
     glm::vec3 cam_pos = -glm::transpose(glm::mat3x3(V)) * glm::vec3(V[3]);
     if (!y_up) {
         K[1][1] *= -1.0;
     }
 
-    transform_[3] = glm::vec4(translation, 1);
     glm::mat4x4 MV = V * transform_;
     glUniformMatrix4fv(u_MV, 1, GL_FALSE, glm::value_ptr(MV));
     glUniformMatrix4fv(u_M, 1, GL_FALSE, glm::value_ptr(transform_));
     glUniformMatrix4fv(u_K, 1, GL_FALSE, glm::value_ptr(K));
     glUniform3fv(u_cam_pos, 1, glm::value_ptr(cam_pos));
     glUniform1i(u_unlit, unlit);
-    glBindVertexArray(vao_);
+    const size_t n_inst = n_instances();
+    glUniform1i(u_inst_color, n_inst > 0 && !instance_color.empty());
+    if (n_inst == 0) {
+        glVertexAttrib4f(INST_ATTRIB, 1.f, 0.f, 0.f, 0.f);
+        glVertexAttrib4f(INST_ATTRIB + 1, 0.f, 1.f, 0.f, 0.f);
+        glVertexAttrib4f(INST_ATTRIB + 2, 0.f, 0.f, 1.f, 0.f);
+    }
+    glBindVertexArray(gl_.vao);
     if (faces.empty()) {
-        glDrawArrays(get_gl_ele_type(face_size), 0, vert.size() / VERT_SZ);
+        if (n_inst > 0) {
+            glDrawArraysInstanced(get_gl_ele_type(face_size), 0,
+                                  vert.size() / VERT_SZ, n_inst);
+        } else if (point_lod_ != nullptr &&
+                   point_lod_->n_points() == vert.size() / VERT_SZ) {
+            // Visible chunk ranges of the indexed point cloud
+            GLint viewport[4];
+            glGetIntegerv(GL_VIEWPORT, viewport);
+            const float focal_px = 0.5f * viewport[3] * std::fabs(K[1][1]);
+            point_lod_->select(MV, K, focal_px, point_lod_px, lod_first_,
+                               lod_count_);
+#ifdef __EMSCRIPTEN__
+            for (size_t i = 0; i < lod_first_.size(); ++i) {
+                glDrawArrays(GL_POINTS, lod_first_[i], lod_count_[i]);
+            }
+#else
+            glMultiDrawArrays(GL_POINTS, lod_first_.data(), lod_count_.data(),
+                              (GLsizei)lod_first_.size());
+#endif
+        } else {
+            glDrawArrays(get_gl_ele_type(face_size), 0,
+                         vert.size() / VERT_SZ);
+        }
     } else {
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
-        glDrawElements(get_gl_ele_type(face_size), faces.size(),
-                       GL_UNSIGNED_INT, (void*)0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl_.ebo);
+        if (n_inst > 0) {
+            glDrawElementsInstanced(get_gl_ele_type(face_size), faces.size(),
+                                    GL_UNSIGNED_INT, (void*)0, n_inst);
+        } else {
+            glDrawElements(get_gl_ele_type(face_size), faces.size(),
+                           GL_UNSIGNED_INT, (void*)0);
+        }
     }
     glBindVertexArray(0);
+#ifndef __EMSCRIPTEN__
+    if (gl_.vbo_map != nullptr) {
+        // Fence the draw so the next upload_vert() can wait for it
+        if (gl_.vbo_fence != nullptr) glDeleteSync((GLsync)gl_.vbo_fence);
+        gl_.vbo_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+#endif
 }
 
 Mesh Mesh::Cube(glm::vec3 color) {
@@ -650,22 +936,33 @@ void Mesh::repeat(int n) {
 }
 
 void Mesh::apply_transform(glm::vec3 r, glm::vec3 t, int start, int end) {
-    glm::mat4 transform;
-    float norm = glm::length(r);
-    if (norm < 1e-3) {
-        transform = glm::mat4(1.0);
-    } else {
-        glm::quat rot = glm::angleAxis(norm, r / norm);
-        transform = glm::mat4_cast(rot);
+    apply_transform(rotation_translation(r, t), start, end);
+}
+
+void Mesh::add_instance(glm::vec3 r, glm::vec3 t) {
+    const glm::mat4 transform = rotation_translation(r, t);
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            instance_transform.push_back(transform[j][i]);
+        }
     }
-    transform[3] = glm::vec4(t, 1);
-    apply_transform(transform, start, end);
+}
+
+glm::mat4 Mesh::instance_matrix(size_t i) const {
+    glm::mat4 transform(1.f);
+    const float* row = &instance_transform[12 * i];
+    for (int r = 0; r < 3; ++r) {
+        for (int c = 0; c < 4; ++c) transform[c][r] = row[4 * r + c];
+    }
+    return transform;
 }
 
 void Mesh::apply_transform(glm::mat4 transform, int start, int end) {
     if (end == -1) {
         end = vert.size() / VERT_SZ;
     }
+    bounds_dirty_ = true;
+    ++version_;
     auto* ptr = &vert[start * VERT_SZ];
     for (int i = start; i < end; ++i) {
         glm::vec4 v(ptr[0], ptr[1], ptr[2], 1.0);
@@ -679,75 +976,16 @@ void Mesh::apply_transform(glm::mat4 transform, int start, int end) {
 
 Mesh _load_basic_obj(const std::string& path_or_string, bool from_string) {
     Mesh mesh;
-    tinyobj::ObjReaderConfig reader_config;
-    if (!from_string) {
-        reader_config.mtl_search_path = "./";  // Path to material files
-    }
-    reader_config.triangulate = true;
-    reader_config.vertex_color = true;
-    tinyobj::ObjReader reader;
-
-    bool read_success;
-    if (from_string)
-        read_success =
-            reader.ParseFromString(path_or_string, "", reader_config);
-    else
-        read_success = reader.ParseFromFile(path_or_string, reader_config);
+    std::string error;
+    const bool read_success =
+        from_string
+            ? internal::parse_obj(path_or_string.data(), path_or_string.size(),
+                                  mesh, error)
+            : internal::parse_obj_file(path_or_string, mesh, error);
     if (!read_success) {
-        if (!reader.Error().empty()) {
-            printf("ERROR Failed to load OBJ: %s", reader.Error().c_str());
-        }
+        printf("ERROR Failed to load OBJ: %s\n", error.c_str());
         return mesh;
     }
-    // if (!reader.Warning().empty()) {
-    //     printf("TinyObjReader: %s\n", reader.Warning().c_str());
-    // }
-
-    auto& attrib = reader.GetAttrib();
-    auto& shapes = reader.GetShapes();
-
-    const size_t n_verts = attrib.vertices.size() / 3;
-    mesh.vert.resize(VERT_SZ * n_verts);
-    for (size_t i = 0; i < n_verts; i++) {
-        auto* ptr = &mesh.vert[i * VERT_SZ];
-        for (int j = 0; j < 3; ++j) {
-            ptr[j] = attrib.vertices[i * 3 + j];
-        }
-    }
-    for (size_t s = 0; s < shapes.size(); s++) {
-        // Loop over faces(polygon)
-        size_t index_offset = 0;
-        for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
-            size_t fv = size_t(shapes[s].mesh.num_face_vertices[f]);
-            if (fv == 3) {
-                for (size_t v = 0; v < fv; v++) {
-                    tinyobj::index_t idx =
-                        shapes[s].mesh.indices[index_offset + v];
-                    mesh.faces.push_back(idx.vertex_index);
-                }
-            }
-            index_offset += fv;
-        }
-    }
-
-    if (attrib.colors.size() / 3 >= n_verts) {
-        for (int i = 0; i < n_verts; ++i) {
-            auto* color_ptr = &mesh.vert[i * VERT_SZ + 3];
-            for (int j = 0; j < 3; ++j) {
-                color_ptr[j] = attrib.colors[3 * i + j];
-            }
-        }
-    }
-    if (attrib.normals.size() / 3 >= n_verts) {
-        for (size_t i = 0; i < n_verts; i++) {
-            auto* normal_ptr = &mesh.vert[i * VERT_SZ + 6];
-            for (int j = 0; j < 3; ++j) {
-                normal_ptr[j] = attrib.normals[i * 3 + j];
-            }
-        }
-    } else {
-        estimate_normals(mesh.vert, mesh.faces);
-    }
 
     mesh.face_size = 3;
     if (from_string) {
@@ -767,20 +1005,19 @@ Mesh Mesh::load_mem_basic_obj(const std::string& str) {
 }
 
 namespace {
-std::vector<Mesh> _load_npz(const cnpy::npz_t& npz, bool default_visible) {
+std::vector<Mesh> _load_npz(const internal::NpzView& npz,
+                            bool default_visible) {
     printf("INFO: Loading drawlist npz\n");
-    std::map<std::string,
-             std::pair<std::string /*type*/,
-                       std::map<std::string, cnpy::NpyArray> /*fields*/>>
+    std::map<std::string, std::pair<std::string /*type*/, NpyFields>>
         mesh_parse_map;
 
-    for (const std::pair<std::string, cnpy::NpyArray>& kv : npz) {
+    for (const auto& kv : npz.arrays()) {
         const std::string& fullname = kv.first;
         std::vector<std::string> spl = split_by_2underscore(fullname);
         if (spl.size() == 1) {
             // Mesh type
-            std::string meshtype(kv.second.data_holder.begin(),
-                                 kv.second.data_holder.end());
+            std::string meshtype(kv.second.ptr,
+                                 kv.second.ptr + kv.second.num_bytes());
             for (size_t i = 4; i < meshtype.size(); i += 4)
                 meshtype[i / 4] = std::tolower(meshtype[i]);
             meshtype.resize(meshtype.size() / 4);
@@ -803,9 +1040,10 @@ std::vector<Mesh> _load_npz(const cnpy::npz_t& npz, bool default_visible) {
     for (const auto& kv : mesh_parse_map) {
         const std::string& mesh_name = kv.first;
         const std::string& mesh_type = kv.second.first;
-        const std::map<std::string, cnpy::NpyArray>& fields = kv.second.second;
+        const NpyFields& fields = kv.second.second;
 
-        volrend::Mesh me;
+        volrend::Mesh me, path;
+        bool has_path = false;
         glm::vec3 color = map_get_vec3(fields, "color", DEFAULT_COLOR, errs);
         if (mesh_type == "cube") {
             me = volrend::Mesh::Cube(color);
@@ -835,47 +1073,41 @@ std::vector<Mesh> _load_npz(const cnpy::npz_t& npz, bool default_visible) {
                             "not "
                             "multiple of 3\n";
                 }
-                const size_t n_verts = me.vert.size() / VERT_SZ;
-                const size_t n_reps = t.size() / 3;
-                me.repeat(n_reps);
-                for (int i = 0; i < n_reps; ++i) {
-                    const int j = i * 3;
+                // One instance per camera
+                const size_t n_reps = std::min(r.size(), t.size()) / 3;
+                me.instance_transform.reserve(n_reps * 12);
+                for (size_t i = 0; i < n_reps; ++i) {
+                    const size_t j = i * 3;
                     glm::vec3 ri{r[j], r[j + 1], r[j + 2]};
                     glm::vec3 ti{t[j], t[j + 1], t[j + 2]};
-                    me.apply_transform(ri, ti, n_verts * i, n_verts * (i + 1));
+                    me.add_instance(ri, ti);
                 }
                 bool connect = map_get_int(fields, "connect", 0, errs) != 0;
-                if (connect) {
-                    // Connect camera centers in a trajectory
-                    const size_t start_idx = me.faces.size();
-                    me.faces.resize(start_idx + (n_reps - 1) * 2);
-                    for (int i = 0; i < n_reps - 1; ++i) {
-                        me.faces[start_idx + i * 2] = n_verts * i;
-                        me.faces[start_idx + i * 2 + 1] = n_verts * (i + 1);
-                    }
+                if (connect && n_reps > 1) {
+                    // Connect camera centers in a trajectory, drawn as a
+                    // separate mesh
+                    t.resize(n_reps * 3);
+                    path = volrend::Mesh::Lines(t, color);
+                    has_path = true;
                 }
             }
         } else if (mesh_type == "lines") {
             // Lines
-            auto data = map_get_floatarr(fields, "points", errs);
-            me = volrend::Mesh::Lines(data, color);
+            me = volrend::Mesh::Lines(
+                map_get_floatarr(fields, "points", errs), color);
             if (fields.count("segs")) {
                 // By default, the points are connected in a single line
                 // i -> i+1 etc
                 // specify this to connect every consecutive pair of indices
                 // 0a 0b 1a 1b 2a 2b ...
-                auto lines = map_get_intarr(fields, "segs", errs);
-                me.faces.resize(lines.size());
-                std::copy(lines.begin(), lines.end(), me.faces.begin());
+                map_get_faces(fields, "segs", me.faces, errs);
             }
         } else if (mesh_type == "points") {
             // Point cloud
-            auto data = map_get_floatarr(fields, "points", errs);
-            me = volrend::Mesh::Points(data, color);
+            me = map_get_points(fields, "points", color, errs);
         } else if (mesh_type == "mesh") {
             // Most generic mesh
-            auto data = map_get_floatarr(fields, "points", errs);
-            me = volrend::Mesh::Points(data, color);
+            me = map_get_points(fields, "points", color, errs);
             // Face_size = 1: points  2: lines  3: triangles
             me.face_size = map_get_int(fields, "face_size", 3, errs);
             if (me.face_size <= 0 || me.face_size > 3) {
@@ -883,40 +1115,54 @@ std::vector<Mesh> _load_npz(const cnpy::npz_t& npz, bool default_visible) {
                 errs << "Mesh face size must be one of 1,2,3\n";
             }
             if (fields.count("faces")) {
-                auto faces = map_get_intarr(fields, "faces", errs);
-                if (faces.size() % me.face_size) {
+                map_get_faces(fields, "faces", me.faces, errs);
+                if (me.faces.size() % me.face_size) {
                     errs << "Faces must have face_size=" << me.face_size
                          << " elements\n";
                 }
-                me.faces.resize(faces.size());
-                std::copy(faces.begin(), faces.end(), me.faces.begin());
             }
             if (me.face_size == 3) {
-                estimate_normals(me.vert, me.faces);
+                internal::estimate_normals(me.vert, me.faces);
             }
         } else {
             errs << "Mesh '" << mesh_name << "' has unsupported type '"
                  << mesh_type << "'\n";
             continue;
         }
-        if (fields.count("vert_color")) {
+        const size_t n_inst = me.n_instances();
+        if (fields.count("instance_color")) {
+            // Per-instance colors
+            me.instance_color =
+                map_get_floatarr(fields, "instance_color", errs);
+            if (me.instance_color.size() != n_inst * 3) {
+                errs << "Mesh " << mesh_name
+                     << " instance_color has invalid size\n";
+                me.instance_color.clear();
+            }
+        } else if (fields.count("vert_color")) {
             // Support manual vertex colors
-            auto vert_color = map_get_floatarr(fields, "vert_color", errs);
-            if (vert_color.size() * VERT_SZ != me.vert.size() * 3) {
+            const size_t n_vert_color = fields.at("vert_color").num_vals;
+            const size_t n_colors = me.vert.size() / VERT_SZ * 3;
+            if (n_inst > 0 && n_vert_color == n_inst * n_colors) {
+                // Colors of every copy, as from before instancing: each
+                // instance takes the color of its first vertex
+                auto vert_color = map_get_floatarr(fields, "vert_color", errs);
+                me.instance_color.resize(n_inst * 3);
+                for (size_t i = 0; i < n_inst; ++i) {
+                    std::copy_n(&vert_color[i * n_colors], 3,
+                                &me.instance_color[i * 3]);
+                }
+            } else if (n_vert_color != n_colors) {
                 errs << "Mesh " << mesh_name
                      << " vert_color has invalid size\n";
                 continue;
-            }
-            const float* in_ptr = vert_color.data();
-            float* out_ptr = me.vert.data() + 3;
-            for (int i = 0; i < vert_color.size(); i += 3) {
-                for (int j = 0; j < 3; ++j) {
-                    out_ptr[j] = in_ptr[j];
-                }
-                in_ptr += 3;
-                out_ptr += VERT_SZ;
+            } else {
+                map_copy_floatarr(fields, "vert_color", me.vert.data() + 3, 3,
+                                  VERT_SZ, errs);
             }
         }
+        // Large point clouds are drawn by visible chunks
+        me.build_point_lod();
         me.name = mesh_name;
         me.scale = map_get_float(fields, "scale", 1.0f, errs);
         me.translation =
@@ -926,7 +1172,16 @@ std::vector<Mesh> _load_npz(const cnpy::npz_t& npz, bool default_visible) {
         me.visible = map_get_int(fields, "visible", default_visible, errs) != 0;
         me.unlit = map_get_int(fields, "unlit", 0, errs) != 0;
         me.update();
+        if (has_path) {
+            path.name = mesh_name + "_path";
+            path.scale = me.scale;
+            path.translation = me.translation;
+            path.rotation = me.rotation;
+            path.visible = me.visible;
+            path.update();
+        }
         meshes.push_back(std::move(me));
+        if (has_path) meshes.push_back(std::move(path));
     }
     std::string errstr = errs.str();
     if (errstr.size()) {
@@ -940,13 +1195,21 @@ std::vector<Mesh> _load_npz(const cnpy::npz_t& npz, bool default_visible) {
 
 std::vector<Mesh> Mesh::open_drawlist(const std::string& path,
                                       bool default_visible) {
-    auto npz = cnpy::npz_load(path);
+    internal::NpzView npz;
+    std::string error;
+    if (!npz.open(path, error)) {
+        throw std::runtime_error("open_drawlist: " + error);
+    }
     return _load_npz(npz, default_visible);
 }
 
 std::vector<Mesh> Mesh::open_drawlist_mem(const char* data, uint64_t size,
                                           bool default_visible) {
-    auto npz = cnpy::npz_load_mem(data, size);
+    internal::NpzView npz;
+    std::string error;
+    if (!npz.open_mem(data, size, error)) {
+        throw std::runtime_error("open_drawlist_mem: " + error);
+    }
     return _load_npz(npz, default_visible);
 }
 
@@ -0,0 +1,195 @@
+#include "volrend/internal/mesh_cull.hpp"
+
+#include <algorithm>
+#include <numeric>
+
+#include "glm/geometric.hpp"
+#include "glm/vec4.hpp"
+
+namespace volrend {
+namespace internal {
+namespace {
+
+// Meshes per BVH leaf, at most
+const uint32_t LEAF_SIZE = 4;
+const uint32_t NO_PARENT = UINT32_MAX;
+
+enum class Overlap { OUTSIDE, PARTIAL, INSIDE };
+
+// View frustum as planes (normal, offset) of the clip matrix, positive
+// inside
+struct Frustum {
+    explicit Frustum(const glm::mat4& m) {
+        for (int i = 0; i < 3; ++i) {
+            planes[2 * i] = row(m, 3) + row(m, i);
+            planes[2 * i + 1] = row(m, 3) - row(m, i);
+        }
+    }
+
+    static glm::vec4 row(const glm::mat4& m, int r) {
+        return glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+    }
+
+    Overlap test(const glm::vec3& min, const glm::vec3& max) const {
+        bool inside = true;
+        for (const glm::vec4& plane : planes) {
+            const glm::vec3 normal(plane);
+            // Corners farthest along and against the normal
+            const glm::vec3 pos(normal.x >= 0.f ? max.x : min.x,
+                                normal.y >= 0.f ? max.y : min.y,
+                                normal.z >= 0.f ? max.z : min.z);
+            const glm::vec3 neg(normal.x >= 0.f ? min.x : max.x,
+                                normal.y >= 0.f ? min.y : max.y,
+                                normal.z >= 0.f ? min.z : max.z);
+            if (glm::dot(normal, pos) + plane.w < 0.f) return Overlap::OUTSIDE;
+            if (glm::dot(normal, neg) + plane.w < 0.f) inside = false;
+        }
+        return inside ? Overlap::INSIDE : Overlap::PARTIAL;
+    }
+
+    glm::vec4 planes[6];
+};
+
+}  // namespace
+
+const std::vector<uint32_t>& MeshCuller::cull(const std::vector<Mesh>& meshes,
+                                              const glm::mat4& V,
+                                              const glm::mat4& K) {
+    const size_t n = meshes.size();
+    const bool resized = stamps_.size() != n;
+    stamps_.resize(n);
+    boxes_.resize(n);
+    changed_.clear();
+    for (size_t i = 0; i < n; ++i) {
+        const Mesh& mesh = meshes[i];
+        const Stamp stamp{mesh.version(), mesh.vert.data(), mesh.rotation,
+                          mesh.translation, mesh.scale};
+        if (!resized && stamp == stamps_[i]) continue;
+        stamps_[i] = stamp;
+        Box& box = boxes_[i];
+        mesh.world_bounds(box.min, box.max);
+        if (box.min.x > box.max.x) {
+            // Empty; a point keeps the hierarchy finite
+            box.min = box.max = glm::vec3(0.f);
+        }
+        changed_.push_back((uint32_t)i);
+    }
+
+    visible_.clear();
+    const Frustum frustum(K * V);
+    if (n < BVH_MIN_MESHES) {
+        nodes_.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (meshes[i].visible &&
+                frustum.test(boxes_[i].min, boxes_[i].max) !=
+                    Overlap::OUTSIDE) {
+                visible_.push_back((uint32_t)i);
+            }
+        }
+        return visible_;
+    }
+
+    if (resized || nodes_.empty()) {
+        items_.resize(n);
+        std::iota(items_.begin(), items_.end(), 0u);
+        leaf_.resize(n);
+        nodes_.clear();
+        build(0, (uint32_t)n, NO_PARENT);
+    } else if (changed_.size() * 4 >= n) {
+        // Most boxes changed: refit all, children follow their parents
+        for (size_t i = nodes_.size(); i-- > 0;) fit((uint32_t)i);
+    } else {
+        // Up from the leaves of the changed meshes, until a box stays the
+        // same (so do its ancestors)
+        for (uint32_t mesh : changed_) {
+            for (uint32_t i = leaf_[mesh]; i != NO_PARENT && fit(i);
+                 i = nodes_[i].parent) {
+            }
+        }
+    }
+
+    uint32_t stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+    while (stack_size > 0) {
+        const uint32_t index = stack[--stack_size];
+        const Node& node = nodes_[index];
+        const Overlap overlap = frustum.test(node.box.min, node.box.max);
+        if (overlap == Overlap::OUTSIDE) continue;
+        if (overlap == Overlap::INSIDE || node.right == 0) {
+            // Whole subtree, or the meshes of a partially visible leaf
+            for (uint32_t i = node.begin; i < node.end; ++i) {
+                const uint32_t mesh = items_[i];
+                if (meshes[mesh].visible &&
+                    (overlap == Overlap::INSIDE ||
+                     frustum.test(boxes_[mesh].min, boxes_[mesh].max) !=
+                         Overlap::OUTSIDE)) {
+                    visible_.push_back(mesh);
+                }
+            }
+        } else {
+            stack[stack_size++] = node.right;
+            stack[stack_size++] = index + 1;
+        }
+    }
+    return visible_;
+}
+
+uint32_t MeshCuller::build(uint32_t begin, uint32_t end, uint32_t parent) {
+    const uint32_t index = (uint32_t)nodes_.size();
+    nodes_.emplace_back();
+    Box box = boxes_[items_[begin]], centers;
+    centers.min = centers.max = 0.5f * (box.min + box.max);
+    for (uint32_t i = begin + 1; i < end; ++i) {
+        const Box& item = boxes_[items_[i]];
+        box.min = glm::min(box.min, item.min);
+        box.max = glm::max(box.max, item.max);
+        const glm::vec3 center = 0.5f * (item.min + item.max);
+        centers.min = glm::min(centers.min, center);
+        centers.max = glm::max(centers.max, center);
+    }
+    nodes_[index] = Node{box, begin, end, 0, parent};
+    if (end - begin <= LEAF_SIZE) {
+        for (uint32_t i = begin; i < end; ++i) leaf_[items_[i]] = index;
+        return index;
+    }
+
+    // Median split along the widest axis of the centers
+    const glm::vec3 extent = centers.max - centers.min;
+    const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0
+                     : extent.y >= extent.z                       ? 1
+                                                                  : 2;
+    const uint32_t mid = begin + (end - begin) / 2;
+    std::nth_element(items_.begin() + begin, items_.begin() + mid,
+                     items_.begin() + end, [&](uint32_t a, uint32_t b) {
+                         return boxes_[a].min[axis] + boxes_[a].max[axis] <
+                                boxes_[b].min[axis] + boxes_[b].max[axis];
+                     });
+    build(begin, mid, index);
+    const uint32_t right = build(mid, end, index);
+    nodes_[index].right = right;
+    return index;
+}
+
+bool MeshCuller::fit(uint32_t i) {
+    Node& node = nodes_[i];
+    Box box;
+    if (node.right == 0) {
+        box = boxes_[items_[node.begin]];
+        for (uint32_t j = node.begin + 1; j < node.end; ++j) {
+            box.min = glm::min(box.min, boxes_[items_[j]].min);
+            box.max = glm::max(box.max, boxes_[items_[j]].max);
+        }
+    } else {
+        const Box& left = nodes_[i + 1].box;
+        const Box& right = nodes_[node.right].box;
+        box.min = glm::min(left.min, right.min);
+        box.max = glm::max(left.max, right.max);
+    }
+    const bool changed = box.min != node.box.min || box.max != node.box.max;
+    node.box = box;
+    return changed;
+}
+
+}  // namespace internal
+}  // namespace volrend
@@ -0,0 +1,236 @@
+#include "volrend/internal/mesh_pick.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "glm/geometric.hpp"
+#include "glm/mat4x4.hpp"
+#include "glm/matrix.hpp"
+
+namespace volrend {
+namespace internal {
+namespace {
+
+const int VERT_SZ = 9;
+// Triangles per leaf, at most
+const uint32_t LEAF_SIZE = 4;
+const uint32_t NO_PARENT = UINT32_MAX;
+
+glm::vec3 inverse_dir(const glm::vec3& dir) {
+    glm::vec3 inv;
+    for (int i = 0; i < 3; ++i) {
+        inv[i] = 1.f / (std::fabs(dir[i]) > 1e-20f ? dir[i]
+                                                   : std::copysign(1e-20f,
+                                                                   dir[i]));
+    }
+    return inv;
+}
+
+// Whether the ray enters the box before tmax, and where
+bool ray_box(const glm::vec3& origin, const glm::vec3& invdir,
+             const glm::vec3& min, const glm::vec3& max, float tmax,
+             float& tmin) {
+    tmin = 0.f;
+    for (int i = 0; i < 3; ++i) {
+        const float t1 = (min[i] - origin[i]) * invdir[i];
+        const float t2 = (max[i] - origin[i]) * invdir[i];
+        tmin = std::max(tmin, std::min(t1, t2));
+        tmax = std::min(tmax, std::max(t1, t2));
+    }
+    return tmin <= tmax;
+}
+
+// Moller-Trumbore, either side; updates t if hit closer
+bool ray_triangle(const glm::vec3& origin, const glm::vec3& dir,
+                  const glm::vec3* tri, float& t) {
+    const glm::vec3 e1 = tri[1] - tri[0], e2 = tri[2] - tri[0];
+    const glm::vec3 p = glm::cross(dir, e2);
+    const float det = glm::dot(e1, p);
+    if (det == 0.f) return false;
+    const float inv_det = 1.f / det;
+    const glm::vec3 s = origin - tri[0];
+    const float u = glm::dot(s, p) * inv_det;
+    if (u < 0.f || u > 1.f) return false;
+    const glm::vec3 q = glm::cross(s, e1);
+    const float v = glm::dot(dir, q) * inv_det;
+    if (v < 0.f || u + v > 1.f) return false;
+    const float hit = glm::dot(e2, q) * inv_det;
+    if (hit <= 0.f || hit >= t) return false;
+    t = hit;
+    return true;
+}
+
+}  // namespace
+
+bool MeshPicker::pick(const std::vector<Mesh>& meshes,
+                      const glm::vec3& origin, const glm::vec3& dir, float& t,
+                      int& mesh) {
+    bvhs_.resize(meshes.size());
+    const glm::vec3 invdir = inverse_dir(dir);
+    float best = std::numeric_limits<float>::infinity();
+    mesh = -1;
+    for (size_t i = 0; i < meshes.size(); ++i) {
+        const Mesh& m = meshes[i];
+        if (!m.visible || m.face_size != 3 || m.vert.empty()) continue;
+        glm::vec3 lo, hi;
+        float tmin;
+        m.world_bounds(lo, hi);
+        if (!ray_box(origin, invdir, lo, hi, best, tmin)) continue;
+
+        Bvh& bvh = bvhs_[i];
+        if (bvh.vert != m.vert.data() || bvh.vert_size != m.vert.size() ||
+            bvh.faces_size != m.faces.size() || bvh.version != m.version() ||
+            bvh.nodes.empty()) {
+            build(m, bvh);
+        }
+        if (bvh.nodes.empty()) continue;
+
+        const glm::mat4 model = m.model_transform();
+        const size_t n_inst = std::max<size_t>(m.n_instances(), 1);
+        for (size_t k = 0; k < n_inst; ++k) {
+            const glm::mat4 inv = glm::inverse(
+                m.n_instances() > 0 ? model * m.instance_matrix(k) : model);
+            const glm::vec3 local_origin(inv * glm::vec4(origin, 1.f));
+            const glm::vec3 local_dir(inv * glm::vec4(dir, 0.f));
+            // The ray parameter is the same in local space
+            if (intersect(bvh, local_origin, local_dir, best)) {
+                mesh = (int)i;
+            }
+        }
+    }
+    if (mesh < 0) return false;
+    t = best;
+    return true;
+}
+
+void MeshPicker::build(const Mesh& mesh, Bvh& bvh) {
+    bvh.vert = mesh.vert.data();
+    bvh.vert_size = mesh.vert.size();
+    bvh.faces_size = mesh.faces.size();
+    bvh.version = mesh.version();
+    bvh.tris.clear();
+    bvh.nodes.clear();
+
+    // Corners of each triangle
+    const size_t n_verts = mesh.vert.size() / VERT_SZ;
+    const size_t n_tris =
+        (mesh.faces.empty() ? n_verts : mesh.faces.size()) / 3;
+    std::vector<glm::vec3> corners;
+    corners.reserve(n_tris * 3);
+    for (size_t i = 0; i < n_tris * 3; ++i) {
+        const size_t v = mesh.faces.empty() ? i : mesh.faces[i];
+        if (v >= n_verts) {
+            corners.resize(corners.size() - i % 3);
+            i += 2 - i % 3;
+            continue;
+        }
+        const float* p = &mesh.vert[v * VERT_SZ];
+        corners.emplace_back(p[0], p[1], p[2]);
+    }
+    const uint32_t n = (uint32_t)(corners.size() / 3);
+    if (n == 0) return;
+    std::vector<uint32_t> items(n);
+    std::vector<glm::vec3> centers(n);
+    for (uint32_t i = 0; i < n; ++i) {
+        items[i] = i;
+        centers[i] =
+            (corners[3 * i] + corners[3 * i + 1] + corners[3 * i + 2]) / 3.f;
+    }
+
+    // Top-down median splits, nodes in depth-first order
+    struct Task {
+        uint32_t begin, end, parent;
+    };
+    std::vector<Task> stack{{0, n, NO_PARENT}};
+    while (!stack.empty()) {
+        const Task task = stack.back();
+        stack.pop_back();
+        const uint32_t index = (uint32_t)bvh.nodes.size();
+        if (task.parent != NO_PARENT) bvh.nodes[task.parent].right = index;
+        glm::vec3 lo(std::numeric_limits<float>::max()),
+            hi(std::numeric_limits<float>::lowest()), center_lo = lo,
+            center_hi = hi;
+        for (uint32_t i = task.begin; i < task.end; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                lo = glm::min(lo, corners[3 * items[i] + c]);
+                hi = glm::max(hi, corners[3 * items[i] + c]);
+            }
+            center_lo = glm::min(center_lo, centers[items[i]]);
+            center_hi = glm::max(center_hi, centers[items[i]]);
+        }
+        bvh.nodes.push_back(Node{lo, hi, task.begin, task.end, 0});
+        if (task.end - task.begin <= LEAF_SIZE) continue;
+
+        const glm::vec3 extent = center_hi - center_lo;
+        const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0
+                         : extent.y >= extent.z                       ? 1
+                                                                      : 2;
+        const uint32_t mid = task.begin + (task.end - task.begin) / 2;
+        std::nth_element(items.begin() + task.begin, items.begin() + mid,
+                         items.begin() + task.end, [&](uint32_t a, uint32_t b) {
+                             return centers[a][axis] < centers[b][axis];
+                         });
+        // Left child next, at index + 1
+        stack.push_back({mid, task.end, index});
+        stack.push_back({task.begin, mid, NO_PARENT});
+    }
+
+    bvh.tris.resize(corners.size());
+    for (uint32_t i = 0; i < n; ++i) {
+        std::copy_n(&corners[3 * items[i]], 3, &bvh.tris[3 * i]);
+    }
+}
+
+bool MeshPicker::intersect(const Bvh& bvh, const glm::vec3& origin,
+                           const glm::vec3& dir, float& t) {
+    const glm::vec3 invdir = inverse_dir(dir);
+    float tmin;
+    if (!ray_box(origin, invdir, bvh.nodes[0].min, bvh.nodes[0].max, t, tmin)) {
+        return false;
+    }
+    // Nodes with their entry distances, nearer child on top
+    bool hit = false;
+    struct Entry {
+        uint32_t index;
+        float tmin;
+    };
+    Entry stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = {0, tmin};
+    while (stack_size > 0) {
+        const Entry entry = stack[--stack_size];
+        if (entry.tmin > t) continue;
+        const Node& node = bvh.nodes[entry.index];
+        if (node.right == 0) {
+            for (uint32_t i = node.begin; i < node.end; ++i) {
+                hit |= ray_triangle(origin, dir, &bvh.tris[3 * i], t);
+            }
+            continue;
+        }
+        const uint32_t left = entry.index + 1;
+        float tleft, tright;
+        const bool in_left = ray_box(origin, invdir, bvh.nodes[left].min,
+                                     bvh.nodes[left].max, t, tleft);
+        const bool in_right =
+            ray_box(origin, invdir, bvh.nodes[node.right].min,
+                    bvh.nodes[node.right].max, t, tright);
+        if (in_left && in_right) {
+            if (tleft <= tright) {
+                stack[stack_size++] = {node.right, tright};
+                stack[stack_size++] = {left, tleft};
+            } else {
+                stack[stack_size++] = {left, tleft};
+                stack[stack_size++] = {node.right, tright};
+            }
+        } else if (in_left) {
+            stack[stack_size++] = {left, tleft};
+        } else if (in_right) {
+            stack[stack_size++] = {node.right, tright};
+        }
+    }
+    return hit;
+}
+
+}  // namespace internal
+}  // namespace volrend
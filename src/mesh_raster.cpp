@@ -0,0 +1,366 @@
+#include "volrend/internal/mesh_raster.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "glm/geometric.hpp"
+#include "glm/mat3x3.hpp"
+#include "glm/mat4x4.hpp"
+
+namespace volrend {
+namespace internal {
+namespace {
+
+const int VERT_SZ = 9;
+// Near clipping plane, as in Camera::K
+const float CLIP_NEAR = 1e-3f;
+// Side of the square drawn for each point, as glPointSize in main.cpp
+const int POINT_SIZE = 4;
+
+// Camera-space vertex before projection
+struct CamVertex {
+    glm::vec3 pos, color, normal;
+};
+
+CamVertex lerp(const CamVertex& a, const CamVertex& b, float t) {
+    return {a.pos + t * (b.pos - a.pos), a.color + t * (b.color - a.color),
+            a.normal + t * (b.normal - a.normal)};
+}
+
+// Lighting of FRAG_SHADER_SRC in mesh.cpp, which takes the view direction
+// from the world camera position to the camera-space fragment position
+glm::vec3 shade_lit(const glm::vec3& color, const glm::vec3& normal,
+                    const glm::vec3& frag_pos, const glm::vec3& cam_pos) {
+    const float ambient = 0.3f, specular_strength = 0.6f,
+                diffuse_strength = 0.7f, diffuse2_strength = 0.2f;
+    const glm::vec3 light_dir = glm::normalize(glm::vec3(0.5f, 0.2f, 1.f)),
+                    light_dir2 =
+                        glm::normalize(glm::vec3(-0.5f, -1.f, -0.5f));
+    const float diffuse =
+        diffuse_strength * std::max(glm::dot(light_dir, normal), 0.f);
+    const float diffuse2 =
+        diffuse2_strength * std::max(glm::dot(light_dir2, normal), 0.f);
+    const glm::vec3 view_dir = glm::normalize(cam_pos - frag_pos);
+    const glm::vec3 reflect_dir = glm::reflect(-light_dir, normal);
+    const float spec =
+        std::pow(std::max(glm::dot(view_dir, reflect_dir), 0.f), 32.f);
+    return (ambient + diffuse + diffuse2 + specular_strength * spec) * color;
+}
+
+}  // namespace
+
+void MeshRasterizer::setup(const std::vector<Mesh>& meshes,
+                           const Camera& cam, int tile_size,
+                           float background) {
+    width_ = cam.width;
+    height_ = cam.height;
+    tile_size_ = tile_size;
+    tiles_x_ = (width_ + tile_size - 1) / tile_size;
+    const int tiles_y = (height_ + tile_size - 1) / tile_size;
+    background_ = background;
+    fx_ = cam.fx;
+    fy_ = cam.fy;
+    cam_pos_ = cam.transform[3];
+    verts_.clear();
+    prims_.clear();
+
+    for (const Mesh& mesh : meshes) {
+        if (!mesh.visible || mesh.face_size < 1 || mesh.face_size > 3) {
+            continue;
+        }
+        const glm::mat4 model = mesh.model_transform();
+        // Instances are drawn as copies
+        const size_t n_inst = mesh.n_instances();
+        for (size_t inst = 0; inst < std::max<size_t>(n_inst, 1); ++inst) {
+            const glm::mat4 inst_model =
+                n_inst > 0 ? model * mesh.instance_matrix(inst) : model;
+            const glm::mat4 model_view = cam.w2c * inst_model;
+            const glm::mat3 normal_mat(inst_model);
+            const float* inst_color =
+                n_inst > 0 && !mesh.instance_color.empty()
+                    ? &mesh.instance_color[3 * inst]
+                    : nullptr;
+            auto load = [&](size_t v) {
+                const float* ptr = &mesh.vert[v * VERT_SZ];
+                const float* color =
+                    inst_color != nullptr ? inst_color : ptr + 3;
+                return CamVertex{
+                    glm::vec3(model_view *
+                              glm::vec4(ptr[0], ptr[1], ptr[2], 1.f)),
+                    glm::vec3(color[0], color[1], color[2]),
+                    glm::normalize(normal_mat *
+                                   glm::vec3(ptr[6], ptr[7], ptr[8]))};
+            };
+
+            const int n = mesh.face_size;
+            const size_t n_verts = mesh.vert.size() / VERT_SZ;
+            const size_t n_prims =
+                mesh.faces.empty() ? n_verts / n : mesh.faces.size() / n;
+            for (size_t i = 0; i < n_prims; ++i) {
+                CamVertex in[3];
+                bool valid = true;
+                for (int j = 0; j < n; ++j) {
+                    const size_t v = mesh.faces.empty()
+                                         ? i * n + j
+                                         : mesh.faces[i * n + j];
+                    if (v >= n_verts) {
+                        valid = false;
+                        break;
+                    }
+                    in[j] = load(v);
+                }
+                if (!valid) continue;
+
+                // Clip to the near plane (camera looks down -z), leaving a
+                // polygon of up to 4 vertices
+                CamVertex clipped[4];
+                int n_clipped = 0;
+                if (n == 1) {
+                    if (in[0].pos.z <= -CLIP_NEAR) {
+                        clipped[n_clipped++] = in[0];
+                    }
+                } else {
+                    const int n_edges = n == 2 ? 1 : 3;
+                    for (int j = 0; j < n_edges; ++j) {
+                        const CamVertex &a = in[j], &b = in[(j + 1) % n];
+                        const bool a_in = a.pos.z <= -CLIP_NEAR,
+                                   b_in = b.pos.z <= -CLIP_NEAR;
+                        if (a_in) clipped[n_clipped++] = a;
+                        if (a_in != b_in) {
+                            const float t =
+                                (-CLIP_NEAR - a.pos.z) / (b.pos.z - a.pos.z);
+                            clipped[n_clipped++] = lerp(a, b, t);
+                        }
+                        if (n == 2 && b_in) clipped[n_clipped++] = b;
+                    }
+                }
+                if (n_clipped < n) continue;
+
+                Vertex proj[4];
+                for (int j = 0; j < n_clipped; ++j) {
+                    const CamVertex& v = clipped[j];
+                    const float inv_z = -1.f / v.pos.z;
+                    // Pixel (x, y) samples the ray of render_pixel in
+                    // cpu_renderer.cpp
+                    proj[j] = {0.5f * width_ + fx_ * v.pos.x * inv_z,
+                               0.5f * height_ - fy_ * v.pos.y * inv_z,
+                               inv_z,
+                               v.pos * inv_z,
+                               v.color * inv_z,
+                               v.normal * inv_z};
+                }
+                if (n_clipped == 4) {
+                    const Vertex second[3] = {proj[0], proj[2], proj[3]};
+                    add_prim(proj, 3, mesh.unlit);
+                    add_prim(second, 3, mesh.unlit);
+                } else {
+                    add_prim(proj, n, mesh.unlit);
+                }
+            }
+        }
+    }
+
+    // Bin the primitives by their screen bounding boxes
+    bin_start_.assign((size_t)tiles_x_ * tiles_y + 1, 0);
+    auto tile_range = [&](const Prim& prim, int& tx0, int& ty0, int& tx1,
+                          int& ty1) {
+        float x0 = verts_[prim.first].x, x1 = x0;
+        float y0 = verts_[prim.first].y, y1 = y0;
+        for (int j = 1; j < prim.n; ++j) {
+            const Vertex& v = verts_[prim.first + j];
+            x0 = std::min(x0, v.x);
+            x1 = std::max(x1, v.x);
+            y0 = std::min(y0, v.y);
+            y1 = std::max(y1, v.y);
+        }
+        // Lines and points round to the nearest pixel; points are squares
+        const float pad = prim.n == 3 ? 0.f : 0.5f * POINT_SIZE + 1.f;
+        tx0 = std::max((int)std::floor((x0 - pad) / tile_size_), 0);
+        ty0 = std::max((int)std::floor((y0 - pad) / tile_size_), 0);
+        tx1 = std::min((int)std::floor((x1 + pad) / tile_size_),
+                       tiles_x_ - 1);
+        ty1 = std::min((int)std::floor((y1 + pad) / tile_size_),
+                       tiles_y - 1);
+    };
+    int tx0, ty0, tx1, ty1;
+    for (const Prim& prim : prims_) {
+        tile_range(prim, tx0, ty0, tx1, ty1);
+        for (int ty = ty0; ty <= ty1; ++ty) {
+            for (int tx = tx0; tx <= tx1; ++tx) {
+                ++bin_start_[(size_t)ty * tiles_x_ + tx + 1];
+            }
+        }
+    }
+    for (size_t t = 1; t < bin_start_.size(); ++t) {
+        bin_start_[t] += bin_start_[t - 1];
+    }
+    bin_items_.resize(bin_start_.back());
+    std::vector<uint32_t> fill(bin_start_.begin(), bin_start_.end() - 1);
+    for (size_t i = 0; i < prims_.size(); ++i) {
+        tile_range(prims_[i], tx0, ty0, tx1, ty1);
+        for (int ty = ty0; ty <= ty1; ++ty) {
+            for (int tx = tx0; tx <= tx1; ++tx) {
+                bin_items_[fill[(size_t)ty * tiles_x_ + tx]++] = (uint32_t)i;
+            }
+        }
+    }
+
+    color_.resize((size_t)4 * width_ * height_);
+    depth_.resize((size_t)width_ * height_);
+}
+
+void MeshRasterizer::add_prim(const Vertex* verts, int n, bool unlit) {
+    if (n == 3) {
+        // Degenerate or entirely off screen
+        const float area =
+            (verts[1].x - verts[0].x) * (verts[2].y - verts[0].y) -
+            (verts[1].y - verts[0].y) * (verts[2].x - verts[0].x);
+        if (std::fabs(area) < 1e-12f) return;
+    }
+    float x0 = verts[0].x, x1 = x0, y0 = verts[0].y, y1 = y0;
+    for (int j = 1; j < n; ++j) {
+        x0 = std::min(x0, verts[j].x);
+        x1 = std::max(x1, verts[j].x);
+        y0 = std::min(y0, verts[j].y);
+        y1 = std::max(y1, verts[j].y);
+    }
+    const float pad = 0.5f * POINT_SIZE + 1.f;
+    if (x1 < -pad || y1 < -pad || x0 > width_ + pad || y0 > height_ + pad) {
+        return;
+    }
+    prims_.push_back({(uint32_t)verts_.size(), (uint8_t)n, unlit});
+    verts_.insert(verts_.end(), verts, verts + n);
+}
+
+void MeshRasterizer::fragment(const Prim& prim, const float* w, int x,
+                              int y) {
+    float inv_z = 0.f;
+    glm::vec3 pos(0.f), color(0.f), normal(0.f);
+    for (int j = 0; j < prim.n; ++j) {
+        const Vertex& v = verts_[prim.first + j];
+        inv_z += w[j] * v.inv_z;
+        pos += w[j] * v.pos;
+        color += w[j] * v.color;
+        normal += w[j] * v.normal;
+    }
+    pos /= inv_z;
+    const size_t pixel = (size_t)y * width_ + x;
+    const float depth = glm::length(pos);
+    if (!(depth < depth_[pixel])) return;
+    depth_[pixel] = depth;
+
+    color /= inv_z;
+    if (!prim.unlit) {
+        color = shade_lit(color, normal / inv_z, pos, cam_pos_);
+    }
+    uint8_t* rgba = &color_[4 * pixel];
+    for (int i = 0; i < 3; ++i) {
+        rgba[i] = uint8_t(std::min(std::max(color[i], 0.f), 1.f) * 255.f +
+                          0.5f);
+    }
+    rgba[3] = 255;
+}
+
+void MeshRasterizer::rasterize_tile(uint32_t tile) {
+    const int x0 = (tile % tiles_x_) * tile_size_,
+              y0 = (tile / tiles_x_) * tile_size_;
+    const int x1 = std::min(x0 + tile_size_, width_),
+              y1 = std::min(y0 + tile_size_, height_);
+    const uint8_t bg = uint8_t(background_ * 255.f + 0.5f);
+    for (int y = y0; y < y1; ++y) {
+        for (int x = x0; x < x1; ++x) {
+            const size_t pixel = (size_t)y * width_ + x;
+            uint8_t* rgba = &color_[4 * pixel];
+            rgba[0] = rgba[1] = rgba[2] = bg;
+            rgba[3] = 255;
+            depth_[pixel] = std::numeric_limits<float>::infinity();
+        }
+    }
+
+    for (uint32_t k = bin_start_[tile]; k < bin_start_[tile + 1]; ++k) {
+        const Prim& prim = prims_[bin_items_[k]];
+        const Vertex* v = &verts_[prim.first];
+        if (prim.n == 3) {
+            // Edge functions, at integer pixel sample positions
+            const float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) -
+                               (v[1].y - v[0].y) * (v[2].x - v[0].x);
+            const float inv_area = 1.f / area;
+            const int px0 = std::max(
+                          (int)std::ceil(std::min({v[0].x, v[1].x, v[2].x})),
+                          x0),
+                      px1 = std::min(
+                          (int)std::floor(std::max({v[0].x, v[1].x, v[2].x})),
+                          x1 - 1),
+                      py0 = std::max(
+                          (int)std::ceil(std::min({v[0].y, v[1].y, v[2].y})),
+                          y0),
+                      py1 = std::min(
+                          (int)std::floor(std::max({v[0].y, v[1].y, v[2].y})),
+                          y1 - 1);
+            for (int y = py0; y <= py1; ++y) {
+                for (int x = px0; x <= px1; ++x) {
+                    float w[3];
+                    for (int j = 0; j < 3; ++j) {
+                        const Vertex &a = v[(j + 1) % 3], &b = v[(j + 2) % 3];
+                        w[j] = ((b.x - a.x) * (y - a.y) -
+                                (b.y - a.y) * (x - a.x)) *
+                               inv_area;
+                    }
+                    if (w[0] < 0.f || w[1] < 0.f || w[2] < 0.f) continue;
+                    fragment(prim, w, x, y);
+                }
+            }
+        } else if (prim.n == 2) {
+            // One fragment per step along the major axis, at the nearest
+            // pixel; only the steps that can land in this tile
+            const float dx = v[1].x - v[0].x, dy = v[1].y - v[0].y;
+            const int n_steps = std::max(
+                (int)std::ceil(std::max(std::fabs(dx), std::fabs(dy))), 1);
+            float t0 = 0.f, t1 = 1.f;
+            const float lo[2] = {x0 - 0.5f, y0 - 0.5f},
+                        hi[2] = {x1 - 0.5f, y1 - 0.5f},
+                        start[2] = {v[0].x, v[0].y}, delta[2] = {dx, dy};
+            for (int i = 0; i < 2; ++i) {
+                if (delta[i] == 0.f) {
+                    if (start[i] < lo[i] || start[i] >= hi[i]) t1 = -1.f;
+                    continue;
+                }
+                float ta = (lo[i] - start[i]) / delta[i],
+                      tb = (hi[i] - start[i]) / delta[i];
+                if (ta > tb) std::swap(ta, tb);
+                t0 = std::max(t0, ta);
+                t1 = std::min(t1, tb);
+            }
+            if (t0 > t1) continue;
+            const int s0 = (int)std::floor(t0 * n_steps),
+                      s1 = std::min((int)std::ceil(t1 * n_steps), n_steps);
+            for (int s = s0; s <= s1; ++s) {
+                const float t = (float)s / n_steps;
+                const int x = (int)std::floor(v[0].x + t * dx + 0.5f),
+                          y = (int)std::floor(v[0].y + t * dy + 0.5f);
+                if (x < x0 || x >= x1 || y < y0 || y >= y1) continue;
+                const float w[2] = {1.f - t, t};
+                fragment(prim, w, x, y);
+            }
+        } else {
+            const float w[1] = {1.f};
+            const int px0 = std::max(
+                          (int)std::ceil(v[0].x - 0.5f * POINT_SIZE), x0),
+                      px1 = std::min(
+                          (int)std::ceil(v[0].x + 0.5f * POINT_SIZE) - 1,
+                          x1 - 1),
+                      py0 = std::max(
+                          (int)std::ceil(v[0].y - 0.5f * POINT_SIZE), y0),
+                      py1 = std::min(
+                          (int)std::ceil(v[0].y + 0.5f * POINT_SIZE) - 1,
+                          y1 - 1);
+            for (int y = py0; y <= py1; ++y) {
+                for (int x = px0; x <= px1; ++x) fragment(prim, w, x, y);
+            }
+        }
+    }
+}
+
+}  // namespace internal
+}  // namespace volrend
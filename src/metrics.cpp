@@ -0,0 +1,195 @@
+#include "volrend/internal/metrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+// The inner loops below are kept branch-free over contiguous float/int
+// arrays so that the compiler vectorizes them
+
+namespace volrend {
+namespace internal {
+namespace {
+const int SSIM_WIN = 11;
+const float SSIM_SIGMA = 1.5f;
+// Pixels per block of the PSNR integer accumulator (cannot overflow u32)
+const size_t PSNR_BLOCK = 4096;
+
+template <bool MASKED>
+void sum_squared_error(const uint8_t* __restrict__ a,
+                       const uint8_t* __restrict__ b,
+                       const uint8_t* __restrict__ mask, size_t n_pix,
+                       uint64_t& sse, uint64_t& count) {
+    sse = count = 0;
+    for (size_t base = 0; base < n_pix; base += PSNR_BLOCK) {
+        const size_t end = std::min(n_pix, base + PSNR_BLOCK);
+        uint32_t block_sse = 0, block_count = 0;
+        for (size_t i = base; i < end; ++i) {
+            const int d0 = (int)a[4 * i] - (int)b[4 * i],
+                      d1 = (int)a[4 * i + 1] - (int)b[4 * i + 1],
+                      d2 = (int)a[4 * i + 2] - (int)b[4 * i + 2];
+            const uint32_t err = d0 * d0 + d1 * d1 + d2 * d2;
+            if (MASKED) {
+                const uint32_t w = mask[i] != 0;
+                block_sse += w * err;
+                block_count += w;
+            } else {
+                block_sse += err;
+            }
+        }
+        sse += block_sse;
+        count += MASKED ? block_count : end - base;
+    }
+}
+
+// Single channel of a u8 RGBA image as float in [0, 1]
+void extract_channel(const uint8_t* __restrict__ rgba, size_t n_pix, int c,
+                     float* __restrict__ out) {
+    for (size_t i = 0; i < n_pix; ++i) {
+        out[i] = rgba[4 * i + c] * (1.f / 255.f);
+    }
+}
+}  // namespace
+
+double psnr(const uint8_t* a, const uint8_t* b, int width, int height,
+            const uint8_t* mask) {
+    const size_t n_pix = (size_t)width * height;
+    uint64_t sse, count;
+    if (mask != nullptr) {
+        sum_squared_error<true>(a, b, mask, n_pix, sse, count);
+    } else {
+        sum_squared_error<false>(a, b, mask, n_pix, sse, count);
+    }
+    if (count == 0) return std::numeric_limits<double>::quiet_NaN();
+    if (sse == 0) return std::numeric_limits<double>::infinity();
+    const double mse = (double)sse / (3.0 * count) / (255.0 * 255.0);
+    return -10.0 * std::log10(mse);
+}
+
+double ssim(const uint8_t* a, const uint8_t* b, int width, int height,
+            const uint8_t* mask) {
+    if (width < SSIM_WIN || height < SSIM_WIN) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    const float C1 = 0.01f * 0.01f, C2 = 0.03f * 0.03f;
+
+    float kernel[SSIM_WIN];
+    float ksum = 0.f;
+    for (int k = 0; k < SSIM_WIN; ++k) {
+        const float d = k - (SSIM_WIN - 1) * 0.5f;
+        kernel[k] = std::exp(-0.5f * d * d / (SSIM_SIGMA * SSIM_SIGMA));
+        ksum += kernel[k];
+    }
+    for (int k = 0; k < SSIM_WIN; ++k) kernel[k] /= ksum;
+
+    const size_t n_pix = (size_t)width * height;
+    const int ow = width - SSIM_WIN + 1, oh = height - SSIM_WIN + 1;
+    const int half_win = SSIM_WIN / 2;
+    std::vector<float> x(n_pix), y(n_pix);
+    // Horizontally filtered x, y, xx, yy, xy for all rows
+    std::vector<float> hbuf(5 * (size_t)ow * height);
+    // Vertically filtered row
+    std::vector<float> vbuf(5 * (size_t)ow);
+    std::vector<float> maskf(ow, 1.f);
+
+    double total = 0.0;
+    size_t total_count = 0;
+    for (int c = 0; c < 3; ++c) {
+        extract_channel(a, n_pix, c, x.data());
+        extract_channel(b, n_pix, c, y.data());
+
+        for (int r = 0; r < height; ++r) {
+            const float* __restrict__ xr = x.data() + (size_t)r * width;
+            const float* __restrict__ yr = y.data() + (size_t)r * width;
+            float* __restrict__ hx = hbuf.data() + (size_t)r * ow;
+            float* __restrict__ hy = hx + (size_t)ow * height;
+            float* __restrict__ hxx = hy + (size_t)ow * height;
+            float* __restrict__ hyy = hxx + (size_t)ow * height;
+            float* __restrict__ hxy = hyy + (size_t)ow * height;
+            std::fill(hx, hx + ow, 0.f);
+            std::fill(hy, hy + ow, 0.f);
+            std::fill(hxx, hxx + ow, 0.f);
+            std::fill(hyy, hyy + ow, 0.f);
+            std::fill(hxy, hxy + ow, 0.f);
+            for (int k = 0; k < SSIM_WIN; ++k) {
+                const float w = kernel[k];
+                for (int i = 0; i < ow; ++i) {
+                    const float xv = xr[i + k], yv = yr[i + k];
+                    hx[i] += w * xv;
+                    hy[i] += w * yv;
+                    hxx[i] += w * xv * xv;
+                    hyy[i] += w * yv * yv;
+                    hxy[i] += w * xv * yv;
+                }
+            }
+        }
+
+        for (int r = 0; r < oh; ++r) {
+            float* __restrict__ mx = vbuf.data();
+            float* __restrict__ my = mx + ow;
+            float* __restrict__ exx = my + ow;
+            float* __restrict__ eyy = exx + ow;
+            float* __restrict__ exy = eyy + ow;
+            std::fill(vbuf.begin(), vbuf.end(), 0.f);
+            for (int k = 0; k < SSIM_WIN; ++k) {
+                const float w = kernel[k];
+                const float* __restrict__ hx =
+                    hbuf.data() + (size_t)(r + k) * ow;
+                const float* __restrict__ hy = hx + (size_t)ow * height;
+                const float* __restrict__ hxx = hy + (size_t)ow * height;
+                const float* __restrict__ hyy = hxx + (size_t)ow * height;
+                const float* __restrict__ hxy = hyy + (size_t)ow * height;
+                for (int i = 0; i < ow; ++i) {
+                    mx[i] += w * hx[i];
+                    my[i] += w * hy[i];
+                    exx[i] += w * hxx[i];
+                    eyy[i] += w * hyy[i];
+                    exy[i] += w * hxy[i];
+                }
+            }
+            if (mask != nullptr) {
+                const uint8_t* mrow =
+                    mask + (size_t)(r + half_win) * width + half_win;
+                for (int i = 0; i < ow; ++i) maskf[i] = mrow[i] != 0;
+            }
+            float row_sum = 0.f;
+            size_t row_count = 0;
+            for (int i = 0; i < ow; ++i) {
+                const float sxx = exx[i] - mx[i] * mx[i],
+                            syy = eyy[i] - my[i] * my[i],
+                            sxy = exy[i] - mx[i] * my[i];
+                const float val =
+                    ((2.f * mx[i] * my[i] + C1) * (2.f * sxy + C2)) /
+                    ((mx[i] * mx[i] + my[i] * my[i] + C1) * (sxx + syy + C2));
+                row_sum += maskf[i] * val;
+            }
+            if (mask != nullptr) {
+                for (int i = 0; i < ow; ++i) row_count += maskf[i] != 0.f;
+            } else {
+                row_count = ow;
+            }
+            total += row_sum;
+            total_count += row_count;
+        }
+    }
+    if (total_count == 0) return std::numeric_limits<double>::quiet_NaN();
+    return total / total_count;
+}
+
+void composite_background(uint8_t* rgba, int width, int height,
+                          float background_brightness) {
+    const size_t n_pix = (size_t)width * height;
+    const float bg = background_brightness * 255.f;
+    for (size_t i = 0; i < n_pix; ++i) {
+        uint8_t* px = rgba + 4 * i;
+        const float alpha = px[3] * (1.f / 255.f);
+        for (int c = 0; c < 3; ++c) {
+            px[c] = (uint8_t)(px[c] * alpha + bg * (1.f - alpha) + 0.5f);
+        }
+        px[3] = 255;
+    }
+}
+
+}  // namespace internal
+}  // namespace volrend
@@ -2,6 +2,7 @@
 #include "volrend/data_format.hpp"
 #include "volrend/internal/morton.hpp"
 
+#include <algorithm>
 #include <cassert>
 #include <cstdio>
 #include <cstring>
@@ -10,6 +11,7 @@
 #include <fstream>
 #include <thread>
 #include <atomic>
+#include <vector>
 
 #include "glm/geometric.hpp"
 
@@ -50,6 +52,63 @@ void unpack_llff_poses_bounds(cnpy::NpyArray& poses_bounds, float& width,
     right = glm::normalize(glm::cross(up, backward));
     up = glm::normalize(glm::cross(backward, right));
 }
+
+// Copy arr's data into a buffer allocated with pages of mode
+void set_array_page_mode(internal::HostArray& arr, PageMode pages) {
+    if (arr.page_mode() == pages) return;
+    decltype(arr.data_holder) holder{internal::HostAllocator<char>(pages)};
+    holder.assign(arr.data_holder.begin(), arr.data_holder.end());
+    arr.data_holder.swap(holder);
+}
+
+// Copy the loaded src into dst, on pages of mode, and free src
+void take_array(cnpy::NpyArray& src, internal::HostArray& dst,
+                PageMode pages) {
+    decltype(dst.data_holder) holder{internal::HostAllocator<char>(pages)};
+    holder.assign(src.data_holder.begin(), src.data_holder.end());
+    dst.data_holder.swap(holder);
+    dst.shape = src.shape;
+    dst.word_size = src.word_size;
+    dst.num_vals = src.num_vals;
+    std::vector<char>().swap(src.data_holder);
+}
+
+// Fill the ropes of the cells of node, given the ropes of the cell pointing
+// to it (all -1 for the root). Ropes are either to a cell of the same size
+// or to a coarser leaf, so an inner rope target always has a child at the
+// same size as the node's cells
+void build_ropes_impl(const int32_t* child, int N, int64_t node,
+                      const int32_t* parent_ropes, int32_t* ropes) {
+    const int N3 = N * N * N;
+    const int stride[3] = {N * N, N, 1};
+    for (int idx = 0; idx < N3; ++idx) {
+        const int64_t cell = node * N3 + idx;
+        const int ijk[3] = {idx / (N * N), idx / N % N, idx % N};
+        int32_t* cell_ropes = ropes + cell * 6;
+        for (int axis = 0; axis < 3; ++axis) {
+            for (int side = 0; side < 2; ++side) {
+                const int c = ijk[axis] + (side ? 1 : -1);
+                int32_t rope;
+                if (c >= 0 && c < N) {
+                    rope = (int32_t)(cell + (c - ijk[axis]) * stride[axis]);
+                } else {
+                    rope = parent_ropes[2 * axis + side];
+                    if (rope >= 0 && child[rope] != 0) {
+                        // Same-size cell across the parent's face
+                        const int64_t sub_node = rope / N3 + child[rope];
+                        const int wrapped = side ? 0 : N - 1;
+                        rope = (int32_t)(sub_node * N3 + idx +
+                                         (wrapped - ijk[axis]) * stride[axis]);
+                    }
+                }
+                cell_ropes[2 * axis + side] = rope;
+            }
+        }
+        if (child[cell] != 0) {
+            build_ropes_impl(child, N, node + child[cell], cell_ropes, ropes);
+        }
+    }
+}
 }  // namespace
 
 void DataFormat::parse(const std::string& str) {
@@ -101,14 +160,14 @@ std::string DataFormat::to_string() const {
 }
 
 N3Tree::N3Tree() {}
-N3Tree::N3Tree(const std::string& path) { open(path); }
+N3Tree::N3Tree(const std::string& path, PageMode pages) { open(path, pages); }
 N3Tree::~N3Tree() {
 #ifdef VOLREND_CUDA
     free_cuda();
 #endif
 }
 
-void N3Tree::open(const std::string& path) {
+void N3Tree::open(const std::string& path, PageMode pages) {
     clear_cpu_memory();
 
     data_loaded_ = false;
@@ -126,7 +185,7 @@ void N3Tree::open(const std::string& path) {
     }
 
     cnpy::npz_t npz = cnpy::npz_load(path);
-    load_npz(npz);
+    load_npz(npz, pages);
 
     use_ndc = bool(std::ifstream(poses_bounds_path_));
     if (use_ndc) {
@@ -225,7 +284,7 @@ void N3Tree::open_mem(const char* data, uint64_t size) {
 // }
 // }  // namespace
 
-void N3Tree::load_npz(cnpy::npz_t& npz) {
+void N3Tree::load_npz(cnpy::npz_t& npz, PageMode pages) {
     data_dim = (int)*npz["data_dim"].data<int64_t>();
     if (npz.count("data_format")) {
         auto& df_node = npz["data_format"];
@@ -267,9 +326,8 @@ void N3Tree::load_npz(cnpy::npz_t& npz) {
         for (int i = 0; i < 3; ++i) offset[i] = offset_data[i];
     }
 
-    auto child_node = npz["child"];
-    std::swap(child_, npz["child"]);
-    N = child_node.shape[1];
+    take_array(npz["child"], child_, pages);
+    N = child_.shape[1];
     if (N != 2) {
         fprintf(stderr, "WARNING: N != 2 probably doesn't work.\n");
     }
@@ -294,10 +352,9 @@ void N3Tree::load_npz(cnpy::npz_t& npz) {
             npz.count("data_retained") ? npz["data_retained"].shape[0] : 0;
         n_basis += n_basis_retain;
 
-        data_.data_holder.clear();
         data_.reinit({(size_t)capacity, (size_t)N, (size_t)N, (size_t)N,
                       (size_t)data_dim},
-                     2, false);
+                     2, pages);
 
         // Decode quantized
         auto& sigma_node = npz["sigma"];
@@ -344,7 +401,7 @@ void N3Tree::load_npz(cnpy::npz_t& npz) {
         if (data_node.word_size != 2) {
             throw std::runtime_error("data must be stored in half precision");
         }
-        std::swap(data_, data_node);
+        take_array(data_node, data_, pages);
     }
 
     if (npz.count("extra_data")) {
@@ -353,6 +410,19 @@ void N3Tree::load_npz(cnpy::npz_t& npz) {
         extra_.data_holder.clear();
     }
 
+    ropes_.data_holder.clear();
+    node_pos_.clear();
+    if (npz.count("ropes")) {
+        auto& ropes_node = npz["ropes"];
+        if (ropes_node.word_size != 4 ||
+            ropes_node.num_vals != child_.num_vals * 6) {
+            fprintf(stderr, "WARNING: Ignoring ropes of unexpected shape\n");
+        } else {
+            take_array(ropes_node, ropes_, pages);
+            index_nodes();
+        }
+    }
+
     // max_depth = _calc_tree_maxdepth(*this, 0, 0, 0, 0);
     // resolution = 1 << (max_depth + 1);
     // resolution3_ = resolution * resolution * resolution;
@@ -446,6 +516,50 @@ void N3Tree::clear_cpu_memory() {
     data_.data_holder.shrink_to_fit();
 }
 
+void N3Tree::set_page_mode(PageMode pages) {
+    set_array_page_mode(child_, pages);
+    set_array_page_mode(data_, pages);
+    if (has_ropes()) set_array_page_mode(ropes_, pages);
+}
+
+void N3Tree::build_ropes() {
+    if (has_ropes()) return;
+    const size_t n_nodes = child_.shape[0];
+    ropes_.reinit({n_nodes, (size_t)N, (size_t)N, (size_t)N, 6}, 4,
+                  child_.page_mode());
+    int32_t* ropes = ropes_.data<int32_t>();
+    std::fill(ropes, ropes + ropes_.num_vals, -1);
+    const int32_t boundary[6] = {-1, -1, -1, -1, -1, -1};
+    build_ropes_impl(child_.data<int32_t>(), N, 0, boundary, ropes);
+    index_nodes();
+#ifdef VOLREND_CUDA
+    if (cuda_loaded_) load_cuda_ropes();
+#endif
+}
+
+bool N3Tree::has_ropes() const { return !ropes_.data_holder.empty(); }
+
+void N3Tree::index_nodes() {
+    const int32_t* child = child_.data<int32_t>();
+    node_pos_.assign(child_.shape[0] * 4, 0);
+    node_pos_[3] = N;
+    std::vector<int64_t> stack(1, 0);
+    while (!stack.empty()) {
+        const int64_t node = stack.back();
+        stack.pop_back();
+        const int32_t* pos = &node_pos_[node * 4];
+        for (int idx = 0; idx < N3_; ++idx) {
+            const int32_t skip = child[node * N3_ + idx];
+            if (skip == 0) continue;
+            const int ijk[3] = {idx / N2_, idx / N % N, idx % N};
+            int32_t* sub_pos = &node_pos_[(node + skip) * 4];
+            for (int i = 0; i < 3; ++i) sub_pos[i] = (pos[i] + ijk[i]) * N;
+            sub_pos[3] = pos[3] * N;
+            stack.push_back(node + skip);
+        }
+    }
+}
+
 int N3Tree::pack_index(int nd, int i, int j, int k) {
     assert(i < N && j < N && k < N && i >= 0 && j >= 0 && k >= 0);
     return nd * N3_ + i * N2_ + j * N + k;
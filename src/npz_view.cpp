@@ -0,0 +1,177 @@
+#include "volrend/internal/npz_view.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <cnpy.h>
+#include <zlib.h>
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define VOLREND_NPZ_MMAP
+#endif
+
+namespace volrend {
+namespace internal {
+namespace {
+
+// Zip local file header, before the name and extra field
+const size_t LOCAL_HEADER_SZ = 30;
+
+template <typename T>
+T read_le(const char* ptr) {
+    T val;
+    memcpy(&val, ptr, sizeof(T));
+    return val;
+}
+
+}  // namespace
+
+NpzView::~NpzView() { close(); }
+
+void NpzView::close() {
+#ifdef VOLREND_NPZ_MMAP
+    if (map_ != nullptr) munmap(map_, map_size_);
+#endif
+    map_ = nullptr;
+    map_size_ = 0;
+    file_.clear();
+    owned_.clear();
+    arrays_.clear();
+}
+
+bool NpzView::open(const std::string& path, std::string& error) {
+    close();
+#ifdef VOLREND_NPZ_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) ::close(fd);
+        error = "Cannot open '" + path + "'";
+        return false;
+    }
+    const size_t size = (size_t)st.st_size;
+    if (size == 0) {
+        ::close(fd);
+        error = "Empty npz '" + path + "'";
+        return false;
+    }
+    void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (ptr == MAP_FAILED) {
+        error = "Cannot map '" + path + "'";
+        return false;
+    }
+    // Read once front to back
+    madvise(ptr, size, MADV_SEQUENTIAL);
+    map_ = ptr;
+    map_size_ = size;
+    return parse((const char*)ptr, size, error);
+#else
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) {
+        error = "Cannot open '" + path + "'";
+        return false;
+    }
+    file_.assign(std::istreambuf_iterator<char>(ifs),
+                 std::istreambuf_iterator<char>());
+    return parse(file_.data(), file_.size(), error);
+#endif
+}
+
+bool NpzView::open_mem(const char* data, size_t size, std::string& error) {
+    close();
+    return parse(data, size, error);
+}
+
+bool NpzView::parse(const char* data, size_t size, std::string& error) {
+    const char* ptr = data;
+    const char* const end = data + size;
+    while (true) {
+        const char* header = ptr;
+        if (ptr + LOCAL_HEADER_SZ > end) {
+            error = "Unexpected end of npz";
+            return false;
+        }
+        // Stop at the central directory
+        if (header[2] != 0x03 || header[3] != 0x04) break;
+        ptr += LOCAL_HEADER_SZ;
+
+        const uint16_t compr_method = read_le<uint16_t>(header + 8);
+        uint64_t compr_bytes = read_le<uint32_t>(header + 18);
+        uint64_t uncompr_bytes = read_le<uint32_t>(header + 22);
+        const uint16_t name_len = read_le<uint16_t>(header + 26);
+        const uint16_t extra_len = read_le<uint16_t>(header + 28);
+        if (name_len < 4 || ptr + name_len + extra_len > end) {
+            error = "Invalid npz entry header";
+            return false;
+        }
+        // Drop the .npy
+        std::string name(ptr, ptr + name_len - 4);
+        ptr += name_len;
+        if (extra_len >= 20 && compr_bytes == 0xffffffff &&
+            uncompr_bytes == 0xffffffff && read_le<uint16_t>(ptr) == 1) {
+            // Zip64 sizes of large arrays
+            uncompr_bytes = read_le<uint64_t>(ptr + 4);
+            compr_bytes = read_le<uint64_t>(ptr + 12);
+        }
+        ptr += extra_len;
+        if (compr_method == 0) compr_bytes = uncompr_bytes;
+        if (compr_bytes > (uint64_t)(end - ptr)) {
+            error = "Unexpected end of npz in '" + name + "'";
+            return false;
+        }
+        if (uncompr_bytes < 10) {
+            error = "Invalid npy header in '" + name + "'";
+            return false;
+        }
+
+        const char* npy = ptr;
+        if (compr_method != 0) {
+            // Deflated
+            owned_.emplace_back(new char[uncompr_bytes]);
+            z_stream strm;
+            memset(&strm, 0, sizeof(strm));
+            inflateInit2(&strm, -MAX_WBITS);
+            strm.avail_in = (uInt)compr_bytes;
+            strm.next_in = (Bytef*)ptr;
+            strm.avail_out = (uInt)uncompr_bytes;
+            strm.next_out = (Bytef*)owned_.back().get();
+            const int err = inflate(&strm, Z_FINISH);
+            inflateEnd(&strm);
+            if (err != Z_STREAM_END) {
+                error = "Cannot inflate '" + name + "'";
+                return false;
+            }
+            npy = owned_.back().get();
+        }
+        ptr += compr_bytes;
+
+        NpyView arr;
+        const size_t header_len = cnpy::parse_npy_header(
+            npy, arr.word_size, arr.shape, arr.fortran_order);
+        arr.num_vals = 1;
+        for (size_t dim : arr.shape) arr.num_vals *= dim;
+        if (header_len + arr.num_bytes() > uncompr_bytes) {
+            error = "Truncated array '" + name + "'";
+            return false;
+        }
+        arr.ptr = npy + header_len;
+        const size_t align = arr.word_size <= 8 ? arr.word_size : 1;
+        if (align > 1 && (uintptr_t)arr.ptr % align) {
+            // Zip entries start at arbitrary offsets
+            owned_.emplace_back(new char[arr.num_bytes()]);
+            memcpy(owned_.back().get(), arr.ptr, arr.num_bytes());
+            arr.ptr = owned_.back().get();
+        }
+        arrays_[name] = std::move(arr);
+    }
+    return true;
+}
+
+}  // namespace internal
+}  // namespace volrend
@@ -0,0 +1,212 @@
+#include "volrend/internal/numa.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace volrend {
+namespace internal {
+namespace {
+
+#ifdef __linux__
+// From linux/mempolicy.h, so that libnuma is not required
+const int MPOL_BIND_ = 2;
+const int MPOL_INTERLEAVE_ = 3;
+const int MPOL_F_NODE_ = 1 << 0;
+const int MPOL_F_ADDR_ = 1 << 1;
+const unsigned MPOL_MF_MOVE_ = 1 << 1;
+const int MAX_NODES = 1024;
+const int BITS_PER_LONG = 8 * sizeof(unsigned long);
+
+// Parse a sysfs list like "0-3,8,10-11"
+std::vector<int> parse_list(const std::string& str) {
+    std::vector<int> result;
+    std::stringstream ss(str);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty() || item == "\n") continue;
+        const size_t dash = item.find('-');
+        const int lo = std::atoi(item.c_str());
+        const int hi =
+            dash == std::string::npos ? lo : std::atoi(item.c_str() + dash + 1);
+        for (int i = lo; i <= hi; ++i) result.push_back(i);
+    }
+    return result;
+}
+
+std::string read_file(const std::string& path) {
+    std::ifstream ifs(path);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+size_t page_size() {
+    static const size_t size = (size_t)sysconf(_SC_PAGESIZE);
+    return size;
+}
+
+long mbind_range(const void* ptr, size_t bytes, int mode,
+                 const std::vector<int>& nodes) {
+    unsigned long mask[MAX_NODES / BITS_PER_LONG] = {};
+    for (int node : nodes) {
+        if (node < MAX_NODES) {
+            mask[node / BITS_PER_LONG] |= 1UL << (node % BITS_PER_LONG);
+        }
+    }
+    const uintptr_t begin = (uintptr_t)ptr & ~(page_size() - 1),
+                    end = ((uintptr_t)ptr + bytes + page_size() - 1) &
+                          ~(page_size() - 1);
+    return syscall(SYS_mbind, begin, end - begin, mode, mask,
+                   (unsigned long)MAX_NODES, MPOL_MF_MOVE_);
+}
+#endif
+
+}  // namespace
+
+const NumaTopology& NumaTopology::get() {
+    static const NumaTopology topology = [] {
+        NumaTopology topo;
+#ifdef __linux__
+        const std::string base = "/sys/devices/system/node/";
+        for (int id : parse_list(read_file(base + "online"))) {
+            std::vector<int> cpus = parse_list(
+                read_file(base + "node" + std::to_string(id) + "/cpulist"));
+            // Memory-only nodes have no CPUs to render with
+            if (cpus.empty()) continue;
+            topo.node_ids.push_back(id);
+            topo.node_cpus.push_back(std::move(cpus));
+        }
+#endif
+        if (topo.node_ids.empty()) {
+            topo.node_ids.push_back(0);
+            topo.node_cpus.emplace_back();
+            const int n_cpus =
+                std::max((int)std::thread::hardware_concurrency(), 1);
+            for (int i = 0; i < n_cpus; ++i) topo.node_cpus[0].push_back(i);
+        }
+        for (int i = 0; i < topo.n_nodes(); ++i) {
+            for (int cpu : topo.node_cpus[i]) {
+                if (cpu >= (int)topo.cpu_nodes.size()) {
+                    topo.cpu_nodes.resize(cpu + 1, 0);
+                }
+                topo.cpu_nodes[cpu] = i;
+            }
+        }
+        return topo;
+    }();
+    return topology;
+}
+
+size_t NumaTopology::free_bytes(int node) const {
+#ifdef __linux__
+    std::ifstream ifs("/sys/devices/system/node/node" +
+                      std::to_string(node_ids[node]) + "/meminfo");
+    std::string line;
+    while (std::getline(ifs, line)) {
+        const size_t pos = line.find("MemFree:");
+        if (pos != std::string::npos) {
+            return (size_t)std::atoll(line.c_str() + pos + 8) * 1024;
+        }
+    }
+#endif
+    return 0;
+}
+
+bool pin_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+int current_cpu() {
+#ifdef __linux__
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+bool numa_interleave(const void* ptr, size_t bytes) {
+#ifdef __linux__
+    const NumaTopology& topo = NumaTopology::get();
+    if (topo.n_nodes() < 2) return false;
+    return mbind_range(ptr, bytes, MPOL_INTERLEAVE_, topo.node_ids) == 0;
+#else
+    return false;
+#endif
+}
+
+bool numa_bind(const void* ptr, size_t bytes, int node) {
+#ifdef __linux__
+    const NumaTopology& topo = NumaTopology::get();
+    if (topo.n_nodes() < 2) return false;
+    return mbind_range(ptr, bytes, MPOL_BIND_, {topo.node_ids[node]}) == 0;
+#else
+    return false;
+#endif
+}
+
+int numa_page_node(const void* ptr) {
+#ifdef __linux__
+    int id = -1;
+    if (syscall(SYS_get_mempolicy, &id, nullptr, 0UL, ptr,
+                (unsigned long)(MPOL_F_NODE_ | MPOL_F_ADDR_)) != 0) {
+        return -1;
+    }
+    const std::vector<int>& ids = NumaTopology::get().node_ids;
+    auto it = std::find(ids.begin(), ids.end(), id);
+    return it == ids.end() ? -1 : (int)(it - ids.begin());
+#else
+    return -1;
+#endif
+}
+
+NumaBuffer::NumaBuffer(size_t bytes, int node) : size_(bytes) {
+#ifdef __linux__
+    mapped_ = std::max<size_t>((bytes + page_size() - 1) & ~(page_size() - 1),
+                               page_size());
+    void* ptr = mmap(nullptr, mapped_, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ptr == MAP_FAILED) {
+        fprintf(stderr, "ERROR: Failed to map %zu bytes: %s\n", bytes,
+                strerror(errno));
+        std::exit(1);
+    }
+    data_ = (char*)ptr;
+    numa_bind(data_, mapped_, node);
+#else
+    data_ = new char[std::max<size_t>(bytes, 1)];
+#endif
+}
+
+NumaBuffer::~NumaBuffer() {
+#ifdef __linux__
+    munmap(data_, mapped_);
+#else
+    delete[] data_;
+#endif
+}
+
+}  // namespace internal
+}  // namespace volrend
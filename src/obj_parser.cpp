@@ -0,0 +1,528 @@
+#include "volrend/internal/obj_parser.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+#include "volrend/internal/parallel.hpp"
+
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define VOLREND_OBJ_MMAP
+#endif
+
+namespace volrend {
+namespace internal {
+namespace {
+
+const int VERT_SZ = 9;
+// Bytes of OBJ text per parsing thread, at least
+const size_t MIN_CHUNK_BYTES = size_t(1) << 20;
+// Items per thread in the merge and normal loops, at least
+const size_t MIN_GRAIN = size_t(1) << 16;
+// Index of a missing normal, and of an invalid position or normal
+const int32_t NO_INDEX = -1;
+const int32_t BAD_INDEX = INT32_MAX;
+
+inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+inline bool is_digit(char c) { return (unsigned)(c - '0') < 10; }
+
+inline void skip_space(const char*& p, const char* end) {
+    while (p < end && is_space(*p)) ++p;
+}
+
+// Parse a decimal number at p (after spaces), advancing past it
+bool parse_float(const char*& p, const char* end, float& out) {
+    static const double POW10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                   1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                   1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                   1e18, 1e19, 1e20, 1e21, 1e22};
+    skip_space(p, end);
+    const char* s = p;
+    bool neg = false;
+    if (s < end && (*s == '-' || *s == '+')) neg = *s++ == '-';
+    double mant = 0.0;
+    int exp10 = 0;
+    bool digits = false;
+    for (; s < end && is_digit(*s); ++s, digits = true) {
+        mant = mant * 10.0 + (*s - '0');
+    }
+    if (s < end && *s == '.') {
+        for (++s; s < end && is_digit(*s); ++s, --exp10, digits = true) {
+            mant = mant * 10.0 + (*s - '0');
+        }
+    }
+    if (!digits) return false;
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char* e = s + 1;
+        bool eneg = false;
+        if (e < end && (*e == '-' || *e == '+')) eneg = *e++ == '-';
+        if (e < end && is_digit(*e)) {
+            int value = 0;
+            for (; e < end && is_digit(*e); ++e) {
+                if (value < 10000) value = value * 10 + (*e - '0');
+            }
+            exp10 += eneg ? -value : value;
+            s = e;
+        }
+    }
+    if (exp10 < 0 && exp10 >= -22) {
+        mant /= POW10[-exp10];
+    } else if (exp10 > 0 && exp10 <= 22) {
+        mant *= POW10[exp10];
+    } else if (exp10 != 0) {
+        mant *= std::pow(10.0, exp10);
+    }
+    out = (float)(neg ? -mant : mant);
+    p = s;
+    return true;
+}
+
+bool parse_int(const char*& p, const char* end, int64_t& out) {
+    const char* s = p;
+    bool neg = false;
+    if (s < end && (*s == '-' || *s == '+')) neg = *s++ == '-';
+    if (s >= end || !is_digit(*s)) return false;
+    int64_t value = 0;
+    for (; s < end && is_digit(*s); ++s) {
+        if (value < INT32_MAX) value = value * 10 + (*s - '0');
+    }
+    out = neg ? -value : value;
+    p = s;
+    return true;
+}
+
+// Parsed lines of one chunk of the file
+struct ObjChunk {
+    // 3 floats per position, its color, and per normal
+    std::vector<float> pos, color, normal;
+    // Corners of each face, and a (position, normal) index pair per corner:
+    // 0-based, NO_INDEX for no normal, or BAD_INDEX. Entries listed in
+    // relative were relative indices and are still offsets from the
+    // chunk's first position or normal
+    std::vector<uint32_t> poly_size;
+    std::vector<int32_t> corners;
+    std::vector<size_t> relative;
+
+    // Filled in by the merge
+    size_t v_offset, vn_offset, tri_offset, n_tris;
+    bool all_vn, vn_is_v;
+};
+
+// OBJ index k (1-based, or relative to the end if negative) of the count
+// items so far in the chunk, recording slot in relative if needed
+int32_t chunk_index(int64_t k, size_t count, size_t slot, ObjChunk& chunk) {
+    if (k > 0) return k <= INT32_MAX ? (int32_t)(k - 1) : BAD_INDEX;
+    if (k == 0) return BAD_INDEX;
+    chunk.relative.push_back(slot);
+    return (int32_t)((int64_t)count + k);
+}
+
+void parse_chunk(const char* p, const char* end, ObjChunk& chunk) {
+    while (p < end) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (eol == nullptr) eol = end;
+        skip_space(p, eol);
+        const size_t len = eol - p;
+        if (len >= 2 && p[0] == 'v' && is_space(p[1])) {
+            // Position, optionally followed by a color
+            p += 2;
+            float xyz[6];
+            int n = 0;
+            while (n < 6 && parse_float(p, eol, xyz[n])) ++n;
+            for (int i = 0; i < 3; ++i) {
+                chunk.pos.push_back(i < n ? xyz[i] : 0.f);
+                chunk.color.push_back(n == 6 ? xyz[3 + i] : 1.f);
+            }
+        } else if (len >= 3 && p[0] == 'v' && p[1] == 'n' && is_space(p[2])) {
+            p += 3;
+            for (int i = 0; i < 3; ++i) {
+                float x = 0.f;
+                parse_float(p, eol, x);
+                chunk.normal.push_back(x);
+            }
+        } else if (len >= 2 && p[0] == 'f' && is_space(p[1])) {
+            // Corners v, v/vt, v//vn or v/vt/vn
+            p += 2;
+            const size_t first = chunk.corners.size(),
+                         first_relative = chunk.relative.size();
+            uint32_t n = 0;
+            for (;; ++n) {
+                skip_space(p, eol);
+                int64_t v, vt, vn = 0;
+                if (!parse_int(p, eol, v)) break;
+                if (p < eol && *p == '/') {
+                    ++p;
+                    parse_int(p, eol, vt);
+                    if (p < eol && *p == '/') {
+                        ++p;
+                        parse_int(p, eol, vn);
+                    }
+                }
+                const size_t slot = chunk.corners.size();
+                chunk.corners.push_back(
+                    chunk_index(v, chunk.pos.size() / 3, slot, chunk));
+                chunk.corners.push_back(
+                    vn == 0 ? NO_INDEX
+                            : chunk_index(vn, chunk.normal.size() / 3,
+                                          slot + 1, chunk));
+                while (p < eol && !is_space(*p)) ++p;
+            }
+            if (n >= 3) {
+                chunk.poly_size.push_back(n);
+            } else {
+                chunk.corners.resize(first);
+                chunk.relative.resize(first_relative);
+            }
+        }
+        p = eol < end ? eol + 1 : end;
+    }
+}
+
+// Whether face corners are valid indices for n_verts positions and
+// n_normals normals
+bool valid_face(const int32_t* corners, uint32_t n, size_t n_verts,
+                size_t n_normals) {
+    for (uint32_t i = 0; i < n; ++i) {
+        const int32_t v = corners[2 * i], vn = corners[2 * i + 1];
+        if (v < 0 || (size_t)v >= n_verts) return false;
+        if (vn != NO_INDEX && (vn < 0 || (size_t)vn >= n_normals)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+float sq_dist(const float* verts, int32_t a, int32_t b) {
+    float sum = 0.f;
+    for (int i = 0; i < 3; ++i) {
+        const float d = verts[a * VERT_SZ + i] - verts[b * VERT_SZ + i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+void cross_normal(const float* verts, const size_t* off, float* out) {
+    float a[3], b[3];
+    for (int j = 0; j < 3; ++j) {
+        a[j] = verts[off[1] + j] - verts[off[0] + j];
+        b[j] = verts[off[2] + j] - verts[off[0] + j];
+    }
+    out[0] = a[1] * b[2] - a[2] * b[1];
+    out[1] = a[2] * b[0] - a[0] * b[2];
+    out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+void normalize3(float* dir) {
+    const float norm =
+        std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+    if (norm > 1e-6f) {
+        for (int i = 0; i < 3; ++i) dir[i] /= norm;
+    }
+}
+
+}  // namespace
+
+bool parse_obj(const char* data, size_t size, Mesh& mesh,
+               std::string& error) {
+    // Chunks end after a newline
+    const int n_chunks = threads_for(size, MIN_CHUNK_BYTES);
+    std::vector<const char*> bounds(n_chunks + 1, data + size);
+    bounds[0] = data;
+    for (int i = 1; i < n_chunks; ++i) {
+        const char* p = std::max(data + size * i / n_chunks, bounds[i - 1]);
+        const char* eol = (const char*)memchr(p, '\n', data + size - p);
+        bounds[i] = eol != nullptr ? eol + 1 : data + size;
+    }
+    std::vector<ObjChunk> chunks(n_chunks);
+    parallel_ranges(n_chunks, n_chunks, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; ++i) {
+            parse_chunk(bounds[i], bounds[i + 1], chunks[i]);
+        }
+    });
+
+    size_t n_verts = 0, n_normals = 0;
+    for (ObjChunk& chunk : chunks) {
+        chunk.v_offset = n_verts;
+        chunk.vn_offset = n_normals;
+        n_verts += chunk.pos.size() / 3;
+        n_normals += chunk.normal.size() / 3;
+    }
+    if (n_verts >= (size_t)BAD_INDEX) {
+        error = "Too many vertices";
+        return false;
+    }
+
+    // Resolve relative indices, build the vertex buffer and count the
+    // triangles of valid faces
+    mesh.vert.assign(n_verts * VERT_SZ, 0.f);
+    std::vector<float> normals(n_normals * 3);
+    parallel_ranges(n_chunks, n_chunks, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; ++i) {
+            ObjChunk& chunk = chunks[i];
+            for (size_t slot : chunk.relative) {
+                const int64_t index =
+                    chunk.corners[slot] +
+                    (int64_t)(slot % 2 ? chunk.vn_offset : chunk.v_offset);
+                chunk.corners[slot] = index >= 0 ? (int32_t)index : BAD_INDEX;
+            }
+            for (size_t j = 0; j < chunk.pos.size() / 3; ++j) {
+                float* ptr = &mesh.vert[(chunk.v_offset + j) * VERT_SZ];
+                for (int k = 0; k < 3; ++k) {
+                    ptr[k] = chunk.pos[3 * j + k];
+                    ptr[3 + k] = chunk.color[3 * j + k];
+                }
+            }
+            std::copy(chunk.normal.begin(), chunk.normal.end(),
+                      normals.begin() + 3 * chunk.vn_offset);
+
+            chunk.n_tris = 0;
+            chunk.all_vn = chunk.vn_is_v = true;
+            const int32_t* corners = chunk.corners.data();
+            for (uint32_t n : chunk.poly_size) {
+                if (valid_face(corners, n, n_verts, n_normals)) {
+                    chunk.n_tris += n - 2;
+                    for (uint32_t j = 0; j < n; ++j) {
+                        const int32_t vn = corners[2 * j + 1];
+                        chunk.all_vn &= vn != NO_INDEX;
+                        chunk.vn_is_v &= vn == corners[2 * j];
+                    }
+                }
+                corners += 2 * n;
+            }
+            std::vector<float>().swap(chunk.pos);
+            std::vector<float>().swap(chunk.color);
+            std::vector<float>().swap(chunk.normal);
+        }
+    });
+
+    size_t n_tris = 0;
+    bool all_vn = true, vn_is_v = true;
+    for (ObjChunk& chunk : chunks) {
+        chunk.tri_offset = n_tris;
+        n_tris += chunk.n_tris;
+        all_vn &= chunk.all_vn;
+        vn_is_v &= chunk.vn_is_v;
+    }
+    // Per-corner normals are used unless they match the positions, in
+    // which case the normals are taken by position index as without them
+    const bool dedup =
+        n_tris > 0 && all_vn && !(vn_is_v && n_normals >= n_verts);
+
+    // Triangulate into faces (and their normal indices)
+    mesh.faces.resize(3 * n_tris);
+    std::vector<int32_t> face_normals(dedup ? 3 * n_tris : 0);
+    parallel_ranges(n_chunks, n_chunks, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; ++i) {
+            const ObjChunk& chunk = chunks[i];
+            size_t out = 3 * chunk.tri_offset;
+            auto emit = [&](const int32_t* corners, uint32_t a, uint32_t b,
+                            uint32_t c) {
+                for (uint32_t j : {a, b, c}) {
+                    mesh.faces[out] = corners[2 * j];
+                    if (dedup) face_normals[out] = corners[2 * j + 1];
+                    ++out;
+                }
+            };
+            const int32_t* corners = chunk.corners.data();
+            for (uint32_t n : chunk.poly_size) {
+                if (valid_face(corners, n, n_verts, n_normals)) {
+                    if (n != 4) {
+                        for (uint32_t j = 1; j + 1 < n; ++j) {
+                            emit(corners, 0, j, j + 1);
+                        }
+                    } else if (sq_dist(mesh.vert.data(), corners[0],
+                                       corners[4]) <
+                               sq_dist(mesh.vert.data(), corners[2],
+                                       corners[6])) {
+                        // Quads are split along the shorter diagonal
+                        emit(corners, 0, 1, 2);
+                        emit(corners, 0, 2, 3);
+                    } else {
+                        emit(corners, 0, 1, 3);
+                        emit(corners, 1, 2, 3);
+                    }
+                }
+                corners += 2 * n;
+            }
+        }
+    });
+    chunks.clear();
+
+    if (dedup) {
+        // A vertex per distinct (position, normal) pair. Most positions
+        // have a single normal, so pairs are only hashed past the first
+        std::vector<uint32_t> first_normal(n_verts, UINT32_MAX),
+            first_vertex(n_verts);
+        std::unordered_map<uint64_t, uint32_t> other_vertex;
+        std::vector<uint32_t> src_v, src_vn;
+        src_v.reserve(n_verts);
+        src_vn.reserve(n_verts);
+        for (size_t i = 0; i < mesh.faces.size(); ++i) {
+            const uint32_t v = mesh.faces[i], vn = face_normals[i];
+            uint32_t id;
+            if (first_normal[v] == UINT32_MAX) {
+                first_normal[v] = vn;
+                id = first_vertex[v] = (uint32_t)src_v.size();
+                src_v.push_back(v);
+                src_vn.push_back(vn);
+            } else if (first_normal[v] == vn) {
+                id = first_vertex[v];
+            } else {
+                auto it = other_vertex.emplace(((uint64_t)v << 32) | vn,
+                                               (uint32_t)src_v.size());
+                if (it.second) {
+                    src_v.push_back(v);
+                    src_vn.push_back(vn);
+                }
+                id = it.first->second;
+            }
+            mesh.faces[i] = id;
+        }
+
+        std::vector<float> verts(src_v.size() * VERT_SZ);
+        parallel_ranges(
+            src_v.size(), threads_for(src_v.size(), MIN_GRAIN),
+            [&](size_t begin, size_t end, int) {
+                for (size_t i = begin; i < end; ++i) {
+                    float* ptr = &verts[i * VERT_SZ];
+                    std::copy_n(&mesh.vert[src_v[i] * VERT_SZ], 6, ptr);
+                    std::copy_n(&normals[3 * src_vn[i]], 3, ptr + 6);
+                }
+            });
+        mesh.vert.swap(verts);
+    } else if (n_normals >= n_verts && n_verts > 0) {
+        parallel_ranges(n_verts, threads_for(n_verts, MIN_GRAIN),
+                        [&](size_t begin, size_t end, int) {
+                            for (size_t i = begin; i < end; ++i) {
+                                std::copy_n(&normals[3 * i], 3,
+                                            &mesh.vert[i * VERT_SZ + 6]);
+                            }
+                        });
+    } else {
+        estimate_normals(mesh.vert, mesh.faces);
+    }
+    return true;
+}
+
+bool parse_obj_file(const std::string& path, Mesh& mesh,
+                    std::string& error) {
+#ifdef VOLREND_OBJ_MMAP
+    const int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        if (fd >= 0) close(fd);
+        error = "Cannot open '" + path + "'";
+        return false;
+    }
+    const size_t size = (size_t)st.st_size;
+    if (size == 0) {
+        close(fd);
+        return parse_obj(nullptr, 0, mesh, error);
+    }
+    void* ptr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        error = "Cannot map '" + path + "'";
+        return false;
+    }
+    // Chunks are read concurrently from their starts
+    madvise(ptr, size, MADV_WILLNEED);
+    const bool ok = parse_obj((const char*)ptr, size, mesh, error);
+    munmap(ptr, size);
+    return ok;
+#else
+    std::ifstream ifs(path, std::ios::binary);
+    if (!ifs) {
+        error = "Cannot open '" + path + "'";
+        return false;
+    }
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    const std::string str = ss.str();
+    return parse_obj(str.data(), str.size(), mesh, error);
+#endif
+}
+
+void estimate_normals(std::vector<float>& verts,
+                      const std::vector<unsigned int>& faces) {
+    const size_t n_verts = verts.size() / VERT_SZ;
+    if (faces.empty()) {
+        // Each vertex is in one triangle
+        const size_t n_faces = n_verts / 3;
+        parallel_ranges(n_faces, threads_for(n_faces, MIN_GRAIN),
+                        [&](size_t begin, size_t end, int) {
+                            for (size_t i = begin; i < end; ++i) {
+                                const size_t off[3] = {
+                                    3 * i * VERT_SZ, (3 * i + 1) * VERT_SZ,
+                                    (3 * i + 2) * VERT_SZ};
+                                float normal[3];
+                                cross_normal(verts.data(), off, normal);
+                                normalize3(normal);
+                                for (size_t o : off) {
+                                    std::copy_n(normal, 3, &verts[o + 6]);
+                                }
+                            }
+                        });
+        return;
+    }
+
+    // Thread 0 sums into verts itself (the normals, which other threads
+    // do not read), the others into their own buffers
+    const size_t n_faces = faces.size() / 3;
+    const int n_threads = threads_for(n_faces, MIN_GRAIN);
+    std::vector<std::vector<float>> partial(n_threads - 1);
+    parallel_ranges(n_faces, n_threads, [&](size_t begin, size_t end, int t) {
+        float* sum;
+        size_t stride;
+        if (t == 0) {
+            for (size_t i = 0; i < n_verts; ++i) {
+                std::fill_n(&verts[i * VERT_SZ + 6], 3, 0.f);
+            }
+            sum = verts.data() + 6;
+            stride = VERT_SZ;
+        } else {
+            partial[t - 1].assign(3 * n_verts, 0.f);
+            sum = partial[t - 1].data();
+            stride = 3;
+        }
+        for (size_t i = begin; i < end; ++i) {
+            const unsigned int* face = &faces[3 * i];
+            if (face[0] >= n_verts || face[1] >= n_verts ||
+                face[2] >= n_verts) {
+                continue;
+            }
+            const size_t off[3] = {face[0] * (size_t)VERT_SZ,
+                                   face[1] * (size_t)VERT_SZ,
+                                   face[2] * (size_t)VERT_SZ};
+            float normal[3];
+            cross_normal(verts.data(), off, normal);
+            for (int j = 0; j < 3; ++j) {
+                float* ptr = sum + face[j] * stride;
+                for (int k = 0; k < 3; ++k) ptr[k] += normal[k];
+            }
+        }
+    });
+    parallel_ranges(n_verts, threads_for(n_verts, MIN_GRAIN),
+                    [&](size_t begin, size_t end, int) {
+                        for (size_t i = begin; i < end; ++i) {
+                            float* normal = &verts[i * VERT_SZ + 6];
+                            for (const std::vector<float>& sum : partial) {
+                                for (int k = 0; k < 3; ++k) {
+                                    normal[k] += sum[3 * i + k];
+                                }
+                            }
+                            normalize3(normal);
+                        }
+                    });
+}
+
+}  // namespace internal
+}  // namespace volrend
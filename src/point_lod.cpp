@@ -0,0 +1,203 @@
+#include "volrend/internal/point_lod.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "glm/geometric.hpp"
+#include "volrend/internal/morton.hpp"
+#include "volrend/internal/parallel.hpp"
+
+namespace volrend {
+namespace internal {
+namespace {
+
+// Points per thread when building, and chunks per thread when selecting
+const size_t BUILD_GRAIN = size_t(1) << 18;
+const size_t SELECT_GRAIN = 1024;
+// Points kept of a visible chunk, at least
+const uint32_t MIN_KEEP = 32;
+// Morton code bits per axis
+const int MORTON_BITS = 10;
+
+uint32_t reverse_bits(uint32_t v, int bits) {
+    uint32_t r = 0;
+    for (int i = 0; i < bits; ++i) {
+        r = (r << 1) | (v & 1);
+        v >>= 1;
+    }
+    return r;
+}
+
+// Sort index by key (LSD radix sort of 30-bit keys, 3 passes of 10 bits)
+void radix_sort(std::vector<uint32_t>& keys, std::vector<uint32_t>& index) {
+    const size_t n = keys.size();
+    std::vector<uint32_t> keys_tmp(n), index_tmp(n);
+    const uint32_t RADIX = 1 << MORTON_BITS;
+    std::vector<size_t> offset(RADIX);
+    for (int shift = 0; shift < 3 * MORTON_BITS; shift += MORTON_BITS) {
+        std::fill(offset.begin(), offset.end(), 0);
+        for (size_t i = 0; i < n; ++i) ++offset[(keys[i] >> shift) % RADIX];
+        size_t sum = 0;
+        for (size_t& o : offset) {
+            const size_t cnt = o;
+            o = sum;
+            sum += cnt;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            const size_t j = offset[(keys[i] >> shift) % RADIX]++;
+            keys_tmp[j] = keys[i];
+            index_tmp[j] = index[i];
+        }
+        keys.swap(keys_tmp);
+        index.swap(index_tmp);
+    }
+}
+
+}  // namespace
+
+void PointLod::build(std::vector<float>& verts, int vert_size) {
+    const size_t n = verts.size() / vert_size;
+    n_points_ = n;
+    chunks_.clear();
+    if (n == 0) return;
+
+    // Bounds
+    const int n_threads = threads_for(n, BUILD_GRAIN);
+    std::vector<glm::vec3> mins(n_threads,
+                                glm::vec3(std::numeric_limits<float>::max())),
+        maxs(n_threads, glm::vec3(std::numeric_limits<float>::lowest()));
+    parallel_ranges(n, n_threads, [&](size_t begin, size_t end, int t) {
+        for (size_t i = begin; i < end; ++i) {
+            const glm::vec3 p(verts[i * vert_size], verts[i * vert_size + 1],
+                              verts[i * vert_size + 2]);
+            mins[t] = glm::min(mins[t], p);
+            maxs[t] = glm::max(maxs[t], p);
+        }
+    });
+    glm::vec3 lo = mins[0], hi = maxs[0];
+    for (int t = 1; t < n_threads; ++t) {
+        lo = glm::min(lo, mins[t]);
+        hi = glm::max(hi, maxs[t]);
+    }
+
+    // Morton order
+    const float qmax = (float)((1 << MORTON_BITS) - 1);
+    const glm::vec3 qscale = qmax / glm::max(hi - lo, glm::vec3(1e-20f));
+    std::vector<uint32_t> keys(n), order(n);
+    parallel_ranges(n, n_threads, [&](size_t begin, size_t end, int) {
+        for (size_t i = begin; i < end; ++i) {
+            uint32_t q[3];
+            for (int j = 0; j < 3; ++j) {
+                const float v = (verts[i * vert_size + j] - lo[j]) * qscale[j];
+                q[j] = (uint32_t)std::min(std::max(v, 0.f), qmax);
+            }
+            keys[i] = morton_code_3(q[0], q[1], q[2]);
+            order[i] = (uint32_t)i;
+        }
+    });
+    radix_sort(keys, order);
+    std::vector<uint32_t>().swap(keys);
+
+    // Chunks, each in bit-reversed order of rank
+    const size_t n_chunks = (n + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    chunks_.resize(n_chunks);
+    std::vector<float> out(n * vert_size);
+    parallel_ranges(
+        n_chunks, threads_for(n_chunks, BUILD_GRAIN / CHUNK_SIZE),
+        [&](size_t begin, size_t end, int) {
+            for (size_t c = begin; c < end; ++c) {
+                Chunk& chunk = chunks_[c];
+                chunk.first = (uint32_t)(c * CHUNK_SIZE);
+                chunk.count = (uint32_t)std::min<size_t>(
+                    CHUNK_SIZE, n - chunk.first);
+                chunk.min = glm::vec3(std::numeric_limits<float>::max());
+                chunk.max = glm::vec3(std::numeric_limits<float>::lowest());
+                int bits = 0;
+                while ((1u << bits) < chunk.count) ++bits;
+                float* dst = &out[(size_t)chunk.first * vert_size];
+                for (uint32_t i = 0; i < (1u << bits); ++i) {
+                    const uint32_t rank = reverse_bits(i, bits);
+                    if (rank >= chunk.count) continue;
+                    const float* src =
+                        &verts[(size_t)order[chunk.first + rank] * vert_size];
+                    std::copy_n(src, vert_size, dst);
+                    const glm::vec3 p(src[0], src[1], src[2]);
+                    chunk.min = glm::min(chunk.min, p);
+                    chunk.max = glm::max(chunk.max, p);
+                    dst += vert_size;
+                }
+            }
+        });
+    verts.swap(out);
+}
+
+void PointLod::select(const glm::mat4& MV, const glm::mat4& K, float focal_px,
+                      float spacing_px, std::vector<int>& first,
+                      std::vector<int>& count) const {
+    first.clear();
+    count.clear();
+    const size_t n_chunks = chunks_.size();
+    const glm::mat4 KMV = K * MV;
+    // Model-view scale, for the bounding sphere radii
+    const float scale = glm::length(glm::vec3(MV[0]));
+    std::vector<uint32_t> keep(n_chunks);
+    parallel_ranges(
+        n_chunks, threads_for(n_chunks, SELECT_GRAIN),
+        [&](size_t begin, size_t end, int) {
+            for (size_t c = begin; c < end; ++c) {
+                const Chunk& chunk = chunks_[c];
+                keep[c] = 0;
+                // Culled if every corner is outside the same clip plane
+                int outside[6] = {0, 0, 0, 0, 0, 0};
+                for (int i = 0; i < 8; ++i) {
+                    const glm::vec4 p =
+                        KMV * glm::vec4(i & 1 ? chunk.max.x : chunk.min.x,
+                                        i & 2 ? chunk.max.y : chunk.min.y,
+                                        i & 4 ? chunk.max.z : chunk.min.z, 1.f);
+                    outside[0] += p.x < -p.w;
+                    outside[1] += p.x > p.w;
+                    outside[2] += p.y < -p.w;
+                    outside[3] += p.y > p.w;
+                    outside[4] += p.z < -p.w;
+                    outside[5] += p.z > p.w;
+                }
+                if (std::find(outside, outside + 6, 8) != outside + 6) {
+                    continue;
+                }
+                keep[c] = chunk.count;
+                if (spacing_px <= 0.f) continue;
+
+                // Projected area of the bounding sphere
+                const glm::vec3 center(
+                    MV * glm::vec4(0.5f * (chunk.min + chunk.max), 1.f));
+                const float radius =
+                    0.5f * scale * glm::length(chunk.max - chunk.min);
+                const float dist = glm::length(center);
+                if (dist <= radius) continue;
+                const float radius_px = focal_px * radius / (dist - radius);
+                const float points = 3.14159265f * radius_px * radius_px /
+                                     (spacing_px * spacing_px);
+                if (points < (float)chunk.count) {
+                    keep[c] = std::max(std::min((uint32_t)points, chunk.count),
+                                       std::min(MIN_KEEP, chunk.count));
+                }
+            }
+        });
+
+    for (size_t c = 0; c < n_chunks; ++c) {
+        if (keep[c] == 0) continue;
+        const Chunk& chunk = chunks_[c];
+        if (!first.empty() &&
+            (uint32_t)(first.back() + count.back()) == chunk.first) {
+            // Continue a range ending with a complete chunk
+            count.back() += (int)keep[c];
+        } else {
+            first.push_back((int)chunk.first);
+            count.push_back((int)keep[c]);
+        }
+    }
+}
+
+}  // namespace internal
+}  // namespace volrend
@@ -0,0 +1,161 @@
+#include "volrend/internal/reprojection.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "glm/geometric.hpp"
+
+namespace volrend {
+namespace internal {
+namespace {
+
+// World direction of pixel (x, y)'s ray; see render_pixel in cpu_renderer.cpp
+glm::vec3 pixel_dir(const glm::mat4x3& c2w, float fx, float fy, int width,
+                    int height, int x, int y) {
+    return glm::normalize(c2w[0] * ((x - 0.5f * width) / fx) -
+                          c2w[1] * ((y - 0.5f * height) / fy) - c2w[2]);
+}
+
+// Whether pixel p = (x, y) of a depth map differs from a 4-neighbour by
+// more than tol relative, or borders a pixel without depth
+bool depth_edge(const float* depth, int width, int height, int x, int y,
+                float tol) {
+    const float d = depth[(size_t)y * width + x];
+    const int dx[4] = {-1, 1, 0, 0}, dy[4] = {0, 0, -1, 1};
+    for (int k = 0; k < 4; ++k) {
+        const int nx = x + dx[k], ny = y + dy[k];
+        if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+        const float nd = depth[(size_t)ny * width + nx];
+        if (!std::isfinite(nd) || std::fabs(nd - d) > tol * d) return true;
+    }
+    return false;
+}
+
+}  // namespace
+
+Reprojector::Reprojector(const ReprojectOptions& options)
+    : options(options) {}
+
+void Reprojector::reset() {
+    rgba_.clear();
+    width_ = height_ = 0;
+}
+
+size_t Reprojector::warp(const Camera& cam, uint8_t* rgba, float* depth,
+                         std::vector<uint8_t>& retrace) {
+    const int width = cam.width, height = cam.height;
+    const size_t n_pixels = (size_t)width * height;
+    retrace.assign(n_pixels, 1);
+    src_.assign(n_pixels, -1);
+    if (rgba_.empty() || width != width_ || height != height_) {
+        return n_pixels;
+    }
+
+    zbuf_.assign(n_pixels, std::numeric_limits<float>::infinity());
+    next_error_.resize(n_pixels);
+    reject_.assign(n_pixels, 0);
+    const glm::vec3 prev_origin = c2w_[3], origin = cam.transform[3];
+    const float cos_max_angle = std::cos(options.max_angle);
+
+    // Splat the previous frame's surface points, nearest first per pixel
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const size_t p = (size_t)y * width + x;
+            const float d = depth_[p];
+            if (!std::isfinite(d)) continue;
+            const glm::vec3 point =
+                prev_origin +
+                d * pixel_dir(c2w_, fx_, fy_, width, height, x, y);
+            const glm::vec3 rel = point - origin;
+            const float z = -glm::dot(rel, cam.transform[2]);
+            if (z <= 0.f) continue;
+            const float u = glm::dot(rel, cam.transform[0]) / z * cam.fx +
+                            0.5f * width,
+                        v = -glm::dot(rel, cam.transform[1]) / z * cam.fy +
+                            0.5f * height;
+            const float tx = std::round(u), ty = std::round(v);
+            if (tx < 0.f || ty < 0.f || tx >= width || ty >= height) continue;
+            const size_t t = (size_t)ty * width + (size_t)tx;
+            const float dist = glm::length(rel);
+            if (dist >= zbuf_[t]) continue;
+
+            zbuf_[t] = dist;
+            src_[t] = (int64_t)p;
+            next_error_[t] = error_[p] + std::hypot(u - tx, v - ty);
+            reject_[t] =
+                next_error_[t] > options.max_error ||
+                glm::dot(rel / dist, traced_dir_[p]) < cos_max_angle ||
+                depth_edge(depth_.data(), width, height, x, y,
+                           options.depth_tol);
+        }
+    }
+
+    size_t n_retrace = 0;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const size_t t = (size_t)y * width + x;
+            bool reuse = src_[t] >= 0 && !reject_[t];
+            if (reuse) {
+                // Background leaking through gaps between splats of a
+                // nearer surface
+                float nearest = zbuf_[t];
+                for (int ny = std::max(y - 1, 0);
+                     ny <= std::min(y + 1, height - 1); ++ny) {
+                    for (int nx = std::max(x - 1, 0);
+                         nx <= std::min(x + 1, width - 1); ++nx) {
+                        nearest =
+                            std::min(nearest, zbuf_[(size_t)ny * width + nx]);
+                    }
+                }
+                reuse = zbuf_[t] <= (1.f + options.depth_tol) * nearest;
+            }
+            if (reuse) {
+                std::memcpy(rgba + 4 * t, &rgba_[4 * src_[t]], 4);
+                depth[t] = zbuf_[t];
+                retrace[t] = 0;
+            } else {
+                src_[t] = -1;
+                ++n_retrace;
+            }
+        }
+    }
+    return n_retrace;
+}
+
+void Reprojector::update(const Camera& cam, const uint8_t* rgba,
+                         const float* depth) {
+    const int width = cam.width, height = cam.height;
+    const size_t n_pixels = (size_t)width * height;
+    if (src_.size() != n_pixels) src_.assign(n_pixels, -1);
+
+    std::vector<float> error(n_pixels);
+    std::vector<glm::vec3> traced_dir(n_pixels);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const size_t t = (size_t)y * width + x;
+            if (src_[t] >= 0) {
+                error[t] = next_error_[t];
+                traced_dir[t] = traced_dir_[src_[t]];
+            } else {
+                error[t] = 0.f;
+                traced_dir[t] = pixel_dir(cam.transform, cam.fx, cam.fy,
+                                          width, height, x, y);
+            }
+        }
+    }
+    error_.swap(error);
+    traced_dir_.swap(traced_dir);
+    rgba_.assign(rgba, rgba + 4 * n_pixels);
+    depth_.assign(depth, depth + n_pixels);
+    width_ = width;
+    height_ = height;
+    fx_ = cam.fx;
+    fy_ = cam.fy;
+    c2w_ = cam.transform;
+    src_.assign(n_pixels, -1);
+}
+
+}  // namespace internal
+}  // namespace volrend
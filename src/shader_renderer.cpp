@@ -20,6 +20,11 @@
 
 #include "volrend/internal/rt_frag.inl"
 #include "volrend/internal/shader.hpp"
+#include "volrend/internal/dynamic_res.hpp"
+#include "volrend/internal/foveation.hpp"
+#include "volrend/internal/frame_cache.hpp"
+#include "volrend/internal/mesh_cull.hpp"
+#include "volrend/internal/progressive.hpp"
 
 namespace volrend {
 
@@ -45,6 +50,10 @@ struct _RenderUniforms {
         opt_sigma_thresh, opt_render_bbox, opt_basis_minmax, opt_rot_dirs;
     GLint tree_data_tex, tree_child_tex;  //, tree_extra_tex;
     GLint mesh_depth_tex, mesh_color_tex;
+    GLint prog_begin, prog_end;
+    GLint roi, roi_passes, roi_step_scale;
+    GLint reproj_max_error, reproj_color_tex, reproj_depth_tex,
+        reproj_info_tex;
 };
 
 }  // namespace
@@ -80,6 +89,20 @@ struct VolumeRenderer::Impl {
         glDeleteTextures(1, &tex_mesh_color);
         glDeleteTextures(1, &tex_mesh_depth);
         glDeleteTextures(1, &tex_mesh_depth_buf);
+        glDeleteFramebuffers(1, &fb_low);
+        glDeleteTextures(1, &tex_low_color);
+        glDeleteTextures(1, &tex_low_depth);
+        glDeleteFramebuffers(1, &fb_prog);
+        glDeleteTextures(1, &tex_prog);
+        glDeleteFramebuffers(2, fb_frame);
+        glDeleteTextures(2, tex_frame_color);
+        glDeleteTextures(2, tex_frame_depth);
+        glDeleteTextures(2, tex_frame_info);
+        glDeleteFramebuffers(1, &fb_warp);
+        glDeleteTextures(1, &tex_warp_color);
+        glDeleteTextures(1, &tex_warp_depth);
+        glDeleteTextures(1, &tex_warp_info);
+        glDeleteTextures(1, &tex_warp_depth_buf);
     }
 
     void start() {
@@ -96,6 +119,20 @@ struct VolumeRenderer::Impl {
         glGenTextures(1, &tex_mesh_depth);
         glGenTextures(1, &tex_mesh_depth_buf);
         glGenFramebuffers(1, &fb);
+        glGenTextures(1, &tex_low_color);
+        glGenTextures(1, &tex_low_depth);
+        glGenFramebuffers(1, &fb_low);
+        glGenTextures(1, &tex_prog);
+        glGenFramebuffers(1, &fb_prog);
+        glGenFramebuffers(2, fb_frame);
+        glGenTextures(2, tex_frame_color);
+        glGenTextures(2, tex_frame_depth);
+        glGenTextures(2, tex_frame_info);
+        glGenFramebuffers(1, &fb_warp);
+        glGenTextures(1, &tex_warp_color);
+        glGenTextures(1, &tex_warp_depth);
+        glGenTextures(1, &tex_warp_info);
+        glGenTextures(1, &tex_warp_depth_buf);
 
         // Put some dummy information to suppress browser warnings
         glBindTexture(GL_TEXTURE_2D, tex_tree_data);
@@ -129,6 +166,54 @@ struct VolumeRenderer::Impl {
             std::exit(1);
         }
 
+        glBindFramebuffer(GL_FRAMEBUFFER, fb_low);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D, tex_low_color, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1,
+                               GL_TEXTURE_2D, tex_low_depth, 0);
+        glDrawBuffers(2, attach_buffers);
+
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+            GL_FRAMEBUFFER_COMPLETE) {
+            fprintf(stderr, "Low resolution framebuffer not complete\n");
+            std::exit(1);
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, fb_prog);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                               GL_TEXTURE_2D, tex_prog, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+            GL_FRAMEBUFFER_COMPLETE) {
+            fprintf(stderr, "Progressive framebuffer not complete\n");
+            std::exit(1);
+        }
+
+        const GLenum frame_buffers[]{GL_COLOR_ATTACHMENT0,
+                                     GL_COLOR_ATTACHMENT1,
+                                     GL_COLOR_ATTACHMENT2};
+        for (int i = 0; i < 3; ++i) {
+            glBindFramebuffer(GL_FRAMEBUFFER, i < 2 ? fb_frame[i] : fb_warp);
+            glFramebufferTexture2D(
+                GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                i < 2 ? tex_frame_color[i] : tex_warp_color, 0);
+            glFramebufferTexture2D(
+                GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D,
+                i < 2 ? tex_frame_depth[i] : tex_warp_depth, 0);
+            glFramebufferTexture2D(
+                GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D,
+                i < 2 ? tex_frame_info[i] : tex_warp_info, 0);
+            if (i == 2) {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                                       GL_TEXTURE_2D, tex_warp_depth_buf, 0);
+            }
+            glDrawBuffers(3, frame_buffers);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) !=
+                GL_FRAMEBUFFER_COMPLETE) {
+                fprintf(stderr, "Reprojection framebuffer not complete\n");
+                std::exit(1);
+            }
+        }
+
         glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
         quad_init();
@@ -145,12 +230,232 @@ struct VolumeRenderer::Impl {
             maybe_gen_wire(options.grid_max_depth);
         }
 
+        if (options.progressive) {
+            render_progressive();
+            return;
+        }
+        if (options.roi) {
+            // Foveated: trace into tex_prog, then interpolate the pixels
+            // skipped outside the region of interest
+            draw_meshes(camera.width, camera.height);
+            glBindFramebuffer(GL_FRAMEBUFFER, fb_prog);
+            draw_volume(camera.width, camera.height, 0,
+                        internal::PROGRESSIVE_PASSES);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            prog_fill_.draw(tex_prog, internal::PROGRESSIVE_PASSES,
+                            camera.width, camera.height, options);
+            return;
+        }
+
+        if (options.reproject && tree != nullptr && !tree->use_ndc) {
+            render_reprojected();
+            return;
+        }
+
+        // Render at a lower resolution while the camera moves, into the
+        // lower-left rw x rh corner of the buffers
+        const float scale =
+            dynamic_res_.next_scale(camera.is_dragging(), options);
+        int rw = camera.width, rh = camera.height;
+        internal::DynamicResolution::scaled_size(camera.width, camera.height,
+                                                 scale, rw, rh);
+        const bool scaled = rw != camera.width || rh != camera.height;
+
+        draw_meshes(rw, rh);
+        glBindFramebuffer(GL_FRAMEBUFFER, scaled ? fb_low : 0);
+        draw_volume(rw, rh, 0, internal::PROGRESSIVE_PASSES);
+
+        if (scaled) {
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            upsampler_.draw(tex_low_color, tex_low_depth, rw, rh,
+                            camera.width, camera.height);
+        } else {
+            glViewport(0, 0, camera.width, camera.height);
+        }
+    }
+
+    // Trace the next options.progressive_passes passes into tex_prog,
+    // restarting when the view changes, and show it hole-filled
+    void render_progressive() {
+        const uint64_t key = progressive_key();
+        if (key != prog_key_) {
+            prog_key_ = key;
+            prog_passes_done_ = 0;
+        }
+        if (prog_passes_done_ < internal::PROGRESSIVE_PASSES) {
+            const int end =
+                std::min(prog_passes_done_ +
+                             std::max(options.progressive_passes, 1),
+                         internal::PROGRESSIVE_PASSES);
+            draw_meshes(camera.width, camera.height);
+            glBindFramebuffer(GL_FRAMEBUFFER, fb_prog);
+            draw_volume(camera.width, camera.height, prog_passes_done_, end);
+            prog_passes_done_ = end;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        prog_fill_.draw(tex_prog, prog_passes_done_, camera.width,
+                        camera.height, options);
+    }
+
+    // Trace into the next of fb_frame, reusing the pixels of the previous
+    // frame warped into the view while the camera moves, and show it
+    void render_reprojected() {
+        const uint64_t key = scene_key(),
+                       camera_key = internal::hash_camera(camera);
+        const int prev = frame_index_;
+        frame_index_ ^= 1;
+        // A still camera or changed scene is traced in full, which also
+        // resets the error of reused pixels
+        const bool reuse = reproj_valid_ && key == reproj_key_ &&
+                           camera_key != reproj_camera_key_;
+
+        draw_meshes(camera.width, camera.height);
+        if (reuse) {
+            glBindFramebuffer(GL_FRAMEBUFFER, fb_warp);
+            reproj_splat_.draw(
+                tex_frame_color[prev], tex_frame_depth[prev],
+                tex_frame_info[prev], camera.width, camera.height,
+                reproj_c2w_, reproj_focal_, camera.transform,
+                glm::vec2(camera.fx, camera.fy),
+                options.reproject_max_angle * (float)M_PI / 180.f, 0.05f);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, fb_frame[frame_index_]);
+        draw_volume(camera.width, camera.height, 0,
+                    internal::PROGRESSIVE_PASSES,
+                    reuse ? std::max(options.reproject_max_error, 0.f)
+                          : -1.f);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fb_frame[frame_index_]);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, camera.width, camera.height, 0, 0,
+                          camera.width, camera.height, GL_COLOR_BUFFER_BIT,
+                          GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        reproj_valid_ = true;
+        reproj_key_ = key;
+        reproj_camera_key_ = camera_key;
+        reproj_c2w_ = camera.transform;
+        reproj_focal_ = glm::vec2(camera.fx, camera.fy);
+    }
+
+    void set(N3Tree& tree) {
+        start();
+        if (tree.capacity > 0) {
+            this->tree = &tree;
+            upload_data();
+            upload_child_links();
+            upload_tree_spec();
+        }
+        options.basis_minmax[0] = 0;
+        options.basis_minmax[1] = std::max(tree.data_format.basis_dim - 1, 0);
+    }
+
+    void maybe_gen_wire(int depth) {
+        if (last_wire_depth_ != depth) {
+            wire_.vert = tree->gen_wireframe(depth);
+            wire_.update();
+            last_wire_depth_ = depth;
+        }
+    }
+
+    void clear() {
+        this->tree = nullptr;
+        prog_key_ = 0;
+        reproj_valid_ = false;
+    }
+
+    void resize(const int width, const int height) {
+        if (camera.width == width && camera.height == height) return;
+        if (width <= 0 || height <= 0) return;
+        camera.width = width;
+        camera.height = height;
+
+        // Re-allocate memory for textures used in mesh-volume compositing
+        // process
+        glBindTexture(GL_TEXTURE_2D, tex_mesh_color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+        glBindTexture(GL_TEXTURE_2D, tex_mesh_depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED,
+                     GL_FLOAT, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+        glBindTexture(GL_TEXTURE_2D, tex_mesh_depth_buf);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+        // Volume color and depth at reduced resolution (dynamic_res); only
+        // the lower-left corner is used
+        glBindTexture(GL_TEXTURE_2D, tex_low_color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+        glBindTexture(GL_TEXTURE_2D, tex_low_depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED,
+                     GL_FLOAT, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+        // Progressively traced image (options.progressive)
+        glBindTexture(GL_TEXTURE_2D, tex_prog);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
+                     GL_UNSIGNED_BYTE, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+        // Color, depth and info of the last two frames and of the warp
+        // (options.reproject)
+        for (int i = 0; i < 3; ++i) {
+            const GLuint color = i < 2 ? tex_frame_color[i] : tex_warp_color,
+                         depth = i < 2 ? tex_frame_depth[i] : tex_warp_depth,
+                         info = i < 2 ? tex_frame_info[i] : tex_warp_info;
+            glBindTexture(GL_TEXTURE_2D, color);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glBindTexture(GL_TEXTURE_2D, depth);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED,
+                         GL_FLOAT, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glBindTexture(GL_TEXTURE_2D, info);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0,
+                         GL_RGBA, GL_FLOAT, 0);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        }
+        glBindTexture(GL_TEXTURE_2D, tex_warp_depth_buf);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        reproj_valid_ = false;
+
+        glViewport(0, 0, width, height);
+    }
+
+   private:
+    // Draw the meshes into fb (color and depth), in its lower-left
+    // width x height corner
+    void draw_meshes(int width, int height) {
         GLfloat clear_color[] = {options.background_brightness,
                                  options.background_brightness,
                                  options.background_brightness, 1.f};
-        GLfloat depth_inf = 1e9, zero = 0;
+        GLfloat depth_inf = 1e9;
 
         glBindFramebuffer(GL_FRAMEBUFFER, fb);
+        glViewport(0, 0, width, height);
         glDepthMask(GL_TRUE);
 
 #ifdef __EMSCRIPTEN__
@@ -164,22 +469,29 @@ struct VolumeRenderer::Impl {
         glClearBufferfv(GL_DEPTH, 0, &depth_inf);
 
         Mesh::use_shader();
-        for (const Mesh& mesh : meshes) {
-            mesh.draw(camera.w2c, camera.K, false);
+        for (uint32_t i : culler_.cull(meshes, camera.w2c, camera.K)) {
+            meshes[i].draw(camera.w2c, camera.K, false);
         }
         probe_.draw(camera.w2c, camera.K);
         if (options.show_grid) {
             wire_.draw(camera.w2c, camera.K, false);
         }
+    }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // Trace the volume over the meshes into the bound framebuffer as a
+    // width x height image, only pixels of progressive passes
+    // [pass_begin, pass_end), reusing the pixels of the warped previous
+    // frame in fb_warp that are within reproj_max_error (>= 0)
+    void draw_volume(int width, int height, int pass_begin, int pass_end,
+                     float reproj_max_error = -1.f) {
         glUseProgram(program);
 
         // FIXME reduce uniform transfers?
         glUniformMatrix4x3fv(u.cam_transform, 1, GL_FALSE,
                              glm::value_ptr(camera.transform));
-        glUniform2f(u.cam_focal, camera.fx, camera.fy);
-        glUniform2f(u.cam_reso, (float)camera.width, (float)camera.height);
+        glUniform2f(u.cam_focal, camera.fx * width / camera.width,
+                    camera.fy * height / camera.height);
+        glUniform2f(u.cam_reso, (float)width, (float)height);
         glUniform1f(u.opt_step_size, options.step_size);
         glUniform1f(u.opt_backgrond_brightness, options.background_brightness);
         glUniform1f(u.opt_stop_thresh, options.stop_thresh);
@@ -187,6 +499,14 @@ struct VolumeRenderer::Impl {
         glUniform1fv(u.opt_render_bbox, 6, options.render_bbox);
         glUniform1iv(u.opt_basis_minmax, 2, options.basis_minmax);
         glUniform3fv(u.opt_rot_dirs, 1, options.rot_dirs);
+        glUniform1i(u.prog_begin, pass_begin);
+        glUniform1i(u.prog_end, pass_end);
+        glUniform3f(u.roi, options.roi_center[0],
+                    camera.height - options.roi_center[1],
+                    options.roi ? options.roi_radius : -1.f);
+        glUniform1i(u.roi_passes, internal::roi_passes(options));
+        glUniform1f(u.roi_step_scale, options.roi_step_scale);
+        glUniform1f(u.reproj_max_error, reproj_max_error);
 
         // FIXME Probably can be done only once
         glActiveTexture(GL_TEXTURE0);
@@ -203,63 +523,51 @@ struct VolumeRenderer::Impl {
 
         // glActiveTexture(GL_TEXTURE4);
         // glBindTexture(GL_TEXTURE_2D, tex_tree_extra);
+        if (reproj_max_error >= 0.f) {
+            glActiveTexture(GL_TEXTURE5);
+            glBindTexture(GL_TEXTURE_2D, tex_warp_color);
+            glActiveTexture(GL_TEXTURE6);
+            glBindTexture(GL_TEXTURE_2D, tex_warp_depth);
+            glActiveTexture(GL_TEXTURE7);
+            glBindTexture(GL_TEXTURE_2D, tex_warp_info);
+            glActiveTexture(GL_TEXTURE0);
+        }
         glBindVertexArray(vao_quad);
         glDrawArrays(GL_TRIANGLE_STRIP, 0, (GLsizei)4);
         glBindVertexArray(0);
     }
 
-    void set(N3Tree& tree) {
-        start();
-        if (tree.capacity > 0) {
-            this->tree = &tree;
-            upload_data();
-            upload_child_links();
-            upload_tree_spec();
-        }
-        options.basis_minmax[0] = 0;
-        options.basis_minmax[1] = std::max(tree.data_format.basis_dim - 1, 0);
+    // Hash of everything a progressive image depends on
+    uint64_t progressive_key() const {
+        return internal::hash_combine(internal::hash_camera(camera),
+                                      scene_key());
     }
 
-    void maybe_gen_wire(int depth) {
-        if (last_wire_depth_ != depth) {
-            wire_.vert = tree->gen_wireframe(depth);
-            wire_.update();
-            last_wire_depth_ = depth;
+    // Hash of everything but the camera a frame depends on
+    uint64_t scene_key() const {
+        uint64_t h = internal::hash_render_options(options);
+        h = internal::hash_combine(
+            h, internal::hash_bytes(options.render_bbox,
+                                    sizeof(options.render_bbox)));
+        h = internal::hash_combine(h, (uint64_t)(uintptr_t)tree);
+        for (const Mesh& mesh : meshes) {
+            const float state[] = {mesh.translation.x, mesh.translation.y,
+                                   mesh.translation.z, mesh.rotation.x,
+                                   mesh.rotation.y,    mesh.rotation.z,
+                                   mesh.scale,         (float)mesh.visible,
+                                   (float)mesh.unlit,
+                                   (float)mesh.n_instances()};
+            h = internal::hash_combine(h,
+                                       internal::hash_bytes(state, sizeof(state)));
+            // Vertex edits bump the version; the address tells apart
+            // meshes replaced by others
+            h = internal::hash_combine(h, mesh.version());
+            h = internal::hash_combine(
+                h, (uint64_t)(uintptr_t)mesh.vert.data());
         }
+        return h;
     }
 
-    void clear() { this->tree = nullptr; }
-
-    void resize(const int width, const int height) {
-        if (camera.width == width && camera.height == height) return;
-        if (width <= 0 || height <= 0) return;
-        camera.width = width;
-        camera.height = height;
-
-        // Re-allocate memory for textures used in mesh-volume compositing
-        // process
-        glBindTexture(GL_TEXTURE_2D, tex_mesh_color);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA,
-                     GL_UNSIGNED_BYTE, 0);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-        glBindTexture(GL_TEXTURE_2D, tex_mesh_depth);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED,
-                     GL_FLOAT, 0);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-        glBindTexture(GL_TEXTURE_2D, tex_mesh_depth_buf);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, width, height, 0,
-                     GL_DEPTH_COMPONENT, GL_FLOAT, 0);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-        glViewport(0, 0, width, height);
-    }
-
-   private:
     void auto_size_2d(size_t size, size_t& width, size_t& height,
                       int base_dim = 1) {
         if (size == 0) {
@@ -384,12 +692,24 @@ struct VolumeRenderer::Impl {
         u.tree_data_tex = glGetUniformLocation(program, "tree_data_tex");
         u.tree_child_tex = glGetUniformLocation(program, "tree_child_tex");
         u.mesh_depth_tex = glGetUniformLocation(program, "mesh_depth_tex");
+        u.prog_begin = glGetUniformLocation(program, "prog_begin");
+        u.prog_end = glGetUniformLocation(program, "prog_end");
+        u.roi = glGetUniformLocation(program, "roi");
+        u.roi_passes = glGetUniformLocation(program, "roi_passes");
+        u.roi_step_scale = glGetUniformLocation(program, "roi_step_scale");
         u.mesh_color_tex = glGetUniformLocation(program, "mesh_color_tex");
+        u.reproj_max_error = glGetUniformLocation(program, "reproj_max_error");
+        u.reproj_color_tex = glGetUniformLocation(program, "reproj_color_tex");
+        u.reproj_depth_tex = glGetUniformLocation(program, "reproj_depth_tex");
+        u.reproj_info_tex = glGetUniformLocation(program, "reproj_info_tex");
         // u.tree_extra_tex = glGetUniformLocation(program, "tree_extra_tex");
         glUniform1i(u.tree_child_tex, 0);
         glUniform1i(u.tree_data_tex, 1);
         glUniform1i(u.mesh_depth_tex, 2);
         glUniform1i(u.mesh_color_tex, 3);
+        glUniform1i(u.reproj_color_tex, 5);
+        glUniform1i(u.reproj_depth_tex, 6);
+        glUniform1i(u.reproj_info_tex, 7);
         glUniform1i(glGetUniformLocation(program, "tree_data_dim"), 0);
         // glUniform1i(u.tree_extra_tex, 4);
     }
@@ -423,8 +743,30 @@ struct VolumeRenderer::Impl {
     int last_wire_depth_ = -1;
 
     std::vector<Mesh>& meshes;
+    internal::MeshCuller culler_;
 
     GLuint fb, tex_mesh_color, tex_mesh_depth, tex_mesh_depth_buf;
+    GLuint fb_low, tex_low_color, tex_low_depth;
+    GLuint fb_prog, tex_prog;
+    GLuint fb_frame[2], tex_frame_color[2], tex_frame_depth[2],
+        tex_frame_info[2];
+    GLuint fb_warp, tex_warp_color, tex_warp_depth, tex_warp_info,
+        tex_warp_depth_buf;
+
+    internal::DynamicResolution dynamic_res_;
+    internal::DepthUpsampler upsampler_;
+    internal::ProgressiveFill prog_fill_;
+    // View the progressive image in tex_prog was traced for, and its passes
+    uint64_t prog_key_ = 0;
+    int prog_passes_done_ = 0;
+    // Reprojection: the fb_frame traced last, whether it is complete, and
+    // the scene and camera it was traced for
+    internal::ReprojectSplat reproj_splat_;
+    int frame_index_ = 0;
+    bool reproj_valid_ = false;
+    uint64_t reproj_key_ = 0, reproj_camera_key_ = 0;
+    glm::mat4x3 reproj_c2w_;
+    glm::vec2 reproj_focal_;
 
     std::string shader_fname = "shaders/rt.frag";
 
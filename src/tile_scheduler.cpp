@@ -0,0 +1,153 @@
+#include "volrend/internal/tile_scheduler.hpp"
+
+#include <algorithm>
+
+namespace volrend {
+namespace internal {
+
+void WorkStealingDeque::reset(size_t capacity) {
+    if (capacity > capacity_) {
+        size_t cap = 16;
+        while (cap < capacity) cap <<= 1;
+        buf_.reset(new std::atomic<uint32_t>[cap]);
+        capacity_ = cap;
+        mask_ = (int64_t)cap - 1;
+    }
+    top_.store(0, std::memory_order_relaxed);
+    bottom_.store(0, std::memory_order_relaxed);
+}
+
+TileScheduler::TileScheduler(int n_threads)
+    : n_threads_(n_threads < 1 ? 1 : n_threads),
+      deques_(new WorkStealingDeque[n_threads_]),
+      groups_(n_threads_, 0) {
+    for (int i = 1; i < n_threads_; ++i) {
+        threads_.emplace_back(&TileScheduler::worker_loop, this, i);
+    }
+}
+
+TileScheduler::~TileScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    start_cv_.notify_all();
+    for (std::thread& thread : threads_) thread.join();
+}
+
+void TileScheduler::run(const std::vector<uint32_t>& tiles,
+                        TileSchedule schedule,
+                        const std::function<void(uint32_t, int)>& fn) {
+    if (tiles.empty()) return;
+    tiles_ = &tiles;
+    schedule_ = schedule;
+    fn_ = &fn;
+    next_tile_.store(0, std::memory_order_relaxed);
+    if (schedule == TileSchedule::STEALING) {
+        // Contiguous ranges, pushed in reverse so owners pop them in order
+        // while thieves take from the far end
+        for (int i = 0; i < n_threads_; ++i) {
+            const size_t begin = tiles.size() * i / n_threads_,
+                         end = tiles.size() * (i + 1) / n_threads_;
+            deques_[i].reset(end - begin);
+            for (size_t j = end; j > begin; --j) {
+                deques_[i].push(tiles[j - 1]);
+            }
+        }
+    }
+    run_all([this](int thread_id) { work_tiles(thread_id); });
+}
+
+void TileScheduler::run_all(const std::function<void(int)>& fn) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = &fn;
+        ++generation_;
+        n_running_ = n_threads_ - 1;
+    }
+    start_cv_.notify_all();
+    fn(0);
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return n_running_ == 0; });
+}
+
+void TileScheduler::set_thread_groups(const std::vector<int>& groups) {
+    std::copy_n(groups.begin(), std::min(groups.size(), groups_.size()),
+                groups_.begin());
+}
+
+void TileScheduler::worker_loop(int thread_id) {
+    uint64_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            start_cv_.wait(lock, [&] {
+                return stop_ || generation_ != seen_generation;
+            });
+            if (stop_) return;
+            seen_generation = generation_;
+        }
+        (*job_)(thread_id);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--n_running_ > 0) continue;
+        }
+        done_cv_.notify_one();
+    }
+}
+
+void TileScheduler::work_tiles(int thread_id) {
+    const std::vector<uint32_t>& tiles = *tiles_;
+    const std::function<void(uint32_t, int)>& fn = *fn_;
+    switch (schedule_) {
+        case TileSchedule::STATIC: {
+            const size_t begin = tiles.size() * thread_id / n_threads_,
+                         end = tiles.size() * (thread_id + 1) / n_threads_;
+            for (size_t i = begin; i < end; ++i) fn(tiles[i], thread_id);
+        } break;
+        case TileSchedule::DYNAMIC: {
+            size_t i;
+            while ((i = next_tile_.fetch_add(1, std::memory_order_relaxed)) <
+                   tiles.size()) {
+                fn(tiles[i], thread_id);
+            }
+        } break;
+        case TileSchedule::STEALING: {
+            uint32_t tile;
+            while (deques_[thread_id].pop(tile)) fn(tile, thread_id);
+            // No tiles are added during a run, so stop once every other
+            // deque was seen empty in one pass. Pass 0 steals from the
+            // thread's own group, pass 1 from the others
+            uint32_t rng = 0x9E3779B9u * (thread_id + 1);
+            for (int pass = 0; pass < 2 && n_threads_ > 1; ++pass) {
+                while (true) {
+                    bool all_empty = true;
+                    rng ^= rng << 13;
+                    rng ^= rng >> 17;
+                    rng ^= rng << 5;
+                    const int first = rng % n_threads_;
+                    for (int k = 0; k < n_threads_; ++k) {
+                        const int victim = (first + k) % n_threads_;
+                        if (victim == thread_id ||
+                            (groups_[victim] == groups_[thread_id]) !=
+                                (pass == 0)) {
+                            continue;
+                        }
+                        WorkStealingDeque::StealResult res;
+                        while ((res = deques_[victim].steal(tile)) ==
+                               WorkStealingDeque::STOLEN) {
+                            fn(tile, thread_id);
+                        }
+                        if (res == WorkStealingDeque::ABORT) {
+                            all_empty = false;
+                        }
+                    }
+                    if (all_empty) break;
+                }
+            }
+        } break;
+    }
+}
+
+}  // namespace internal
+}  // namespace volrend